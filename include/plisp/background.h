@@ -0,0 +1,18 @@
+#ifndef PLISP_BACKGROUND_H
+#define PLISP_BACKGROUND_H
+
+#include <plisp/object.h>
+
+void plisp_init_background(void);
+void plisp_end_background(void);
+
+// queues job(arg, obj) to run on a compiler thread, with the gc lock
+// held. obj is kept alive until then. returns false if there are no
+// compiler threads or the queue is full, so the caller should do the
+// work itself.
+bool plisp_background(void (*job)(void *, plisp_t), void *arg, plisp_t obj);
+
+// waits for every queued job to finish
+void plisp_background_wait(void);
+
+#endif
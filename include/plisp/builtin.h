@@ -6,6 +6,16 @@
 void plisp_init_builtin(void);
 
 void plisp_define_builtin(const char *name, plisp_fn_t fun);
+// like plisp_define_builtin, but fun gets data as its closure data, so
+// one C function can back several builtins
+void plisp_define_builtin_data(const char *name, plisp_fn_t fun,
+                               struct plisp_closure_data *data);
+// like plisp_define_builtin, but code compiled with (safety 0) calls
+// unchecked instead
+void plisp_define_builtin_unchecked(const char *name, plisp_fn_t fun,
+                                    plisp_fn_t unchecked);
+// the unchecked entry point of a builtin closure, or NULL
+plisp_fn_t plisp_unchecked_entry(plisp_t fn);
 
 plisp_t plisp_builtin_plus(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b, ...);
 plisp_t plisp_builtin_minus(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b, ...);
@@ -26,13 +36,12 @@ plisp_t plisp_builtin_equal(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
 plisp_t plisp_builtin_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
 
 plisp_t plisp_builtin_pair(plisp_t *clos, size_t nargs, plisp_t obj);
+plisp_t plisp_builtin_fixnump(plisp_t *clos, size_t nargs, plisp_t obj);
 bool plisp_c_listp(plisp_t obj);
 plisp_t plisp_builtin_listp(plisp_t *clos, size_t nargs, plisp_t obj);
 
 size_t plisp_c_length(plisp_t lst);
 plisp_t plisp_builtin_length(plisp_t *clos, size_t nargs, plisp_t lst);
-plisp_t plisp_append(plisp_t a, plisp_t b);
-plisp_t plisp_builtin_append(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
 
 plisp_t plisp_builtin_display(plisp_t *clos, size_t nargs, plisp_t obj);
 plisp_t plisp_builtin_write(plisp_t *clos, size_t nargs, plisp_t obj);
@@ -57,19 +66,31 @@ plisp_t plisp_builtin_vector_append(plisp_t *clos, size_t nargs, ...);
 plisp_t plisp_builtin_string_append(plisp_t *clos, size_t nargs, ...);
 plisp_t plisp_builtin_vector_length(plisp_t *clos, size_t nargs, plisp_t vec);
 plisp_t plisp_builtin_string_length(plisp_t *clos, size_t nargs, plisp_t vec);
+plisp_t plisp_builtin_subvector(plisp_t *clos, size_t nargs,
+                                plisp_t vec, plisp_t start, plisp_t end);
+plisp_t plisp_builtin_substring(plisp_t *clos, size_t nargs,
+                                plisp_t str, plisp_t start, plisp_t end);
+plisp_t plisp_builtin_vector_copy(plisp_t *clos, size_t nargs, plisp_t to,
+                                  plisp_t at, plisp_t from, plisp_t start,
+                                  plisp_t end);
 
 plisp_t plisp_builtin_read(plisp_t *clos, size_t nargs);
 void plisp_c_load(const char *fname);
 plisp_t plisp_builtin_load(plisp_t *clos, size_t nargs, plisp_t fname);
 
 plisp_t plisp_builtin_eval(plisp_t *clos, size_t nargs, plisp_t expr);
+plisp_t plisp_call_closure(plisp_t fn, size_t nargs, plisp_t *args);
 plisp_t plisp_builtin_apply(plisp_t *clos, size_t nargs, plisp_t fn, ...);
 plisp_t plisp_builtin_disassemble(plisp_t *clos, size_t nargs, plisp_t expr);
+plisp_t plisp_builtin_procedure_tier(plisp_t *clos, size_t nargs, plisp_t fn);
 
 plisp_t plisp_builtin_hashq(plisp_t *clos, size_t nargs, plisp_t obj, plisp_t bits);
 
 plisp_t plisp_builtin_unspecified(plisp_t *clos, size_t nargs);
 
+// a symbol no other has been named, and whether sym is one
+plisp_t plisp_c_gensym(void);
+bool plisp_c_gensymp(plisp_t sym);
 plisp_t plisp_builtin_gensym(plisp_t *clos, size_t nargs);
 
 #endif
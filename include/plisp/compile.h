@@ -7,8 +7,14 @@
 void plisp_init_compiler(char *argv0);
 void plisp_end_compiler(void);
 plisp_fn_t plisp_compile_lambda(plisp_t lambda);
+// compiles a lambda whose closure data holds the boxes of
+// closure_syms, in order
+plisp_fn_t plisp_compile_lambda_closure(plisp_t lambda, plisp_t closure_syms);
 
 void plisp_free_fn(plisp_fn_t fn);
 void plisp_disassemble_fn(plisp_fn_t fn);
+// which tier of code calls to fn run: "builtin", "uncompiled",
+// "baseline" or "optimized"
+const char *plisp_fn_tier(plisp_fn_t fn);
 
 #endif
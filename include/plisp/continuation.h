@@ -7,5 +7,12 @@ void plisp_init_continuation(void);
 
 
 plisp_t plisp_builtin_callcc(plisp_t *clos, size_t nargs, plisp_t proc);
+// continuations that can only escape, while the call/ec is running,
+// but are made and called in constant time
+plisp_t plisp_builtin_callec(plisp_t *clos, size_t nargs, plisp_t proc);
+
+// the live extents of call/cc and call/ec belong to the stack they are
+// on, so switching stacks switches them too. returns the old ones.
+void *plisp_switch_extents(void *extents);
 
 #endif
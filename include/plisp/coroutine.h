@@ -0,0 +1,40 @@
+#ifndef PLISP_COROUTINE_H
+#define PLISP_COROUTINE_H
+
+#include <plisp/object.h>
+
+void plisp_init_coroutine(void);
+// gives the calling thread a scheduler, and its stack a coroutine
+void plisp_init_coroutine_thread(void);
+
+bool plisp_c_coroutinep(plisp_t obj);
+// a coroutine that calls thunk on a stack of its own. tasks are run by
+// the scheduler rather than resumed by hand.
+plisp_t plisp_make_coroutine(plisp_t thunk, bool task);
+// runs co until it yields or returns, passing it value, and returns
+// what it yielded or returned
+plisp_t plisp_coroutine_resume(plisp_t co, plisp_t value);
+// goes back to whatever resumed the running coroutine, with value, and
+// returns the value it is resumed with next
+plisp_t plisp_yield(plisp_t value);
+
+// whether the running coroutine is a task
+bool plisp_in_task(void);
+// the running task
+plisp_t plisp_current_task(void);
+// suspends the running task until it is woken
+void plisp_park(void);
+// puts a parked task back on the run queue
+void plisp_wake(plisp_t task);
+// runs the next task on the run queue until it yields or parks, and
+// returns false if nothing could run
+bool plisp_run_one(void);
+
+// wakes tasks parked on something outside the scheduler, like i/o. it
+// is called between tasks with wait false, and with wait true when the
+// run queue is empty, when it blocks until it wakes one if any are
+// parked on it. it returns whether it woke any.
+typedef bool (*plisp_poller_t)(bool wait);
+void plisp_scheduler_poller(plisp_poller_t poll);
+
+#endif
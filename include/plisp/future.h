@@ -0,0 +1,16 @@
+#ifndef PLISP_FUTURE_H
+#define PLISP_FUTURE_H
+
+#include <plisp/object.h>
+
+void plisp_init_future(void);
+
+bool plisp_c_futurep(plisp_t obj);
+// a future of calling thunk, which a worker of the pool runs when one
+// is free
+plisp_t plisp_make_future(plisp_t thunk);
+// what future's thunk returned. it is called here if no worker has
+// started it yet.
+plisp_t plisp_touch(plisp_t future);
+
+#endif
@@ -3,12 +3,44 @@
 
 #include <plisp/object.h>
 
-extern plisp_t *stack_bottom;
+// the bottom of the stack this thread runs on, which changes when
+// switching to a coroutine
+extern __thread plisp_t *stack_bottom;
 
 void plisp_init_gc(void);
 
 size_t plisp_collect_garbage(void);
 
+// threads that run scheme register, so that collections stop them and
+// scan their stacks. a thread that isn't registered never collects,
+// and holds the gc lock whenever it touches the heap.
+void plisp_gc_register_thread(void);
+void plisp_gc_unregister_thread(void);
+
+// set while a collection waits for the threads to stop. they stop at
+// safepoints, which allocation, calls and blocking all pass through.
+extern bool plisp_stop_requested;
+void plisp_safepoint_slow(void);
+static inline void plisp_safepoint(void) {
+    if (__atomic_load_n(&plisp_stop_requested, __ATOMIC_RELAXED)) {
+        plisp_safepoint_slow();
+    }
+}
+// around anything that might block, so collections don't wait on it.
+// nothing in between may touch the heap.
+void plisp_enter_blocking(void);
+void plisp_leave_blocking(void);
+
+// no other thread collects or compiles while this is held
+void plisp_gc_lock(void);
+bool plisp_gc_trylock(void);
+void plisp_gc_unlock(void);
+// stops every other mutator at a safepoint, for changing objects that
+// are read a word at a time, like closures. hold the gc lock around
+// both, and don't pass a safepoint in between.
+void plisp_gc_stop_world(void);
+void plisp_gc_start_world(void);
+
 plisp_t plisp_alloc_obj(uintptr_t tags, bool freecdr);
 
 bool plisp_heap_allocated(plisp_t obj);
@@ -16,4 +48,46 @@ bool plisp_heap_allocated(plisp_t obj);
 void plisp_gc_permanent(plisp_t obj);
 //void plisp_gc_nopermanent(plisp_t obj);
 
+// keeps owner alive for as long as obj is, for objects that point into
+// memory owned by another object. obj must not be allocated with
+// freecdr, since that memory isn't its own.
+void plisp_gc_set_owner(plisp_t obj, plisp_t owner);
+// the owner set for obj, or obj itself if it has none
+plisp_t plisp_gc_owner(plisp_t obj);
+
+// custom objects whose data holds references register a tracer for
+// their typesym, which passes each of those references to trace
+typedef void (*plisp_tracer_t)(void *data, void (*trace)(plisp_t));
+void plisp_gc_custom_tracer(plisp_t typesym, plisp_tracer_t tracer);
+// for tracers of memory that holds references among other things, like
+// saved stacks. traces every word from start to end that refers to a
+// live object.
+void plisp_gc_scan(void *start, void *end);
+
+// frees the data of a custom object with finalize rather than free,
+// for data that holds more than the memory malloc gave it
+typedef void (*plisp_finalizer_t)(void *data);
+void plisp_gc_finalizer(plisp_t obj, plisp_finalizer_t finalize);
+
+// how many collections have moved objects. anything hashed by address
+// has to be rehashed when this changes.
+size_t plisp_gc_moves(void);
+
+// trace whatever slot holds on every collection
+void plisp_gc_root(plisp_t *slot);
+// the same, until the calling thread unregisters, for thread locals
+void plisp_gc_thread_root(plisp_t *slot);
+// stop tracing a slot given to plisp_gc_root
+void plisp_gc_unroot(plisp_t *slot);
+
+// frees ptr at the next collection, once no thread can still be
+// reading it
+void plisp_gc_retire(void *ptr);
+// calls destroy(arg) after the first collection that finds no return
+// address from start to start+size on any stack, for code nothing
+// calls anymore that may still be running. it runs with the gc lock
+// held but the world started again.
+void plisp_gc_retire_code(void *start, size_t size,
+                          void (*destroy)(void *), void *arg);
+
 #endif
@@ -0,0 +1,32 @@
+#ifndef PLISP_HASHTABLE_H
+#define PLISP_HASHTABLE_H
+
+#include <plisp/object.h>
+
+// what a table compares its keys with. string tables only take string
+// keys, and compare their contents.
+enum plisp_hash_kind {
+    HASH_EQ,
+    HASH_EQV,
+    HASH_EQUAL,
+    HASH_STRING,
+};
+
+void plisp_init_hashtable(void);
+
+bool plisp_c_hash_tablep(plisp_t obj);
+plisp_t plisp_make_hash_table(enum plisp_hash_kind kind, size_t capacity);
+// stores the value of key in out, or returns false if there isn't one
+bool plisp_hash_table_lookup(plisp_t table, plisp_t key, plisp_t *out);
+void plisp_hash_table_set(plisp_t table, plisp_t key, plisp_t value);
+// returns false if key wasn't in table
+bool plisp_hash_table_delete(plisp_t table, plisp_t key);
+size_t plisp_hash_table_count(plisp_t table);
+
+// the hash tables of kind give key. sets *addressed if it was hashed
+// by address, so it changes when the collector moves key.
+uint64_t plisp_hash_key(enum plisp_hash_kind kind, plisp_t key,
+                        bool *addressed);
+bool plisp_hash_keys_equal(enum plisp_hash_kind kind, plisp_t a, plisp_t b);
+
+#endif
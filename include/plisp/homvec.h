@@ -0,0 +1,30 @@
+#ifndef PLISP_HOMVEC_H
+#define PLISP_HOMVEC_H
+
+#include <plisp/object.h>
+
+// srfi 4 style vectors of unboxed numbers. u8vectors are VEC_INT
+// vectors with VFLAG_UNSIGNED, s32vectors and s64vectors are signed
+// VEC_INT vectors, and f64vectors are VEC_FLOAT vectors.
+enum plisp_homvec_kind {
+    HOMVEC_U8,
+    HOMVEC_S32,
+    HOMVEC_S64,
+    HOMVEC_F64,
+    HOMVEC_NONE,
+};
+
+void plisp_init_homvec(void);
+
+// the kind of vec, or HOMVEC_NONE if it isn't a homogeneous vector
+enum plisp_homvec_kind plisp_homvec_kind(plisp_t vec);
+// the tag the reader and writer use for kind, like "f64"
+const char *plisp_homvec_tag(enum plisp_homvec_kind kind);
+// the kind tagged tag, or HOMVEC_NONE
+enum plisp_homvec_kind plisp_homvec_tag_kind(const char *tag);
+
+// a zeroed vector of kind
+plisp_t plisp_make_homvec(enum plisp_homvec_kind kind, size_t len);
+plisp_t plisp_list_to_homvec(enum plisp_homvec_kind kind, plisp_t lst);
+
+#endif
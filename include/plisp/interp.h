@@ -0,0 +1,22 @@
+#ifndef PLISP_INTERP_H
+#define PLISP_INTERP_H
+
+#include <plisp/object.h>
+
+void plisp_init_interp(void);
+
+// evaluates a fully macroexpanded form. env is an alist of (sym . box)
+plisp_t plisp_interp_eval(plisp_t expr, plisp_t env);
+
+// every symbol in expr outside of quoted data. this is a superset of
+// the free variables, which is fine: extra ones are never referenced
+plisp_t plisp_mentioned_symbols(plisp_t expr);
+
+// the lambda of an interpreted closure made at toplevel, or nil if it
+// closes over local variables
+plisp_t plisp_interp_lambda(plisp_t closure);
+
+bool plisp_c_interpretedp(plisp_t closure);
+plisp_fn_t plisp_interp_promote(plisp_t closure);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef PLISP_LIST_H
+#define PLISP_LIST_H
+
+#include <plisp/object.h>
+
+void plisp_init_list(void);
+
+// a copy of a with b as its last cdr
+plisp_t plisp_append(plisp_t a, plisp_t b);
+plisp_t plisp_list_copy(plisp_t lst);
+
+#endif
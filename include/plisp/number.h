@@ -0,0 +1,74 @@
+#ifndef PLISP_NUMBER_H
+#define PLISP_NUMBER_H
+
+#include <plisp/object.h>
+#include <stdio.h>
+
+#define PLISP_FIXNUM_MAX (INT64_MAX >> LOSHIFT)
+#define PLISP_FIXNUM_MIN (INT64_MIN >> LOSHIFT)
+
+enum plisp_num_type {
+    NUM_FLONUM,
+    NUM_BIGNUM,
+};
+
+// the cell of an LT_NUMBER object. bignums own their limbs, so they
+// are allocated with freecdr (change the compiler's flonum loads
+// whenever this changes)
+struct plisp_number {
+    uint64_t type;
+    union {
+        double flonum;
+        struct plisp_bignum *bignum;
+    };
+};
+
+// sign and magnitude, least significant limb first. a bignum is never
+// in fixnum range and never has leading zero limbs.
+struct plisp_bignum {
+    bool negative;
+    uint32_t len;
+    uint32_t limbs[];
+};
+
+void plisp_init_number(void);
+
+// fixnums, flonums and bignums
+bool plisp_c_numberp(plisp_t val);
+bool plisp_c_flonump(plisp_t val);
+bool plisp_c_bignump(plisp_t val);
+
+plisp_t plisp_make_flonum(double val);
+double plisp_flonum_value(plisp_t val);
+// a fixnum if val fits in one, otherwise a bignum
+plisp_t plisp_make_integer(int64_t val);
+// stores the value of an exact integer in out, or returns false if num
+// isn't one or doesn't fit in 64 bits
+bool plisp_integer_to_int64(plisp_t num, int64_t *out);
+double plisp_number_to_double(plisp_t num);
+
+// the generic arithmetic behind the builtins. fixnum results that
+// overflow become bignums, and flonums are contagious.
+plisp_t plisp_num_add(plisp_t a, plisp_t b);
+plisp_t plisp_num_sub(plisp_t a, plisp_t b);
+plisp_t plisp_num_mul(plisp_t a, plisp_t b);
+plisp_t plisp_num_div(plisp_t a, plisp_t b);
+bool plisp_num_lt(plisp_t a, plisp_t b);
+bool plisp_num_eq(plisp_t a, plisp_t b);
+// like plisp_num_eq, but exact and inexact numbers always differ
+bool plisp_num_eqv(plisp_t a, plisp_t b);
+// a hash that is the same for numbers that are eqv
+uint64_t plisp_number_hash(plisp_t num);
+
+void plisp_write_number(FILE *f, plisp_t num);
+// the number spelled by text, or plisp_unbound if it doesn't spell one
+plisp_t plisp_parse_number(const char *text);
+
+plisp_t plisp_builtin_numeq(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
+plisp_t plisp_builtin_divide(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
+plisp_t plisp_builtin_numberp(plisp_t *clos, size_t nargs, plisp_t obj);
+plisp_t plisp_builtin_flonump(plisp_t *clos, size_t nargs, plisp_t obj);
+plisp_t plisp_builtin_exact_to_inexact(plisp_t *clos, size_t nargs, plisp_t num);
+plisp_t plisp_builtin_inexact_to_exact(plisp_t *clos, size_t nargs, plisp_t num);
+
+#endif
@@ -17,6 +17,7 @@ enum plisp_lotag {
     LT_SYM    = 5,
     LT_VECTOR = 6,
     LT_NUMBER = 7,
+    LT_RECORD = 8,
 };
 
 // when LT_HITAGS is used, the higher 4 bits of the lowest byte is
@@ -56,6 +57,8 @@ bool plisp_c_consp(plisp_t val);
 plisp_t plisp_cons(plisp_t car, plisp_t cdr);
 plisp_t plisp_car(plisp_t cons);
 plisp_t plisp_cdr(plisp_t cons);
+// for building lists front to back
+void plisp_set_cdr(plisp_t cons, plisp_t cdr);
 
 bool plisp_c_nullp(plisp_t val);
 #define plisp_nil ((plisp_t) (0lu | LT_CONS))
@@ -89,6 +92,11 @@ enum plisp_vec_type {
 };
 
 #define VFLAG_IMMUTABLE (1 << 0)
+// VEC_INT elements are unsigned
+#define VFLAG_UNSIGNED  (1 << 1)
+// vec points into the payload of another vector, which the collector
+// keeps alive for as long as this one
+#define VFLAG_SLICE     (1 << 2)
 
 struct plisp_vector {
     uint8_t  type;
@@ -109,10 +117,19 @@ plisp_t plisp_make_vector(enum plisp_vec_type type, uint8_t
 plisp_t plisp_vector_ref(plisp_t vec, size_t idx);
 void plisp_vector_set(plisp_t vec, size_t idx, plisp_t value);
 size_t plisp_vector_c_length(plisp_t vec);
+// the elements of a VEC_OBJ vector. they are freed with vec, so keep
+// vec itself around while using them
+plisp_t *plisp_vector_objs(plisp_t vec);
+// elements start to end of vec, sharing its payload
+plisp_t plisp_make_slice(plisp_t vec, size_t start, size_t end);
 
 bool plisp_c_stringp(plisp_t val);
 plisp_t plisp_make_string(const char *string);
+// the chars of str. they are followed by a nul, except in substrings
+// that end before the string they share, so use plisp_c_stringlen
 const char *plisp_string_value(plisp_t str);
+// a malloc'd, nul terminated copy of str
+char *plisp_string_cstring(plisp_t str);
 size_t plisp_c_stringlen(plisp_t str);
 
 struct plisp_custom {
@@ -0,0 +1,37 @@
+#ifndef PLISP_PERSISTENT_H
+#define PLISP_PERSISTENT_H
+
+#include <plisp/object.h>
+#include <plisp/hashtable.h>
+
+void plisp_init_persistent(void);
+
+bool plisp_c_pmapp(plisp_t obj);
+// an empty map comparing its keys the way a hash table of kind does
+plisp_t plisp_make_pmap(enum plisp_hash_kind kind);
+// stores the value of key in out, or returns false if there isn't one
+bool plisp_pmap_lookup(plisp_t map, plisp_t key, plisp_t *out);
+// a map like map, but with key set to value. a transient map is
+// changed in place and returned.
+plisp_t plisp_pmap_set(plisp_t map, plisp_t key, plisp_t value);
+// likewise without key
+plisp_t plisp_pmap_delete(plisp_t map, plisp_t key);
+size_t plisp_pmap_count(plisp_t map);
+
+bool plisp_c_pvectorp(plisp_t obj);
+plisp_t plisp_make_pvector(void);
+plisp_t plisp_pvector_ref(plisp_t vec, size_t idx);
+// like plisp_pmap_set, vec with the element at idx replaced, with
+// value appended, or without its last element
+plisp_t plisp_pvector_set(plisp_t vec, size_t idx, plisp_t value);
+plisp_t plisp_pvector_push(plisp_t vec, plisp_t value);
+plisp_t plisp_pvector_pop(plisp_t vec);
+size_t plisp_pvector_length(plisp_t vec);
+
+// a transient version of a persistent map or vector, which can be
+// changed in place until it is made persistent again
+plisp_t plisp_transient(plisp_t obj);
+// the persistent version of a transient, which can't be changed after
+plisp_t plisp_persistent(plisp_t obj);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef PLISP_PORT_H
+#define PLISP_PORT_H
+
+#include <plisp/object.h>
+
+void plisp_init_port(void);
+// closes the calling thread's epoll set, when it is done with ports
+void plisp_end_port_thread(void);
+
+bool plisp_c_portp(plisp_t obj);
+// a port reading and writing fd, which it makes non blocking and
+// closes once it is closed or collected
+plisp_t plisp_make_port(int fd);
+
+#endif
@@ -8,5 +8,7 @@ void plisp_init_posix(void);
 plisp_t plisp_realpath(plisp_t *clos, size_t nargs, plisp_t path);
 plisp_t plisp_dirname(plisp_t *clos, size_t nargs, plisp_t path);
 plisp_t plisp_basename(plisp_t *clos, size_t nargs, plisp_t path);
+plisp_t plisp_make_temp_directory(plisp_t *clos, size_t nargs);
+plisp_t plisp_delete_file(plisp_t *clos, size_t nargs, plisp_t path);
 
 #endif
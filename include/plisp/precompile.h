@@ -0,0 +1,40 @@
+#ifndef PLISP_PRECOMPILE_H
+#define PLISP_PRECOMPILE_H
+
+#include <plisp/object.h>
+#include <stdio.h>
+#include <Judy.h>
+
+void plisp_init_precompile(void);
+
+// the path of the compiled artifact for src. free it when done
+char *plisp_compiled_path(const char *src);
+// whether compiled was made from the current version of src, and of
+// everything that was loaded when it was compiled, with the macros
+// defined now
+bool plisp_compiled_fresh(const char *src, const char *compiled);
+// every file loaded must be noted, since files compiled later depend
+// on it
+void plisp_note_loaded_file(const char *path);
+// and every toplevel macro-set! form evaluated, since compiled files
+// depend on the macros defined too
+void plisp_note_macro_definition(plisp_t form);
+
+void plisp_c_compile_file(const char *src, const char *dst);
+// reads the header of a compiled file, and returns fresh names for the
+// gensyms it lists, for plisp_rename_gensyms
+Pvoid_t plisp_read_compiled_header(FILE *f);
+// form, with the gensyms of a compiled file swapped for the new names
+plisp_t plisp_rename_gensyms(plisp_t form, Pvoid_t renames);
+void plisp_free_renames(Pvoid_t renames);
+
+// like plisp_macroexpand, but keeps expansions on disk between runs
+plisp_t plisp_cached_macroexpand(plisp_t form);
+// every expanded form loaded must be noted, for the cache keys
+void plisp_note_loaded_form(plisp_t expanded);
+void plisp_expansion_cache_report(FILE *f);
+
+plisp_t plisp_builtin_compile_file(plisp_t *clos, size_t nargs,
+                                   plisp_t src, plisp_t dst);
+
+#endif
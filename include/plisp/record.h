@@ -0,0 +1,37 @@
+#ifndef PLISP_RECORD_H
+#define PLISP_RECORD_H
+
+#include <plisp/object.h>
+
+// (change the compiler whenever this changes)
+struct plisp_record {
+    plisp_t rtd;
+    plisp_t *fields;
+};
+
+// the closure data of accessors and modifiers is the type descriptor
+// and the index of the field, and of predicates just the descriptor
+enum {
+    RECORD_DATA_RTD,
+    RECORD_DATA_INDEX,
+};
+
+void plisp_init_record(void);
+
+bool plisp_c_recordp(plisp_t obj);
+plisp_t plisp_record_rtd(plisp_t rec);
+// fields is a list of symbols
+plisp_t plisp_make_record_type(plisp_t name, plisp_t fields);
+plisp_t plisp_record_type_name(plisp_t rtd);
+size_t plisp_record_type_nfields(plisp_t rtd);
+// a record of type rtd, with every field unspecified
+plisp_t plisp_make_record(plisp_t rtd);
+
+plisp_t plisp_record_ref(struct plisp_closure_data *data, size_t nargs,
+                         plisp_t rec);
+plisp_t plisp_record_set(struct plisp_closure_data *data, size_t nargs,
+                         plisp_t rec, plisp_t value);
+plisp_t plisp_record_p(struct plisp_closure_data *data, size_t nargs,
+                       plisp_t obj);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PLISP_SIMD_H
+#define PLISP_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// picks the kernels for the best instruction set the cpu supports, or
+// the one named by PLISP_SIMD (scalar, sse2 or avx2)
+void plisp_init_simd(void);
+const char *plisp_simd_name(void);
+
+// bulk kernels over unboxed arrays. min and max need n > 0, and which
+// nan they return, if any, is unspecified. float sums are added in a
+// different order on each instruction set, so they may round
+// differently.
+void plisp_simd_fill_f64(double *dst, double val, size_t n);
+void plisp_simd_fill_s32(int32_t *dst, int32_t val, size_t n);
+void plisp_simd_fill_s64(int64_t *dst, int64_t val, size_t n);
+
+double plisp_simd_sum_f64(const double *src, size_t n);
+double plisp_simd_dot_f64(const double *a, const double *b, size_t n);
+double plisp_simd_min_f64(const double *src, size_t n);
+double plisp_simd_max_f64(const double *src, size_t n);
+
+uint64_t plisp_simd_sum_u8(const uint8_t *src, size_t n);
+uint8_t plisp_simd_min_u8(const uint8_t *src, size_t n);
+uint8_t plisp_simd_max_u8(const uint8_t *src, size_t n);
+
+int64_t plisp_simd_sum_s32(const int32_t *src, size_t n);
+int32_t plisp_simd_min_s32(const int32_t *src, size_t n);
+int32_t plisp_simd_max_s32(const int32_t *src, size_t n);
+
+// the first index where a and b differ, or n if they don't
+size_t plisp_simd_mismatch(const uint8_t *a, const uint8_t *b, size_t n);
+// the first index of byte in src, or n
+size_t plisp_simd_find_byte(const uint8_t *src, uint8_t byte, size_t n);
+// the first index of needle in hay, or SIZE_MAX
+size_t plisp_simd_search(const uint8_t *hay, size_t n,
+                         const uint8_t *needle, size_t m);
+// a hash of src that is the same whichever kernels were picked
+uint64_t plisp_simd_hash(const uint8_t *src, size_t n);
+// mixes the bits of word, for hashing anything that isn't bytes
+uint64_t plisp_hash_word(uint64_t word);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef PLISP_SORT_H
+#define PLISP_SORT_H
+
+#include <plisp/object.h>
+
+void plisp_init_sort(void);
+
+// sorts lst stably by relinking its cells, and returns the new head
+plisp_t plisp_sort_list(plisp_t lst, plisp_t less);
+// sorts a vector of objects in place. equal elements may be reordered.
+void plisp_sort_vector(plisp_t vec, plisp_t less);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PLISP_TEXT_H
+#define PLISP_TEXT_H
+
+#include <plisp/object.h>
+
+void plisp_init_text(void);
+
+bool plisp_c_string_equal(plisp_t a, plisp_t b);
+bool plisp_c_string_less(plisp_t a, plisp_t b);
+
+plisp_t plisp_builtin_string_eq(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
+plisp_t plisp_builtin_string_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
+plisp_t plisp_builtin_string_index(plisp_t *clos, size_t nargs, plisp_t str,
+                                   plisp_t ch, plisp_t start);
+plisp_t plisp_builtin_string_contains(plisp_t *clos, size_t nargs, plisp_t str,
+                                      plisp_t needle, plisp_t start);
+plisp_t plisp_builtin_string_hash(plisp_t *clos, size_t nargs, plisp_t str,
+                                  plisp_t bound);
+
+#endif
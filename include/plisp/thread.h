@@ -0,0 +1,14 @@
+#ifndef PLISP_THREAD_H
+#define PLISP_THREAD_H
+
+#include <plisp/object.h>
+
+void plisp_init_thread(void);
+
+bool plisp_c_threadp(plisp_t obj);
+// an os thread calling thunk, which starts at once
+plisp_t plisp_make_thread(plisp_t thunk);
+// waits for thread to finish, and returns what thunk returned
+plisp_t plisp_thread_join(plisp_t thread);
+
+#endif
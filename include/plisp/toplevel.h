@@ -9,5 +9,8 @@ void plisp_toplevel_define(plisp_t sym, plisp_t value);
 plisp_t *plisp_toplevel_ref(plisp_t sym);
 
 plisp_t plisp_toplevel_eval(plisp_t form);
+// for forms that have already been through plisp_macroexpand
+plisp_t plisp_toplevel_eval_expanded(plisp_t form);
+plisp_t plisp_macroexpand(plisp_t form);
 
 #endif
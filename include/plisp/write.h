@@ -5,5 +5,7 @@
 #include <stdio.h>
 
 void plisp_c_write(FILE *f, plisp_t obj);
+// whether plisp_c_read can read back what plisp_c_write writes
+bool plisp_c_readablep(plisp_t obj);
 
 #endif
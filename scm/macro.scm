@@ -1,19 +1,17 @@
 (require "alist.scm")
-(require "listtools.scm")
 
 ;;; begin
 
-;; the following functions and values will be replaced later in the
-;; bootstrapping process. probably with a hashtable or something
+;; macroexpand looks up the head of every list form, so this is a
+;; hash table rather than an alist
 
-(define macros '())
+(define macros (make-eq-hash-table))
 
 (define (macro-find sym)
-  (assq-ref macros sym))
+  (hash-table-ref/default macros sym #f))
 
 (define (macro-set! sym fn)
-  (set! macros (acons sym fn macros))
-  (unspecified))
+  (hash-table-set! macros sym fn))
 ;;; end
 
 ;; expand the unquoted part of quasiquotes
@@ -45,6 +43,19 @@
                                           (cdr expr)))
                       (map macroexpand expr)))))))
 
+;; toplevel forms are expanded with this. a begin at the toplevel is
+;; kept, rather than turned into a lambda, so the definitions in it are
+;; toplevel definitions, and so are the ones macros expand into begins
+(define (macroexpand-toplevel expr)
+  (if (not (if (pair? expr) (list? expr) #f))
+      (macroexpand expr)
+      (if (eq? (car expr) 'begin)
+          (cons 'begin (map macroexpand-toplevel (cdr expr)))
+          (if (macro-find (car expr))
+              (macroexpand-toplevel (apply (macro-find (car expr))
+                                           (cdr expr)))
+              (macroexpand expr)))))
+
 (macro-set! 'define-macro
             (lambda (args . body)
               `(macro-set! ',(car args)
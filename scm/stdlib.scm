@@ -1,6 +1,5 @@
 (require "alist.scm")
 (require "cadr.scm")
-(require "listtools.scm")
 (require "macro.scm")
 ;; from here on out macros are built into the language
 
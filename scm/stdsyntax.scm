@@ -57,3 +57,66 @@
   `(if ,cond
        ,(unspecified)
        (begin ,@body)))
+
+;; type is bound to the type descriptor. each field is (name accessor)
+;; or (name accessor modifier), and the constructor is (name field ...)
+;; or just a name, to take every field in order.
+(define-macro (define-record-type type ctor pred . fields)
+  `(begin
+     (define ,type (make-record-type ',type ',(map car fields)))
+     ,(if (pair? ctor)
+          `(define ,(car ctor) (record-constructor ,type ',(cdr ctor)))
+          `(define ,ctor (record-constructor ,type)))
+     (define ,pred (record-predicate ,type))
+     ,@(map (lambda (field)
+              `(define ,(cadr field) (record-accessor ,type ',(car field))))
+            (filter (lambda (field) (pair? (cdr field))) fields))
+     ,@(map (lambda (field)
+              `(define ,(car (cddr field))
+                 (record-modifier ,type ',(car field))))
+            (filter (lambda (field) (pair? (cddr field))) fields))))
+
+;; whether sym appears anywhere in expr, outside of quotes
+(define (mentions? sym expr)
+  (cond
+   ((eq? expr sym) #t)
+   ((not (pair? expr)) #f)
+   ((eq? (car expr) 'quote) #f)
+   (else (or (mentions? sym (car expr)) (mentions? sym (cdr expr))))))
+
+;; whether sym only ever appears in expr, which is macroexpanded, as
+;; the procedure of a call that can't happen after expr returns. a
+;; lambda could be called later, so it mustn't mention sym at all,
+;; unless it is called on the spot, like a let's, and doesn't rebind it.
+(define (operator-only? sym expr)
+  (cond
+   ((eq? expr sym) #f)
+   ((not (pair? expr)) #t)
+   ((eq? (car expr) 'quote) #t)
+   ((not (list? expr)) #f)
+   ((eq? (car expr) 'lambda) (not (mentions? sym expr)))
+   ((and (eq? (car expr) 'define) (pair? (cdr expr)) (pair? (cadr expr)))
+    (not (mentions? sym expr)))
+   ((and (pair? (car expr)) (eq? (caar expr) 'lambda)
+         (pair? (cdr (car expr))))
+    (and (not (mentions? sym (cadr (car expr))))
+         (operator-only-all? sym (cddr (car expr)))
+         (operator-only-all? sym (cdr expr))))
+   (else (and (or (eq? (car expr) sym) (operator-only? sym (car expr)))
+              (operator-only-all? sym (cdr expr))))))
+
+(define (operator-only-all? sym exprs)
+  (or (null? exprs)
+      (and (operator-only? sym (car exprs))
+           (operator-only-all? sym (cdr exprs)))))
+
+;; a continuation that is only ever called, and never from a procedure
+;; that could outlive the call/cc, can't be called after call/cc
+;; returns, so it can be made with call/ec, which doesn't copy the stack
+(define-macro (call/cc proc)
+  (let ((expanded (macroexpand proc)))
+    (if (and (pair? expanded) (eq? (car expanded) 'lambda)
+             (pair? (cadr expanded)) (null? (cdr (cadr expanded)))
+             (operator-only-all? (car (cadr expanded)) (cddr expanded)))
+        `(call/ec ,expanded)
+        `(call-with-current-continuation ,proc))))
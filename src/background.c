@@ -0,0 +1,151 @@
+#include <plisp/background.h>
+#include <plisp/gc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+hot functions are compiled on background threads, so the mutator keeps
+running them in the interpreter or in baseline code until the compiled
+code is ready. the compiler shares the heap with the mutator, so jobs
+run with the gc lock held. that keeps collections out while a job has
+references only on its own stack, and runs one compile at a time.
+*/
+
+#define QUEUE_SIZE 64
+#define MAX_THREADS 8
+#define DEFAULT_THREADS 1
+
+struct job {
+    void (*fn)(void *, plisp_t);
+    void *arg;
+    plisp_t obj;
+};
+
+static struct job queue[QUEUE_SIZE];
+static size_t head = 0;
+static size_t count = 0;
+static size_t running = 0;
+static size_t finished = 0;
+static bool stopping = false;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+
+static pthread_t threads[MAX_THREADS];
+// the obj of the job each thread is running
+static plisp_t current[MAX_THREADS];
+static size_t nthreads = 0;
+
+static void *compiler_thread(void *arg) {
+    size_t id = (size_t) arg;
+
+    pthread_mutex_lock(&queue_lock);
+    while (true) {
+        while (count == 0 && !stopping) {
+            pthread_cond_wait(&queued, &queue_lock);
+        }
+        if (stopping) {
+            break;
+        }
+
+        // move the obj to our root before the queue slot is reused
+        struct job job = queue[head];
+        current[id] = job.obj;
+        queue[head].obj = plisp_nil;
+        head = (head + 1) % QUEUE_SIZE;
+        count--;
+        running++;
+        pthread_mutex_unlock(&queue_lock);
+
+        plisp_gc_lock();
+        job.fn(job.arg, job.obj);
+        plisp_gc_unlock();
+
+        pthread_mutex_lock(&queue_lock);
+        current[id] = plisp_nil;
+        running--;
+        finished++;
+        if (count == 0 && running == 0) {
+            pthread_cond_broadcast(&idle);
+        }
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return NULL;
+}
+
+void plisp_init_background(void) {
+    // PLISP_JIT_THREADS=0 compiles on the main thread
+    nthreads = DEFAULT_THREADS;
+    const char *setting = getenv("PLISP_JIT_THREADS");
+    if (setting != NULL) {
+        nthreads = strtoul(setting, NULL, 10);
+    }
+    if (nthreads > MAX_THREADS) {
+        nthreads = MAX_THREADS;
+    }
+
+    for (size_t i = 0; i < QUEUE_SIZE; ++i) {
+        queue[i].obj = plisp_nil;
+        plisp_gc_root(&queue[i].obj);
+    }
+
+    for (size_t i = 0; i < nthreads; ++i) {
+        current[i] = plisp_nil;
+        plisp_gc_root(&current[i]);
+        pthread_create(&threads[i], NULL, compiler_thread, (void *) i);
+    }
+}
+
+void plisp_end_background(void) {
+    // whatever is still queued is dropped, it would only have sped
+    // things up
+    pthread_mutex_lock(&queue_lock);
+    stopping = true;
+    pthread_cond_broadcast(&queued);
+    pthread_mutex_unlock(&queue_lock);
+
+    for (size_t i = 0; i < nthreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (getenv("PLISP_JIT_STATS") != NULL) {
+        fprintf(stderr, "background compiles: %lu\n", finished);
+    }
+    nthreads = 0;
+}
+
+bool plisp_background(void (*fn)(void *, plisp_t), void *arg, plisp_t obj) {
+    if (nthreads == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    if (count == QUEUE_SIZE || stopping) {
+        pthread_mutex_unlock(&queue_lock);
+        return false;
+    }
+
+    struct job *job = &queue[(head + count) % QUEUE_SIZE];
+    job->fn = fn;
+    job->arg = arg;
+    job->obj = obj;
+    count++;
+    pthread_cond_signal(&queued);
+    pthread_mutex_unlock(&queue_lock);
+
+    return true;
+}
+
+void plisp_background_wait(void) {
+    // jobs can't start while a collection holds the gc lock
+    plisp_enter_blocking();
+    pthread_mutex_lock(&queue_lock);
+    while ((count != 0 || running != 0) && !stopping) {
+        pthread_cond_wait(&idle, &queue_lock);
+    }
+    pthread_mutex_unlock(&queue_lock);
+    plisp_leave_blocking();
+}
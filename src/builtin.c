@@ -8,12 +8,44 @@
 #include <plisp/gc.h>
 #include <plisp/posix.h>
 #include <plisp/continuation.h>
+#include <plisp/interp.h>
+#include <plisp/precompile.h>
+#include <plisp/number.h>
+#include <plisp/homvec.h>
+#include <plisp/text.h>
+#include <plisp/hashtable.h>
+#include <plisp/list.h>
+#include <plisp/sort.h>
+#include <plisp/record.h>
+#include <plisp/persistent.h>
+#include <plisp/coroutine.h>
+#include <plisp/port.h>
+#include <plisp/thread.h>
+#include <plisp/future.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stdlib.h>
 #include <lightning.h>
+#include <Judy.h>
+#include <pthread.h>
 
 static plisp_t filesym;
 
+// maps checked builtins to their unchecked entry points
+static Pvoid_t unchecked_entries = NULL;
+
+static plisp_t unchecked_plus(plisp_t *clos, size_t nargs, plisp_t a,
+                              plisp_t b, ...);
+static plisp_t unchecked_minus(plisp_t *clos, size_t nargs, plisp_t a,
+                               plisp_t b, ...);
+static plisp_t unchecked_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b);
+static plisp_t unchecked_car(plisp_t *clos, size_t nargs, plisp_t cell);
+static plisp_t unchecked_cdr(plisp_t *clos, size_t nargs, plisp_t cell);
+static plisp_t unchecked_vector_ref(plisp_t *clos, size_t nargs,
+                                    plisp_t vector, plisp_t idx);
+static plisp_t unchecked_vector_length(plisp_t *clos, size_t nargs,
+                                       plisp_t vec);
+
 void plisp_init_builtin(void) {
     filesym = plisp_intern(plisp_make_symbol("%file"));
     // gcc passes variadic args just like regular args, so this is
@@ -21,13 +53,17 @@ void plisp_init_builtin(void) {
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 
-    plisp_define_builtin("+", plisp_builtin_plus);
-    plisp_define_builtin("-", plisp_builtin_minus);
+    plisp_define_builtin_unchecked("+", plisp_builtin_plus,
+                                   unchecked_plus);
+    plisp_define_builtin_unchecked("-", plisp_builtin_minus,
+                                   unchecked_minus);
     plisp_define_builtin("*", plisp_builtin_times);
 
     plisp_define_builtin("cons", plisp_builtin_cons);
-    plisp_define_builtin("car", plisp_builtin_car);
-    plisp_define_builtin("cdr", plisp_builtin_cdr);
+    plisp_define_builtin_unchecked("car", plisp_builtin_car,
+                                   unchecked_car);
+    plisp_define_builtin_unchecked("cdr", plisp_builtin_cdr,
+                                   unchecked_cdr);
 
     plisp_define_builtin("reverse", plisp_builtin_reverse);
     plisp_define_builtin("list", plisp_builtin_list);
@@ -36,13 +72,14 @@ void plisp_init_builtin(void) {
     plisp_define_builtin("null?", plisp_builtin_nullp);
     plisp_define_builtin("eq?", plisp_builtin_eq);
     plisp_define_builtin("equal?", plisp_builtin_equal);
-    plisp_define_builtin("<", plisp_builtin_lt);
+    plisp_define_builtin_unchecked("<", plisp_builtin_lt,
+                                   unchecked_lt);
 
     plisp_define_builtin("pair?", plisp_builtin_pair);
+    plisp_define_builtin("fixnum?", plisp_builtin_fixnump);
     plisp_define_builtin("list?", plisp_builtin_listp);
 
     plisp_define_builtin("length", plisp_builtin_length);
-    plisp_define_builtin("append", plisp_builtin_append);
 
     plisp_define_builtin("display", plisp_builtin_display);
     plisp_define_builtin("write", plisp_builtin_write);
@@ -52,16 +89,22 @@ void plisp_init_builtin(void) {
     plisp_define_builtin("collect-garbage", plisp_builtin_collect_garbage);
     plisp_define_builtin("object-addr", plisp_builtin_object_addr);
     plisp_define_builtin("disassemble", plisp_builtin_disassemble);
+    plisp_define_builtin("procedure-tier", plisp_builtin_procedure_tier);
 
     plisp_define_builtin("vector", plisp_builtin_vector);
     plisp_define_builtin("make-vector", plisp_builtin_make_vector);
     plisp_define_builtin("list->vector", plisp_builtin_list_to_vector);
-    plisp_define_builtin("vector-ref", plisp_builtin_vector_ref);
+    plisp_define_builtin_unchecked("vector-ref", plisp_builtin_vector_ref,
+                                   unchecked_vector_ref);
     plisp_define_builtin("vector-set!", plisp_builtin_vector_set);
     plisp_define_builtin("vector-append", plisp_builtin_vector_append);
     plisp_define_builtin("string-append", plisp_builtin_string_append);
-    plisp_define_builtin("vector-length", plisp_builtin_vector_length);
+    plisp_define_builtin_unchecked("vector-length", plisp_builtin_vector_length,
+                                   unchecked_vector_length);
     plisp_define_builtin("string-length", plisp_builtin_string_length);
+    plisp_define_builtin("subvector", plisp_builtin_subvector);
+    plisp_define_builtin("substring", plisp_builtin_substring);
+    plisp_define_builtin("vector-copy!", plisp_builtin_vector_copy);
 
 
     plisp_define_builtin("read", plisp_builtin_read);
@@ -79,29 +122,148 @@ void plisp_init_builtin(void) {
 
     plisp_init_posix();
     plisp_init_continuation();
+    plisp_init_precompile();
+    plisp_init_number();
+    plisp_init_homvec();
+    plisp_init_text();
+    plisp_init_hashtable();
+    plisp_init_list();
+    plisp_init_sort();
+    plisp_init_record();
+    plisp_init_persistent();
+    plisp_init_coroutine();
+    plisp_init_port();
+    plisp_init_thread();
+    plisp_init_future();
 }
 
 void plisp_define_builtin(const char *name, plisp_fn_t fun) {
-    plisp_toplevel_define(
-        plisp_intern(plisp_make_symbol(name)),
-        plisp_make_closure(NULL, fun));
+    plisp_define_builtin_data(name, fun, NULL);
+}
+
+void plisp_define_builtin_data(const char *name, plisp_fn_t fun,
+                               struct plisp_closure_data *data) {
+    plisp_t closure = plisp_make_closure(data, fun);
+    // compiled code compares against builtins to inline them, so they
+    // must never be reused
+    plisp_gc_permanent(closure);
+    plisp_toplevel_define(plisp_intern(plisp_make_symbol(name)), closure);
+}
+
+void plisp_define_builtin_unchecked(const char *name, plisp_fn_t fun,
+                                    plisp_fn_t unchecked) {
+    plisp_define_builtin(name, fun);
+
+    plisp_fn_t *pval;
+    JLI(pval, unchecked_entries, (uintptr_t) fun);
+    *pval = unchecked;
+}
+
+plisp_fn_t plisp_unchecked_entry(plisp_t fn) {
+    if (!plisp_c_closurep(fn)) {
+        return NULL;
+    }
+
+    plisp_fn_t *pval;
+    JLG(pval, unchecked_entries, (uintptr_t) plisp_closure_fun(fn));
+    if (pval == NULL) {
+        return NULL;
+    }
+    return *pval;
+}
+
+/*
+unchecked entry points skip the argument count and type checks. they
+are only called directly by code compiled with (safety 0), which
+promises to pass the right arguments. fixnum arithmetic wraps instead
+of overflowing into bignums, but other numbers still work.
+*/
+
+static plisp_t unchecked_add(plisp_t a, plisp_t b) {
+    if (((a | b) & LOTAGS) == LT_FIXNUM) {
+        return a + b;
+    }
+    return plisp_num_add(a, b);
+}
+
+static plisp_t unchecked_sub(plisp_t a, plisp_t b) {
+    if (((a | b) & LOTAGS) == LT_FIXNUM) {
+        return a - b;
+    }
+    return plisp_num_sub(a, b);
+}
+
+static plisp_t unchecked_plus(plisp_t *clos, size_t nargs, plisp_t a,
+                              plisp_t b, ...) {
+    va_list vl;
+    va_start(vl, b);
+
+    plisp_t sum = unchecked_add(a, b);
+    for (size_t i = 2; i < nargs; ++i) {
+        sum = unchecked_add(sum, va_arg(vl, plisp_t));
+    }
+
+    va_end(vl);
+    return sum;
+}
+
+static plisp_t unchecked_minus(plisp_t *clos, size_t nargs, plisp_t a,
+                               plisp_t b, ...) {
+    va_list vl;
+    va_start(vl, b);
+
+    plisp_t sum = unchecked_sub(a, b);
+    for (size_t i = 2; i < nargs; ++i) {
+        sum = unchecked_sub(sum, va_arg(vl, plisp_t));
+    }
+
+    va_end(vl);
+    return sum;
+}
+
+static plisp_t unchecked_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
+    if (((a | b) & LOTAGS) == LT_FIXNUM) {
+        return plisp_make_bool((intptr_t) a < (intptr_t) b);
+    }
+    return plisp_make_bool(plisp_num_lt(a, b));
+}
+
+static plisp_t unchecked_car(plisp_t *clos, size_t nargs, plisp_t cell) {
+    return ((struct plisp_cons *) (cell & ~LOTAGS))->car;
+}
+
+static plisp_t unchecked_cdr(plisp_t *clos, size_t nargs, plisp_t cell) {
+    return ((struct plisp_cons *) (cell & ~LOTAGS))->cdr;
+}
+
+static plisp_t unchecked_vector_ref(plisp_t *clos, size_t nargs,
+                                    plisp_t vector, plisp_t idx) {
+    struct plisp_vector *vecptr = (void *) (vector & ~LOTAGS);
+    size_t i = plisp_fixnum_value(idx);
+
+    if (vecptr->type == VEC_OBJ) {
+        return ((plisp_t *) vecptr->vec)[i];
+    }
+    return plisp_vector_ref(vector, i);
+}
+
+static plisp_t unchecked_vector_length(plisp_t *clos, size_t nargs,
+                                       plisp_t vec) {
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    return plisp_make_fixnum(vecptr->len);
 }
 
 plisp_t plisp_builtin_plus(plisp_t *clos, size_t nargs, plisp_t a,
                            plisp_t b, ...) {
     plisp_assert(nargs >= 2);
-    plisp_assert(plisp_c_fixnump(a));
-    plisp_assert(plisp_c_fixnump(b));
 
     va_list vl;
     va_start(vl, b);
 
-    plisp_t sum = a + b;
+    plisp_t sum = plisp_num_add(a, b);
 
     for (size_t i = 2; i < nargs; ++i) {
-        plisp_t arg = va_arg(vl, plisp_t);
-        plisp_assert(plisp_c_fixnump(arg));
-        sum += arg;
+        sum = plisp_num_add(sum, va_arg(vl, plisp_t));
     }
 
     va_end(vl);
@@ -111,19 +273,22 @@ plisp_t plisp_builtin_plus(plisp_t *clos, size_t nargs, plisp_t a,
 
 plisp_t plisp_builtin_minus(plisp_t *clos, size_t nargs, plisp_t a,
                             plisp_t b, ...) {
-    plisp_assert(plisp_c_fixnump(a));
-    plisp_assert(plisp_c_fixnump(b));
-    plisp_assert(nargs >= 2);
+    plisp_assert(nargs >= 1);
+    if (nargs == 1) {
+        // 0 - 0.0 is 0.0, but (- 0.0) is -0.0
+        if (plisp_c_flonump(a)) {
+            return plisp_make_flonum(-plisp_flonum_value(a));
+        }
+        return plisp_num_sub(plisp_make_fixnum(0), a);
+    }
 
     va_list vl;
     va_start(vl, b);
 
-    plisp_t sum = a - b;
+    plisp_t sum = plisp_num_sub(a, b);
 
     for (size_t i = 2; i < nargs; ++i) {
-        plisp_t arg = va_arg(vl, plisp_t);
-        plisp_assert(plisp_c_fixnump(arg));
-        sum -= arg;
+        sum = plisp_num_sub(sum, va_arg(vl, plisp_t));
     }
 
     va_end(vl);
@@ -137,17 +302,15 @@ plisp_t plisp_builtin_times(plisp_t *clos, size_t nargs, ...) {
     va_list vl;
     va_start(vl, nargs);
 
-    int64_t prod = 1;
+    plisp_t prod = va_arg(vl, plisp_t);
 
-    for (size_t i = 0; i < nargs; ++i) {
-        plisp_t arg = va_arg(vl, plisp_t);
-        plisp_assert(plisp_c_fixnump(arg));
-        prod *= plisp_fixnum_value(arg);
+    for (size_t i = 1; i < nargs; ++i) {
+        prod = plisp_num_mul(prod, va_arg(vl, plisp_t));
     }
 
     va_end(vl);
 
-    return plisp_make_fixnum(prod);
+    return prod;
 }
 
 plisp_t plisp_builtin_cons(plisp_t *clos, size_t nargs, plisp_t car,
@@ -178,12 +341,10 @@ plisp_t plisp_builtin_reverse(plisp_t *clos, size_t nargs,
         onto = plisp_nil;
     }
 
-    if (plisp_c_nullp(lst)) {
-        return onto;
+    for (; !plisp_c_nullp(lst); lst = plisp_cdr(lst)) {
+        onto = plisp_cons(plisp_car(lst), onto);
     }
-
-    return plisp_builtin_reverse(NULL, 2, plisp_cdr(lst),
-                                 plisp_cons(plisp_car(lst), onto));
+    return onto;
 }
 
 plisp_t plisp_builtin_list(plisp_t *clos, size_t nargs, ...) {
@@ -227,7 +388,7 @@ plisp_t plisp_builtin_equal(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
 
 plisp_t plisp_builtin_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
     plisp_assert(nargs == 2);
-    return plisp_make_bool(a < b);
+    return plisp_make_bool(plisp_num_lt(a, b));
 }
 
 plisp_t plisp_builtin_pair(plisp_t *clos, size_t nargs, plisp_t obj) {
@@ -235,9 +396,27 @@ plisp_t plisp_builtin_pair(plisp_t *clos, size_t nargs, plisp_t obj) {
     return plisp_make_bool(plisp_c_consp(obj));
 }
 
+plisp_t plisp_builtin_fixnump(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_fixnump(obj));
+}
+
 bool plisp_c_listp(plisp_t obj) {
-    return obj == plisp_nil
-        || (plisp_c_consp(obj) && plisp_c_listp(plisp_cdr(obj)));
+    // slow follows fast at half speed, so they meet if the list is
+    // circular
+    plisp_t slow = obj;
+    while (plisp_c_consp(obj)) {
+        obj = plisp_cdr(obj);
+        if (!plisp_c_consp(obj)) {
+            break;
+        }
+        obj = plisp_cdr(obj);
+        slow = plisp_cdr(slow);
+        if (obj == slow) {
+            return false;
+        }
+    }
+    return plisp_c_nullp(obj);
 }
 
 plisp_t plisp_builtin_listp(plisp_t *clos, size_t nargs, plisp_t obj) {
@@ -246,13 +425,11 @@ plisp_t plisp_builtin_listp(plisp_t *clos, size_t nargs, plisp_t obj) {
 }
 
 size_t plisp_c_length(plisp_t lst) {
-    plisp_assert(plisp_c_consp(lst) || plisp_c_nullp(lst));
-
-    if (plisp_c_nullp(lst)) {
-        return 0;
+    size_t len = 0;
+    for (; !plisp_c_nullp(lst); lst = plisp_cdr(lst)) {
+        len++;
     }
-
-    return 1 + plisp_c_length(plisp_cdr(lst));
+    return len;
 }
 
 plisp_t plisp_builtin_length(plisp_t *clos, size_t nargs, plisp_t lst) {
@@ -260,17 +437,6 @@ plisp_t plisp_builtin_length(plisp_t *clos, size_t nargs, plisp_t lst) {
     return plisp_make_fixnum(plisp_c_length(lst));
 }
 
-plisp_t plisp_append(plisp_t a, plisp_t b) {
-    for (plisp_t i = plisp_c_reverse(a); i != plisp_nil; i = plisp_cdr(i)) {
-        b = plisp_cons(plisp_car(i), b);
-    }
-    return b;
-}
-
-plisp_t plisp_builtin_append(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
-    plisp_assert(nargs == 2);
-    return plisp_append(a, b);
-}
 
 plisp_t plisp_builtin_display(plisp_t *clos, size_t nargs, plisp_t obj) {
     plisp_assert(nargs == 1);
@@ -467,6 +633,68 @@ plisp_t plisp_builtin_string_length(plisp_t *clos, size_t nargs, plisp_t vec) {
     return plisp_make_fixnum(plisp_vector_c_length(vec)-1);
 }
 
+plisp_t plisp_builtin_subvector(plisp_t *clos, size_t nargs,
+                                plisp_t vec, plisp_t start, plisp_t end) {
+    plisp_assert(nargs == 3);
+    plisp_assert(plisp_c_fixnump(start) && plisp_c_fixnump(end));
+    plisp_assert(plisp_fixnum_value(start) >= 0);
+    return plisp_make_slice(vec, plisp_fixnum_value(start),
+                            plisp_fixnum_value(end));
+}
+
+plisp_t plisp_builtin_substring(plisp_t *clos, size_t nargs,
+                                plisp_t str, plisp_t start, plisp_t end) {
+    plisp_assert(nargs == 2 || nargs == 3);
+    plisp_assert(plisp_c_stringp(str));
+    if (nargs == 2) {
+        end = plisp_make_fixnum(plisp_c_stringlen(str));
+    }
+    plisp_assert(plisp_c_fixnump(start) && plisp_c_fixnump(end));
+    plisp_assert(plisp_fixnum_value(start) >= 0);
+    plisp_assert(plisp_fixnum_value(end) <= (int64_t) plisp_c_stringlen(str));
+
+    // keep the byte after the last char, so a substring that runs to
+    // the end still has its nul
+    return plisp_make_slice(str, plisp_fixnum_value(start),
+                            plisp_fixnum_value(end) + 1);
+}
+
+plisp_t plisp_builtin_vector_copy(plisp_t *clos, size_t nargs, plisp_t to,
+                                  plisp_t at, plisp_t from, plisp_t start,
+                                  plisp_t end) {
+    plisp_assert(nargs >= 3 && nargs <= 5);
+    plisp_assert(plisp_c_vectorp(to) && plisp_c_vectorp(from));
+    struct plisp_vector *toptr = (void *) (to & ~LOTAGS);
+    struct plisp_vector *fromptr = (void *) (from & ~LOTAGS);
+
+    if (nargs < 4) {
+        start = plisp_make_fixnum(0);
+    }
+    if (nargs < 5) {
+        end = plisp_make_fixnum(fromptr->len);
+    }
+    plisp_assert(plisp_c_fixnump(at) && plisp_c_fixnump(start)
+                 && plisp_c_fixnump(end));
+
+    int64_t dst = plisp_fixnum_value(at);
+    int64_t lo = plisp_fixnum_value(start);
+    int64_t hi = plisp_fixnum_value(end);
+    plisp_assert(0 <= lo && lo <= hi && hi <= fromptr->len);
+    plisp_assert(0 <= dst && dst + (hi - lo) <= toptr->len);
+
+    plisp_assert(!(toptr->flags & VFLAG_IMMUTABLE));
+    plisp_assert(toptr->type == fromptr->type
+                 && toptr->elem_width == fromptr->elem_width
+                 && (toptr->flags & VFLAG_UNSIGNED)
+                    == (fromptr->flags & VFLAG_UNSIGNED));
+
+    // memmove, since they may be slices of the same payload
+    size_t width = toptr->elem_width;
+    memmove(toptr->vec + dst * width, fromptr->vec + lo * width,
+            (hi - lo) * width);
+    return plisp_unspec;
+}
+
 plisp_t plisp_builtin_read(plisp_t *clos, size_t nargs) {
     plisp_assert(nargs == 0);
     return plisp_c_read(stdin);
@@ -475,23 +703,41 @@ plisp_t plisp_builtin_read(plisp_t *clos, size_t nargs) {
 void plisp_c_load(const char *fname) {
     plisp_t oldfile = *plisp_toplevel_ref(filesym);
     plisp_toplevel_define(filesym, plisp_make_string(fname));
+    plisp_note_loaded_file(fname);
+
+    // prefer an up to date compiled file, which is already expanded
+    char *compiled = plisp_compiled_path(fname);
+    bool expanded = plisp_compiled_fresh(fname, compiled);
 
-    FILE *file = fopen(fname, "r");
+    FILE *file = fopen(expanded ? compiled : fname, "r");
     plisp_assert(file != NULL);
+    free(compiled);
+
+    // its gensyms were made by another process, so get new ones
+    Pvoid_t renames = expanded ? plisp_read_compiled_header(file) : NULL;
 
     plisp_t obj;
     while (!plisp_c_eofp(obj = plisp_c_read(file))) {
-        plisp_toplevel_eval(obj);
+        if (!expanded) {
+            obj = plisp_cached_macroexpand(obj);
+        } else if (renames != NULL) {
+            obj = plisp_rename_gensyms(obj, renames);
+        }
+        plisp_note_loaded_form(obj);
+        plisp_toplevel_eval_expanded(obj);
     }
 
     fclose(file);
+    plisp_free_renames(renames);
 
     plisp_toplevel_define(filesym, oldfile);
 }
 
 plisp_t plisp_builtin_load(plisp_t *clos, size_t nargs, plisp_t fname) {
     plisp_assert(nargs == 1);
-    plisp_c_load(plisp_string_value(fname));
+    char *path = plisp_string_cstring(fname);
+    plisp_c_load(path);
+    free(path);
     return plisp_unspec;
 }
 
@@ -500,24 +746,9 @@ plisp_t plisp_builtin_eval(plisp_t *clos, size_t nargs, plisp_t expr) {
     return plisp_toplevel_eval(expr);
 }
 
-plisp_t plisp_builtin_apply(plisp_t *clos, size_t nargs, plisp_t fn, ...) {
-    plisp_assert(nargs >= 2);
+plisp_t plisp_call_closure(plisp_t fn, size_t nnargs, plisp_t *args) {
     plisp_assert(plisp_c_closurep(fn));
 
-    plisp_t args[32];
-
-    va_list vl;
-    va_start(vl, fn);
-
-    size_t nnargs = 0;
-    for (size_t i = 0; i < (nargs-2); ++i) {
-        args[nnargs++] = va_arg(vl, plisp_t);
-    }
-
-    for (plisp_t lst = va_arg(vl, plisp_t); lst != plisp_nil; lst = plisp_cdr(lst)) {
-        args[nnargs++] = plisp_car(lst);
-    }
-
     plisp_fn_t fun = plisp_closure_fun(fn);
     void *cdata    = plisp_closure_data(fn);
     if (nnargs == 0) {
@@ -593,12 +824,50 @@ plisp_t plisp_builtin_apply(plisp_t *clos, size_t nargs, plisp_t fn, ...) {
 }
 
 
+
+plisp_t plisp_builtin_apply(plisp_t *clos, size_t nargs, plisp_t fn, ...) {
+    plisp_assert(nargs >= 2);
+    plisp_assert(plisp_c_closurep(fn));
+
+    plisp_t args[32];
+
+    va_list vl;
+    va_start(vl, fn);
+
+    size_t nnargs = 0;
+    for (size_t i = 0; i < (nargs-2); ++i) {
+        args[nnargs++] = va_arg(vl, plisp_t);
+    }
+
+    for (plisp_t lst = va_arg(vl, plisp_t); lst != plisp_nil; lst = plisp_cdr(lst)) {
+        args[nnargs++] = plisp_car(lst);
+    }
+
+    va_end(vl);
+
+    return plisp_call_closure(fn, nnargs, args);
+}
+
 plisp_t plisp_builtin_disassemble(plisp_t *clos, size_t nargs, plisp_t expr) {
     plisp_assert(nargs == 1);
+    if (plisp_c_interpretedp(expr)) {
+        plisp_interp_promote(expr);
+    }
     plisp_disassemble_fn(plisp_closure_fun(expr));
     return plisp_unspec;
 }
 
+plisp_t plisp_builtin_procedure_tier(plisp_t *clos, size_t nargs,
+                                     plisp_t fn) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_closurep(fn));
+    if (plisp_c_interpretedp(fn)) {
+        return plisp_intern(plisp_make_symbol("interpreted"));
+    }
+    return plisp_intern(plisp_make_symbol(
+                            plisp_fn_tier(plisp_closure_fun(fn))));
+}
+
 plisp_t plisp_builtin_hashq(plisp_t *clos, size_t nargs, plisp_t obj,
                             plisp_t bits) {
     plisp_assert(nargs == 2);
@@ -611,16 +880,40 @@ plisp_t plisp_builtin_unspecified(plisp_t *clos, size_t nargs) {
     return plisp_unspec;
 }
 
-plisp_t plisp_builtin_gensym(plisp_t *clos, size_t nargs) {
-    plisp_assert(nargs == 0);
+// the symbols gensym has made, which compiled files rename when loaded
+static Pvoid_t gensyms = NULL;
+static pthread_mutex_t gensym_lock = PTHREAD_MUTEX_INITIALIZER;
+
+plisp_t plisp_c_gensym(void) {
     static size_t gscounter = 0;
 
     char buff[64];
     plisp_t sym;
     do {
-        snprintf(buff, 64, "g%lu", gscounter);
+        // threads each take a number of their own
+        snprintf(buff, 64, "g%lu",
+                 __atomic_fetch_add(&gscounter, 1, __ATOMIC_RELAXED));
         sym = plisp_make_symbol(buff);
-        gscounter++;
     } while(plisp_symbol_internedp(sym));
-    return plisp_intern(sym);
+    sym = plisp_intern(sym);
+
+    pthread_mutex_lock(&gensym_lock);
+    Word_t *pval;
+    JLI(pval, gensyms, sym);
+    *pval = 1;
+    pthread_mutex_unlock(&gensym_lock);
+    return sym;
+}
+
+bool plisp_c_gensymp(plisp_t sym) {
+    pthread_mutex_lock(&gensym_lock);
+    Word_t *pval;
+    JLG(pval, gensyms, sym);
+    pthread_mutex_unlock(&gensym_lock);
+    return pval != NULL;
+}
+
+plisp_t plisp_builtin_gensym(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    return plisp_c_gensym();
 }
@@ -6,10 +6,17 @@
 #include <plisp/gc.h>
 #include <plisp/toplevel.h>
 #include <plisp/builtin.h>
+#include <plisp/list.h>
 #include <plisp/object.h>
 #include <plisp/saftey.h>
+#include <plisp/interp.h>
+#include <plisp/background.h>
+#include <plisp/number.h>
+#include <plisp/record.h>
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
 
 static plisp_t lambda_sym;
@@ -20,9 +27,119 @@ static plisp_t quasiquote_sym;
 static plisp_t unquote_sym;
 static plisp_t unquote_splicing_sym;
 static plisp_t set_sym;
+static plisp_t declare_sym;
+static plisp_t safety_sym;
 
-// associates jit context with functions
+#ifdef PLISP_UNSAFE
+#define DEFAULT_SAFE false
+#else
+#define DEFAULT_SAFE true
+#endif
+
+// calls before a baseline function is recompiled using its profile
+#define OPT_THRESHOLD 1000
+// failed speculations before optimized code is abandoned
+#define DEOPT_LIMIT 100
+// the most atoms a toplevel function's body can have to be inlined
+#define INLINE_BUDGET 16
+#define INLINE_DEPTH 2
+// how many times a function may be optimized
+#define MAX_OPT_GENERATIONS 3
+
+// the profile of one site in a baseline function. sites are found by
+// the form they profile, so the optimizing compiler can reach them in
+// any order, and every copy of a form compiled shares one.
+struct profile_site {
+    uintptr_t tags;   // primitive calls: mask of argument lotags
+    size_t taken;     // branches
+    size_t not_taken;
+    plisp_t target;   // calls: last closure called
+    size_t retargets;
+};
+
+struct fn_info {
+    jit_state_t *jit;
+    // only toplevel functions of fixed arity are tiered
+    bool tierable;
+    plisp_t lambda;
+    plisp_t preset_closure;
+    // the safety the lambda inherited
+    bool safe;
+    size_t calls;
+    // profile sites and call caches, by form and then by inline
+    // context (see site_slot)
+    Pvoid_t sites;
+    Pvoid_t caches;
+    // objects the code embeds, which live as long as it does
+    plisp_t roots;
+    // where the code was emitted
+    void *code;
+    size_t code_size;
+    // once set, the baseline code forwards every call here
+    plisp_fn_t optimized;
+    size_t deopts;
+    size_t generation;
+    // shared by the uncompiled inner lambdas of one arity
+    bool lazy_stub;
+};
+
+// misses before a call site counts as megamorphic
+#define POLY_LIMIT 4
+
+// an inline cache at a call through a variable. it remembers the last
+// code pointer called, so the optimizing tier can call it directly.
+struct call_cache {
+    plisp_fn_t fun;
+    size_t hits;
+    size_t misses;
+    struct call_cache *next;
+};
+
+// every call cache, for PLISP_JIT_STATS
+static struct call_cache *call_caches = NULL;
+static bool print_stats = false;
+
+// an inner lambda that hasn't been compiled yet. its closures run a
+// stub shared by every lambda of the same arity, which compiles the
+// real code on the first call. the closure data has LAZY_SLOTS past
+// its variables for the stub: the lazy_lambda, and the closure itself
+// so the stub can patch it.
+struct lazy_lambda {
+    plisp_t lambda;
+    // (sym . boxed) for each closure variable
+    plisp_t layout;
+    bool safe;
+    plisp_fn_t fun;
+};
+
+#define LAZY_SLOTS 2
+#define MAX_ARGS 128
+
+static plisp_fn_t lazy_stubs[MAX_ARGS];
+static size_t lazy_lambdas = 0;
+static size_t lazy_compiled = 0;
+
+// associates jit context and tier metadata with functions
 static Pvoid_t jit_info = NULL;
+// compiling holds the gc lock, but jit_info is read without it
+static pthread_mutex_t info_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct fn_info *get_info(plisp_fn_t fun) {
+    pthread_mutex_lock(&info_lock);
+    struct fn_info **pval;
+    JLG(pval, jit_info, (uintptr_t) fun);
+    struct fn_info *info = pval != NULL ? *pval : NULL;
+    pthread_mutex_unlock(&info_lock);
+    return info;
+}
+
+static void set_info(plisp_fn_t fun, struct fn_info *info) {
+    pthread_mutex_lock(&info_lock);
+    struct fn_info **pval;
+    JLI(pval, jit_info, (uintptr_t) fun);
+    *pval = info;
+    pthread_mutex_unlock(&info_lock);
+}
 
 void plisp_init_compiler(char *argv0) {
     init_jit(argv0);
@@ -34,12 +151,65 @@ void plisp_init_compiler(char *argv0) {
     unquote_sym = plisp_intern(plisp_make_symbol("unquote"));
     unquote_splicing_sym = plisp_intern(plisp_make_symbol("unquote-splicing"));
     set_sym = plisp_intern(plisp_make_symbol("set!"));
+    declare_sym = plisp_intern(plisp_make_symbol("declare"));
+    safety_sym = plisp_intern(plisp_make_symbol("safety"));
+    print_stats = getenv("PLISP_JIT_STATS") != NULL;
+}
+
+static void plisp_print_call_stats(FILE *f) {
+    size_t sites = 0, mono = 0, poly = 0, mega = 0;
+    size_t hits = 0, misses = 0;
+    for (struct call_cache *c = call_caches; c != NULL; c = c->next) {
+        if (c->misses == 0) {
+            continue;
+        }
+        sites++;
+        if (c->misses == 1) {
+            mono++;
+        } else if (c->misses <= POLY_LIMIT) {
+            poly++;
+        } else {
+            mega++;
+        }
+        hits += c->hits;
+        misses += c->misses;
+    }
+
+    fprintf(f, "call sites: %lu (%lu monomorphic, %lu polymorphic, "
+            "%lu megamorphic)\n", sites, mono, poly, mega);
+    fprintf(f, "inline cache hits: %lu, misses: %lu\n", hits, misses);
+    fprintf(f, "lazy lambdas: %lu, compiled: %lu\n",
+            lazy_lambdas, lazy_compiled);
 }
 
 void plisp_end_compiler(void) {
+    if (print_stats) {
+        plisp_print_call_stats(stderr);
+    }
     finish_jit();
 }
 
+// what the compiler knows about a value, as the set of kinds it
+// could be
+enum {
+    TY_FIXNUM  = 1 << 0,
+    TY_PAIR    = 1 << 1,
+    TY_NULL    = 1 << 2,
+    TY_CLOSURE = 1 << 3,
+    TY_FLONUM  = 1 << 4,
+    TY_OTHER   = 1 << 5,
+    TY_ANY     = (1 << 6) - 1,
+};
+
+// the type of an unboxed local from some point on. unboxed locals are
+// never assigned, so a fact holds until the scope that made it ends.
+struct type_fact {
+    plisp_t sym;
+    int type;
+};
+
+#define MAX_FACTS 64
+
 struct lambda_state {
     jit_state_t *jit;
     Pvoid_t arg_table;
@@ -51,9 +221,119 @@ struct lambda_state {
     size_t closure_idx;
     int closure_on_stack;
     Pvoid_t boxed;
+    struct fn_info *info;
+    // the baseline's metadata, when compiling an optimized version
+    struct fn_info *profile;
+    // the calls the code being compiled was inlined into, hashed, so
+    // the sites of a body inlined at two calls are told apart
+    uintptr_t site_context;
+    // whether runtime checks are emitted, see plisp_lambda_safety
+    bool safe;
+    struct type_fact facts[MAX_FACTS];
+    size_t nfacts;
+    // set while compiling code reached when a predicate was redefined,
+    // where its result says nothing about types
+    int nofacts;
+    // how many calls deep the code being compiled was inlined
+    int inline_depth;
 };
 #define _jit (_state->jit)
 
+static bool profiling(struct lambda_state *_state) {
+    return _state->profile == NULL && _state->info->tierable;
+}
+
+static bool optimizing(struct lambda_state *_state) {
+    return _state->profile != NULL;
+}
+
+// the slot for form, compiled in context, in a map of sites or caches.
+// if create isn't set, NULL when there is none.
+static void **site_slot(Pvoid_t *map, plisp_t form, uintptr_t context,
+                        bool create) {
+    Pvoid_t *contexts;
+    void **slot;
+    if (create) {
+        JLI(contexts, *map, form);
+        JLI(slot, *contexts, context);
+    } else {
+        JLG(contexts, *map, form);
+        if (contexts == NULL) {
+            return NULL;
+        }
+        JLG(slot, *contexts, context);
+    }
+    return slot;
+}
+
+// the context of the body of a call inlined at call
+static uintptr_t inline_context(uintptr_t context, plisp_t call) {
+    return (context ^ call) * 0x9e3779b97f4a7c15lu;
+}
+
+// the profile of form, or NULL if there is none
+static struct profile_site *find_site(struct lambda_state *_state,
+                                      plisp_t form) {
+    if (optimizing(_state)) {
+        void **slot = site_slot(&_state->profile->sites, form,
+                                _state->site_context, false);
+        return slot != NULL ? *slot : NULL;
+    } else if (!profiling(_state)) {
+        return NULL;
+    }
+
+    void **slot = site_slot(&_state->info->sites, form,
+                            _state->site_context, true);
+    if (*slot == NULL) {
+        struct profile_site *site = calloc(1, sizeof(struct profile_site));
+        site->target = plisp_unbound;
+        plisp_gc_root(&site->target);
+        *slot = site;
+    }
+    return *slot;
+}
+
+// the call cache of the call form. when optimizing, baseline is set
+// to the cache of the same call in the baseline
+static struct call_cache *find_cache(struct lambda_state *_state,
+                                     plisp_t form,
+                                     struct call_cache **baseline) {
+    *baseline = NULL;
+    if (optimizing(_state)) {
+        void **slot = site_slot(&_state->profile->caches, form,
+                                _state->site_context, false);
+        if (slot != NULL) {
+            *baseline = *slot;
+        }
+    }
+
+    void **slot = site_slot(&_state->info->caches, form,
+                            _state->site_context, true);
+    if (*slot == NULL) {
+        struct call_cache *cache = calloc(1, sizeof(struct call_cache));
+        cache->next = call_caches;
+        call_caches = cache;
+        *slot = cache;
+    }
+    return *slot;
+}
+
+// keeps obj alive for as long as the code being compiled, which
+// refers to it
+static void code_root(struct lambda_state *_state, plisp_t obj) {
+    struct fn_info *info = _state->info;
+    if (info->roots == plisp_nil) {
+        plisp_gc_root(&info->roots);
+    }
+    info->roots = plisp_cons(obj, info->roots);
+}
+
+static void emit_count(struct lambda_state *_state, size_t *counter) {
+    jit_ldi(JIT_R1, counter);
+    jit_addi(JIT_R1, JIT_R1, 1);
+    jit_sti(counter, JIT_R1);
+}
+
 static int push(struct lambda_state *_state, int reg) {
     if (_state->stack_max == _state->stack_cur) {
         _state->stack_cur = jit_allocai(sizeof(plisp_t));
@@ -80,7 +360,6 @@ static void pop(struct lambda_state *_state, int reg) {
     assert(_state->stack_cur <= _state->stack_nopop);
 }
 
-#ifndef PLISP_UNSAFE
 static void assert_is_closure(plisp_t clos) {
     if (!plisp_c_closurep(clos)) {
         fprintf(stderr, "error: attempt to call non-closure object\n");
@@ -108,70 +387,1316 @@ static void assert_bound(plisp_t obj, plisp_t sym) {
         plisp_c_write(stderr, sym);
         fprintf(stderr, "'\n");
     }
-    assert(obj != plisp_unbound);
+    assert(obj != plisp_unbound);
+}
+
+static void plisp_compile_expr(struct lambda_state *_state, plisp_t expr);
+static void plisp_compile_ref(struct lambda_state *_state, plisp_t sym);
+static bool plisp_must_be_boxed(plisp_t sym, plisp_t cdr);
+static bool plisp_fixed_arityp(plisp_t arglist);
+static plisp_fn_t plisp_compile_lambda_context(
+    plisp_t lambda,
+    struct lambda_state *parent_state,
+    Pvoid_t *closure_vars,
+    plisp_t preset_closure,
+    struct fn_info *profile);
+
+static bool tracked_local(struct lambda_state *_state, plisp_t sym) {
+    if (!plisp_c_symbolp(sym)) {
+        return false;
+    }
+
+    int *pval;
+    JLG(pval, _state->arg_table, sym);
+    bool *bval;
+    JLG(bval, _state->boxed, sym);
+    return pval != NULL && bval != NULL && !*bval;
+}
+
+static int local_type(struct lambda_state *_state, plisp_t sym) {
+    if (!tracked_local(_state, sym)) {
+        return TY_ANY;
+    }
+
+    for (size_t i = _state->nfacts; i-- > 0;) {
+        if (_state->facts[i].sym == sym) {
+            return _state->facts[i].type;
+        }
+    }
+    return TY_ANY;
+}
+
+static void push_fact(struct lambda_state *_state, plisp_t sym, int type) {
+    if (_state->nfacts == MAX_FACTS) {
+        // forget what we knew rather than let an old fact stand
+        for (size_t i = 0; i < _state->nfacts; ++i) {
+            if (_state->facts[i].sym == sym) {
+                _state->facts[i].type = TY_ANY;
+            }
+        }
+        return;
+    }
+
+    _state->facts[_state->nfacts].sym = sym;
+    _state->facts[_state->nfacts].type = type;
+    _state->nfacts++;
+}
+
+static int value_type(plisp_t obj) {
+    if (plisp_c_fixnump(obj)) {
+        return TY_FIXNUM;
+    } else if (plisp_c_nullp(obj)) {
+        return TY_NULL;
+    } else if (plisp_c_consp(obj)) {
+        return TY_PAIR;
+    } else if (plisp_c_closurep(obj)) {
+        return TY_CLOSURE;
+    } else if (plisp_c_flonump(obj)) {
+        return TY_FLONUM;
+    }
+    return TY_OTHER;
+}
+
+static int expr_type(struct lambda_state *_state, plisp_t expr) {
+    if (plisp_c_symbolp(expr)) {
+        return local_type(_state, expr);
+    } else if (plisp_c_consp(expr)) {
+        if (plisp_car(expr) == quote_sym) {
+            return value_type(plisp_car(plisp_cdr(expr)));
+        } else if (plisp_car(expr) == lambda_sym) {
+            return TY_CLOSURE;
+        }
+        return TY_ANY;
+    }
+    return value_type(expr);
+}
+
+// branches taken when R0 isn't of the single type ty. returns how
+// many were stored in fail
+static int emit_type_test(struct lambda_state *_state, int ty,
+                          jit_node_t **fail) {
+    if (ty == TY_NULL) {
+        fail[0] = jit_bnei(JIT_R0, plisp_nil);
+        return 1;
+    } else if (ty == TY_FLONUM) {
+        jit_andi(JIT_R1, JIT_R0, LOTAGS);
+        fail[0] = jit_bnei(JIT_R1, LT_NUMBER);
+        jit_andi(JIT_R1, JIT_R0, ~LOTAGS);
+        jit_ldr(JIT_R1, JIT_R1);
+        fail[1] = jit_bnei(JIT_R1, NUM_FLONUM);
+        return 2;
+    }
+
+    int n = 0;
+    if (ty == TY_PAIR) {
+        // nil has the cons tag too
+        fail[n++] = jit_beqi(JIT_R0, plisp_nil);
+    }
+    jit_andi(JIT_R1, JIT_R0, LOTAGS);
+    fail[n++] = jit_bnei(JIT_R1, ty == TY_PAIR ? LT_CONS : LT_FIXNUM);
+    return n;
+}
+
+static bool lazy_stubp(plisp_fn_t fun) {
+    struct fn_info *info = get_info(fun);
+    return info != NULL && info->lazy_stub;
+}
+
+static void call_cache_miss(struct call_cache *cache, plisp_fn_t fun) {
+    // the closure is about to be patched with its real code, which is
+    // what should be cached
+    if (lazy_stubp(fun)) {
+        return;
+    }
+    cache->fun = fun;
+    cache->misses++;
+}
+
+// calls the closure in R0 with the arguments in the stack slots args,
+// through cache if there is one. check is false if R0 is known to be
+// a closure
+static void emit_closure_call(struct lambda_state *_state,
+                              struct call_cache *cache, bool check,
+                              int *args, int nargs) {
+    if (check) {
+        // check the tag inline, and only call out to report the error
+        jit_andi(JIT_R1, JIT_R0, LOTAGS);
+        jit_node_t *isclos = jit_beqi(JIT_R1, LT_CLOS);
+        jit_prepare();
+        jit_pushargr(JIT_R0);
+        jit_finishi(assert_is_closure);
+        jit_patch(isclos);
+    }
+
+    // the callee only gets the closure data, so the closure is kept
+    // here until it returns, in case nothing else refers to it
+    push(_state, JIT_R0);
+
+    // inline closure call (change whenever plisp_closure changes)
+    jit_andi(JIT_R0, JIT_R0, ~LOTAGS);
+
+    if (cache != NULL) {
+        jit_ldr(JIT_R1, JIT_R0);
+        jit_ldi(JIT_R2, &cache->fun);
+        jit_node_t *miss = jit_bner(JIT_R1, JIT_R2);
+        emit_count(_state, &cache->hits);
+        jit_node_t *hit = jit_jmpi();
+
+        jit_patch(miss);
+        push(_state, JIT_R0);
+        jit_prepare();
+        jit_pushargi((jit_word_t) cache);
+        jit_pushargr(JIT_R1);
+        jit_finishi(call_cache_miss);
+        pop(_state, JIT_R0);
+
+        jit_patch(hit);
+    }
+
+    jit_ldxi(JIT_R1, JIT_R0, sizeof(plisp_fn_t));
+
+    jit_prepare();
+    jit_pushargr(JIT_R1); // push closure data
+    jit_pushargi(nargs);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R1, JIT_FP, args[i]);
+        jit_pushargr(JIT_R1);
+    }
+    jit_ldr(JIT_R0, JIT_R0);
+    jit_finishr(JIT_R0);
+    jit_retval(JIT_R0);
+    pop(_state, -1);
+}
+
+static ssize_t plisp_get_closure(struct lambda_state *_state,
+                                 plisp_t sym, bool *boxed);
+
+// the toplevel slot expr refers to, or NULL if it isn't a reference
+// to a toplevel variable
+static plisp_t *toplevel_slot(struct lambda_state *_state, plisp_t expr) {
+    if (!plisp_c_symbolp(expr)) {
+        return NULL;
+    }
+
+    int *pval;
+    JLG(pval, _state->arg_table, expr);
+    bool boxed;
+    if (pval != NULL || plisp_get_closure(_state, expr, &boxed) != -1) {
+        return NULL;
+    }
+
+    return plisp_toplevel_ref(expr);
+}
+
+enum primitive {
+    PRIM_NONE,
+    // binary, inlined by the optimizing tier
+    PRIM_PLUS,
+    PRIM_MINUS,
+    PRIM_TIMES,
+    PRIM_LT,
+    // unary, always inlined
+    PRIM_CAR,
+    PRIM_CDR,
+    PRIM_PAIRP,
+    PRIM_NULLP,
+    PRIM_FIXNUMP,
+    PRIM_FLONUMP,
+    // record accessors, modifiers and predicates, always inlined
+    PRIM_RECORD_REF,
+    PRIM_RECORD_SET,
+    PRIM_RECORD_P,
+};
+
+static enum primitive primitive_of(plisp_t fn, int nargs) {
+    if (!plisp_c_closurep(fn)) {
+        return PRIM_NONE;
+    }
+
+    plisp_fn_t fun = plisp_closure_fun(fn);
+    if (nargs == 2) {
+        if (fun == (plisp_fn_t) plisp_builtin_plus) {
+            return PRIM_PLUS;
+        } else if (fun == (plisp_fn_t) plisp_builtin_minus) {
+            return PRIM_MINUS;
+        } else if (fun == (plisp_fn_t) plisp_builtin_times) {
+            return PRIM_TIMES;
+        } else if (fun == (plisp_fn_t) plisp_builtin_lt) {
+            return PRIM_LT;
+        } else if (fun == (plisp_fn_t) plisp_record_set) {
+            return PRIM_RECORD_SET;
+        }
+    } else if (nargs == 1) {
+        if (fun == (plisp_fn_t) plisp_builtin_car) {
+            return PRIM_CAR;
+        } else if (fun == (plisp_fn_t) plisp_builtin_cdr) {
+            return PRIM_CDR;
+        } else if (fun == (plisp_fn_t) plisp_builtin_pair) {
+            return PRIM_PAIRP;
+        } else if (fun == (plisp_fn_t) plisp_builtin_nullp) {
+            return PRIM_NULLP;
+        } else if (fun == (plisp_fn_t) plisp_builtin_fixnump) {
+            return PRIM_FIXNUMP;
+        } else if (fun == (plisp_fn_t) plisp_builtin_flonump) {
+            return PRIM_FLONUMP;
+        } else if (fun == (plisp_fn_t) plisp_record_ref) {
+            return PRIM_RECORD_REF;
+        } else if (fun == (plisp_fn_t) plisp_record_p) {
+            return PRIM_RECORD_P;
+        }
+    }
+    return PRIM_NONE;
+}
+
+static bool binary_primitivep(enum primitive prim) {
+    return prim == PRIM_PLUS || prim == PRIM_MINUS || prim == PRIM_TIMES
+        || prim == PRIM_LT;
+}
+
+static bool record_primitivep(enum primitive prim) {
+    return prim == PRIM_RECORD_REF || prim == PRIM_RECORD_SET
+        || prim == PRIM_RECORD_P;
+}
+
+// the type a predicate tests for, or 0
+static int predicate_type(enum primitive prim) {
+    switch (prim) {
+    case PRIM_PAIRP:
+        return TY_PAIR;
+    case PRIM_NULLP:
+        return TY_NULL;
+    case PRIM_FIXNUMP:
+        return TY_FIXNUM;
+    case PRIM_FLONUMP:
+        return TY_FLONUM;
+    default:
+        return 0;
+    }
+}
+
+static void plisp_deoptimize(struct fn_info *info);
+
+// count a failed speculation in the baseline's metadata
+static void emit_deopt_count(struct lambda_state *_state) {
+    if (!optimizing(_state)) {
+        return;
+    }
+
+    emit_count(_state, &_state->profile->deopts);
+    jit_node_t *ok = jit_bnei(JIT_R1, DEOPT_LIMIT);
+    jit_prepare();
+    jit_pushargi((jit_word_t) _state->profile);
+    jit_finishi(plisp_deoptimize);
+    jit_patch(ok);
+}
+
+static void emit_tag_profile(struct lambda_state *_state,
+                             struct profile_site *site,
+                             int *args, int nargs) {
+    jit_movi(JIT_R2, 0);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R0, JIT_FP, args[i]);
+        jit_andi(JIT_R0, JIT_R0, LOTAGS);
+        jit_movi(JIT_R1, 1);
+        jit_lshr(JIT_R1, JIT_R1, JIT_R0);
+        jit_orr(JIT_R2, JIT_R2, JIT_R1);
+    }
+    jit_ldi(JIT_R0, &site->tags);
+    jit_orr(JIT_R0, JIT_R0, JIT_R2);
+    jit_sti(&site->tags, JIT_R0);
+}
+
+static void profile_retarget(struct profile_site *site, plisp_t target) {
+    if (site->target != plisp_unbound) {
+        site->retargets++;
+    }
+    site->target = target;
+}
+
+// expects the closure being called in R0
+static void emit_target_profile(struct lambda_state *_state,
+                                struct profile_site *site) {
+    jit_ldi(JIT_R1, &site->target);
+    jit_node_t *same = jit_beqr(JIT_R0, JIT_R1);
+
+    push(_state, JIT_R0);
+    jit_prepare();
+    jit_pushargi((jit_word_t) site);
+    jit_pushargr(JIT_R0);
+    jit_finishi(profile_retarget);
+    pop(_state, JIT_R0);
+
+    jit_patch(same);
+}
+
+// the float registers flonum code may use. lightning guarantees six
+#define FLONUM_REGS 6
+
+// whether a fixnum converts to a double exactly. the range checked at
+// run time is the same
+static bool exact_double(plisp_t fixnum) {
+    int64_t val = plisp_fixnum_value(fixnum);
+    return val >= -(1l << 53) && val < (1l << 53);
+}
+
+// unbox R0, a number of type ty, into the float register JIT_F(reg).
+// fixnums with no exact double branch to a new entry of fail, so the
+// builtins decide what they mean
+static void emit_unbox_double(struct lambda_state *_state, int ty, int reg,
+                              jit_node_t **fail, int *nfail) {
+    if (ty == TY_FIXNUM) {
+        jit_rshi(JIT_R0, JIT_R0, LOSHIFT);
+        // in range when the bits from 53 up are all the sign
+        jit_rshi(JIT_R1, JIT_R0, 53);
+        jit_addi(JIT_R1, JIT_R1, 1);
+        jit_rshi(JIT_R1, JIT_R1, 1);
+        fail[(*nfail)++] = jit_bnei(JIT_R1, 0);
+        jit_extr_d(JIT_F(reg), JIT_R0);
+    } else {
+        // (change whenever struct plisp_number changes)
+        jit_andi(JIT_R0, JIT_R0, ~LOTAGS);
+        jit_ldxi_d(JIT_F(reg), JIT_R0, offsetof(struct plisp_number, flonum));
+    }
+}
+
+// unbox the argument in stack slot off into JIT_F(reg). unless its
+// type ty is known, anything but a fixnum or a flonum branches to new
+// entries of fail
+static void emit_load_double(struct lambda_state *_state, int off, int ty,
+                             int reg, jit_node_t **fail, int *nfail) {
+    jit_ldxi(JIT_R0, JIT_FP, off);
+    if (ty == TY_FIXNUM || ty == TY_FLONUM) {
+        emit_unbox_double(_state, ty, reg, fail, nfail);
+        return;
+    }
+
+    jit_andi(JIT_R1, JIT_R0, LOTAGS);
+    jit_node_t *not_fixnum = jit_bnei(JIT_R1, LT_FIXNUM);
+    emit_unbox_double(_state, TY_FIXNUM, reg, fail, nfail);
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(not_fixnum);
+    *nfail += emit_type_test(_state, TY_FLONUM, fail + *nfail);
+    emit_unbox_double(_state, TY_FLONUM, reg, fail, nfail);
+    jit_patch(done);
+}
+
+// apply prim to JIT_F(reg) and JIT_F(reg+1). arithmetic leaves its
+// result in JIT_F(reg), and < leaves a bool in R0
+static void emit_flonum_op(struct lambda_state *_state,
+                           enum primitive prim, int reg) {
+    if (prim == PRIM_PLUS) {
+        jit_addr_d(JIT_F(reg), JIT_F(reg), JIT_F(reg+1));
+    } else if (prim == PRIM_MINUS) {
+        jit_subr_d(JIT_F(reg), JIT_F(reg), JIT_F(reg+1));
+    } else if (prim == PRIM_TIMES) {
+        jit_mulr_d(JIT_F(reg), JIT_F(reg), JIT_F(reg+1));
+    } else {
+        jit_ltr_d(JIT_R0, JIT_F(reg), JIT_F(reg+1));
+        jit_lshi(JIT_R0, JIT_R0, HISHIFT);
+        jit_ori(JIT_R0, JIT_R0, LT_HITAGS | HT_BOOL);
+    }
+}
+
+// box JIT_F0 as a flonum in R0
+static void emit_box_flonum(struct lambda_state *_state) {
+    jit_prepare();
+    jit_pushargr_d(JIT_F0);
+    jit_finishi(plisp_make_flonum);
+    jit_retval(JIT_R0);
+}
+
+// inline a binary primitive, speculating that both arguments are
+// fixnums and that the primitive hasn't been redefined. the tag check
+// is left out when the arguments are known to be fixnums. when
+// flonums is set, arguments that aren't both fixnums are tried as
+// flonums before falling back to the builtin, and the fixnum case is
+// left out entirely if either argument is known to be a flonum.
+static void compile_fixnum_primitive(struct lambda_state *_state,
+                                     enum primitive prim, plisp_t *slot,
+                                     plisp_t fnexpr, int *args, int *argtypes,
+                                     bool flonums) {
+    // the primitives are permanent, so comparing against them is safe
+    jit_ldi(JIT_R0, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R0, *slot);
+
+    bool fixnums = argtypes[0] != TY_FLONUM && argtypes[1] != TY_FLONUM;
+    jit_node_t *not_fixnum = NULL;
+    jit_node_t *overflow = NULL;
+    jit_node_t *done = NULL;
+
+    if (fixnums) {
+        jit_ldxi(JIT_R0, JIT_FP, args[0]);
+        jit_ldxi(JIT_R1, JIT_FP, args[1]);
+        if (argtypes[0] != TY_FIXNUM || argtypes[1] != TY_FIXNUM) {
+            jit_orr(JIT_R2, JIT_R0, JIT_R1);
+            jit_andi(JIT_R2, JIT_R2, LOTAGS);
+            not_fixnum = jit_bnei(JIT_R2, 0);
+        }
+
+        // fixnums are tagged with 0, so the tagged values can be added
+        // and compared directly
+        if (prim == PRIM_PLUS) {
+            overflow = jit_boaddr(JIT_R0, JIT_R1);
+        } else if (prim == PRIM_MINUS) {
+            overflow = jit_bosubr(JIT_R0, JIT_R1);
+        } else if (prim == PRIM_TIMES) {
+            // untagging one factor leaves the product tagged. it
+            // overflowed if the high word isn't just the sign
+            jit_rshi(JIT_R0, JIT_R0, LOSHIFT);
+            jit_qmulr(JIT_R0, JIT_R2, JIT_R0, JIT_R1);
+            jit_rshi(JIT_R1, JIT_R0, 63);
+            overflow = jit_bner(JIT_R2, JIT_R1);
+        } else {
+            jit_ltr(JIT_R0, JIT_R0, JIT_R1);
+            jit_lshi(JIT_R0, JIT_R0, HISHIFT);
+            jit_ori(JIT_R0, JIT_R0, LT_HITAGS | HT_BOOL);
+        }
+        done = jit_jmpi();
+    }
+
+    jit_node_t *fail[6];
+    int nfail = 0;
+    jit_node_t *flonum_done = NULL;
+    if (flonums && (not_fixnum != NULL || !fixnums)) {
+        if (not_fixnum != NULL) {
+            jit_patch(not_fixnum);
+            not_fixnum = NULL;
+        }
+
+        emit_load_double(_state, args[0], argtypes[0], 0, fail, &nfail);
+        emit_load_double(_state, args[1], argtypes[1], 1, fail, &nfail);
+        emit_flonum_op(_state, prim, 0);
+        if (prim != PRIM_LT) {
+            emit_box_flonum(_state);
+        }
+        flonum_done = jit_jmpi();
+    }
+
+    jit_patch(redefined);
+    if (not_fixnum != NULL) {
+        jit_patch(not_fixnum);
+    }
+    if (overflow != NULL) {
+        jit_patch(overflow);
+    }
+    for (int i = 0; i < nfail; ++i) {
+        jit_patch(fail[i]);
+    }
+    emit_deopt_count(_state);
+    plisp_compile_expr(_state, fnexpr);
+    emit_closure_call(_state, NULL, _state->safe, args, 2);
+
+    if (done != NULL) {
+        jit_patch(done);
+    }
+    if (flonum_done != NULL) {
+        jit_patch(flonum_done);
+    }
+}
+
+// inline car, cdr or a type predicate, as long as the primitive
+// hasn't been redefined. checks are left out where the type of the
+// argument is known.
+static void compile_unary_primitive(struct lambda_state *_state,
+                                    enum primitive prim, plisp_t *slot,
+                                    plisp_t fnexpr, struct call_cache *cache,
+                                    int *args, int argtype) {
+    jit_ldi(JIT_R0, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R0, *slot);
+    jit_ldxi(JIT_R0, JIT_FP, args[0]);
+
+    jit_node_t *fail[2];
+    int nfail = 0;
+    int ty = predicate_type(prim);
+
+    if (prim == PRIM_CAR || prim == PRIM_CDR) {
+        // let the builtin report the error
+        if (_state->safe && argtype != TY_PAIR) {
+            nfail = emit_type_test(_state, TY_PAIR, fail);
+        }
+
+        // (change whenever plisp_cons changes)
+        jit_andi(JIT_R0, JIT_R0, ~LOTAGS);
+        if (prim == PRIM_CAR) {
+            jit_ldr(JIT_R0, JIT_R0);
+        } else {
+            jit_ldxi(JIT_R0, JIT_R0, sizeof(plisp_t));
+        }
+    } else if ((argtype & ty) == 0) {
+        jit_movi(JIT_R0, plisp_make_bool(false));
+    } else if ((argtype & ~ty) == 0) {
+        jit_movi(JIT_R0, plisp_make_bool(true));
+    } else {
+        jit_node_t *no[2];
+        int nno = emit_type_test(_state, ty, no);
+        jit_movi(JIT_R0, plisp_make_bool(true));
+        jit_node_t *yes = jit_jmpi();
+        for (int i = 0; i < nno; ++i) {
+            jit_patch(no[i]);
+        }
+        jit_movi(JIT_R0, plisp_make_bool(false));
+        jit_patch(yes);
+    }
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(redefined);
+    for (int i = 0; i < nfail; ++i) {
+        jit_patch(fail[i]);
+    }
+    plisp_compile_expr(_state, fnexpr);
+    emit_closure_call(_state, cache, _state->safe, args, 1);
+
+    jit_patch(done);
+}
+
+// inline a record accessor, modifier or predicate as a check of the
+// tag and type descriptor and a load or store, as long as the variable
+// still holds it. unsafe code skips the checks, except in predicates.
+static void compile_record_primitive(struct lambda_state *_state,
+                                     enum primitive prim, plisp_t *slot,
+                                     plisp_t fnexpr, struct call_cache *cache,
+                                     int *args, int nargs) {
+    // unlike builtins, these closures can be collected once the
+    // variable is redefined, and another one could take their place
+    plisp_t target = *slot;
+    code_root(_state, target);
+    struct plisp_closure_data *data = plisp_closure_data(target);
+    plisp_t rtd = data->objs[RECORD_DATA_RTD];
+
+    jit_ldi(JIT_R0, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R0, target);
+    jit_ldxi(JIT_R0, JIT_FP, args[0]);
+
+    jit_node_t *fail[2];
+    int nfail = 0;
+    if (prim == PRIM_RECORD_P || _state->safe) {
+        // (change whenever struct plisp_record changes)
+        jit_andi(JIT_R1, JIT_R0, LOTAGS);
+        fail[nfail++] = jit_bnei(JIT_R1, LT_RECORD);
+        jit_andi(JIT_R1, JIT_R0, ~LOTAGS);
+        jit_ldr(JIT_R1, JIT_R1);
+        fail[nfail++] = jit_bnei(JIT_R1, rtd);
+    }
+
+    if (prim == PRIM_RECORD_P) {
+        jit_movi(JIT_R0, plisp_make_bool(true));
+        jit_node_t *yes = jit_jmpi();
+        for (int i = 0; i < nfail; ++i) {
+            jit_patch(fail[i]);
+        }
+        nfail = 0;
+        jit_movi(JIT_R0, plisp_make_bool(false));
+        jit_patch(yes);
+    } else {
+        size_t off = plisp_fixnum_value(data->objs[RECORD_DATA_INDEX])
+            * sizeof(plisp_t);
+        jit_andi(JIT_R0, JIT_R0, ~LOTAGS);
+        jit_ldxi(JIT_R0, JIT_R0, sizeof(plisp_t));
+        if (prim == PRIM_RECORD_REF) {
+            jit_ldxi(JIT_R0, JIT_R0, off);
+        } else {
+            jit_ldxi(JIT_R1, JIT_FP, args[1]);
+            jit_stxi(off, JIT_R0, JIT_R1);
+            jit_movi(JIT_R0, plisp_unspec);
+        }
+    }
+    jit_node_t *done = jit_jmpi();
+
+    // let the closure report the error
+    jit_patch(redefined);
+    for (int i = 0; i < nfail; ++i) {
+        jit_patch(fail[i]);
+    }
+    plisp_compile_expr(_state, fnexpr);
+    emit_closure_call(_state, cache, _state->safe, args, nargs);
+
+    jit_patch(done);
+}
+
+// whether sym is a local variable here, without capturing it
+static bool plisp_localp(struct lambda_state *_state, plisp_t sym) {
+    int *pval;
+    JLG(pval, _state->arg_table, sym);
+    if (pval != NULL) {
+        return true;
+    }
+
+    for (struct lambda_state *s = _state; s->parent != NULL; s = s->parent) {
+        size_t *clnum;
+        JLG(pval, s->arg_table, sym);
+        JLG(clnum, s->closure_vars, sym);
+        if (pval != NULL || clnum != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the number of atoms in expr, up to budget+1
+static size_t plisp_form_size(plisp_t expr, size_t budget) {
+    if (!plisp_c_consp(expr)) {
+        return 1;
+    }
+
+    size_t size = 0;
+    for (; plisp_c_consp(expr) && size <= budget; expr = plisp_cdr(expr)) {
+        size += plisp_form_size(plisp_car(expr), budget - size);
+    }
+    return size;
+}
+
+// the lambda of a closure that closes over nothing, or nil
+static plisp_t plisp_closure_lambda(plisp_t closure) {
+    if (plisp_c_interpretedp(closure)) {
+        return plisp_interp_lambda(closure);
+    }
+
+    struct fn_info *info = get_info(plisp_closure_fun(closure));
+    struct plisp_closure_data *data = plisp_closure_data(closure);
+    if (info != NULL && info->tierable && info->preset_closure == plisp_nil
+        && (data == NULL || data->length == 0)) {
+        return info->lambda;
+    }
+    return plisp_nil;
+}
+
+// the lambda of the toplevel function slot holds, if it's small enough
+// to inline with nargs arguments here, or nil
+static plisp_t inline_candidate(struct lambda_state *_state,
+                                plisp_t *slot, int nargs) {
+    if (slot == NULL || _state->inline_depth >= INLINE_DEPTH
+        || !plisp_c_closurep(*slot)) {
+        return plisp_nil;
+    }
+
+    plisp_t lambda = plisp_closure_lambda(*slot);
+    if (lambda == plisp_nil) {
+        return plisp_nil;
+    }
+
+    plisp_t params = plisp_car(plisp_cdr(lambda));
+    plisp_t body = plisp_cdr(plisp_cdr(lambda));
+    int nparams = 0;
+    for (plisp_t i = params; plisp_c_consp(i); i = plisp_cdr(i)) {
+        nparams++;
+    }
+    if (!plisp_fixed_arityp(params) || nparams != nargs || body == plisp_nil
+        || plisp_form_size(body, INLINE_BUDGET) > INLINE_BUDGET) {
+        return plisp_nil;
+    }
+
+    // the parameters live in the caller's argument slots, so they
+    // can't be assigned, and definitions would outlive the call
+    for (plisp_t i = body; i != plisp_nil; i = plisp_cdr(i)) {
+        plisp_t stmt = plisp_car(i);
+        if (plisp_c_consp(stmt) && (plisp_car(stmt) == define_sym
+                                    || plisp_car(stmt) == declare_sym)) {
+            return plisp_nil;
+        }
+    }
+    for (plisp_t i = params; i != plisp_nil; i = plisp_cdr(i)) {
+        if (plisp_must_be_boxed(plisp_car(i), body)) {
+            return plisp_nil;
+        }
+    }
+
+    // the body's free variables are toplevel, and must not be
+    // shadowed here
+    for (plisp_t syms = plisp_mentioned_symbols(body);
+         syms != plisp_nil; syms = plisp_cdr(syms)) {
+        plisp_t sym = plisp_car(syms);
+        bool param = false;
+        for (plisp_t i = params; i != plisp_nil; i = plisp_cdr(i)) {
+            param = param || plisp_car(i) == sym;
+        }
+        if (!param && plisp_localp(_state, sym)) {
+            return plisp_nil;
+        }
+    }
+
+    return lambda;
+}
+
+// compile the body of a small toplevel function in place of a call to
+// it, as long as the variable still holds it
+static void compile_inline_call(struct lambda_state *_state,
+                                plisp_t lambda, plisp_t *slot,
+                                struct call_cache *cache,
+                                int *args, int *argtypes, int nargs) {
+    plisp_t target = *slot;
+    code_root(_state, target);
+
+    jit_ldi(JIT_R0, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R0, target);
+
+    // the parameters are bound to the argument slots for the body
+    // only, so save whatever they shadow
+    bool had_slot[MAX_ARGS], had_boxed[MAX_ARGS];
+    int saved_slot[MAX_ARGS];
+    bool saved_boxed[MAX_ARGS];
+    size_t nfacts = _state->nfacts;
+
+    plisp_t params = plisp_car(plisp_cdr(lambda));
+    int i = 0;
+    for (plisp_t p = params; p != plisp_nil; p = plisp_cdr(p), ++i) {
+        plisp_t sym = plisp_car(p);
+
+        int *pval;
+        JLG(pval, _state->arg_table, sym);
+        had_slot[i] = pval != NULL;
+        if (had_slot[i]) {
+            saved_slot[i] = *pval;
+        }
+        bool *bval;
+        JLG(bval, _state->boxed, sym);
+        had_boxed[i] = bval != NULL;
+        if (had_boxed[i]) {
+            saved_boxed[i] = *bval;
+        }
+
+        JLI(pval, _state->arg_table, sym);
+        *pval = args[i];
+        JLI(bval, _state->boxed, sym);
+        *bval = false;
+        push_fact(_state, sym, argtypes[i]);
+    }
+
+    _state->inline_depth++;
+    for (plisp_t body = plisp_cdr(plisp_cdr(lambda));
+         body != plisp_nil; body = plisp_cdr(body)) {
+        plisp_compile_expr(_state, plisp_car(body));
+    }
+    _state->inline_depth--;
+
+    // restore in reverse, in case a parameter is repeated
+    for (plisp_t p = plisp_c_reverse(params); p != plisp_nil; p = plisp_cdr(p)) {
+        plisp_t sym = plisp_car(p);
+        --i;
+
+        int Rc_int;
+        int *pval;
+        if (had_slot[i]) {
+            JLI(pval, _state->arg_table, sym);
+            *pval = saved_slot[i];
+        } else {
+            JLD(Rc_int, _state->arg_table, sym);
+        }
+        bool *bval;
+        if (had_boxed[i]) {
+            JLI(bval, _state->boxed, sym);
+            *bval = saved_boxed[i];
+        } else {
+            JLD(Rc_int, _state->boxed, sym);
+        }
+    }
+    _state->nfacts = nfacts;
+
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(redefined);
+    emit_closure_call(_state, cache, _state->safe, args, nargs);
+
+    jit_patch(done);
+}
+
+static bool monomorphic(struct profile_site *site) {
+    return site->retargets == 0
+        && plisp_c_closurep(site->target)
+        && !plisp_c_interpretedp(site->target);
+}
+
+// call the code of the only closure the site has seen directly
+static void compile_monomorphic_call(struct lambda_state *_state,
+                                     struct profile_site *site,
+                                     plisp_t fnexpr, int *args, int nargs) {
+    // the guard compares addresses, so another closure mustn't take
+    // the target's place while this code can run
+    plisp_t target = site->target;
+    code_root(_state, target);
+
+    plisp_compile_expr(_state, fnexpr);
+    jit_node_t *miss = jit_bnei(JIT_R0, target);
+
+    // (change whenever plisp_closure changes)
+    jit_andi(JIT_R1, JIT_R0, ~LOTAGS);
+    jit_ldxi(JIT_R1, JIT_R1, sizeof(plisp_fn_t));
+    jit_prepare();
+    jit_pushargr(JIT_R1);
+    jit_pushargi(nargs);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R1, JIT_FP, args[i]);
+        jit_pushargr(JIT_R1);
+    }
+    jit_finishi(plisp_closure_fun(target));
+    jit_retval(JIT_R0);
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(miss);
+    push(_state, JIT_R0);
+    emit_deopt_count(_state);
+    pop(_state, JIT_R0);
+    emit_closure_call(_state, NULL, _state->safe, args, nargs);
+
+    jit_patch(done);
+}
+
+// the closure in R0 may be any closure, but its code has always been
+// the same. call that code directly, with whatever data it has.
+static void compile_cached_call(struct lambda_state *_state,
+                                struct call_cache *baseline,
+                                struct call_cache *cache,
+                                int *args, int nargs) {
+    push(_state, JIT_R0);
+    jit_andi(JIT_R1, JIT_R0, LOTAGS);
+    jit_node_t *notclos = jit_bnei(JIT_R1, LT_CLOS);
+    jit_andi(JIT_R2, JIT_R0, ~LOTAGS);
+    jit_ldr(JIT_R1, JIT_R2);
+    jit_node_t *miss = jit_bnei(JIT_R1, (jit_word_t) baseline->fun);
+
+    jit_ldxi(JIT_R2, JIT_R2, sizeof(plisp_fn_t));
+    jit_prepare();
+    jit_pushargr(JIT_R2);
+    jit_pushargi(nargs);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R1, JIT_FP, args[i]);
+        jit_pushargr(JIT_R1);
+    }
+    jit_finishi(baseline->fun);
+    jit_retval(JIT_R0);
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(notclos);
+    jit_patch(miss);
+    push(_state, JIT_R0);
+    emit_deopt_count(_state);
+    pop(_state, JIT_R0);
+    emit_closure_call(_state, cache, _state->safe, args, nargs);
+
+    jit_patch(done);
+    pop(_state, -1);
+}
+
+// unsafe code calls a builtin's unchecked entry point directly, as
+// long as the variable still holds the builtin
+static void compile_unchecked_call(struct lambda_state *_state,
+                                   plisp_t *slot, plisp_fn_t unchecked,
+                                   struct call_cache *cache,
+                                   int *args, int nargs) {
+    jit_ldi(JIT_R0, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R0, *slot);
+
+    jit_prepare();
+    jit_pushargi(0); // builtins have no closure data
+    jit_pushargi(nargs);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R1, JIT_FP, args[i]);
+        jit_pushargr(JIT_R1);
+    }
+    jit_finishi(unchecked);
+    jit_retval(JIT_R0);
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(redefined);
+    emit_closure_call(_state, cache, _state->safe, args, nargs);
+
+    jit_patch(done);
+}
+
+static void compile_call_generic(struct lambda_state *_state, plisp_t expr) {
+    int args[128];
+    int argtypes[128];
+    int nargs = 0;
+    for (plisp_t arglist = plisp_cdr(expr);
+         arglist != plisp_nil; arglist = plisp_cdr(arglist)) {
+
+        argtypes[nargs] = expr_type(_state, plisp_car(arglist));
+        plisp_compile_expr(_state, plisp_car(arglist));
+        args[nargs++] = push(_state, JIT_R0);
+    }
+
+    plisp_t fnexpr = plisp_car(expr);
+    plisp_t *slot = toplevel_slot(_state, fnexpr);
+    enum primitive prim = PRIM_NONE;
+    if (slot != NULL) {
+        prim = primitive_of(*slot, nargs);
+    }
+
+    // calls to toplevel functions are profiled, either the argument
+    // types of primitives or the closures called
+    struct profile_site *site = NULL;
+    if (slot != NULL) {
+        site = find_site(_state, expr);
+    }
+
+    // every other call goes through an inline cache
+    struct call_cache *baseline;
+    struct call_cache *cache = find_cache(_state, expr, &baseline);
+
+    plisp_fn_t unchecked = NULL;
+    if (!_state->safe && slot != NULL) {
+        unchecked = plisp_unchecked_entry(*slot);
+    }
+
+    bool proven_fixnums = nargs == 2
+        && argtypes[0] == TY_FIXNUM && argtypes[1] == TY_FIXNUM;
+    bool proven_flonum = nargs == 2
+        && (argtypes[0] == TY_FLONUM || argtypes[1] == TY_FLONUM);
+    // a site that has only seen fixnums and other numbers
+    bool number_site = optimizing(_state) && site != NULL
+        && (site->tags & (1lu << LT_NUMBER)) != 0
+        && (site->tags & ~((1lu << LT_FIXNUM) | (1lu << LT_NUMBER))) == 0;
+
+    plisp_t inlined = plisp_nil;
+    if (prim == PRIM_NONE) {
+        inlined = inline_candidate(_state, slot, nargs);
+    }
+
+    if (record_primitivep(prim)) {
+        compile_record_primitive(_state, prim, slot, fnexpr, cache,
+                                 args, nargs);
+    } else if (binary_primitivep(prim)
+               && (proven_fixnums || proven_flonum || number_site
+                   || (optimizing(_state) && site != NULL
+                       && site->tags == (1lu << LT_FIXNUM)))) {
+        compile_fixnum_primitive(_state, prim, slot, fnexpr, args, argtypes,
+                                 proven_flonum || number_site);
+    } else if (prim != PRIM_NONE && !binary_primitivep(prim)) {
+        compile_unary_primitive(_state, prim, slot, fnexpr, cache,
+                                args, argtypes[0]);
+    } else if (inlined != plisp_nil) {
+        uintptr_t context = _state->site_context;
+        _state->site_context = inline_context(context, expr);
+        compile_inline_call(_state, inlined, slot, cache,
+                            args, argtypes, nargs);
+        _state->site_context = context;
+    } else if (prim == PRIM_NONE && optimizing(_state) && site != NULL
+               && monomorphic(site)) {
+        compile_monomorphic_call(_state, site, fnexpr, args, nargs);
+    } else if (unchecked != NULL) {
+        if (prim != PRIM_NONE && profiling(_state)) {
+            emit_tag_profile(_state, site, args, nargs);
+        }
+
+        compile_unchecked_call(_state, slot, unchecked, cache, args, nargs);
+    } else {
+        if (prim != PRIM_NONE && profiling(_state)) {
+            emit_tag_profile(_state, site, args, nargs);
+        }
+
+        plisp_compile_expr(_state, fnexpr);
+
+        if (prim == PRIM_NONE && profiling(_state) && site != NULL) {
+            emit_target_profile(_state, site);
+        }
+
+        if (baseline != NULL && baseline->misses == 1) {
+            compile_cached_call(_state, baseline, cache, args, nargs);
+        } else {
+            bool check = _state->safe && expr_type(_state, fnexpr) != TY_CLOSURE;
+            emit_closure_call(_state, cache, check, args, nargs);
+        }
+    }
+
+    for (int i = 0; i < nargs; ++i) {
+        pop(_state, -1);
+    }
+}
+
+/*
+arithmetic on numbers of known type is done in float registers when
+any of them is a flonum, so a tree like (+ (* a b) c) boxes only its
+final result, and a comparison of one boxes nothing. every primitive
+in the tree is checked for redefinition up front, and if any was, the
+call is compiled as usual.
+*/
+
+// the primitive of a two argument call to +, -, * or <, or PRIM_NONE
+static enum primitive arith_call(struct lambda_state *_state, plisp_t expr,
+                                 plisp_t **slot) {
+    if (!plisp_c_consp(expr) || !plisp_c_consp(plisp_cdr(expr))
+        || !plisp_c_consp(plisp_cdr(plisp_cdr(expr)))
+        || plisp_cdr(plisp_cdr(plisp_cdr(expr))) != plisp_nil) {
+        return PRIM_NONE;
+    }
+
+    // special forms of the same shape
+    plisp_t fn = plisp_car(expr);
+    if (fn == lambda_sym || fn == define_sym || fn == set_sym || fn == if_sym) {
+        return PRIM_NONE;
+    }
+
+    *slot = toplevel_slot(_state, fn);
+    if (*slot == NULL) {
+        return PRIM_NONE;
+    }
+
+    enum primitive prim = primitive_of(**slot, 2);
+    return binary_primitivep(prim) ? prim : PRIM_NONE;
+}
+
+static int flonum_tree_type(struct lambda_state *_state, plisp_t expr,
+                            int *regs);
+
+// whether the arguments of the binary call expr can be computed in
+// float registers, needing regs of them, with a flonum among them
+static bool flonum_operands(struct lambda_state *_state, plisp_t expr,
+                            int *regs) {
+    int aregs, bregs;
+    int a = flonum_tree_type(_state, plisp_car(plisp_cdr(expr)), &aregs);
+    int b = flonum_tree_type(_state, plisp_car(plisp_cdr(plisp_cdr(expr))),
+                             &bregs);
+    if (a == 0 || b == 0 || (a == TY_FIXNUM && b == TY_FIXNUM)) {
+        return false;
+    }
+
+    // the first operand is held in a register while the second is
+    // computed
+    *regs = aregs > bregs + 1 ? aregs : bregs + 1;
+    return *regs <= FLONUM_REGS;
+}
+
+// TY_FLONUM if expr can be computed in float registers, TY_FIXNUM if
+// it is a fixnum that such a computation can use, otherwise 0
+static int flonum_tree_type(struct lambda_state *_state, plisp_t expr,
+                            int *regs) {
+    *regs = 1;
+
+    plisp_t *slot;
+    enum primitive prim = arith_call(_state, expr, &slot);
+    if (prim == PRIM_NONE) {
+        int ty = expr_type(_state, expr);
+        if (ty == TY_FIXNUM && !plisp_c_symbolp(expr)) {
+            // a literal, which is checked now rather than at run time
+            plisp_t val = plisp_c_consp(expr) ? plisp_car(plisp_cdr(expr))
+                                              : expr;
+            return exact_double(val) ? ty : 0;
+        }
+        return ty == TY_FIXNUM || ty == TY_FLONUM ? ty : 0;
+    }
+
+    if (prim != PRIM_LT && flonum_operands(_state, expr, regs)) {
+        return TY_FLONUM;
+    }
+    return 0;
+}
+
+// sets R2 to nonzero if a primitive in the tree was redefined
+static void emit_tree_guards(struct lambda_state *_state, plisp_t expr) {
+    plisp_t *slot;
+    if (arith_call(_state, expr, &slot) == PRIM_NONE) {
+        return;
+    }
+
+    jit_ldi(JIT_R1, slot);
+    jit_xori(JIT_R1, JIT_R1, *slot);
+    jit_orr(JIT_R2, JIT_R2, JIT_R1);
+
+    emit_tree_guards(_state, plisp_car(plisp_cdr(expr)));
+    emit_tree_guards(_state, plisp_car(plisp_cdr(plisp_cdr(expr))));
+}
+
+// how many leaves a flonum tree has
+static int flonum_tree_leaves(struct lambda_state *_state, plisp_t expr) {
+    plisp_t *slot;
+    if (arith_call(_state, expr, &slot) == PRIM_NONE) {
+        return 1;
+    }
+    return flonum_tree_leaves(_state, plisp_car(plisp_cdr(expr)))
+        + flonum_tree_leaves(_state, plisp_car(plisp_cdr(plisp_cdr(expr))));
+}
+
+// computes a flonum tree into JIT_F(reg), using the registers above it.
+// fixnums with no exact double branch to new entries of fail
+static void emit_flonum_tree(struct lambda_state *_state, plisp_t expr,
+                             int reg, jit_node_t **fail, int *nfail) {
+    plisp_t *slot;
+    enum primitive prim = arith_call(_state, expr, &slot);
+    if (prim != PRIM_NONE) {
+        emit_flonum_tree(_state, plisp_car(plisp_cdr(expr)), reg,
+                         fail, nfail);
+        emit_flonum_tree(_state, plisp_car(plisp_cdr(plisp_cdr(expr))),
+                         reg + 1, fail, nfail);
+        emit_flonum_op(_state, prim, reg);
+    } else if (plisp_c_symbolp(expr)) {
+        plisp_compile_ref(_state, expr);
+        emit_unbox_double(_state, local_type(_state, expr), reg,
+                          fail, nfail);
+    } else {
+        // a literal, maybe quoted
+        plisp_t val = plisp_c_consp(expr) ? plisp_car(plisp_cdr(expr)) : expr;
+        jit_movi_d(JIT_F(reg), plisp_number_to_double(val));
+    }
+}
+
+static enum primitive flonum_call(struct lambda_state *_state, plisp_t expr) {
+    plisp_t *slot;
+    int regs;
+    enum primitive prim = arith_call(_state, expr, &slot);
+    if (prim != PRIM_NONE && flonum_operands(_state, expr, &regs)) {
+        return prim;
+    }
+    return PRIM_NONE;
+}
+
+static void compile_flonum_call(struct lambda_state *_state, plisp_t expr,
+                                enum primitive prim) {
+    jit_movi(JIT_R2, 0);
+    emit_tree_guards(_state, expr);
+    jit_node_t *redefined = jit_bnei(JIT_R2, 0);
+
+    jit_node_t **inexact = malloc(flonum_tree_leaves(_state, expr)
+                                  * sizeof(jit_node_t *));
+    int ninexact = 0;
+    if (prim == PRIM_LT) {
+        emit_flonum_tree(_state, plisp_car(plisp_cdr(expr)), 0,
+                         inexact, &ninexact);
+        emit_flonum_tree(_state, plisp_car(plisp_cdr(plisp_cdr(expr))), 1,
+                         inexact, &ninexact);
+        emit_flonum_op(_state, prim, 0);
+    } else {
+        emit_flonum_tree(_state, expr, 0, inexact, &ninexact);
+        emit_box_flonum(_state);
+    }
+    jit_node_t *done = jit_jmpi();
+
+    jit_patch(redefined);
+    for (int i = 0; i < ninexact; ++i) {
+        jit_patch(inexact[i]);
+    }
+    free(inexact);
+    compile_call_generic(_state, expr);
+
+    jit_patch(done);
+}
+
+static void plisp_compile_call(struct lambda_state *_state, plisp_t expr) {
+    enum primitive prim = flonum_call(_state, expr);
+    if (prim != PRIM_NONE) {
+        compile_flonum_call(_state, expr, prim);
+    } else {
+        compile_call_generic(_state, expr);
+    }
+}
+
+// the alternative of an if, which is unspecified when it has none,
+// as in the interpreter
+static plisp_t if_alternative(plisp_t expr) {
+    plisp_t alt = plisp_cdr(plisp_cdr(plisp_cdr(expr)));
+    if (alt == plisp_nil) {
+        return plisp_unspec;
+    }
+    return plisp_car(alt);
+}
+
+static void plisp_compile_if_generic(struct lambda_state *_state,
+                                     plisp_t expr) {
+    plisp_t conseq = plisp_car(plisp_cdr(plisp_cdr(expr)));
+    plisp_t alt = if_alternative(expr);
+
+    // get condition into R0
+    plisp_compile_expr(_state, plisp_car(plisp_cdr(expr)));
+
+    struct profile_site *site = find_site(_state, expr);
+
+    if (optimizing(_state) && site != NULL
+        && site->not_taken > 2 * site->taken) {
+        // the alternative is hot, so make it the fallthrough
+        jit_node_t *cond = jit_bnei(JIT_R0, plisp_make_bool(false));
+        plisp_compile_expr(_state, alt);
+        jit_node_t *rest = jit_jmpi();
+        jit_patch(cond);
+        plisp_compile_expr(_state, conseq);
+        jit_patch(rest);
+        return;
+    }
+
+    jit_node_t *cond = jit_beqi(JIT_R0, plisp_make_bool(false));
+    if (profiling(_state)) {
+        emit_count(_state, &site->taken);
+    }
+    plisp_compile_expr(_state, conseq);
+    jit_node_t *rest = jit_jmpi();
+    jit_patch(cond);
+    if (profiling(_state)) {
+        emit_count(_state, &site->not_taken);
+    }
+    plisp_compile_expr(_state, alt);
+    jit_patch(rest);
 }
-#endif
 
-static void plisp_compile_expr(struct lambda_state *_state, plisp_t expr);
-static plisp_fn_t plisp_compile_lambda_context(
-    plisp_t lambda,
-    struct lambda_state *parent_state,
-    Pvoid_t *closure_vars);
+// compiles (if (pred x) ...) where pred is an inlined type predicate
+// and x an unboxed local, so each branch knows the type of x. returns
+// false if expr isn't of that form.
+static bool plisp_compile_if_predicate(struct lambda_state *_state,
+                                       plisp_t expr) {
+    plisp_t test = plisp_car(plisp_cdr(expr));
+    if (_state->nofacts != 0 || !plisp_c_consp(test)
+        || !plisp_c_consp(plisp_cdr(test))
+        || plisp_cdr(plisp_cdr(test)) != plisp_nil) {
+        return false;
+    }
 
-static void plisp_compile_call(struct lambda_state *_state, plisp_t expr) {
-    int args[128];
-    int nargs = 0;
-    for (plisp_t arglist = plisp_cdr(expr);
-         arglist != plisp_nil; arglist = plisp_cdr(arglist)) {
+    plisp_t sym = plisp_car(plisp_cdr(test));
+    plisp_t *slot = toplevel_slot(_state, plisp_car(test));
+    if (!tracked_local(_state, sym) || slot == NULL) {
+        return false;
+    }
 
-        plisp_compile_expr(_state, plisp_car(arglist));
-        args[nargs++] = push(_state, JIT_R0);
+    int ty = predicate_type(primitive_of(*slot, 1));
+    if (ty == 0) {
+        return false;
     }
 
-    plisp_compile_expr(_state, plisp_car(expr));
+    plisp_t conseq = plisp_car(plisp_cdr(plisp_cdr(expr)));
+    plisp_t alt = if_alternative(expr);
+    int known = local_type(_state, sym);
+    size_t nfacts = _state->nfacts;
 
-    #ifndef PLISP_UNSAFE
-    push(_state, JIT_R0);
+    plisp_compile_ref(_state, sym);
+    jit_ldi(JIT_R1, slot);
+    jit_node_t *redefined = jit_bnei(JIT_R1, *slot);
 
-    // assert that we are calling a closure
-    jit_prepare();
-    jit_pushargr(JIT_R0);
-    jit_finishi(assert_is_closure);
+    if ((known & ty) == 0) {
+        plisp_compile_expr(_state, alt);
+    } else if ((known & ~ty) == 0) {
+        plisp_compile_expr(_state, conseq);
+    } else {
+        jit_node_t *no[2];
+        int nno = emit_type_test(_state, ty, no);
 
-    pop(_state, JIT_R0);
-    #endif
+        push_fact(_state, sym, known & ty);
+        plisp_compile_expr(_state, conseq);
+        _state->nfacts = nfacts;
+        jit_node_t *rest = jit_jmpi();
 
-    // inline closure call (change whenever plisp_closure changes)
-    jit_andi(JIT_R0, JIT_R0, ~LOTAGS);
-    jit_ldxi(JIT_R1, JIT_R0, sizeof(plisp_fn_t));
+        for (int i = 0; i < nno; ++i) {
+            jit_patch(no[i]);
+        }
+        push_fact(_state, sym, known & ~ty);
+        plisp_compile_expr(_state, alt);
+        _state->nfacts = nfacts;
 
-    jit_prepare();
-    jit_pushargr(JIT_R1); // push closure data
-    jit_pushargi(nargs);
-    for (int i = 0; i < nargs; ++i) {
-        jit_ldxi(JIT_R1, JIT_FP, args[i]);
-        jit_pushargr(JIT_R1);
-    }
-    for (int i = 0; i < nargs; ++i) {
-        pop(_state, -1);
+        jit_patch(rest);
     }
-    jit_ldr(JIT_R0, JIT_R0);
-    jit_finishr(JIT_R0);
-    jit_retval(JIT_R0);
+    jit_node_t *done = jit_jmpi();
+
+    // the predicate was redefined, so its answer proves nothing. this
+    // copy can't add facts of its own, so code grows linearly with
+    // nesting rather than doubling.
+    jit_patch(redefined);
+    _state->nofacts++;
+    plisp_compile_if_generic(_state, expr);
+    _state->nofacts--;
+
+    jit_patch(done);
+    return true;
 }
 
 static void plisp_compile_if(struct lambda_state *_state, plisp_t expr) {
-    // get condition into R0
-    plisp_compile_expr(_state, plisp_car(plisp_cdr(expr)));
-
-    jit_node_t *cond = jit_beqi(JIT_R0, plisp_make_bool(false));
-    plisp_compile_expr(_state, plisp_car(plisp_cdr(plisp_cdr(expr))));
-    jit_node_t *rest = jit_jmpi();
-    jit_patch(cond);
-    plisp_compile_expr(_state,
-                       plisp_car(plisp_cdr
-                                 (plisp_cdr(plisp_cdr(expr)))));
-    jit_patch(rest);
+    if (!plisp_compile_if_predicate(_state, expr)) {
+        plisp_compile_if_generic(_state, expr);
+    }
 }
 
 
@@ -251,10 +1776,9 @@ static void plisp_compile_ref(struct lambda_state *_state, plisp_t sym) {
     plisp_t *tl_slot = plisp_toplevel_ref(sym);
     jit_ldi(JIT_R0, tl_slot);
 
-    #ifndef PLISP_UNSAFE
     // don't generate a runtime check if the variable is bound at
     // compile time
-    if (*tl_slot == plisp_unbound) {
+    if (_state->safe && *tl_slot == plisp_unbound) {
         push(_state, JIT_R0);
 
         // assert that the variable we reference is bound
@@ -265,7 +1789,6 @@ static void plisp_compile_ref(struct lambda_state *_state, plisp_t sym) {
 
         pop(_state, JIT_R0);
     }
-    #endif
 }
 
 static void plisp_compile_closure_ref(struct lambda_state *_state, plisp_t sym) {
@@ -288,10 +1811,9 @@ static void plisp_compile_closure_ref(struct lambda_state *_state, plisp_t sym)
     plisp_t *tl_slot = plisp_toplevel_ref(sym);
     jit_ldi(JIT_R0, tl_slot);
 
-    #ifndef PLISP_UNSAFE
     // don't generate a runtime check if the variable is bound at
     // compile time
-    if (*tl_slot == plisp_unbound) {
+    if (_state->safe && *tl_slot == plisp_unbound) {
         push(_state, JIT_R0);
 
         // assert that the variable we reference is bound
@@ -302,22 +1824,22 @@ static void plisp_compile_closure_ref(struct lambda_state *_state, plisp_t sym)
 
         pop(_state, JIT_R0);
     }
-    #endif
 }
 
+// extra is the number of slots to leave past the variables
 static void plisp_compile_gen_closure(struct lambda_state *_state,
-                                      Pvoid_t closure) {
+                                      Pvoid_t closure, size_t extra) {
     size_t num_elems;
     JLC(num_elems, closure, 0, -1);
 
     // don't generate a malloc call if it isn't a closure
-    if (num_elems == 0) {
+    if (num_elems == 0 && extra == 0) {
         jit_movi(JIT_R1, (jit_word_t) NULL);
         return;
     }
 
     jit_prepare();
-    jit_pushargi((num_elems+1) * sizeof(plisp_t));
+    jit_pushargi((num_elems+1+extra) * sizeof(plisp_t));
     jit_finishi(malloc);
     jit_retval(JIT_R1); //R1 holds the closure data
 
@@ -383,10 +1905,9 @@ static void plisp_compile_set(struct lambda_state *_state, plisp_t expr) {
 
     plisp_t *tl_slot = plisp_toplevel_ref(sym);
 
-    #ifndef PLISP_UNSAFE
     // don't generate a runtime check if the variable is bound at
     // compile time
-    if (*tl_slot == plisp_unbound) {
+    if (_state->safe && *tl_slot == plisp_unbound) {
         // assert that the variable we reference is bound
         jit_ldi(JIT_R0, tl_slot);
         jit_prepare();
@@ -394,7 +1915,6 @@ static void plisp_compile_set(struct lambda_state *_state, plisp_t expr) {
         jit_pushargi(sym);
         jit_finishi(assert_bound);
     }
-    #endif
 
     plisp_compile_expr(_state, value);
     jit_sti(tl_slot, JIT_R0);
@@ -443,14 +1963,21 @@ static void plisp_compile_quasiquote(struct lambda_state *_state, plisp_t expr)
 
 }
 
+static void plisp_compile_lazy_lambda(struct lambda_state *_state,
+                                      plisp_t lambda);
+
 static void plisp_compile_expr(struct lambda_state *_state, plisp_t expr) {
     if (plisp_c_consp(expr)) {
-        if (plisp_car(expr) == lambda_sym) {
+        if (plisp_car(expr) == lambda_sym
+            && plisp_fixed_arityp(plisp_car(plisp_cdr(expr)))) {
+            plisp_compile_lazy_lambda(_state, expr);
+        } else if (plisp_car(expr) == lambda_sym) {
             Pvoid_t closure;
-            plisp_fn_t fun = plisp_compile_lambda_context(expr, _state, &closure);
+            plisp_fn_t fun = plisp_compile_lambda_context(expr, _state, &closure,
+                                                          plisp_nil, NULL);
 
             // produces closure data in JIT_R1
-            plisp_compile_gen_closure(_state, closure);
+            plisp_compile_gen_closure(_state, closure, 0);
 
             size_t Rc_word;
             JLFA(Rc_word, closure);
@@ -482,8 +2009,6 @@ static void plisp_compile_expr(struct lambda_state *_state, plisp_t expr) {
     }
 }
 
-static bool plisp_must_be_boxed(plisp_t sym, plisp_t cdr);
-
 static bool plisp_must_be_boxed_expr(plisp_t sym, plisp_t expr) {
     if (!plisp_c_consp(expr)) {
         return false;
@@ -567,6 +2092,21 @@ static void box_R0(struct lambda_state *_state) {
     jit_retval(JIT_R0);
 }
 
+static bool mentions_symbol(plisp_t expr, plisp_t sym) {
+    if (expr == sym) {
+        return true;
+    }
+    if (!plisp_c_consp(expr) || plisp_car(expr) == quote_sym) {
+        return false;
+    }
+    for (; plisp_c_consp(expr); expr = plisp_cdr(expr)) {
+        if (mentions_symbol(plisp_car(expr), sym)) {
+            return true;
+        }
+    }
+    return expr == sym;
+}
+
 static void plisp_compile_local_define(struct lambda_state *_state,
                                        plisp_t exprlist) {
 
@@ -591,13 +2131,32 @@ static void plisp_compile_local_define(struct lambda_state *_state,
         valexpr = plisp_car(plisp_cdr(plisp_cdr(form)));
     }
 
+    // a value that refers to the variable, like a recursive local
+    // function, closes over its box before the box is filled
+    bool recursive = mentions_symbol(valexpr, sym);
+
     bool *bval;
     JLI(bval, _state->boxed, sym);
-    *bval = plisp_must_be_boxed(sym, plisp_cdr(exprlist));
+    *bval = recursive || plisp_must_be_boxed(sym, plisp_cdr(exprlist));
 
     int *pval;
     JLI(pval, _state->arg_table, sym);
 
+    if (recursive) {
+        jit_movi(JIT_R0, plisp_unspec);
+        box_R0(_state);
+        *pval = push_perm(_state, JIT_R0);
+
+        plisp_compile_expr(_state, valexpr);
+        jit_ldxi(JIT_R1, JIT_FP, *pval);
+        jit_andi(JIT_R1, JIT_R1, ~LOTAGS);
+        jit_str(JIT_R1, JIT_R0);
+
+        jit_movi(JIT_R0, plisp_unspec);
+        return;
+    }
+
+    int type = expr_type(_state, valexpr);
     plisp_compile_expr(_state, valexpr);
 
     if (*bval) {
@@ -605,6 +2164,9 @@ static void plisp_compile_local_define(struct lambda_state *_state,
     }
 
     *pval = push_perm(_state, JIT_R0);
+    if (!*bval) {
+        push_fact(_state, sym, type);
+    }
 
     jit_movi(JIT_R0, plisp_unspec);
 }
@@ -629,10 +2191,64 @@ static plisp_t va_to_list(size_t nargs, va_list args) {
     return plisp_c_reverse(lst);
 }
 
+static void plisp_tier_up(struct fn_info *info);
+
+static bool plisp_declarep(plisp_t stmt) {
+    return plisp_c_consp(stmt) && plisp_car(stmt) == declare_sym;
+}
+
+// finds (safety n) anywhere in a declaration, so both
+// (declare (optimize speed) (safety 0)) and
+// (declare (optimize (speed 3) (safety 0))) work
+static void plisp_declared_safety(plisp_t decl, bool *safe) {
+    for (; plisp_c_consp(decl); decl = plisp_cdr(decl)) {
+        plisp_t clause = plisp_car(decl);
+        if (!plisp_c_consp(clause)) {
+            continue;
+        }
+
+        if (plisp_car(clause) == safety_sym
+            && plisp_c_consp(plisp_cdr(clause))
+            && plisp_c_fixnump(plisp_car(plisp_cdr(clause)))) {
+            *safe = plisp_fixnum_value(plisp_car(plisp_cdr(clause))) > 0;
+        } else {
+            plisp_declared_safety(plisp_cdr(clause), safe);
+        }
+    }
+}
+
+// lambdas are as safe as the code around them unless their body
+// starts with a declaration saying otherwise
+static bool plisp_lambda_safety(plisp_t lambda, bool inherited) {
+    bool safe = inherited;
+    for (plisp_t body = plisp_cdr(plisp_cdr(lambda));
+         plisp_c_consp(body) && plisp_declarep(plisp_car(body));
+         body = plisp_cdr(body)) {
+        plisp_declared_safety(plisp_cdr(plisp_car(body)), &safe);
+    }
+    return safe;
+}
+
+static bool plisp_fixed_arityp(plisp_t arglist) {
+    while (plisp_c_consp(arglist)) {
+        arglist = plisp_cdr(arglist);
+    }
+    return plisp_c_nullp(arglist);
+}
+
 static plisp_fn_t plisp_compile_lambda_context(
     plisp_t lambda,
     struct lambda_state *parent_state,
-    Pvoid_t *closure_vars) {
+    Pvoid_t *closure_vars,
+    plisp_t preset_closure,
+    struct fn_info *profile) {
+
+    // compiles on other threads allocate, and share jit_info and
+    // lightning
+    plisp_gc_lock();
+
+    struct fn_info *info = calloc(1, sizeof(struct fn_info));
+    info->roots = plisp_nil;
 
     // maps argument names to nodes
     struct lambda_state state = {
@@ -644,13 +2260,48 @@ static plisp_fn_t plisp_compile_lambda_context(
         .parent = parent_state,
         .closure_vars = NULL,
         .closure_idx = 0,
-        .boxed = NULL
+        .boxed = NULL,
+        .info = info,
+        .profile = profile,
+        .site_context = 0,
+        .safe = plisp_lambda_safety(lambda, parent_state != NULL
+                                    ? parent_state->safe : DEFAULT_SAFE)
     };
 
     struct lambda_state *_state = &state;
 
     assert(plisp_car(lambda) == lambda_sym);
 
+    // functions compiled directly under the root scope are toplevel
+    // or lazy inner lambdas, and can be recompiled from their lambda
+    // and closure layout
+    info->tierable = profile == NULL
+        && parent_state != NULL && parent_state->jit == NULL
+        && plisp_fixed_arityp(plisp_car(plisp_cdr(lambda)));
+    if (info->tierable) {
+        info->lambda = lambda;
+        info->preset_closure = preset_closure;
+        info->safe = parent_state->safe;
+        plisp_gc_permanent(lambda);
+        if (preset_closure != plisp_nil) {
+            plisp_gc_permanent(preset_closure);
+        }
+    }
+
+    // the closure layout was fixed by the caller, as a list of
+    // (sym . boxed)
+    for (plisp_t i = preset_closure; i != plisp_nil; i = plisp_cdr(i)) {
+        plisp_t sym = plisp_car(plisp_car(i));
+
+        size_t *clnum;
+        JLI(clnum, _state->closure_vars, sym);
+        *clnum = _state->closure_idx++;
+
+        bool *bval;
+        JLI(bval, _state->boxed, sym);
+        *bval = plisp_cdr(plisp_car(i)) != plisp_make_bool(false);
+    }
+
     jit_prolog();
 
     jit_getarg(JIT_R0, jit_arg());
@@ -659,9 +2310,54 @@ static plisp_fn_t plisp_compile_lambda_context(
     jit_getarg(JIT_R0, jit_arg());
     int nargs = push_perm(_state, JIT_R0);
 
+    // every argument is loaded before anything is called, so the
+    // optimized version can be called with them
+    int argslots[MAX_ARGS];
     int real_nargs = 0;
 
     plisp_t arglist;
+    for (arglist = plisp_car(plisp_cdr(lambda));
+         plisp_c_consp(arglist); arglist = plisp_cdr(arglist)) {
+
+        jit_getarg(JIT_R0, jit_arg());
+        argslots[real_nargs++] = push_perm(_state, JIT_R0);
+    }
+
+    if (_state->safe && plisp_c_nullp(arglist)) {
+        // assert that the right number of arguments were passed
+        jit_ldxi(JIT_R0, JIT_FP, nargs);
+        jit_prepare();
+        jit_pushargi(real_nargs);
+        jit_pushargr(JIT_R0);
+        jit_finishi(assert_nargs);
+    }
+
+    if (info->tierable) {
+        // forward to the optimized version once there is one
+        jit_ldi(JIT_R0, &info->optimized);
+        jit_node_t *baseline = jit_beqi(JIT_R0, 0);
+        jit_prepare();
+        jit_ldxi(JIT_R1, JIT_FP, _state->closure_on_stack);
+        jit_pushargr(JIT_R1);
+        jit_pushargi(real_nargs);
+        for (int i = 0; i < real_nargs; ++i) {
+            jit_ldxi(JIT_R1, JIT_FP, argslots[i]);
+            jit_pushargr(JIT_R1);
+        }
+        jit_finishr(JIT_R0);
+        jit_retval(JIT_R0);
+        jit_retr(JIT_R0);
+        jit_patch(baseline);
+
+        emit_count(_state, &info->calls);
+        jit_node_t *cold = jit_bnei(JIT_R1, OPT_THRESHOLD);
+        jit_prepare();
+        jit_pushargi((jit_word_t) info);
+        jit_finishi(plisp_tier_up);
+        jit_patch(cold);
+    }
+
+    int argn = 0;
     for (arglist = plisp_car(plisp_cdr(lambda));
          plisp_c_consp(arglist); arglist = plisp_cdr(arglist)) {
 
@@ -673,28 +2369,16 @@ static plisp_fn_t plisp_compile_lambda_context(
 
         int *pval;
         JLI(pval, _state->arg_table, sym);
-
-        jit_getarg(JIT_R0, jit_arg());
+        *pval = argslots[argn++];
 
         if (*bval) {
+            jit_ldxi(JIT_R0, JIT_FP, *pval);
             box_R0(_state);
+            jit_stxi(*pval, JIT_FP, JIT_R0);
         }
-
-        *pval = push_perm(_state, JIT_R0);
-
-        real_nargs++;
     }
 
-    if (plisp_c_nullp(arglist)) {
-        #ifndef PLISP_UNSAFE
-        // assert that the right number of arguments were passed
-        jit_ldxi(JIT_R0, JIT_FP, nargs);
-        jit_prepare();
-        jit_pushargi(real_nargs);
-        jit_pushargr(JIT_R0);
-        jit_finishi(assert_nargs);
-        #endif
-    } else {
+    if (!plisp_c_nullp(arglist)) {
         assert(plisp_c_symbolp(arglist));
         // pass the remaining arguments as a list
 
@@ -702,14 +2386,14 @@ static plisp_fn_t plisp_compile_lambda_context(
         jit_va_start(JIT_R0);
         int va = push(_state, JIT_R0);
 
-        #ifndef PLISP_UNSAFE
-        // make sure we get the minimum number of arguments
-        jit_ldxi(JIT_R0, JIT_FP, nargs);
-        jit_prepare();
-        jit_pushargi(real_nargs);
-        jit_pushargr(JIT_R0);
-        jit_finishi(assert_gt_nargs);
-        #endif
+        if (_state->safe) {
+            // make sure we get the minimum number of arguments
+            jit_ldxi(JIT_R0, JIT_FP, nargs);
+            jit_prepare();
+            jit_pushargi(real_nargs);
+            jit_pushargr(JIT_R0);
+            jit_finishi(assert_gt_nargs);
+        }
 
         // get a list of the remaining arguments
         jit_ldxi(JIT_R1, JIT_FP, va);
@@ -738,7 +2422,20 @@ static plisp_fn_t plisp_compile_lambda_context(
         jit_va_end(JIT_R1);
     }
 
-    for (plisp_t exprlist = plisp_cdr(plisp_cdr(lambda));
+    // stop here while another thread collects. loops are calls, so
+    // no thread runs long without passing one of these.
+    jit_ldi_uc(JIT_R0, &plisp_stop_requested);
+    jit_node_t *running = jit_beqi(JIT_R0, 0);
+    jit_prepare();
+    jit_finishi(plisp_safepoint_slow);
+    jit_patch(running);
+
+    plisp_t body = plisp_cdr(plisp_cdr(lambda));
+    while (body != plisp_nil && plisp_declarep(plisp_car(body))) {
+        body = plisp_cdr(body);
+    }
+
+    for (plisp_t exprlist = body;
          exprlist != plisp_nil; exprlist = plisp_cdr(exprlist)) {
 
         plisp_compile_stmt(_state, exprlist);
@@ -752,6 +2449,9 @@ static plisp_fn_t plisp_compile_lambda_context(
     JLFA(Rc_word, _state->boxed);
 
     plisp_fn_t fun = jit_emit();
+    jit_word_t code_size;
+    info->code = jit_get_code(&code_size);
+    info->code_size = code_size;
     jit_clear_state();
 
 
@@ -760,37 +2460,324 @@ static plisp_fn_t plisp_compile_lambda_context(
         *closure_vars = _state->closure_vars;
     }
 
-    jit_state_t **pval;
-    JLG(pval, jit_info, (uintptr_t) fun);
-    if (pval == NULL) {
-        JLI(pval, jit_info, (uintptr_t) fun);
-    }
-    *pval = _state->jit;
+    info->jit = _state->jit;
+    set_info(fun, info);
 
+    plisp_gc_unlock();
     return fun;
 }
 
 plisp_fn_t plisp_compile_lambda(plisp_t lambda) {
-    return plisp_compile_lambda_context(lambda, NULL, NULL);
+    return plisp_compile_lambda_context(lambda, NULL, NULL, plisp_nil, NULL);
+}
+
+static plisp_fn_t compile_toplevel_lambda(plisp_t lambda, plisp_t layout,
+                                          bool safe, struct fn_info *profile) {
+    // an empty outermost scope, like the thunk toplevel forms are
+    // wrapped in, so the lambda's own arguments can be closed over
+    struct lambda_state root = {
+        .jit = NULL,
+        .arg_table = NULL,
+        .parent = NULL,
+        .closure_vars = NULL,
+        .closure_idx = 0,
+        .boxed = NULL,
+        .safe = safe
+    };
+
+    Pvoid_t closure;
+    plisp_fn_t fun = plisp_compile_lambda_context(lambda, &root, &closure,
+                                                  layout, profile);
+    size_t Rc_word;
+    JLFA(Rc_word, closure);
+    return fun;
+}
+
+plisp_fn_t plisp_compile_lambda_closure(plisp_t lambda, plisp_t closure_syms) {
+    // every variable the interpreter closes over is a box
+    plisp_t layout = plisp_nil;
+    for (; closure_syms != plisp_nil; closure_syms = plisp_cdr(closure_syms)) {
+        layout = plisp_cons(plisp_cons(plisp_car(closure_syms),
+                                       plisp_make_bool(true)),
+                            layout);
+    }
+    return compile_toplevel_lambda(lambda, plisp_c_reverse(layout),
+                                   DEFAULT_SAFE, NULL);
+}
+
+// compiles the lambda behind the closure data of a lazy closure, the
+// first time any of its closures are called
+static plisp_fn_t plisp_lazy_compile(struct plisp_closure_data *data) {
+    struct lazy_lambda *lazy = (void *) data->objs[data->length];
+    plisp_t self = data->objs[data->length + 1];
+
+    if (lazy->fun == NULL) {
+        lazy->fun = compile_toplevel_lambda(lazy->lambda, lazy->layout,
+                                            lazy->safe, NULL);
+        lazy_compiled++;
+    }
+
+    // (change whenever plisp_closure changes)
+    struct plisp_closure *clptr = (void *) (self & ~LOTAGS);
+    clptr->fun = lazy->fun;
+    return lazy->fun;
+}
+
+// the stub lazy closures of nargs arguments start with. it compiles
+// the lambda, then forwards the call.
+static plisp_fn_t lazy_stub(int nargs) {
+    if (lazy_stubs[nargs] != NULL) {
+        return lazy_stubs[nargs];
+    }
+
+    struct fn_info *info = calloc(1, sizeof(struct fn_info));
+    info->roots = plisp_nil;
+    info->lazy_stub = true;
+
+    struct lambda_state state = {
+        .jit = jit_new_state(),
+        .info = info
+    };
+    struct lambda_state *_state = &state;
+
+    jit_prolog();
+
+    jit_getarg(JIT_R0, jit_arg());
+    int data = push_perm(_state, JIT_R0);
+    jit_getarg(JIT_R0, jit_arg());
+    int passed = push_perm(_state, JIT_R0);
+
+    int args[MAX_ARGS];
+    for (int i = 0; i < nargs; ++i) {
+        jit_getarg(JIT_R0, jit_arg());
+        args[i] = push_perm(_state, JIT_R0);
+    }
+
+    jit_prepare();
+    jit_ldxi(JIT_R0, JIT_FP, data);
+    jit_pushargr(JIT_R0);
+    jit_finishi(plisp_lazy_compile);
+    jit_retval(JIT_R0);
+
+    jit_prepare();
+    jit_ldxi(JIT_R1, JIT_FP, data);
+    jit_pushargr(JIT_R1);
+    jit_ldxi(JIT_R1, JIT_FP, passed);
+    jit_pushargr(JIT_R1);
+    for (int i = 0; i < nargs; ++i) {
+        jit_ldxi(JIT_R1, JIT_FP, args[i]);
+        jit_pushargr(JIT_R1);
+    }
+    jit_finishr(JIT_R0);
+    jit_retval(JIT_R0);
+    jit_retr(JIT_R0);
+
+    plisp_fn_t fun = jit_emit();
+    jit_clear_state();
+    info->jit = _state->jit;
+    set_info(fun, info);
+
+    lazy_stubs[nargs] = fun;
+    return fun;
+}
+
+// makes a closure of an inner lambda without compiling it. only its
+// closure layout is decided now, from the variables here it mentions.
+static void plisp_compile_lazy_lambda(struct lambda_state *_state,
+                                      plisp_t lambda) {
+    int nargs = 0;
+    for (plisp_t arglist = plisp_car(plisp_cdr(lambda));
+         arglist != plisp_nil; arglist = plisp_cdr(arglist)) {
+        nargs++;
+    }
+    plisp_assert(nargs < MAX_ARGS);
+
+    plisp_t layout = plisp_nil;
+    for (plisp_t syms = plisp_mentioned_symbols(plisp_cdr(plisp_cdr(lambda)));
+         syms != plisp_nil; syms = plisp_cdr(syms)) {
+
+        // the same lookup the lambda would make if it were compiled
+        // now, which adds the variable to our closure if needed
+        bool boxed;
+        if (plisp_get_closure(_state, plisp_car(syms), &boxed) != -1) {
+            layout = plisp_cons(plisp_cons(plisp_car(syms),
+                                           plisp_make_bool(boxed)),
+                                layout);
+        }
+    }
+
+    struct lazy_lambda *lazy = calloc(1, sizeof(struct lazy_lambda));
+    lazy->lambda = lambda;
+    lazy->layout = layout;
+    lazy->safe = _state->safe;
+    plisp_gc_permanent(lambda);
+    if (layout != plisp_nil) {
+        plisp_gc_permanent(layout);
+    }
+    lazy_lambdas++;
+
+    Pvoid_t closure = NULL;
+    size_t nvars = 0;
+    for (; layout != plisp_nil; layout = plisp_cdr(layout)) {
+        size_t *idx;
+        JLI(idx, closure, plisp_car(plisp_car(layout)));
+        *idx = nvars++;
+    }
+
+    // produces closure data in JIT_R1
+    plisp_compile_gen_closure(_state, closure, LAZY_SLOTS);
+
+    size_t Rc_word;
+    JLFA(Rc_word, closure);
+
+    jit_movi(JIT_R0, (jit_word_t) lazy);
+    jit_stxi((nvars+1) * sizeof(plisp_t), JIT_R1, JIT_R0);
+    push(_state, JIT_R1);
+
+    // closures made after the first call skip the stub
+    jit_ldi(JIT_R0, &lazy->fun);
+    jit_node_t *compiled = jit_bnei(JIT_R0, 0);
+    jit_movi(JIT_R0, (jit_word_t) lazy_stub(nargs));
+    jit_patch(compiled);
+
+    jit_prepare();
+    jit_pushargr(JIT_R1);
+    jit_pushargr(JIT_R0);
+    jit_finishi(plisp_make_closure);
+    jit_retval(JIT_R0);
+
+    pop(_state, JIT_R1);
+    jit_stxi((nvars+2) * sizeof(plisp_t), JIT_R1, JIT_R0);
+}
+
+static void tier_up_job(void *arg, plisp_t unused) {
+    struct fn_info *info = arg;
+    plisp_fn_t fun = compile_toplevel_lambda(info->lambda,
+                                             info->preset_closure,
+                                             info->safe, info);
+    // the baseline starts forwarding as soon as this is visible
+    __atomic_store_n(&info->optimized, fun, __ATOMIC_RELEASE);
+}
+
+// recompile a hot function using the profile its baseline collected.
+// the closure layout is the same, so the optimized code takes the
+// same closure data. the baseline keeps running until it's ready.
+static void plisp_tier_up(struct fn_info *info) {
+    if (info->optimized != NULL || info->generation >= MAX_OPT_GENERATIONS) {
+        return;
+    }
+
+    info->deopts = 0;
+    if (!plisp_background(tier_up_job, info, plisp_nil)) {
+        tier_up_job(info, plisp_nil);
+    }
 }
 
 #undef _jit
 
+// frees every value in a map made by site_slot, and the map
+static void free_site_map(Pvoid_t *map, void (*free_value)(void *)) {
+    size_t Rc_word;
+    Word_t form = 0;
+    Pvoid_t *contexts;
+    JLF(contexts, *map, form);
+    while (contexts != NULL) {
+        Word_t context = 0;
+        void **value;
+        JLF(value, *contexts, context);
+        while (value != NULL) {
+            free_value(*value);
+            JLN(value, *contexts, context);
+        }
+        JLFA(Rc_word, *contexts);
+        JLN(contexts, *map, form);
+    }
+    JLFA(Rc_word, *map);
+}
+
+static void free_site(void *site) {
+    plisp_gc_unroot(&((struct profile_site *) site)->target);
+    free(site);
+}
+
+static void free_cache(void *cache) {
+    struct call_cache **c = &call_caches;
+    while (*c != cache) {
+        c = &(*c)->next;
+    }
+    *c = (*c)->next;
+    free(cache);
+}
+
+// once no frame runs optimized code anymore, it goes along with
+// everything that lived as long as it did
+static void destroy_optimized(void *arg) {
+    plisp_fn_t fun = arg;
+    struct fn_info *info = get_info(fun);
+
+    pthread_mutex_lock(&info_lock);
+    int Rc_int;
+    JLD(Rc_int, jit_info, (uintptr_t) fun);
+    pthread_mutex_unlock(&info_lock);
+
+    free_site_map(&info->sites, free_site);
+    free_site_map(&info->caches, free_cache);
+    if (info->roots != plisp_nil) {
+        plisp_gc_unroot(&info->roots);
+    }
+    jit_state_t *_jit = info->jit;
+    jit_destroy_state();
+    free(info);
+}
+
+// too many guesses failed. the baseline goes back to profiling, so
+// the next generation is compiled with what was learned since. the
+// code that failed is freed once nothing is running it.
+static void plisp_deoptimize(struct fn_info *info) {
+    plisp_fn_t old = __atomic_exchange_n(&info->optimized, NULL,
+                                         __ATOMIC_ACQ_REL);
+    if (old == NULL) {
+        return;
+    }
+    info->calls = 0;
+    info->deopts = 0;
+    info->generation++;
+
+    struct fn_info *old_info = get_info(old);
+    plisp_gc_retire_code(old_info->code, old_info->code_size,
+                         destroy_optimized, old);
+}
+
 void plisp_free_fn(plisp_fn_t fn) {
-    jit_state_t **pval;
-    JLG(pval, jit_info, (uintptr_t) fn);
-    jit_state_t *_jit = *pval;
+    jit_state_t *_jit = get_info(fn)->jit;
     jit_destroy_state();
 }
 
+const char *plisp_fn_tier(plisp_fn_t fn) {
+    struct fn_info *info = get_info(fn);
+    if (info == NULL) {
+        return "builtin";
+    } else if (info->lazy_stub) {
+        return "uncompiled";
+    } else if (__atomic_load_n(&info->optimized, __ATOMIC_ACQUIRE) != NULL) {
+        return "optimized";
+    } else {
+        return "baseline";
+    }
+}
+
 void plisp_disassemble_fn(plisp_fn_t fn) {
-    jit_state_t **pval;
-    JLG(pval, jit_info, (uintptr_t) fn);
-    if (pval == NULL) {
+    struct fn_info *info = get_info(fn);
+    if (info == NULL) {
         printf("builtins cannot be disassembled\n");
     } else {
-        jit_state_t *_jit = *pval;
+        jit_state_t *_jit = info->jit;
 
         jit_disassemble();
+
+        if (info->optimized != NULL) {
+            printf("optimized:\n");
+            plisp_disassemble_fn(info->optimized);
+        }
     }
 }
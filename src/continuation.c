@@ -2,72 +2,219 @@
 #include <plisp/builtin.h>
 #include <plisp/saftey.h>
 #include <plisp/gc.h>
+#include <plisp/read.h>
 #include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
+#include <alloca.h>
+#include <stdio.h>
 
+/*
+call/ec makes escape only continuations, which can only be called
+while the call/ec that made them hasn't returned, so all they need is
+a jmp_buf into its frame. every call/ec keeps an extent on its frame,
+chained to the one of the call/ec it is inside of, and an escape
+checks that its own is still live. an extent is taken off the chain
+when its call/ec returns or is escaped past, and its id cleared so a
+stale one can't look live again. the chain is on the stack, so the
+stacks saved by call/cc have the extents that were live then, and
+calling a call/cc continuation brings them back with it. call/cc
+keeps an extent too, to find the stack it can share.
+*/
+
+struct extent {
+    uint64_t id;
+    struct extent *outer;
+    // the segment sealed by a call/cc, or nil
+    plisp_t seal;
+};
+
+struct escape {
+    size_t length; // 0, so the collector doesn't scan the rest
+    uint64_t id;
+    struct extent *extent;
+    jmp_buf env;
+};
+
+// the innermost live extent. stacks are per thread, and so is all
+// the state of continuations.
+static __thread struct extent *extents = NULL;
+static __thread uint64_t last_extent_id = 0;
+
+static plisp_t segment_sym;
+static void trace_segment(void *data, void (*trace)(plisp_t));
 
 void plisp_init_continuation(void) {
+    segment_sym = plisp_intern(plisp_make_symbol("stack-segment"));
+    plisp_gc_custom_tracer(segment_sym, trace_segment);
+
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
 
     plisp_define_builtin("call-with-current-continuation", plisp_builtin_callcc);
     plisp_define_builtin("call/cc", plisp_builtin_callcc);
+    plisp_define_builtin("call-with-escape-continuation",
+                         plisp_builtin_callec);
+    plisp_define_builtin("call/ec", plisp_builtin_callec);
 
     #pragma GCC diagnostic pop
 }
 
+void *plisp_switch_extents(void *chain) {
+    struct extent *old = extents;
+    extents = chain;
+    return old;
+}
+
+// takes extents off the chain down to (but not including) last
+static void leave_extents(struct extent *last) {
+    for (; extents != last; extents = extents->outer) {
+        extents->id = 0;
+    }
+}
+
+/*
+call/cc saves the stack as a chain of segments, each a copy of the
+stack between two addresses, ending at the bottom of the stack. a
+call/cc seals the stack above its frame, which belongs to its callers
+and can't change until it returns, into a segment. it copies only as
+far as the seal of the innermost live call/cc, and shares the rest.
+its continuation is its own frame followed by the seal, so capturing
+one inside another costs as much as the stack between them.
+
+calling a continuation writes back its segments, except the ones that
+are the seals of call/cc's that are still live, which are on the
+stack already.
+*/
+
+struct segment {
+    plisp_t next;
+    // where it starts, as the distance from stack_bottom
+    size_t start;
+    size_t length;
+    char bytes[];
+};
 
 struct fake_clos {
     size_t length;
-    plisp_t stackvec;
+    plisp_t stack;
+    struct extent *extents;
+    // of the stack it was captured on
+    plisp_t *bottom;
     jmp_buf env;
 };
 
-static plisp_t save_stack(void) {
-    plisp_t stack_top;
-    char *stop = (char *) &stack_top;
-    char *sbottom = (char *) stack_bottom;
-    size_t length = (sbottom - stop);
+// saved stacks are scanned like the live one, so whatever a
+// continuation's frames refer to lives as long as it does
+static void trace_segment(void *data, void (*trace)(plisp_t)) {
+    struct segment *seg = data;
+    trace(seg->next);
+    plisp_gc_scan(seg->bytes, seg->bytes + seg->length);
+}
+
+static struct segment *get_segment(plisp_t seg) {
+    return plisp_custom_data(seg);
+}
 
-    plisp_t vec = plisp_make_vector(VEC_CHAR, sizeof(char),
-                                    0, length, 0, false);
+static char *segment_start(plisp_t seg) {
+    return (char *) stack_bottom - get_segment(seg)->start;
+}
+
+// a segment copying the stack from start up to next, or to the bottom
+static plisp_t make_segment(char *start, plisp_t next) {
+    volatile plisp_t keep = next;
+    char *end = next == plisp_nil ? (char *) stack_bottom
+                                  : segment_start(next);
+    size_t length = end - start;
 
+    struct segment *seg = malloc(sizeof(struct segment) + length);
+    seg->next = next;
+    seg->start = (char *) stack_bottom - start;
+    seg->length = length;
+    memcpy(seg->bytes, start, length);
 
-    struct plisp_vector *vecptr = (void *)(vec & ~LOTAGS);
-    memcpy(vecptr->vec, stop, length);
+    plisp_t obj = plisp_make_custom(segment_sym, seg);
+    (void) keep;
+    return obj;
+}
 
-    return vec;
+// the seal of the innermost live call/cc
+static plisp_t live_seal(void) {
+    for (struct extent *ext = extents; ext != NULL; ext = ext->outer) {
+        if (ext->seal != plisp_nil) {
+            return ext->seal;
+        }
+    }
+    return plisp_nil;
+}
+
+// the stack from this frame up to seal
+static __attribute__((noinline)) plisp_t save_frames(plisp_t seal) {
+    plisp_t stack_top;
+    return make_segment((char *) &stack_top, seal);
 }
 
 
-static plisp_t contret = plisp_unspec;
+static __thread plisp_t contret = plisp_unspec;
+
+// must be called from below the saved region, because it is
+// overwritten. nothing in this frame is touched after the memcpy.
+static __attribute__((noinline)) void restore_stack(struct fake_clos *clos,
+                                                    plisp_t keep) {
+    for (plisp_t seg = clos->stack; seg != keep;
+         seg = get_segment(seg)->next) {
+        memcpy(segment_start(seg), get_segment(seg)->bytes,
+               get_segment(seg)->length);
+    }
+
+    longjmp(clos->env, 1);
+}
 
 static plisp_t plisp_contfn(struct fake_clos *clos,
                             size_t nargs, plisp_t ret) {
-    static jmp_buf *tmp_buf;
-    static size_t length;
-    static char *stop;
-    static char *scopy;
-
     plisp_assert(nargs == 1 || nargs == 0);
     plisp_assert(clos != NULL);
 
+    if (clos->bottom != stack_bottom) {
+        fprintf(stderr, "error: continuation called from another "
+                "coroutine than the one it was captured in\n");
+        assert(false);
+    }
+
     if (nargs == 1) {
         contret = ret;
     } else {
         contret = plisp_unspec;
     }
-    tmp_buf = &(clos->env);
 
-    struct plisp_vector *vecptr = (void *)(clos->stackvec & ~LOTAGS);
-    stop = ((char *) stack_bottom) + length;
-    length = vecptr->len;
-    scopy = vecptr->vec;
+    // the first segment of the continuation that is still on the
+    // stack, and the extent that sealed it
+    struct extent *live = NULL;
+    plisp_t keep = plisp_nil;
+    for (plisp_t seg = clos->stack; seg != plisp_nil && live == NULL;
+         seg = get_segment(seg)->next) {
+        for (struct extent *ext = extents; ext != NULL; ext = ext->outer) {
+            if (ext->seal == seg) {
+                live = ext;
+                keep = seg;
+                break;
+            }
+        }
+    }
 
-    memcpy(stop, scopy, length);
+    // grow the stack past the saved region before restoring it
+    char *stop = segment_start(clos->stack);
+    char here;
+    if (&here >= stop) {
+        volatile char *pad = alloca(&here - stop + 1024);
+        pad[0] = 0;
+    }
 
-    longjmp(*tmp_buf, 1);
+    // the extents inside the live one are gone, and the saved stack
+    // has the ones that were live when it was saved
+    leave_extents(live != NULL ? live->outer : NULL);
+    extents = clos->extents;
+    restore_stack(clos, keep);
 
     return plisp_unspec;
 }
@@ -76,16 +223,73 @@ plisp_t plisp_builtin_callcc(plisp_t *clos, size_t nargs, plisp_t proc) {
     plisp_assert(nargs == 1);
     plisp_assert(plisp_c_closurep(proc));
 
+    // everything from here to the bottom of the stack is the callers'
+    char *callers = __builtin_dwarf_cfa();
+    struct extent extent = { ++last_extent_id, extents, plisp_nil };
+    extent.seal = make_segment(callers, live_seal());
+
     struct fake_clos *fc = malloc(sizeof(struct fake_clos));
-    fc->length = 1; // length is 0 so gc will not try to scan jmp_buf
-    fc->stackvec = save_stack();
+    fc->length = 1; // only the stack is scanned, not the jmp_buf
+    fc->stack = plisp_nil;
+    fc->extents = &extent;
+    fc->bottom = stack_bottom;
+    volatile plisp_t cont = plisp_make_closure((void *) fc,
+                                               (plisp_fn_t) plisp_contfn);
 
-    plisp_t cont = plisp_make_closure((void *) fc, (plisp_fn_t) plisp_contfn);
+    extents = &extent;
+    fc->stack = save_frames(extent.seal);
 
+    plisp_t ret;
     if (setjmp(fc->env) == 0) {
-        return plisp_closure_fun(proc)(
-            plisp_closure_data(proc), 1, cont);
+        ret = plisp_closure_fun(proc)(plisp_closure_data(proc), 1, cont);
     } else {
-        return contret;
+        ret = contret;
     }
+
+    leave_extents(extent.outer);
+    return ret;
+}
+
+static __thread plisp_t escape_ret = plisp_unspec;
+
+static plisp_t plisp_escapefn(struct escape *esc, size_t nargs, plisp_t ret) {
+    plisp_assert(nargs == 1 || nargs == 0);
+
+    char here;
+    if ((char *) esc->extent < &here
+        || (plisp_t *) esc->extent >= stack_bottom
+        || esc->extent->id != esc->id) {
+        fprintf(stderr, "error: escape continuation called after its "
+                "call/ec returned\n");
+        assert(false);
+    }
+
+    escape_ret = nargs == 1 ? ret : plisp_unspec;
+    leave_extents(esc->extent);
+    longjmp(esc->env, 1);
+}
+
+plisp_t plisp_builtin_callec(plisp_t *clos, size_t nargs, plisp_t proc) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_closurep(proc));
+
+    struct extent extent = { ++last_extent_id, extents, plisp_nil };
+    struct escape *esc = malloc(sizeof(struct escape));
+    esc->length = 0;
+    esc->id = extent.id;
+    esc->extent = &extent;
+
+    // kept on the stack, so it lives until the extent ends
+    volatile plisp_t cont = plisp_make_closure((void *) esc,
+                                               (plisp_fn_t) plisp_escapefn);
+    plisp_t ret;
+    if (setjmp(esc->env) == 0) {
+        extents = &extent;
+        ret = plisp_closure_fun(proc)(plisp_closure_data(proc), 1, cont);
+    } else {
+        ret = escape_ret;
+    }
+
+    leave_extents(extent.outer);
+    return ret;
 }
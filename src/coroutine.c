@@ -0,0 +1,594 @@
+#include <plisp/coroutine.h>
+#include <plisp/continuation.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifndef __x86_64__
+#include <ucontext.h>
+#endif
+
+/*
+a coroutine runs on a stack of its own, mapped as big as the main one
+but only touched as it is used, and unmapped once it returns or is
+collected. switching
+to one saves the callee saved registers on the current stack, stores
+the stack pointer in the coroutine being left and loads the one of the
+coroutine being entered, so it costs about as much as a function call.
+stack_bottom and the extents of call/cc and call/ec follow the stack
+being run on, so the collector scans the running stack as it always
+has, and coroutines scan their own stacks when they are suspended.
+
+tasks are coroutines that the scheduler resumes from a run queue, in
+order. a task that yields goes to the back of it, and one that waits
+on a channel parks, off the queue, until another task wakes it.
+waiting anywhere else runs tasks until whatever it waits for happens.
+tasks parked on i/o are woken by a poller, which the scheduler calls
+between tasks and blocks in when there are none to run.
+
+every thread has a main coroutine and a scheduler of its own, and
+coroutines can only be resumed or woken by the thread that made them.
+*/
+
+// there are no tail calls, so loops recurse as deep as they go
+#define COROUTINE_STACK (8 * 1024 * 1024)
+// how many tasks run between polls when there are some to run
+#define POLL_INTERVAL 64
+
+enum coroutine_state {
+    CO_NEW,
+    // running, or resuming another
+    CO_RUNNING,
+    // yielded, and waiting to be resumed
+    CO_SUSPENDED,
+    // a task that can be run
+    CO_READY,
+    CO_PARKED,
+    CO_DONE,
+};
+
+struct coroutine {
+    plisp_t thunk;
+    // passed in by resuming and out by yielding or returning
+    plisp_t transfer;
+    // whatever resumed it, which it goes back to
+    plisp_t caller;
+    bool task;
+    enum coroutine_state state;
+    // whether a thread is running on its stack, rather than it being
+    // saved
+    bool active;
+    pthread_t thread;
+    void *extents;
+    void *sp;
+    plisp_t *bottom;
+#ifndef __x86_64__
+    ucontext_t context;
+#endif
+    // with a guard page at the end it grows towards
+    char *stack;
+};
+
+// a first in first out queue of objects
+struct queue {
+    plisp_t *items;
+    size_t head;
+    size_t count;
+    size_t size;
+};
+
+struct channel {
+    struct queue items;
+    // 0 for no limit
+    size_t capacity;
+    struct queue senders;
+    struct queue receivers;
+};
+
+static plisp_t coroutine_sym;
+static plisp_t channel_sym;
+static plisp_t run_queue_sym;
+
+// the thread's own stack, which isn't a coroutine, but is switched
+// from and to like one
+static __thread plisp_t main_coroutine;
+static __thread plisp_t current;
+static __thread plisp_t run_queue_obj;
+static __thread struct queue *run_queue;
+static __thread size_t since_poll = 0;
+static plisp_poller_t poller = NULL;
+
+static void trace_coroutine(void *data, void (*trace)(plisp_t));
+static void trace_channel(void *data, void (*trace)(plisp_t));
+static void trace_run_queue(void *data, void (*trace)(plisp_t));
+static void finalize_run_queue(void *data);
+
+static plisp_t coroutine_make(plisp_t *clos, size_t nargs, plisp_t thunk);
+static plisp_t coroutine_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t coroutine_resume(plisp_t *clos, size_t nargs, plisp_t co,
+                                plisp_t value);
+static plisp_t coroutine_done(plisp_t *clos, size_t nargs, plisp_t co);
+static plisp_t coroutine_yield(plisp_t *clos, size_t nargs, plisp_t value);
+static plisp_t coroutine_spawn(plisp_t *clos, size_t nargs, plisp_t thunk);
+static plisp_t coroutine_run_scheduler(plisp_t *clos, size_t nargs);
+static plisp_t channel_make(plisp_t *clos, size_t nargs, plisp_t capacity);
+static plisp_t channel_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t channel_send(plisp_t *clos, size_t nargs, plisp_t ch,
+                            plisp_t value);
+static plisp_t channel_receive(plisp_t *clos, size_t nargs, plisp_t ch);
+
+void plisp_init_coroutine(void) {
+    coroutine_sym = plisp_intern(plisp_make_symbol("coroutine"));
+    channel_sym = plisp_intern(plisp_make_symbol("channel"));
+    run_queue_sym = plisp_intern(plisp_make_symbol("run-queue"));
+    plisp_gc_custom_tracer(coroutine_sym, trace_coroutine);
+    plisp_gc_custom_tracer(channel_sym, trace_channel);
+    plisp_gc_custom_tracer(run_queue_sym, trace_run_queue);
+    plisp_init_coroutine_thread();
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("make-coroutine", coroutine_make);
+    plisp_define_builtin("coroutine?", coroutine_p);
+    plisp_define_builtin("coroutine-resume", coroutine_resume);
+    plisp_define_builtin("coroutine-done?", coroutine_done);
+    plisp_define_builtin("yield", coroutine_yield);
+    plisp_define_builtin("spawn", coroutine_spawn);
+    plisp_define_builtin("run-scheduler", coroutine_run_scheduler);
+    plisp_define_builtin("make-channel", channel_make);
+    plisp_define_builtin("channel?", channel_p);
+    plisp_define_builtin("channel-send!", channel_send);
+    plisp_define_builtin("channel-receive", channel_receive);
+
+    #pragma GCC diagnostic pop
+}
+
+void plisp_init_coroutine_thread(void) {
+    struct coroutine *main_co = calloc(1, sizeof(struct coroutine));
+    main_co->thunk = plisp_nil;
+    main_co->transfer = plisp_unspec;
+    main_co->caller = plisp_nil;
+    main_co->state = CO_RUNNING;
+    main_co->active = true;
+    main_co->thread = pthread_self();
+    main_co->bottom = stack_bottom;
+    main_coroutine = plisp_make_custom(coroutine_sym, main_co);
+    plisp_gc_thread_root(&main_coroutine);
+    current = main_coroutine;
+    plisp_gc_thread_root(&current);
+
+    run_queue = calloc(1, sizeof(struct queue));
+    run_queue_obj = plisp_make_custom(run_queue_sym, run_queue);
+    plisp_gc_finalizer(run_queue_obj, finalize_run_queue);
+    plisp_gc_thread_root(&run_queue_obj);
+}
+
+/*
+queues
+*/
+
+static void queue_push(struct queue *q, plisp_t obj) {
+    if (q->count == q->size) {
+        size_t size = q->size == 0 ? 8 : q->size * 2;
+        plisp_t *items = malloc(size * sizeof(plisp_t));
+        for (size_t i = 0; i < q->count; ++i) {
+            items[i] = q->items[(q->head + i) % q->size];
+        }
+        free(q->items);
+        q->items = items;
+        q->head = 0;
+        q->size = size;
+    }
+    q->items[(q->head + q->count) % q->size] = obj;
+    q->count++;
+}
+
+static plisp_t queue_pop(struct queue *q) {
+    plisp_assert(q->count > 0);
+    plisp_t obj = q->items[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+    return obj;
+}
+
+static void trace_queue(struct queue *q, void (*trace)(plisp_t)) {
+    for (size_t i = 0; i < q->count; ++i) {
+        trace(q->items[(q->head + i) % q->size]);
+    }
+}
+
+static void trace_run_queue(void *data, void (*trace)(plisp_t)) {
+    trace_queue(data, trace);
+}
+
+static void finalize_run_queue(void *data) {
+    free(((struct queue *) data)->items);
+    free(data);
+}
+
+/*
+switching
+*/
+
+#ifdef __x86_64__
+// pushes the callee saved registers, stores the stack pointer in *from,
+// and returns on the stack at to, popping the ones pushed there
+void plisp_switch_stack(void **from, void *to);
+__asm__(
+    ".text\n"
+    ".globl plisp_switch_stack\n"
+    ".type plisp_switch_stack, @function\n"
+    "plisp_switch_stack:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size plisp_switch_stack, .-plisp_switch_stack\n");
+#endif
+
+static struct coroutine *get_coroutine(plisp_t obj) {
+    if (!plisp_c_coroutinep(obj)) {
+        fprintf(stderr, "error: expected a coroutine, got ");
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    struct coroutine *co = plisp_custom_data(obj);
+    if (!pthread_equal(co->thread, pthread_self())) {
+        fprintf(stderr, "error: used a coroutine from another thread than "
+                "the one that made it\n");
+        assert(false);
+    }
+    return co;
+}
+
+static void switch_to(plisp_t to) {
+    struct coroutine *from = plisp_custom_data(current);
+    struct coroutine *dest = plisp_custom_data(to);
+    from->extents = plisp_switch_extents(dest->extents);
+    from->active = false;
+    dest->active = true;
+    current = to;
+    stack_bottom = dest->bottom;
+
+#ifdef __x86_64__
+    plisp_switch_stack(&from->sp, dest->sp);
+#else
+    plisp_t here;
+    from->sp = &here;
+    swapcontext(&from->context, &dest->context);
+#endif
+}
+
+static void trace_coroutine(void *data, void (*trace)(plisp_t)) {
+    struct coroutine *co = data;
+    trace(co->thunk);
+    trace(co->transfer);
+    trace(co->caller);
+
+    // the stacks being run on are scanned with their threads'
+    if (co->state != CO_NEW && co->state != CO_DONE && !co->active) {
+        plisp_gc_scan(co->sp, co->bottom);
+#ifndef __x86_64__
+        plisp_gc_scan(&co->context, &co->context + 1);
+#endif
+    }
+}
+
+static void free_stack(struct coroutine *co) {
+    if (co->stack != NULL) {
+        munmap(co->stack, COROUTINE_STACK);
+        co->stack = NULL;
+    }
+}
+
+static void finalize_coroutine(void *data) {
+    free_stack(data);
+    free(data);
+}
+
+static void coroutine_entry(void) {
+    struct coroutine *co = plisp_custom_data(current);
+    plisp_t ret = plisp_call_closure(co->thunk, 0, NULL);
+
+    co = plisp_custom_data(current);
+    co->state = CO_DONE;
+    co->transfer = ret;
+    switch_to(co->caller);
+    assert(false);
+}
+
+/*
+coroutines
+*/
+
+bool plisp_c_coroutinep(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == coroutine_sym;
+}
+
+plisp_t plisp_make_coroutine(plisp_t thunk, bool task) {
+    plisp_assert(plisp_c_closurep(thunk));
+
+    char *stack = mmap(NULL, COROUTINE_STACK, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+                       | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+        perror("error: couldn't map a coroutine stack");
+        assert(false);
+    }
+    mprotect(stack, sysconf(_SC_PAGESIZE), PROT_NONE);
+
+    struct coroutine *co = malloc(sizeof(struct coroutine));
+    co->stack = stack;
+    co->thunk = thunk;
+    co->transfer = plisp_unspec;
+    co->caller = plisp_nil;
+    co->task = task;
+    co->state = CO_NEW;
+    co->active = false;
+    co->thread = pthread_self();
+    co->extents = NULL;
+
+    char *top = (char *) (((uintptr_t) co->stack + COROUTINE_STACK)
+                          & ~(uintptr_t) 15);
+    co->bottom = (plisp_t *) top;
+
+#ifdef __x86_64__
+    // what plisp_switch_stack pops, returning into coroutine_entry as
+    // if it had been called
+    void **sp = (void **) top;
+    *--sp = NULL;
+    *--sp = (void *) coroutine_entry;
+    for (int i = 0; i < 6; ++i) {
+        *--sp = NULL;
+    }
+    co->sp = sp;
+#else
+    getcontext(&co->context);
+    co->context.uc_stack.ss_sp = co->stack;
+    co->context.uc_stack.ss_size = top - co->stack;
+    co->context.uc_link = NULL;
+    makecontext(&co->context, coroutine_entry, 0);
+    co->sp = top;
+#endif
+
+    plisp_t obj = plisp_make_custom(coroutine_sym, co);
+    plisp_gc_finalizer(obj, finalize_coroutine);
+    return obj;
+}
+
+plisp_t plisp_coroutine_resume(plisp_t obj, plisp_t value) {
+    struct coroutine *co = get_coroutine(obj);
+    if (co->state == CO_DONE) {
+        fprintf(stderr, "error: resumed a coroutine that has returned\n");
+        assert(false);
+    } else if (co->state == CO_RUNNING || co->state == CO_PARKED) {
+        fprintf(stderr, "error: resumed a coroutine that is %s\n",
+                co->state == CO_RUNNING ? "running" : "parked");
+        assert(false);
+    }
+
+    co->caller = current;
+    co->transfer = value;
+    co->state = CO_RUNNING;
+    switch_to(obj);
+
+    // it yielded or returned, and in that case its stack is done with
+    co = get_coroutine(obj);
+    if (co->state == CO_DONE) {
+        free_stack(co);
+    }
+    return co->transfer;
+}
+
+plisp_t plisp_yield(plisp_t value) {
+    if (current == main_coroutine) {
+        fprintf(stderr, "error: yield outside of a coroutine\n");
+        assert(false);
+    }
+
+    struct coroutine *co = plisp_custom_data(current);
+    co->state = co->task ? CO_READY : CO_SUSPENDED;
+    co->transfer = value;
+    switch_to(co->caller);
+
+    return ((struct coroutine *) plisp_custom_data(current))->transfer;
+}
+
+/*
+the scheduler
+*/
+
+bool plisp_in_task(void) {
+    return ((struct coroutine *) plisp_custom_data(current))->task;
+}
+
+plisp_t plisp_current_task(void) {
+    plisp_assert(plisp_in_task());
+    return current;
+}
+
+void plisp_park(void) {
+    struct coroutine *co = plisp_custom_data(plisp_current_task());
+    co->state = CO_PARKED;
+    co->transfer = plisp_unspec;
+    switch_to(co->caller);
+}
+
+void plisp_wake(plisp_t task) {
+    struct coroutine *co = get_coroutine(task);
+    if (co->state == CO_PARKED) {
+        co->state = CO_READY;
+        queue_push(run_queue, task);
+    }
+}
+
+void plisp_scheduler_poller(plisp_poller_t poll) {
+    poller = poll;
+}
+
+bool plisp_run_one(void) {
+    // polling between tasks too keeps busy ones from starving the rest
+    if (poller != NULL
+        && (run_queue->count == 0 || ++since_poll >= POLL_INTERVAL)) {
+        since_poll = 0;
+        poller(run_queue->count == 0);
+    }
+    if (run_queue->count == 0) {
+        return false;
+    }
+
+    plisp_t task = queue_pop(run_queue);
+    plisp_coroutine_resume(task, plisp_unspec);
+    if (get_coroutine(task)->state == CO_READY) {
+        queue_push(run_queue, task);
+    }
+    return true;
+}
+
+// waits to be woken from waiters. anything but a task runs other tasks
+// instead, so the caller checks again whatever it waits for either way.
+static void wait_on(struct queue *waiters) {
+    if (plisp_in_task()) {
+        queue_push(waiters, current);
+        plisp_park();
+    } else if (!plisp_run_one()) {
+        fprintf(stderr, "error: waiting on a channel no task can use\n");
+        assert(false);
+    }
+}
+
+static void wake_one(struct queue *waiters) {
+    if (waiters->count > 0) {
+        plisp_wake(queue_pop(waiters));
+    }
+}
+
+/*
+channels
+*/
+
+static void trace_channel(void *data, void (*trace)(plisp_t)) {
+    struct channel *ch = data;
+    trace_queue(&ch->items, trace);
+    trace_queue(&ch->senders, trace);
+    trace_queue(&ch->receivers, trace);
+}
+
+static bool channelp(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == channel_sym;
+}
+
+static struct channel *get_channel(plisp_t obj) {
+    if (!channelp(obj)) {
+        fprintf(stderr, "error: expected a channel, got ");
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    return plisp_custom_data(obj);
+}
+
+/*
+builtins
+*/
+
+static plisp_t coroutine_make(plisp_t *clos, size_t nargs, plisp_t thunk) {
+    plisp_assert(nargs == 1);
+    return plisp_make_coroutine(thunk, false);
+}
+
+static plisp_t coroutine_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_coroutinep(obj));
+}
+
+static plisp_t coroutine_resume(plisp_t *clos, size_t nargs, plisp_t co,
+                                plisp_t value) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    return plisp_coroutine_resume(co, nargs == 2 ? value : plisp_unspec);
+}
+
+static plisp_t coroutine_done(plisp_t *clos, size_t nargs, plisp_t co) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(get_coroutine(co)->state == CO_DONE);
+}
+
+static plisp_t coroutine_yield(plisp_t *clos, size_t nargs, plisp_t value) {
+    plisp_assert(nargs == 0 || nargs == 1);
+    return plisp_yield(nargs == 1 ? value : plisp_unspec);
+}
+
+static plisp_t coroutine_spawn(plisp_t *clos, size_t nargs, plisp_t thunk) {
+    plisp_assert(nargs == 1);
+    plisp_t task = plisp_make_coroutine(thunk, true);
+    queue_push(run_queue, task);
+    return task;
+}
+
+static plisp_t coroutine_run_scheduler(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    while (plisp_run_one());
+    return plisp_unspec;
+}
+
+static plisp_t channel_make(plisp_t *clos, size_t nargs, plisp_t capacity) {
+    plisp_assert(nargs == 0 || nargs == 1);
+    struct channel *ch = calloc(1, sizeof(struct channel));
+    if (nargs == 1) {
+        plisp_assert(plisp_c_fixnump(capacity)
+                     && plisp_fixnum_value(capacity) > 0);
+        ch->capacity = plisp_fixnum_value(capacity);
+    }
+    return plisp_make_custom(channel_sym, ch);
+}
+
+static plisp_t channel_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(channelp(obj));
+}
+
+static plisp_t channel_send(plisp_t *clos, size_t nargs, plisp_t obj,
+                            plisp_t value) {
+    plisp_assert(nargs == 2);
+    struct channel *ch = get_channel(obj);
+    while (ch->capacity != 0 && ch->items.count >= ch->capacity) {
+        wait_on(&ch->senders);
+        ch = get_channel(obj);
+    }
+    queue_push(&ch->items, value);
+    wake_one(&ch->receivers);
+    return plisp_unspec;
+}
+
+static plisp_t channel_receive(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    struct channel *ch = get_channel(obj);
+    while (ch->items.count == 0) {
+        wait_on(&ch->receivers);
+        ch = get_channel(obj);
+    }
+    plisp_t value = queue_pop(&ch->items);
+    wake_one(&ch->senders);
+    return value;
+}
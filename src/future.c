@@ -0,0 +1,621 @@
+#include <plisp/future.h>
+#include <plisp/coroutine.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+futures and parallel jobs run on a pool of worker threads, started the
+first time one is made. each worker has a deque of tasks: it pushes and
+pops at the bottom, so it works on what it split off last, while idle
+workers steal from the top, where the biggest pieces are. threads that
+aren't workers push onto a deque of their own kind, which the workers
+steal from too.
+
+a parallel job over n elements is cut into chunks, about
+CHUNKS_PER_WORKER for each thread, and a task covers a range of them.
+running a task splits its range in half, pushing the top half, until
+one chunk is left, so a thief takes half of what is left in one steal,
+and chunks are only as small as they need to be for every thread to
+get some.
+
+whoever waits on a future or a job runs tasks while it waits, and only
+sleeps once there are none, so a future touched before any worker
+started it runs on the thread that touched it, and waiting inside a
+task never leaves a worker idle.
+*/
+
+// like the main stack and threads'
+#define WORKER_STACK (8 * 1024 * 1024)
+#define MAX_WORKERS 256
+#define CHUNKS_PER_WORKER 8
+
+struct task {
+    // a future, or a job
+    plisp_t obj;
+    // the chunks of a job it covers
+    size_t lo;
+    size_t hi;
+};
+
+struct deque {
+    pthread_mutex_t lock;
+    struct task *tasks;
+    // tasks[top, bottom) are waiting
+    size_t top;
+    size_t bottom;
+    size_t cap;
+};
+
+enum future_state {
+    FUTURE_QUEUED,
+    FUTURE_RUNNING,
+    FUTURE_DONE,
+};
+
+struct future {
+    plisp_t thunk;
+    plisp_t result;
+    int state;
+};
+
+enum job_kind {
+    JOB_MAP,
+    JOB_FOR_EACH,
+    JOB_REDUCE,
+};
+
+struct job {
+    enum job_kind kind;
+    plisp_t fn;
+    plisp_t init;
+    size_t n;
+    plisp_t *items;
+    // an element for each item when mapping, and for each chunk when
+    // reducing
+    plisp_t *results;
+    size_t chunk;
+    size_t nchunks;
+    // chunks that haven't finished
+    size_t remaining;
+};
+
+static plisp_t future_sym;
+static plisp_t job_sym;
+static plisp_t pool_sym;
+
+static size_t nworkers = 0;
+// the workers', then the one other threads share
+static struct deque deques[MAX_WORKERS + 1];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+// the calling thread's deque, if it is a worker
+static __thread struct deque *own = NULL;
+// where the calling thread starts looking for something to steal
+static __thread size_t steal_from = 0;
+
+// bumped whenever a task is pushed or finishes, so that threads with
+// nothing to do sleep until something changes
+static size_t epoch = 0;
+static size_t sleepers = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_changed = PTHREAD_COND_INITIALIZER;
+
+static void trace_future(void *data, void (*trace)(plisp_t));
+static void trace_job(void *data, void (*trace)(plisp_t));
+static void trace_pool(void *data, void (*trace)(plisp_t));
+
+static plisp_t future_make(plisp_t *clos, size_t nargs, plisp_t thunk);
+static plisp_t future_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t future_touch(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t parallel_map(plisp_t *clos, size_t nargs, plisp_t fn,
+                            plisp_t seq);
+static plisp_t parallel_for_each(plisp_t *clos, size_t nargs, plisp_t fn,
+                                 plisp_t seq);
+static plisp_t parallel_reduce(plisp_t *clos, size_t nargs, plisp_t fn,
+                               plisp_t init, plisp_t seq);
+static plisp_t pool_size(plisp_t *clos, size_t nargs);
+
+void plisp_init_future(void) {
+    future_sym = plisp_intern(plisp_make_symbol("future"));
+    job_sym = plisp_intern(plisp_make_symbol("parallel-job"));
+    pool_sym = plisp_intern(plisp_make_symbol("worker-pool"));
+    plisp_gc_custom_tracer(future_sym, trace_future);
+    plisp_gc_custom_tracer(job_sym, trace_job);
+    plisp_gc_custom_tracer(pool_sym, trace_pool);
+    plisp_gc_permanent(plisp_make_custom(pool_sym, NULL));
+
+    // PLISP_WORKERS sets how many, otherwise there is one for each
+    // cpu but the one the program runs on
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    nworkers = ncpus > 1 ? ncpus - 1 : 1;
+    const char *setting = getenv("PLISP_WORKERS");
+    if (setting != NULL) {
+        nworkers = strtoul(setting, NULL, 10);
+    }
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+    if (nworkers > MAX_WORKERS) {
+        nworkers = MAX_WORKERS;
+    }
+    for (size_t i = 0; i <= nworkers; ++i) {
+        pthread_mutex_init(&deques[i].lock, NULL);
+    }
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("future", future_make);
+    plisp_define_builtin("future?", future_p);
+    plisp_define_builtin("touch", future_touch);
+    plisp_define_builtin("parallel-map", parallel_map);
+    plisp_define_builtin("parallel-for-each", parallel_for_each);
+    plisp_define_builtin("parallel-reduce", parallel_reduce);
+    plisp_define_builtin("worker-count", pool_size);
+
+    #pragma GCC diagnostic pop
+}
+
+static bool customp(plisp_t obj, plisp_t typesym) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == typesym;
+}
+
+static void *get_custom(plisp_t obj, plisp_t typesym) {
+    if (!customp(obj, typesym)) {
+        fprintf(stderr, "error: expected a %s, got ",
+                plisp_string_value(plisp_symbol_name(typesym)));
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    return plisp_custom_data(obj);
+}
+
+/*
+deques
+*/
+
+static void push(struct deque *dq, struct task task) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom == dq->cap) {
+        if (dq->top > 0) {
+            memmove(dq->tasks, dq->tasks + dq->top,
+                    (dq->bottom - dq->top) * sizeof(struct task));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        } else {
+            dq->cap = dq->cap == 0 ? 64 : dq->cap * 2;
+            dq->tasks = realloc(dq->tasks, dq->cap * sizeof(struct task));
+        }
+    }
+    dq->tasks[dq->bottom++] = task;
+    pthread_mutex_unlock(&dq->lock);
+}
+
+static bool pop(struct deque *dq, struct task *task, bool steal) {
+    pthread_mutex_lock(&dq->lock);
+    bool found = dq->top != dq->bottom;
+    if (found) {
+        *task = steal ? dq->tasks[dq->top++] : dq->tasks[--dq->bottom];
+        if (dq->top == dq->bottom) {
+            dq->top = dq->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static struct deque *my_deque(void) {
+    return own != NULL ? own : &deques[nworkers];
+}
+
+// nothing touches a deque at a safepoint, so none is being changed
+// while they are traced
+static void trace_pool(void *data, void (*trace)(plisp_t)) {
+    for (size_t i = 0; i <= nworkers; ++i) {
+        for (size_t j = deques[i].top; j < deques[i].bottom; ++j) {
+            trace(deques[i].tasks[j].obj);
+        }
+    }
+}
+
+/*
+the pool
+*/
+
+static void changed(void) {
+    pthread_mutex_lock(&pool_lock);
+    __atomic_store_n(&epoch, epoch + 1, __ATOMIC_RELEASE);
+    if (sleepers > 0) {
+        pthread_cond_broadcast(&pool_changed);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static size_t current_epoch(void) {
+    return __atomic_load_n(&epoch, __ATOMIC_ACQUIRE);
+}
+
+static void wait_for_change(size_t seen) {
+    plisp_enter_blocking();
+    pthread_mutex_lock(&pool_lock);
+    sleepers++;
+    while (epoch == seen) {
+        pthread_cond_wait(&pool_changed, &pool_lock);
+    }
+    sleepers--;
+    pthread_mutex_unlock(&pool_lock);
+    plisp_leave_blocking();
+}
+
+// pops from the calling thread's deque, or steals from another
+static bool take_task(struct task *task) {
+    if (pop(my_deque(), task, false)) {
+        return true;
+    }
+    for (size_t i = 0; i <= nworkers; ++i) {
+        struct deque *dq = &deques[(steal_from + i) % (nworkers + 1)];
+        if (dq != my_deque() && pop(dq, task, true)) {
+            steal_from = (steal_from + i) % (nworkers + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void run_future(struct future *fu) {
+    plisp_t result = plisp_call_closure(fu->thunk, 0, NULL);
+    fu->result = result;
+    fu->thunk = plisp_nil;
+    __atomic_store_n(&fu->state, FUTURE_DONE, __ATOMIC_RELEASE);
+    changed();
+}
+
+static void run_chunk(struct job *job, size_t c) {
+    size_t start = c * job->chunk;
+    size_t end = start + job->chunk < job->n ? start + job->chunk : job->n;
+
+    plisp_t acc = job->init;
+    for (size_t i = start; i < end; ++i) {
+        plisp_t args[2];
+        switch (job->kind) {
+        case JOB_MAP:
+            args[0] = job->items[i];
+            job->results[i] = plisp_call_closure(job->fn, 1, args);
+            break;
+        case JOB_FOR_EACH:
+            args[0] = job->items[i];
+            plisp_call_closure(job->fn, 1, args);
+            break;
+        case JOB_REDUCE:
+            args[0] = acc;
+            args[1] = job->items[i];
+            acc = plisp_call_closure(job->fn, 2, args);
+            break;
+        }
+    }
+    if (job->kind == JOB_REDUCE) {
+        job->results[c] = acc;
+    }
+}
+
+static void run_range(plisp_t obj, size_t lo, size_t hi) {
+    volatile plisp_t keep = obj;
+    struct job *job = plisp_custom_data(obj);
+
+    if (hi - lo > 1) {
+        while (hi - lo > 1) {
+            size_t mid = lo + (hi - lo) / 2;
+            push(my_deque(), (struct task) {obj, mid, hi});
+            hi = mid;
+        }
+        changed();
+    }
+
+    run_chunk(job, lo);
+    if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        changed();
+    }
+    (void) keep;
+}
+
+static void run_task(struct task task) {
+    if (customp(task.obj, future_sym)) {
+        struct future *fu = plisp_custom_data(task.obj);
+        int queued = FUTURE_QUEUED;
+        // it was already taken, by whoever touched it
+        if (__atomic_compare_exchange_n(&fu->state, &queued, FUTURE_RUNNING,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+            run_future(fu);
+        }
+    } else {
+        run_range(task.obj, task.lo, task.hi);
+    }
+}
+
+// runs tasks until done(arg), sleeping when there are none
+static void help_until(bool (*done)(void *), void *arg) {
+    while (true) {
+        // read first, so finishing in between still wakes it
+        size_t seen = current_epoch();
+        if (done(arg)) {
+            return;
+        }
+        struct task task;
+        if (take_task(&task)) {
+            run_task(task);
+        } else {
+            wait_for_change(seen);
+        }
+    }
+}
+
+static bool never(void *arg) {
+    return false;
+}
+
+static void *worker_main(void *arg) {
+    own = arg;
+    steal_from = own - deques;
+    plisp_gc_register_thread();
+    plisp_init_coroutine_thread();
+    help_until(never, NULL);
+    return NULL;
+}
+
+static void start_pool(void) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, WORKER_STACK);
+    for (size_t i = 0; i < nworkers; ++i) {
+        pthread_t id;
+        int err = pthread_create(&id, &attr, worker_main, &deques[i]);
+        if (err != 0) {
+            fprintf(stderr, "error: couldn't start a worker: %s\n",
+                    strerror(err));
+            assert(false);
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/*
+futures
+*/
+
+static void trace_future(void *data, void (*trace)(plisp_t)) {
+    struct future *fu = data;
+    trace(fu->thunk);
+    trace(fu->result);
+}
+
+static void finalize_future(void *data) {
+    free(data);
+}
+
+bool plisp_c_futurep(plisp_t obj) {
+    return customp(obj, future_sym);
+}
+
+plisp_t plisp_make_future(plisp_t thunk) {
+    plisp_assert(plisp_c_closurep(thunk));
+    pthread_once(&pool_once, start_pool);
+
+    struct future *fu = malloc(sizeof(struct future));
+    fu->thunk = thunk;
+    fu->result = plisp_unspec;
+    fu->state = FUTURE_QUEUED;
+    plisp_t obj = plisp_make_custom(future_sym, fu);
+    plisp_gc_finalizer(obj, finalize_future);
+
+    push(my_deque(), (struct task) {obj, 0, 0});
+    changed();
+    return obj;
+}
+
+static bool future_done(void *arg) {
+    struct future *fu = arg;
+    return __atomic_load_n(&fu->state, __ATOMIC_ACQUIRE) == FUTURE_DONE;
+}
+
+plisp_t plisp_touch(plisp_t obj) {
+    volatile plisp_t keep = obj;
+    struct future *fu = get_custom(obj, future_sym);
+
+    int queued = FUTURE_QUEUED;
+    if (__atomic_compare_exchange_n(&fu->state, &queued, FUTURE_RUNNING,
+                                    false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+        run_future(fu);
+    } else {
+        help_until(future_done, fu);
+    }
+
+    (void) keep;
+    return fu->result;
+}
+
+/*
+parallel jobs
+*/
+
+static void trace_job(void *data, void (*trace)(plisp_t)) {
+    struct job *job = data;
+    trace(job->fn);
+    trace(job->init);
+    for (size_t i = 0; i < job->n; ++i) {
+        trace(job->items[i]);
+    }
+    size_t nresults = job->kind == JOB_MAP ? job->n
+        : job->kind == JOB_REDUCE ? job->nchunks : 0;
+    for (size_t i = 0; i < nresults; ++i) {
+        trace(job->results[i]);
+    }
+}
+
+static void finalize_job(void *data) {
+    struct job *job = data;
+    free(job->items);
+    free(job->results);
+    free(job);
+}
+
+static bool job_done(void *arg) {
+    struct job *job = arg;
+    return __atomic_load_n(&job->remaining, __ATOMIC_ACQUIRE) == 0;
+}
+
+// calls fn on each element of seq, a list or a vector, across the pool,
+// and returns the finished job
+static plisp_t run_job(enum job_kind kind, plisp_t fn, plisp_t init,
+                       plisp_t seq) {
+    plisp_assert(plisp_c_closurep(fn));
+    pthread_once(&pool_once, start_pool);
+
+    size_t n;
+    if (plisp_c_vectorp(seq)) {
+        n = plisp_vector_c_length(seq);
+    } else {
+        plisp_assert(plisp_c_consp(seq) || plisp_c_nullp(seq));
+        n = plisp_c_length(seq);
+    }
+
+    // big inputs get bigger chunks, so each thread still only takes a
+    // few, and small ones a chunk per element
+    size_t target = (nworkers + 1) * CHUNKS_PER_WORKER;
+    size_t chunk = n > target ? (n + target - 1) / target : 1;
+    size_t nchunks = n == 0 ? 0 : (n + chunk - 1) / chunk;
+
+    size_t nresults = kind == JOB_MAP ? n
+        : kind == JOB_REDUCE ? nchunks : 0;
+    plisp_t *results = malloc((nresults + 1) * sizeof(plisp_t));
+    for (size_t i = 0; i < nresults; ++i) {
+        results[i] = plisp_unspec;
+    }
+
+    // n and nchunks count up as items are filled in, since boxing the
+    // elements of some vectors allocates
+    struct job *job = malloc(sizeof(struct job));
+    *job = (struct job) {
+        .kind = kind,
+        .fn = fn,
+        .init = init,
+        .n = 0,
+        .items = malloc((n + 1) * sizeof(plisp_t)),
+        .results = results,
+        .chunk = chunk,
+        .nchunks = 0,
+        .remaining = nchunks,
+    };
+    plisp_t obj = plisp_make_custom(job_sym, job);
+    volatile plisp_t keep = obj;
+    plisp_gc_finalizer(obj, finalize_job);
+
+    plisp_t lst = seq;
+    for (size_t i = 0; i < n; ++i) {
+        if (plisp_c_vectorp(seq)) {
+            job->items[i] = plisp_vector_ref(seq, i);
+        } else {
+            job->items[i] = plisp_car(lst);
+            lst = plisp_cdr(lst);
+        }
+        job->n = i + 1;
+    }
+    job->nchunks = nchunks;
+
+    if (nchunks > 0) {
+        run_range(obj, 0, nchunks);
+        help_until(job_done, job);
+    }
+
+    (void) keep;
+    return obj;
+}
+
+/*
+builtins
+*/
+
+static plisp_t future_make(plisp_t *clos, size_t nargs, plisp_t thunk) {
+    plisp_assert(nargs == 1);
+    return plisp_make_future(thunk);
+}
+
+static plisp_t future_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_futurep(obj));
+}
+
+static plisp_t future_touch(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_touch(obj);
+}
+
+// returns a list for a list, and a vector for a vector
+static plisp_t parallel_map(plisp_t *clos, size_t nargs, plisp_t fn,
+                            plisp_t seq) {
+    plisp_assert(nargs == 2);
+    plisp_t obj = run_job(JOB_MAP, fn, plisp_unspec, seq);
+    volatile plisp_t keep = obj;
+    struct job *job = plisp_custom_data(obj);
+
+    plisp_t res;
+    if (plisp_c_vectorp(seq)) {
+        res = plisp_make_vector(VEC_OBJ, sizeof(plisp_t), 0, job->n,
+                                plisp_unspec, true);
+        memcpy(plisp_vector_objs(res), job->results,
+               job->n * sizeof(plisp_t));
+    } else {
+        res = plisp_nil;
+        for (size_t i = job->n; i > 0; --i) {
+            res = plisp_cons(job->results[i - 1], res);
+        }
+    }
+
+    (void) keep;
+    return res;
+}
+
+static plisp_t parallel_for_each(plisp_t *clos, size_t nargs, plisp_t fn,
+                                 plisp_t seq) {
+    plisp_assert(nargs == 2);
+    run_job(JOB_FOR_EACH, fn, plisp_unspec, seq);
+    return plisp_unspec;
+}
+
+// (fn acc elem), which has to be associative with init as its
+// identity, since each chunk is folded from init on its own
+static plisp_t parallel_reduce(plisp_t *clos, size_t nargs, plisp_t fn,
+                               plisp_t init, plisp_t seq) {
+    plisp_assert(nargs == 3);
+    plisp_t obj = run_job(JOB_REDUCE, fn, init, seq);
+    volatile plisp_t keep = obj;
+    struct job *job = plisp_custom_data(obj);
+
+    if (job->nchunks == 0) {
+        return init;
+    }
+    plisp_t acc = job->results[0];
+    for (size_t c = 1; c < job->nchunks; ++c) {
+        plisp_t args[2] = {acc, job->results[c]};
+        acc = plisp_call_closure(fn, 2, args);
+    }
+
+    (void) keep;
+    return acc;
+}
+
+static plisp_t pool_size(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    return plisp_make_fixnum(nworkers);
+}
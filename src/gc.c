@@ -1,25 +1,121 @@
+#define _GNU_SOURCE
 #include <plisp/gc.h>
+#include <plisp/record.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <Judy.h>
 
 #define MAX_ALLOC_PAGE_SIZE 8192
+// pools are aligned to their size, so the pool of an object is found
+// from its address
+#define POOL_BYTES (MAX_ALLOC_PAGE_SIZE * sizeof(struct plisp_cons))
 
 struct obj_allocs {
     size_t allocated[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
     //size_t grey_set[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
     size_t black_set[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
     size_t freecdr[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
+    // set for objects with an entry in owners
+    size_t owned[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
+    // set for objects with an entry in finalizers
+    size_t finalized[MAX_ALLOC_PAGE_SIZE/(sizeof(size_t)*8)];
+    // the tag each object was allocated with
+    uint8_t tags[MAX_ALLOC_PAGE_SIZE];
     size_t num_objs;
+    // every word of allocated before this one is full
+    size_t search_from;
     struct plisp_cons *objs;
     struct obj_allocs *next;
 };
 
 // pool for allocating cons sized objects
 static struct obj_allocs *conspool = NULL;
+static size_t npools = 0;
+// every pool before this one is full
+static struct obj_allocs *alloc_from = NULL;
+// maps the address of each pool's objects over POOL_BYTES to the pool
+static Pvoid_t pool_index = NULL;
 static plisp_t perm_root = plisp_nil;
-plisp_t *stack_bottom;
+// maps objects that point into another object's memory, like vector
+// slices, to the object that owns it
+static Pvoid_t owners = NULL;
+// maps custom objects to what frees their data
+static Pvoid_t finalizers = NULL;
+// maps the typesym of custom objects to the function that traces
+// their data
+static Pvoid_t tracers = NULL;
+// slots outside the heap that hold references, like profiling data
+static plisp_t **roots = NULL;
+static size_t nroots = 0;
+// memory to free at the next collection
+static void **retired = NULL;
+static size_t nretired = 0;
+
+// code waiting for no stack to return into it
+struct retired_code {
+    uintptr_t start, end;
+    void (*destroy)(void *);
+    void *arg;
+    bool running;
+};
+static struct retired_code *retired_code = NULL;
+static size_t nretired_code = 0;
+// found unused by the last collection, destroyed once the world runs
+static struct retired_code *dead_code = NULL;
+static size_t ndead_code = 0;
+static size_t collections = 0;
+__thread plisp_t *stack_bottom = NULL;
+
+/*
+every thread that allocates has a heap_thread, with a tlab: a word of
+some pool's allocated bitmap that it has claimed, and allocates the
+free cells of without locking. claiming one moves the pool's
+search_from past it, so no other thread allocates there until a
+collection takes every tlab back.
+
+registered threads are mutators, which run scheme. whichever one runs
+out of room collects: it takes the gc lock, asks the others to stop,
+and waits until each is stopped at a safepoint or blocking, with its
+registers saved and the top of its stack noted, to scan their stacks
+along with its own. threads that aren't registered, like the
+compiler's, are never stopped and never collect, and hold the gc lock
+whenever they touch the heap instead.
+*/
+
+struct heap_thread {
+    bool mutator;
+    struct obj_allocs *tlab_pool;
+    size_t tlab_word;
+    // a bit for each cell of the tlab that is free
+    size_t tlab_free;
+    // where its stack starts while it is stopped or blocking
+    void *top;
+    // its stack_bottom, which is thread local
+    plisp_t **bottom;
+    plisp_t **roots;
+    size_t nroots;
+    struct heap_thread *next;
+};
+
+static __thread struct heap_thread *self = NULL;
+// every heap_thread, guarded by world_lock
+static struct heap_thread *threads = NULL;
+// how many mutators aren't stopped or blocking
+static size_t running = 0;
+static pthread_mutex_t world_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t world_changed = PTHREAD_COND_INITIALIZER;
+bool plisp_stop_requested = false;
+// drops the heap_thread of a thread that never registered when it exits
+static pthread_key_t helper_key;
+
+static pthread_mutex_t gc_lock;
+// guards the pools and roots, since other threads allocate too
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void drop_helper(void *helper);
 
 
 // thanks jacob <3
@@ -34,6 +130,166 @@ void plisp_init_gc(void) {
            "%*u %*u %*u %lu", &sb);
     stack_bottom = (plisp_t *) sb;
     fclose(statfp);
+
+    // the compiler allocates while holding it
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&gc_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    pthread_key_create(&helper_key, drop_helper);
+    plisp_gc_register_thread();
+}
+
+/*
+threads
+*/
+
+static struct heap_thread *add_heap_thread(bool mutator) {
+    struct heap_thread *t = calloc(1, sizeof(struct heap_thread));
+    t->mutator = mutator;
+    t->bottom = &stack_bottom;
+
+    pthread_mutex_lock(&world_lock);
+    // a collection is walking the list
+    while (plisp_stop_requested) {
+        pthread_cond_wait(&world_changed, &world_lock);
+    }
+    t->next = threads;
+    threads = t;
+    if (mutator) {
+        running++;
+    }
+    pthread_mutex_unlock(&world_lock);
+
+    self = t;
+    return t;
+}
+
+// with world_lock held
+static void remove_heap_thread(struct heap_thread *t) {
+    for (struct heap_thread **p = &threads; *p != NULL; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    free(t->roots);
+    free(t);
+}
+
+static void drop_helper(void *helper) {
+    pthread_mutex_lock(&world_lock);
+    remove_heap_thread(helper);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void plisp_gc_register_thread(void) {
+    assert(self == NULL);
+    // the main thread's was read from /proc already
+    if (stack_bottom == NULL) {
+        pthread_attr_t attr;
+        void *addr;
+        size_t size;
+        pthread_getattr_np(pthread_self(), &attr);
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        stack_bottom = (plisp_t *) ((char *) addr + size);
+    }
+    add_heap_thread(true);
+}
+
+void plisp_gc_unregister_thread(void) {
+    assert(self != NULL && self->mutator);
+    // it blocks for good, so collections go ahead without it
+    plisp_enter_blocking();
+
+    pthread_mutex_lock(&world_lock);
+    while (plisp_stop_requested) {
+        pthread_cond_wait(&world_changed, &world_lock);
+    }
+    remove_heap_thread(self);
+    pthread_mutex_unlock(&world_lock);
+    self = NULL;
+}
+
+// the frame of a call is below every frame of its caller
+static __attribute__((noinline)) void note_top(struct heap_thread *t) {
+    t->top = __builtin_frame_address(0);
+    __asm__ volatile ("" ::: "memory");
+}
+
+void plisp_enter_blocking(void) {
+    struct heap_thread *t = self;
+    if (t == NULL || !t->mutator) {
+        return;
+    }
+
+    // spill callee saved registers into this frame, so they are
+    // scanned with the stack above note_top's frame. (setjmp would
+    // mangle some of them.)
+    __builtin_unwind_init();
+    note_top(t);
+
+    pthread_mutex_lock(&world_lock);
+    running--;
+    pthread_cond_broadcast(&world_changed);
+    pthread_mutex_unlock(&world_lock);
+}
+
+void plisp_leave_blocking(void) {
+    struct heap_thread *t = self;
+    if (t == NULL || !t->mutator) {
+        return;
+    }
+
+    pthread_mutex_lock(&world_lock);
+    while (plisp_stop_requested) {
+        pthread_cond_wait(&world_changed, &world_lock);
+    }
+    running++;
+    pthread_mutex_unlock(&world_lock);
+}
+
+void plisp_safepoint_slow(void) {
+    plisp_enter_blocking();
+    plisp_leave_blocking();
+}
+
+void plisp_gc_lock(void) {
+    // the holder might be collecting, and waiting for this thread to
+    // stop
+    if (pthread_mutex_trylock(&gc_lock) != 0) {
+        plisp_enter_blocking();
+        pthread_mutex_lock(&gc_lock);
+        plisp_leave_blocking();
+    }
+}
+
+bool plisp_gc_trylock(void) {
+    return pthread_mutex_trylock(&gc_lock) == 0;
+}
+
+void plisp_gc_unlock(void) {
+    pthread_mutex_unlock(&gc_lock);
+}
+
+void plisp_gc_stop_world(void) {
+    size_t mine = self != NULL && self->mutator ? 1 : 0;
+    pthread_mutex_lock(&world_lock);
+    __atomic_store_n(&plisp_stop_requested, true, __ATOMIC_RELAXED);
+    while (running > mine) {
+        pthread_cond_wait(&world_changed, &world_lock);
+    }
+    pthread_mutex_unlock(&world_lock);
+}
+
+void plisp_gc_start_world(void) {
+    pthread_mutex_lock(&world_lock);
+    __atomic_store_n(&plisp_stop_requested, false, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&world_changed);
+    pthread_mutex_unlock(&world_lock);
 }
 
 static bool get_bit(size_t *array, size_t i) {
@@ -49,9 +305,11 @@ static void set_bit(size_t *array, size_t i, bool val) {
     }
 }
 
-// gets the index of the first free 0 bit
-static size_t first_free(const size_t *array, size_t len) {
-    for (size_t i = 0; i < len/(sizeof(size_t) * 8); ++i) {
+// gets the index of the first free 0 bit, starting from the word
+// *from, which is moved past the words that are full
+static size_t first_free(const size_t *array, size_t len, size_t *from) {
+    for (size_t i = *from; i < len/(sizeof(size_t) * 8); ++i) {
+        *from = i;
         size_t block = array[i];
         if (block != 0xfffffffffffffffflu) {
             for (size_t j = 0; j < sizeof(size_t) * 8; ++j) {
@@ -64,19 +322,24 @@ static size_t first_free(const size_t *array, size_t len) {
     return len;
 }
 
-static void *allocate_or_null(struct obj_allocs *pool, bool freecdr) {
-    if (pool == NULL) {
-        return NULL;
-    }
-
-    size_t i = first_free(pool->allocated, pool->num_objs);
-    if (i == pool->num_objs) {
-        return allocate_or_null(pool->next, freecdr);
+// claims the word of free cells first_free finds next for t's tlab,
+// with alloc_lock held. returns false if the pools are full.
+static bool claim_tlab(struct heap_thread *t) {
+    for (; alloc_from != NULL; alloc_from = alloc_from->next) {
+        struct obj_allocs *pool = alloc_from;
+        size_t i = first_free(pool->allocated, pool->num_objs,
+                              &pool->search_from);
+        if (i != pool->num_objs) {
+            size_t word = i / (sizeof(size_t)*8);
+            t->tlab_pool = pool;
+            t->tlab_word = word;
+            t->tlab_free = ~pool->allocated[word];
+            // so nothing else allocates from it
+            pool->search_from = word + 1;
+            return true;
+        }
     }
-
-    set_bit(pool->allocated, i, 1);
-    set_bit(pool->freecdr, i, freecdr);
-    return pool->objs + i;
+    return false;
 }
 
 static struct obj_allocs *make_obj_allocs(struct obj_allocs *next) {
@@ -86,100 +349,176 @@ static struct obj_allocs *make_obj_allocs(struct obj_allocs *next) {
     //memset(allocs->grey_set, 0, sizeof(allocs->grey_set));
     memset(allocs->black_set, 0, sizeof(allocs->black_set));
     memset(allocs->freecdr, 0, sizeof(allocs->freecdr));
+    memset(allocs->owned, 0, sizeof(allocs->owned));
+    memset(allocs->finalized, 0, sizeof(allocs->finalized));
 
     allocs->num_objs = MAX_ALLOC_PAGE_SIZE; // TODO: maybe set this dynamically
-    allocs->objs = malloc(allocs->num_objs * sizeof(struct plisp_cons));
+    allocs->search_from = 0;
+    allocs->objs = aligned_alloc(POOL_BYTES, POOL_BYTES);
     allocs->next = next;
 
+    struct obj_allocs **slot;
+    JLI(slot, pool_index, (uintptr_t) allocs->objs / POOL_BYTES);
+    *slot = allocs;
+
     return allocs;
 }
 
+// finds the pool of obj, or sets *pool to NULL if it isn't in one
 static size_t get_pool_off(plisp_t obj, struct obj_allocs **pool) {
-    if (*pool == NULL) {
-        return 0;
-    }
     struct plisp_cons *ptr = (struct plisp_cons *) (obj & ~LOTAGS);
-    if (ptr >= (*pool)->objs && ptr < (*pool)->objs + (*pool)->num_objs) {
-        return ptr - (*pool)->objs;
-    } else {
-        *pool = (*pool)->next;
-        return get_pool_off(obj, pool);
+    struct obj_allocs **slot;
+    JLG(slot, pool_index, (uintptr_t) ptr / POOL_BYTES);
+    if (slot == NULL) {
+        *pool = NULL;
+        return 0;
     }
+    *pool = *slot;
+    return ptr - (*pool)->objs;
 }
 
 static void trace_object(plisp_t obj) {
-    if (!plisp_heap_allocated(obj)) {
+    // loops down the cdrs of lists rather than recursing, so long
+    // lists don't overflow the stack
+    while (plisp_heap_allocated(obj)) {
+        struct obj_allocs *pool;
+        size_t off = get_pool_off(obj, &pool);
+        if (pool == NULL) {
+            return;
+        }
+
+        assert(get_bit(pool->allocated, off));
+
+        if (get_bit(pool->black_set, off)) {
+            return;
+        }
+
+        set_bit(pool->black_set, off, 1);
+
+        if (get_bit(pool->owned, off)) {
+            plisp_t *owner;
+            JLG(owner, owners, obj & ~LOTAGS);
+            trace_object(*owner);
+        }
+
+        if (plisp_c_consp(obj)) {
+            trace_object(plisp_car(obj));
+            obj = plisp_cdr(obj);
+            continue;
+        } else if (plisp_c_customp(obj)) {
+            trace_object(plisp_custom_typesym(obj));
+            plisp_tracer_t *tracer;
+            JLG(tracer, tracers, plisp_custom_typesym(obj));
+            if (tracer != NULL) {
+                (*tracer)(plisp_custom_data(obj), trace_object);
+            }
+        } else if (plisp_c_closurep(obj)) {
+            struct plisp_closure_data *data = plisp_closure_data(obj);
+            if (data != NULL) {
+                for (size_t i = 0; i < data->length; ++i) {
+                    trace_object(data->objs[i]);
+                }
+            }
+        } else if (plisp_c_recordp(obj)) {
+            struct plisp_record *recptr = (void *) (obj & ~LOTAGS);
+            trace_object(recptr->rtd);
+            size_t nfields = plisp_record_type_nfields(recptr->rtd);
+            for (size_t i = 0; i < nfields; ++i) {
+                trace_object(recptr->fields[i]);
+            }
+        } else if (plisp_c_symbolp(obj)) {
+            //nothing to do here
+        } else if (plisp_c_vectorp(obj)) {
+            struct plisp_vector *vecptr = (void *) (obj & ~LOTAGS);
+            // the other vector types hold unboxed data, so their
+            // payloads are never scanned
+            if (vecptr->type == VEC_OBJ) {
+                for (size_t i = 0; i < vecptr->len; ++i) {
+                    trace_object(((plisp_t *) vecptr->vec)[i]);
+                }
+            }
+        }
+        // numbers hold no references
         return;
     }
+}
 
-    struct obj_allocs *pool = conspool;
-    size_t off = get_pool_off(obj, &pool);
-    if (pool == NULL) {
+// traces word if it refers to a live object. words on stacks can be
+// anything, including references to objects that have since been freed.
+// a stale word's object may since have been freed and reused for
+// another type, and a pointer to the cdr of a cons has the record tag,
+// so only words tagged the way their object was allocated are traced.
+static void trace_word(plisp_t word) {
+    if (!plisp_heap_allocated(word)) {
         return;
     }
-
-    assert(get_bit(pool->allocated, off));
-
-    if (get_bit(pool->black_set, off)) {
+    struct obj_allocs *pool;
+    size_t off = get_pool_off(word, &pool);
+    if (pool == NULL || !get_bit(pool->allocated, off)) {
         return;
     }
+    uint8_t tag = word & LOTAGS;
+    // symbols are strings with another tag
+    if (tag == pool->tags[off]
+        || (tag == LT_SYM && pool->tags[off] == LT_VECTOR)) {
+        trace_object(word);
+    }
+}
 
-    set_bit(pool->black_set, off, 1);
+// a frame running retired code leaves its return address on the
+// stack, whenever it has called something that might collect
+static void mark_running(uintptr_t word) {
+    for (size_t i = 0; i < nretired_code; ++i) {
+        if (word >= retired_code[i].start && word < retired_code[i].end) {
+            retired_code[i].running = true;
+        }
+    }
+}
 
-    if (plisp_c_consp(obj)) {
-        trace_object(plisp_car(obj));
-        trace_object(plisp_cdr(obj));
-    } else if (plisp_c_customp(obj)) {
-        trace_object(plisp_custom_typesym(obj));
-    } else if (plisp_c_closurep(obj)) {
-        struct plisp_closure_data *data = plisp_closure_data(obj);
-        if (data != NULL) {
-            for (size_t i = 0; i < data->length; ++i) {
-                trace_object(data->objs[i]);
-            }
+void plisp_gc_scan(void *start, void *end) {
+    for (plisp_t *n = start; n < (plisp_t *) end; ++n) {
+        trace_word(*n);
+        if (nretired_code > 0) {
+            mark_running(*n);
         }
-    } else if (plisp_c_symbolp(obj)) {
-        //nothing to do here
-    } else if (plisp_c_vectorp(obj)) {
-        //TODO: only scan if it's a vector of objects
     }
-    // add numbers when needed
 }
 
 static void trace_stack(void) {
     plisp_t stack_top;
-    for (plisp_t *n = &stack_top; n < stack_bottom; ++n) {
-        trace_object(*n);
-    }
+    plisp_gc_scan(&stack_top, stack_bottom);
 }
 
-#define PUSH_REGS                               \
-    asm("pushq %rax");                          \
-    asm("pushq %rbx");                          \
-    asm("pushq %rcx");                          \
-    asm("pushq %rdx");                          \
-    asm("pushq %rsi");                          \
-    asm("pushq %rdi");                          \
-    asm("pushq %r8");                           \
-    asm("pushq %r9");                           \
-    asm("pushq %r10");                          \
-    asm("pushq %r11");                          \
-    asm("pushq %r12");                          \
-    asm("pushq %r13");                          \
-    asm("pushq %r14");                          \
-    asm("pushq %r15");                          \
-
-
-size_t plisp_collect_garbage(void) {
+// with every other mutator stopped, and world_lock and alloc_lock held
+static size_t collect(void) {
     for (struct obj_allocs *pool = conspool; pool != NULL; pool = pool->next) {
         memset(pool->black_set, 0, sizeof(pool->black_set));
+        pool->search_from = 0;
+    }
+    alloc_from = conspool;
+    collections++;
+    for (size_t i = 0; i < nretired_code; ++i) {
+        retired_code[i].running = false;
     }
 
     trace_object(perm_root);
+    for (size_t i = 0; i < nroots; ++i) {
+        trace_object(*roots[i]);
+    }
+
+    for (struct heap_thread *t = threads; t != NULL; t = t->next) {
+        t->tlab_free = 0;
+        for (size_t i = 0; i < t->nroots; ++i) {
+            trace_object(*t->roots[i]);
+        }
+        if (t->mutator && t != self) {
+            plisp_gc_scan(t->top, *t->bottom);
+        }
+    }
 
-    // push registers, so they will be scanned with the stack
-    //PUSH_REGS;
-    // BROKEN
+    // spill callee saved registers into this frame, so they will
+    // be scanned with the stack
+    __builtin_unwind_init();
 
     trace_stack();
 
@@ -189,29 +528,143 @@ size_t plisp_collect_garbage(void) {
             if (!get_bit(pool->black_set, i) && get_bit(pool->allocated, i)) {
                 ++freed;
                 set_bit(pool->allocated, i, 0);
-                if (get_bit(pool->freecdr, i)) {
+                if (get_bit(pool->finalized, i)) {
+                    plisp_finalizer_t *finalize;
+                    JLG(finalize, finalizers, (uintptr_t) (pool->objs + i));
+                    (*finalize)((void *) pool->objs[i].cdr);
+                    int Rc_int;
+                    JLD(Rc_int, finalizers, (uintptr_t) (pool->objs + i));
+                    set_bit(pool->finalized, i, 0);
+                } else if (get_bit(pool->freecdr, i)) {
                     free((void *) pool->objs[i].cdr);
                 }
+                if (get_bit(pool->owned, i)) {
+                    int Rc_int;
+                    JLD(Rc_int, owners, (uintptr_t) (pool->objs + i));
+                    set_bit(pool->owned, i, 0);
+                }
             }
         }
     }
 
+    for (size_t i = 0; i < nretired; ++i) {
+        free(retired[i]);
+    }
+    nretired = 0;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < nretired_code; ++i) {
+        if (retired_code[i].running) {
+            retired_code[kept++] = retired_code[i];
+        } else {
+            dead_code = realloc(dead_code,
+                                (ndead_code + 1) * sizeof(struct retired_code));
+            dead_code[ndead_code++] = retired_code[i];
+        }
+    }
+    nretired_code = kept;
+
+    return freed;
+}
+
+static void grow_heap(size_t pools) {
+    for (size_t i = 0; i < pools; ++i) {
+        conspool = make_obj_allocs(conspool);
+        npools++;
+    }
+    alloc_from = conspool;
+}
+
+// stops the other mutators and collects, unless a collection has
+// happened since the caller saw seen of them. when most of the heap is
+// live another collection would soon follow, so if grow is set it
+// grows the heap in proportion to its size instead.
+static size_t collect_world(size_t seen, bool grow) {
+    assert(self != NULL && self->mutator);
+    plisp_gc_lock();
+    pthread_mutex_lock(&world_lock);
+    if (collections != seen) {
+        pthread_mutex_unlock(&world_lock);
+        plisp_gc_unlock();
+        return 0;
+    }
+
+    __atomic_store_n(&plisp_stop_requested, true, __ATOMIC_RELAXED);
+    while (running > 1) {
+        pthread_cond_wait(&world_changed, &world_lock);
+    }
+
+    pthread_mutex_lock(&alloc_lock);
+    size_t freed = collect();
+    if (grow && freed < npools * MAX_ALLOC_PAGE_SIZE / 4) {
+        grow_heap(npools / 2 + 1);
+    }
+    pthread_mutex_unlock(&alloc_lock);
+
+    __atomic_store_n(&plisp_stop_requested, false, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&world_changed);
+    pthread_mutex_unlock(&world_lock);
+
+    // destroying code may unroot things, which takes the alloc lock
+    for (size_t i = 0; i < ndead_code; ++i) {
+        dead_code[i].destroy(dead_code[i].arg);
+    }
+    ndead_code = 0;
+    plisp_gc_unlock();
+
     return freed;
 }
 
+size_t plisp_collect_garbage(void) {
+    pthread_mutex_lock(&alloc_lock);
+    size_t seen = collections;
+    pthread_mutex_unlock(&alloc_lock);
+    return collect_world(seen, false);
+}
+
+static void refill_tlab(struct heap_thread *t) {
+    pthread_mutex_lock(&alloc_lock);
+    bool claimed = claim_tlab(t);
+    size_t seen = collections;
+    pthread_mutex_unlock(&alloc_lock);
+
+    if (!claimed && t->mutator) {
+        collect_world(seen, true);
+        pthread_mutex_lock(&alloc_lock);
+        claimed = claim_tlab(t);
+        pthread_mutex_unlock(&alloc_lock);
+    }
+
+    if (!claimed) {
+        pthread_mutex_lock(&alloc_lock);
+        grow_heap(1);
+        claimed = claim_tlab(t);
+        pthread_mutex_unlock(&alloc_lock);
+        assert(claimed);
+    }
+}
 
 plisp_t plisp_alloc_obj(uintptr_t tags, bool freecdr) {
-    void *ptr = allocate_or_null(conspool, freecdr);
-    if (ptr == NULL) {
-        plisp_collect_garbage();
-        ptr = allocate_or_null(conspool, freecdr);
-        if (ptr == NULL) {
-            conspool = make_obj_allocs(conspool);
-            ptr = allocate_or_null(conspool, freecdr);
-            assert(ptr != NULL);
-        }
+    struct heap_thread *t = self;
+    if (t == NULL) {
+        t = add_heap_thread(false);
+        pthread_setspecific(helper_key, t);
+    } else if (t->mutator) {
+        plisp_safepoint();
+    }
+
+    if (t->tlab_free == 0) {
+        refill_tlab(t);
     }
-    return ((plisp_t) ptr) | tags;
+    size_t bit = __builtin_ctzl(t->tlab_free);
+    t->tlab_free &= t->tlab_free - 1;
+
+    struct obj_allocs *pool = t->tlab_pool;
+    size_t i = t->tlab_word * (sizeof(size_t)*8) + bit;
+    set_bit(pool->allocated, i, 1);
+    set_bit(pool->freecdr, i, freecdr);
+    pool->tags[i] = tags & LOTAGS;
+    return ((plisp_t) (pool->objs + i)) | tags;
 }
 
 bool plisp_heap_allocated(plisp_t obj) {
@@ -221,11 +674,119 @@ bool plisp_heap_allocated(plisp_t obj) {
          || plisp_c_vectorp(obj)
          || plisp_c_stringp(obj)
          || plisp_c_customp(obj)
-         || plisp_c_closurep(obj));
+         || plisp_c_closurep(obj)
+         || plisp_c_recordp(obj)
+         || (obj & LOTAGS) == LT_NUMBER);
 }
 
 
 void plisp_gc_permanent(plisp_t obj) {
     assert(plisp_heap_allocated(obj));
-    perm_root = plisp_cons(obj, perm_root);
+    plisp_t cell = plisp_cons(obj, plisp_nil);
+
+    pthread_mutex_lock(&alloc_lock);
+    struct plisp_cons *cellptr = (void *) (cell & ~LOTAGS);
+    cellptr->cdr = perm_root;
+    perm_root = cell;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+void plisp_gc_set_owner(plisp_t obj, plisp_t owner) {
+    // the owner of an owned object owns whatever it points into, so
+    // chains of slices never form
+    owner = plisp_gc_owner(owner);
+
+    pthread_mutex_lock(&alloc_lock);
+    struct obj_allocs *pool;
+    size_t off = get_pool_off(obj, &pool);
+    assert(pool != NULL && !get_bit(pool->freecdr, off));
+    set_bit(pool->owned, off, 1);
+
+    plisp_t *slot;
+    JLI(slot, owners, obj & ~LOTAGS);
+    *slot = owner;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+void plisp_gc_finalizer(plisp_t obj, plisp_finalizer_t finalize) {
+    assert(plisp_c_customp(obj));
+
+    pthread_mutex_lock(&alloc_lock);
+    struct obj_allocs *pool;
+    size_t off = get_pool_off(obj, &pool);
+    set_bit(pool->finalized, off, 1);
+
+    plisp_finalizer_t *slot;
+    JLI(slot, finalizers, obj & ~LOTAGS);
+    *slot = finalize;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+plisp_t plisp_gc_owner(plisp_t obj) {
+    pthread_mutex_lock(&alloc_lock);
+    plisp_t *owner;
+    JLG(owner, owners, obj & ~LOTAGS);
+    plisp_t res = owner != NULL ? *owner : obj;
+    pthread_mutex_unlock(&alloc_lock);
+    return res;
+}
+
+void plisp_gc_custom_tracer(plisp_t typesym, plisp_tracer_t tracer) {
+    pthread_mutex_lock(&alloc_lock);
+    plisp_tracer_t *slot;
+    JLI(slot, tracers, typesym);
+    *slot = tracer;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+size_t plisp_gc_moves(void) {
+    // nothing ever moves yet
+    return 0;
+}
+
+void plisp_gc_root(plisp_t *slot) {
+    pthread_mutex_lock(&alloc_lock);
+    roots = realloc(roots, (nroots + 1) * sizeof(plisp_t *));
+    roots[nroots++] = slot;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+void plisp_gc_unroot(plisp_t *slot) {
+    pthread_mutex_lock(&alloc_lock);
+    for (size_t i = 0; i < nroots; ++i) {
+        if (roots[i] == slot) {
+            roots[i] = roots[--nroots];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+void plisp_gc_thread_root(plisp_t *slot) {
+    struct heap_thread *t = self;
+    assert(t != NULL && t->mutator);
+    t->roots = realloc(t->roots, (t->nroots + 1) * sizeof(plisp_t *));
+    t->roots[t->nroots++] = slot;
+}
+
+void plisp_gc_retire(void *ptr) {
+    pthread_mutex_lock(&alloc_lock);
+    retired = realloc(retired, (nretired + 1) * sizeof(void *));
+    retired[nretired++] = ptr;
+    pthread_mutex_unlock(&alloc_lock);
+}
+
+void plisp_gc_retire_code(void *start, size_t size,
+                          void (*destroy)(void *), void *arg) {
+    pthread_mutex_lock(&alloc_lock);
+    retired_code = realloc(retired_code,
+                           (nretired_code + 1) * sizeof(struct retired_code));
+    retired_code[nretired_code++] = (struct retired_code) {
+        .start = (uintptr_t) start,
+        .end = (uintptr_t) start + size,
+        .destroy = destroy,
+        .arg = arg,
+        .running = false
+    };
+    pthread_mutex_unlock(&alloc_lock);
 }
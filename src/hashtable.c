@@ -0,0 +1,611 @@
+#include <plisp/hashtable.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/number.h>
+#include <plisp/read.h>
+#include <plisp/simd.h>
+#include <plisp/text.h>
+#include <plisp/toplevel.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+hash tables are open addressed with robin hood probing: every key sits
+as close to its home slot as it can, and an insert that has probed
+further than the key in its way takes that slot and carries the other
+key on. that keeps probes short at 7/8 full, lets a lookup stop as
+soon as it has probed further than the key it is looking at, and lets
+a delete shift the following keys back instead of leaving tombstones.
+
+every slot keeps the full hash of its key, so probes compare hashes
+before calling the equality predicate and growing never rehashes a
+key. keys hashed by address, which is anything that isn't a number,
+char or the contents of a string, pair or vector, hash differently
+once the collector moves them, so a table holding any remembers
+plisp_gc_moves and rehashes everything when it changes.
+
+a table is one malloc block hung off a custom object, so the
+collector frees it with the object, and growing just swaps the block.
+*/
+
+// the top bit of the hash of an occupied slot is always set, so empty
+// slots are the ones with a hash of 0
+#define OCCUPIED (1llu << 63)
+#define MIN_CAPACITY 8
+// how far equal hashes look into nested pairs and vectors, and how
+// many elements of each they look at
+#define EQUAL_DEPTH 4
+#define EQUAL_WIDTH 16
+
+struct slot {
+    uint64_t hash;
+    plisp_t key;
+    plisp_t value;
+};
+
+struct table {
+    enum plisp_hash_kind kind;
+    // whether any key is hashed by address
+    bool address_keys;
+    // plisp_gc_moves when the keys were hashed
+    size_t moves;
+    size_t count;
+    size_t mask;
+    struct slot slots[];
+};
+
+static plisp_t hash_table_sym;
+// the equivalence predicates make-hash-table takes, by kind
+static plisp_t equiv_syms[4];
+
+static void trace_table(void *data, void (*trace)(plisp_t));
+
+static plisp_t make_table(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t capacity);
+static plisp_t make_hash_table(plisp_t *clos, size_t nargs, plisp_t equiv,
+                               plisp_t capacity);
+static plisp_t hash_table_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t hash_table_ref(plisp_t *clos, size_t nargs, plisp_t table,
+                              plisp_t key, plisp_t fail);
+static plisp_t hash_table_ref_default(plisp_t *clos, size_t nargs,
+                                      plisp_t table, plisp_t key,
+                                      plisp_t dflt);
+static plisp_t hash_table_set(plisp_t *clos, size_t nargs, plisp_t table,
+                              plisp_t key, plisp_t value);
+static plisp_t hash_table_update(plisp_t *clos, size_t nargs, plisp_t table,
+                                 plisp_t key, plisp_t proc, plisp_t fail);
+static plisp_t hash_table_update_default(plisp_t *clos, size_t nargs,
+                                         plisp_t table, plisp_t key,
+                                         plisp_t proc, plisp_t dflt);
+static plisp_t hash_table_delete(plisp_t *clos, size_t nargs, plisp_t table,
+                                 plisp_t key);
+static plisp_t hash_table_contains(plisp_t *clos, size_t nargs,
+                                   plisp_t table, plisp_t key);
+static plisp_t hash_table_count(plisp_t *clos, size_t nargs, plisp_t table);
+static plisp_t hash_table_keys(plisp_t *clos, size_t nargs, plisp_t table);
+static plisp_t hash_table_values(plisp_t *clos, size_t nargs, plisp_t table);
+static plisp_t hash_table_to_alist(plisp_t *clos, size_t nargs,
+                                   plisp_t table);
+static plisp_t hash_table_walk(plisp_t *clos, size_t nargs, plisp_t table,
+                               plisp_t proc);
+static plisp_t hash_table_fold(plisp_t *clos, size_t nargs, plisp_t table,
+                               plisp_t kons, plisp_t knil);
+
+static void define_kind_builtin(enum plisp_hash_kind kind, const char *name) {
+    struct plisp_closure_data *data = malloc(sizeof(struct plisp_closure_data)
+                                             + sizeof(plisp_t));
+    data->length = 1;
+    data->objs[0] = plisp_make_fixnum(kind);
+    plisp_define_builtin_data(name, (plisp_fn_t) make_table, data);
+}
+
+void plisp_init_hashtable(void) {
+    hash_table_sym = plisp_intern(plisp_make_symbol("hash-table"));
+    plisp_gc_custom_tracer(hash_table_sym, trace_table);
+
+    define_kind_builtin(HASH_EQ, "make-eq-hash-table");
+    define_kind_builtin(HASH_EQV, "make-eqv-hash-table");
+    define_kind_builtin(HASH_EQUAL, "make-equal-hash-table");
+    define_kind_builtin(HASH_STRING, "make-string-hash-table");
+
+    equiv_syms[HASH_EQ] = plisp_intern(plisp_make_symbol("eq?"));
+    equiv_syms[HASH_EQV] = plisp_intern(plisp_make_symbol("eqv?"));
+    equiv_syms[HASH_EQUAL] = plisp_intern(plisp_make_symbol("equal?"));
+    equiv_syms[HASH_STRING] = plisp_intern(plisp_make_symbol("string=?"));
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("make-hash-table", make_hash_table);
+
+    plisp_define_builtin("hash-table?", hash_table_p);
+    plisp_define_builtin("hash-table-ref", hash_table_ref);
+    plisp_define_builtin("hash-table-ref/default", hash_table_ref_default);
+    plisp_define_builtin("hash-table-set!", hash_table_set);
+    plisp_define_builtin("hash-table-update!", hash_table_update);
+    plisp_define_builtin("hash-table-update!/default",
+                         hash_table_update_default);
+    plisp_define_builtin("hash-table-delete!", hash_table_delete);
+    plisp_define_builtin("hash-table-contains?", hash_table_contains);
+    plisp_define_builtin("hash-table-count", hash_table_count);
+    plisp_define_builtin("hash-table-keys", hash_table_keys);
+    plisp_define_builtin("hash-table-values", hash_table_values);
+    plisp_define_builtin("hash-table->alist", hash_table_to_alist);
+    plisp_define_builtin("hash-table-walk", hash_table_walk);
+    plisp_define_builtin("hash-table-fold", hash_table_fold);
+
+    #pragma GCC diagnostic pop
+}
+
+static void trace_table(void *data, void (*trace)(plisp_t)) {
+    struct table *tab = data;
+    for (size_t i = 0; i <= tab->mask; ++i) {
+        if (tab->slots[i].hash != 0) {
+            trace(tab->slots[i].key);
+            trace(tab->slots[i].value);
+        }
+    }
+}
+
+static struct table *alloc_table(enum plisp_hash_kind kind, size_t capacity) {
+    struct table *tab = calloc(1, sizeof(struct table)
+                               + capacity * sizeof(struct slot));
+    tab->kind = kind;
+    tab->moves = plisp_gc_moves();
+    tab->mask = capacity - 1;
+    return tab;
+}
+
+static void set_table(plisp_t table, struct table *tab) {
+    struct plisp_custom *customptr = (void *) (table & ~LOTAGS);
+    customptr->data = tab;
+}
+
+// whether obj is stored in its word rather than on the heap
+static bool immediatep(plisp_t obj) {
+    return plisp_c_fixnump(obj) || (obj & LOTAGS) == LT_HITAGS
+        || plisp_c_nullp(obj);
+}
+
+static uint64_t hash_address(plisp_t obj, bool *addressed) {
+    if (!immediatep(obj)) {
+        *addressed = true;
+    }
+    return plisp_hash_word(obj);
+}
+
+static uint64_t hash_combine(uint64_t hash, uint64_t elem) {
+    return plisp_hash_word(hash * 31 + elem);
+}
+
+// hashes just enough of obj that objects that are equal always hash
+// the same
+static uint64_t hash_equal(plisp_t obj, int depth, bool *addressed) {
+    if (plisp_c_stringp(obj)) {
+        return plisp_simd_hash((const uint8_t *) plisp_string_value(obj),
+                               plisp_c_stringlen(obj));
+    } else if (plisp_c_numberp(obj)) {
+        return plisp_number_hash(obj);
+    } else if (depth == 0 && (plisp_c_consp(obj) || plisp_c_vectorp(obj))) {
+        return 0;
+    } else if (plisp_c_consp(obj)) {
+        uint64_t hash = 1;
+        for (size_t i = 0; i < EQUAL_WIDTH && plisp_c_consp(obj); ++i) {
+            hash = hash_combine(hash, hash_equal(plisp_car(obj), depth - 1,
+                                                 addressed));
+            obj = plisp_cdr(obj);
+        }
+        // the rest of a long list is left out
+        if (!plisp_c_consp(obj)) {
+            hash = hash_combine(hash, hash_equal(obj, depth - 1, addressed));
+        }
+        return hash;
+    } else if (plisp_c_vectorp(obj)) {
+        size_t len = plisp_vector_c_length(obj);
+        uint64_t hash = plisp_hash_word(len);
+        for (size_t i = 0; i < len && i < EQUAL_WIDTH; ++i) {
+            hash = hash_combine(hash, hash_equal(plisp_vector_ref(obj, i),
+                                                 depth - 1, addressed));
+        }
+        return hash;
+    }
+    return hash_address(obj, addressed);
+}
+
+uint64_t plisp_hash_key(enum plisp_hash_kind kind, plisp_t key,
+                        bool *addressed) {
+    switch (kind) {
+    case HASH_EQ:
+        return hash_address(key, addressed) | OCCUPIED;
+    case HASH_EQV:
+        if (plisp_c_numberp(key)) {
+            return plisp_number_hash(key) | OCCUPIED;
+        }
+        return hash_address(key, addressed) | OCCUPIED;
+    case HASH_EQUAL:
+        return hash_equal(key, EQUAL_DEPTH, addressed) | OCCUPIED;
+    case HASH_STRING:
+        plisp_assert(plisp_c_stringp(key));
+        return hash_equal(key, 0, addressed) | OCCUPIED;
+    }
+    assert(false);
+}
+
+bool plisp_hash_keys_equal(enum plisp_hash_kind kind, plisp_t a, plisp_t b) {
+    switch (kind) {
+    case HASH_EQ:
+        return a == b;
+    case HASH_EQV:
+        return a == b || (plisp_c_numberp(a) && plisp_c_numberp(b)
+                          && plisp_num_eqv(a, b));
+    case HASH_EQUAL:
+        return plisp_c_equal(a, b);
+    case HASH_STRING:
+        return plisp_c_string_equal(a, b);
+    }
+    assert(false);
+}
+
+// how far the key in slot idx is from its home slot
+static size_t distance(struct table *tab, uint64_t hash, size_t idx) {
+    return (idx - hash) & tab->mask;
+}
+
+// puts a key that isn't in tab yet into it. tab must have room.
+static void insert(struct table *tab, uint64_t hash, plisp_t key,
+                   plisp_t value) {
+    struct slot carry = { hash, key, value };
+    size_t dist = 0;
+    for (size_t i = hash & tab->mask;; i = (i + 1) & tab->mask, ++dist) {
+        struct slot *slot = &tab->slots[i];
+        if (slot->hash == 0) {
+            *slot = carry;
+            tab->count++;
+            return;
+        }
+
+        // take the slot from a key nearer its home, and find that key
+        // another one
+        size_t theirs = distance(tab, slot->hash, i);
+        if (theirs < dist) {
+            struct slot tmp = *slot;
+            *slot = carry;
+            carry = tmp;
+            dist = theirs;
+        }
+    }
+}
+
+// a copy of tab with room for capacity keys. rehash computes the
+// hashes again rather than reusing them.
+static struct table *rebuild(struct table *tab, size_t capacity,
+                             bool rehash) {
+    struct table *fresh = alloc_table(tab->kind, capacity);
+    fresh->address_keys = tab->address_keys && !rehash;
+    for (size_t i = 0; i <= tab->mask; ++i) {
+        struct slot *slot = &tab->slots[i];
+        if (slot->hash == 0) {
+            continue;
+        }
+
+        uint64_t hash = slot->hash;
+        if (rehash) {
+            hash = plisp_hash_key(tab->kind, slot->key,
+                                  &fresh->address_keys);
+        }
+        insert(fresh, hash, slot->key, slot->value);
+    }
+    free(tab);
+    return fresh;
+}
+
+// the table of table, rehashed first if the collector has moved its
+// keys since they were hashed
+static struct table *get_table(plisp_t table) {
+    if (!plisp_c_hash_tablep(table)) {
+        fprintf(stderr, "error: expected a hash table, got ");
+        plisp_c_write(stderr, table);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+
+    struct table *tab = plisp_custom_data(table);
+    if (tab->address_keys && tab->moves != plisp_gc_moves()) {
+        tab = rebuild(tab, tab->mask + 1, true);
+        set_table(table, tab);
+    }
+    return tab;
+}
+
+// the slot index of key, or SIZE_MAX if it isn't in tab
+static size_t find(struct table *tab, plisp_t key) {
+    bool addressed = false;
+    uint64_t hash = plisp_hash_key(tab->kind, key, &addressed);
+    size_t dist = 0;
+    for (size_t i = hash & tab->mask;; i = (i + 1) & tab->mask, ++dist) {
+        struct slot *slot = &tab->slots[i];
+        // robin hood insertion would have put key here before a key
+        // nearer its home
+        if (slot->hash == 0 || distance(tab, slot->hash, i) < dist) {
+            return SIZE_MAX;
+        }
+        if (slot->hash == hash
+            && plisp_hash_keys_equal(tab->kind, slot->key, key)) {
+            return i;
+        }
+    }
+}
+
+bool plisp_c_hash_tablep(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == hash_table_sym;
+}
+
+plisp_t plisp_make_hash_table(enum plisp_hash_kind kind, size_t capacity) {
+    // round up to a power of two that holds capacity at 7/8 full
+    size_t slots = MIN_CAPACITY;
+    while (slots / 8 * 7 < capacity) {
+        slots *= 2;
+    }
+    return plisp_make_custom(hash_table_sym, alloc_table(kind, slots));
+}
+
+bool plisp_hash_table_lookup(plisp_t table, plisp_t key, plisp_t *out) {
+    struct table *tab = get_table(table);
+    size_t i = find(tab, key);
+    if (i == SIZE_MAX) {
+        return false;
+    }
+    *out = tab->slots[i].value;
+    return true;
+}
+
+void plisp_hash_table_set(plisp_t table, plisp_t key, plisp_t value) {
+    struct table *tab = get_table(table);
+    size_t i = find(tab, key);
+    if (i != SIZE_MAX) {
+        tab->slots[i].value = value;
+        return;
+    }
+
+    size_t capacity = tab->mask + 1;
+    if ((tab->count + 1) * 8 > capacity * 7) {
+        tab = rebuild(tab, capacity * 2, false);
+        set_table(table, tab);
+    }
+    uint64_t hash = plisp_hash_key(tab->kind, key, &tab->address_keys);
+    insert(tab, hash, key, value);
+}
+
+bool plisp_hash_table_delete(plisp_t table, plisp_t key) {
+    struct table *tab = get_table(table);
+    size_t i = find(tab, key);
+    if (i == SIZE_MAX) {
+        return false;
+    }
+
+    // shift the keys after it back until one is already home
+    size_t next = (i + 1) & tab->mask;
+    while (tab->slots[next].hash != 0
+           && distance(tab, tab->slots[next].hash, next) != 0) {
+        tab->slots[i] = tab->slots[next];
+        i = next;
+        next = (next + 1) & tab->mask;
+    }
+    tab->slots[i].hash = 0;
+    tab->count--;
+    return true;
+}
+
+size_t plisp_hash_table_count(plisp_t table) {
+    return get_table(table)->count;
+}
+
+static size_t capacity_value(plisp_t capacity) {
+    plisp_assert(plisp_c_fixnump(capacity)
+                 && plisp_fixnum_value(capacity) >= 0);
+    return plisp_fixnum_value(capacity);
+}
+
+static plisp_t make_table(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t capacity) {
+    plisp_assert(nargs == 0 || nargs == 1);
+    size_t slots = nargs == 1 ? capacity_value(capacity) : 0;
+    return plisp_make_hash_table(plisp_fixnum_value(kind->objs[0]), slots);
+}
+
+// takes the equivalence predicate first, which is one of eq?, eqv?,
+// equal? or string=? as they are currently defined, then the capacity.
+// either may be left out, and the default is equal?
+static plisp_t make_hash_table(plisp_t *clos, size_t nargs, plisp_t equiv,
+                               plisp_t capacity) {
+    plisp_assert(nargs <= 2);
+    if (nargs == 1 && plisp_c_fixnump(equiv)) {
+        return plisp_make_hash_table(HASH_EQUAL, capacity_value(equiv));
+    }
+
+    enum plisp_hash_kind kind = HASH_EQUAL;
+    if (nargs >= 1) {
+        size_t nkinds = sizeof(equiv_syms) / sizeof(equiv_syms[0]);
+        size_t i = 0;
+        while (i < nkinds && *plisp_toplevel_ref(equiv_syms[i]) != equiv) {
+            ++i;
+        }
+        if (i == nkinds) {
+            fprintf(stderr, "error: make-hash-table takes eq?, eqv?, "
+                    "equal? or string=?, not ");
+            plisp_c_write(stderr, equiv);
+            fprintf(stderr, "\n");
+        }
+        plisp_assert(i < nkinds);
+        kind = i;
+    }
+    size_t slots = nargs == 2 ? capacity_value(capacity) : 0;
+    return plisp_make_hash_table(kind, slots);
+}
+
+static plisp_t hash_table_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_hash_tablep(obj));
+}
+
+static void missing_key(plisp_t key) {
+    fprintf(stderr, "error: key not in hash table: ");
+    plisp_c_write(stderr, key);
+    fprintf(stderr, "\n");
+    assert(false);
+}
+
+static plisp_t hash_table_ref(plisp_t *clos, size_t nargs, plisp_t table,
+                              plisp_t key, plisp_t fail) {
+    plisp_assert(nargs == 2 || nargs == 3);
+    plisp_t value;
+    if (plisp_hash_table_lookup(table, key, &value)) {
+        return value;
+    } else if (nargs == 3) {
+        return plisp_call_closure(fail, 0, NULL);
+    }
+    missing_key(key);
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_ref_default(plisp_t *clos, size_t nargs,
+                                      plisp_t table, plisp_t key,
+                                      plisp_t dflt) {
+    plisp_assert(nargs == 3);
+    plisp_t value;
+    if (plisp_hash_table_lookup(table, key, &value)) {
+        return value;
+    }
+    return dflt;
+}
+
+static plisp_t hash_table_set(plisp_t *clos, size_t nargs, plisp_t table,
+                              plisp_t key, plisp_t value) {
+    plisp_assert(nargs == 3);
+    plisp_hash_table_set(table, key, value);
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_update(plisp_t *clos, size_t nargs, plisp_t table,
+                                 plisp_t key, plisp_t proc, plisp_t fail) {
+    plisp_assert(nargs == 3 || nargs == 4);
+    plisp_t value;
+    if (!plisp_hash_table_lookup(table, key, &value)) {
+        if (nargs == 3) {
+            missing_key(key);
+        }
+        value = plisp_call_closure(fail, 0, NULL);
+    }
+
+    // proc may have changed the table, so look key up again to set it
+    value = plisp_call_closure(proc, 1, &value);
+    plisp_hash_table_set(table, key, value);
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_update_default(plisp_t *clos, size_t nargs,
+                                         plisp_t table, plisp_t key,
+                                         plisp_t proc, plisp_t dflt) {
+    plisp_assert(nargs == 4);
+    plisp_t value;
+    if (!plisp_hash_table_lookup(table, key, &value)) {
+        value = dflt;
+    }
+    value = plisp_call_closure(proc, 1, &value);
+    plisp_hash_table_set(table, key, value);
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_delete(plisp_t *clos, size_t nargs, plisp_t table,
+                                 plisp_t key) {
+    plisp_assert(nargs == 2);
+    plisp_hash_table_delete(table, key);
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_contains(plisp_t *clos, size_t nargs,
+                                   plisp_t table, plisp_t key) {
+    plisp_assert(nargs == 2);
+    plisp_t value;
+    return plisp_make_bool(plisp_hash_table_lookup(table, key, &value));
+}
+
+static plisp_t hash_table_count(plisp_t *clos, size_t nargs, plisp_t table) {
+    plisp_assert(nargs == 1);
+    return plisp_make_fixnum(plisp_hash_table_count(table));
+}
+
+enum collect {
+    COLLECT_KEYS,
+    COLLECT_VALUES,
+    COLLECT_PAIRS,
+};
+
+// consing can't change the table, but it can collect, and a collector
+// that moves would rehash the table under us, so the table is fetched
+// again for every slot
+static plisp_t collect(plisp_t table, enum collect what) {
+    plisp_t lst = plisp_nil;
+    for (size_t i = 0; i <= get_table(table)->mask; ++i) {
+        struct slot slot = get_table(table)->slots[i];
+        if (slot.hash == 0) {
+            continue;
+        }
+
+        plisp_t elem = slot.key;
+        if (what == COLLECT_VALUES) {
+            elem = slot.value;
+        } else if (what == COLLECT_PAIRS) {
+            elem = plisp_cons(slot.key, slot.value);
+        }
+        lst = plisp_cons(elem, lst);
+    }
+    return lst;
+}
+
+static plisp_t hash_table_keys(plisp_t *clos, size_t nargs, plisp_t table) {
+    plisp_assert(nargs == 1);
+    return collect(table, COLLECT_KEYS);
+}
+
+static plisp_t hash_table_values(plisp_t *clos, size_t nargs, plisp_t table) {
+    plisp_assert(nargs == 1);
+    return collect(table, COLLECT_VALUES);
+}
+
+static plisp_t hash_table_to_alist(plisp_t *clos, size_t nargs,
+                                   plisp_t table) {
+    plisp_assert(nargs == 1);
+    return collect(table, COLLECT_PAIRS);
+}
+
+// walking and folding call out to scheme, which may change the table
+// however it likes, so they walk a snapshot of its pairs
+static plisp_t hash_table_walk(plisp_t *clos, size_t nargs, plisp_t table,
+                               plisp_t proc) {
+    plisp_assert(nargs == 2);
+    for (plisp_t lst = collect(table, COLLECT_PAIRS); !plisp_c_nullp(lst);
+         lst = plisp_cdr(lst)) {
+        plisp_t args[] = { plisp_car(plisp_car(lst)),
+                           plisp_cdr(plisp_car(lst)) };
+        plisp_call_closure(proc, 2, args);
+    }
+    return plisp_unspec;
+}
+
+static plisp_t hash_table_fold(plisp_t *clos, size_t nargs, plisp_t table,
+                               plisp_t kons, plisp_t knil) {
+    plisp_assert(nargs == 3);
+    plisp_t acc = knil;
+    for (plisp_t lst = collect(table, COLLECT_PAIRS); !plisp_c_nullp(lst);
+         lst = plisp_cdr(lst)) {
+        plisp_t args[] = { plisp_car(plisp_car(lst)),
+                           plisp_cdr(plisp_car(lst)), acc };
+        acc = plisp_call_closure(kons, 3, args);
+    }
+    return acc;
+}
@@ -0,0 +1,407 @@
+#include <plisp/homvec.h>
+#include <plisp/builtin.h>
+#include <plisp/number.h>
+#include <plisp/simd.h>
+#include <plisp/saftey.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+every kind gets the same set of builtins, make-u8vector, f64vector-sum
+and so on. each builtin is one C function shared by all the kinds, and
+the closure data of each one holds the kind it checks its arguments
+against. the elements are stored unboxed, so the collector never
+traces them, and the bulk operations run the kernels in simd.c over
+them directly.
+*/
+
+struct kind {
+    const char *tag;
+    enum plisp_vec_type type;
+    uint8_t elem_width;
+    uint16_t flags;
+};
+
+static const struct kind kinds[] = {
+    [HOMVEC_U8]  = { "u8",  VEC_INT,   sizeof(uint8_t), VFLAG_UNSIGNED },
+    [HOMVEC_S32] = { "s32", VEC_INT,   sizeof(int32_t), 0 },
+    [HOMVEC_S64] = { "s64", VEC_INT,   sizeof(int64_t), 0 },
+    [HOMVEC_F64] = { "f64", VEC_FLOAT, sizeof(double),  0 },
+};
+
+static plisp_t homvec_make(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t len, plisp_t fill);
+static plisp_t homvec_construct(struct plisp_closure_data *kind,
+                                size_t nargs, ...);
+static plisp_t homvec_p(struct plisp_closure_data *kind, size_t nargs,
+                        plisp_t obj);
+static plisp_t homvec_from_list(struct plisp_closure_data *kind,
+                                size_t nargs, plisp_t lst);
+static plisp_t homvec_to_list(struct plisp_closure_data *kind,
+                              size_t nargs, plisp_t vec);
+static plisp_t homvec_ref(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec, plisp_t idx);
+static plisp_t homvec_set(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec, plisp_t idx, plisp_t val);
+static plisp_t homvec_length(struct plisp_closure_data *kind, size_t nargs,
+                             plisp_t vec);
+static plisp_t homvec_fill(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t vec, plisp_t val);
+static plisp_t homvec_copy(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t vec);
+static plisp_t homvec_map(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t proc, plisp_t vec);
+static plisp_t homvec_fold(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t kons, plisp_t knil, plisp_t vec);
+static plisp_t homvec_sum(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec);
+static plisp_t homvec_dot(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t a, plisp_t b);
+static plisp_t homvec_min(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec);
+static plisp_t homvec_max(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec);
+
+static void define_kind_builtin(enum plisp_homvec_kind kind,
+                                const char *format, plisp_fn_t fun) {
+    char name[64];
+    snprintf(name, sizeof(name), format, kinds[kind].tag);
+
+    struct plisp_closure_data *data = malloc(sizeof(struct plisp_closure_data)
+                                             + sizeof(plisp_t));
+    data->length = 1;
+    data->objs[0] = plisp_make_fixnum(kind);
+    plisp_define_builtin_data(name, fun, data);
+}
+
+void plisp_init_homvec(void) {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    for (enum plisp_homvec_kind kind = 0; kind < HOMVEC_NONE; ++kind) {
+        define_kind_builtin(kind, "make-%svector", homvec_make);
+        define_kind_builtin(kind, "%svector", homvec_construct);
+        define_kind_builtin(kind, "%svector?", homvec_p);
+        define_kind_builtin(kind, "list->%svector", homvec_from_list);
+        define_kind_builtin(kind, "%svector->list", homvec_to_list);
+        define_kind_builtin(kind, "%svector-ref", homvec_ref);
+        define_kind_builtin(kind, "%svector-set!", homvec_set);
+        define_kind_builtin(kind, "%svector-length", homvec_length);
+        define_kind_builtin(kind, "%svector-fill!", homvec_fill);
+        define_kind_builtin(kind, "%svector-copy", homvec_copy);
+        define_kind_builtin(kind, "%svector-map", homvec_map);
+        define_kind_builtin(kind, "%svector-fold", homvec_fold);
+        define_kind_builtin(kind, "%svector-sum", homvec_sum);
+        define_kind_builtin(kind, "%svector-dot", homvec_dot);
+        define_kind_builtin(kind, "%svector-min", homvec_min);
+        define_kind_builtin(kind, "%svector-max", homvec_max);
+    }
+
+    #pragma GCC diagnostic pop
+}
+
+enum plisp_homvec_kind plisp_homvec_kind(plisp_t vec) {
+    if (!plisp_c_vectorp(vec)) {
+        return HOMVEC_NONE;
+    }
+
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    for (enum plisp_homvec_kind kind = 0; kind < HOMVEC_NONE; ++kind) {
+        if (vecptr->type == kinds[kind].type
+            && vecptr->elem_width == kinds[kind].elem_width
+            && (vecptr->flags & VFLAG_UNSIGNED) == kinds[kind].flags) {
+            return kind;
+        }
+    }
+    return HOMVEC_NONE;
+}
+
+const char *plisp_homvec_tag(enum plisp_homvec_kind kind) {
+    plisp_assert(kind < HOMVEC_NONE);
+    return kinds[kind].tag;
+}
+
+enum plisp_homvec_kind plisp_homvec_tag_kind(const char *tag) {
+    for (enum plisp_homvec_kind kind = 0; kind < HOMVEC_NONE; ++kind) {
+        if (strcmp(tag, kinds[kind].tag) == 0) {
+            return kind;
+        }
+    }
+    return HOMVEC_NONE;
+}
+
+plisp_t plisp_make_homvec(enum plisp_homvec_kind kind, size_t len) {
+    plisp_assert(kind < HOMVEC_NONE);
+    return plisp_make_vector(kinds[kind].type, kinds[kind].elem_width,
+                             kinds[kind].flags, len, plisp_unspec, false);
+}
+
+plisp_t plisp_list_to_homvec(enum plisp_homvec_kind kind, plisp_t lst) {
+    plisp_assert(plisp_c_listp(lst));
+    size_t len = plisp_c_length(lst);
+    plisp_t vec = plisp_make_homvec(kind, len);
+
+    for (size_t i = 0; i < len; ++i) {
+        plisp_vector_set(vec, i, plisp_car(lst));
+        lst = plisp_cdr(lst);
+    }
+
+    return vec;
+}
+
+static enum plisp_homvec_kind closure_kind(struct plisp_closure_data *data) {
+    return plisp_fixnum_value(data->objs[0]);
+}
+
+// the payload of vec, which must be of kind
+static struct plisp_vector *checked_vector(struct plisp_closure_data *kind,
+                                           plisp_t vec) {
+    plisp_assert(plisp_homvec_kind(vec) == closure_kind(kind));
+    return (void *) (vec & ~LOTAGS);
+}
+
+static plisp_t homvec_make(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t len, plisp_t fill) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    plisp_assert(plisp_c_fixnump(len) && plisp_fixnum_value(len) >= 0);
+
+    plisp_t vec = plisp_make_homvec(closure_kind(kind),
+                                    plisp_fixnum_value(len));
+    if (nargs == 2) {
+        homvec_fill(kind, 2, vec, fill);
+    }
+    return vec;
+}
+
+static plisp_t homvec_construct(struct plisp_closure_data *kind,
+                                size_t nargs, ...) {
+    plisp_t vec = plisp_make_homvec(closure_kind(kind), nargs);
+
+    va_list vl;
+    va_start(vl, nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        plisp_vector_set(vec, i, va_arg(vl, plisp_t));
+    }
+    va_end(vl);
+
+    return vec;
+}
+
+static plisp_t homvec_p(struct plisp_closure_data *kind, size_t nargs,
+                        plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_homvec_kind(obj) == closure_kind(kind));
+}
+
+static plisp_t homvec_from_list(struct plisp_closure_data *kind,
+                                size_t nargs, plisp_t lst) {
+    plisp_assert(nargs == 1);
+    return plisp_list_to_homvec(closure_kind(kind), lst);
+}
+
+static plisp_t homvec_to_list(struct plisp_closure_data *kind,
+                              size_t nargs, plisp_t vec) {
+    plisp_assert(nargs == 1);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+
+    plisp_t lst = plisp_nil;
+    for (size_t i = vecptr->len; i-- > 0;) {
+        lst = plisp_cons(plisp_vector_ref(vec, i), lst);
+    }
+    return lst;
+}
+
+static plisp_t homvec_ref(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec, plisp_t idx) {
+    plisp_assert(nargs == 2);
+    checked_vector(kind, vec);
+    plisp_assert(plisp_c_fixnump(idx));
+    return plisp_vector_ref(vec, plisp_fixnum_value(idx));
+}
+
+static plisp_t homvec_set(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec, plisp_t idx, plisp_t val) {
+    plisp_assert(nargs == 3);
+    checked_vector(kind, vec);
+    plisp_assert(plisp_c_fixnump(idx));
+    plisp_vector_set(vec, plisp_fixnum_value(idx), val);
+    return plisp_unspec;
+}
+
+static plisp_t homvec_length(struct plisp_closure_data *kind, size_t nargs,
+                             plisp_t vec) {
+    plisp_assert(nargs == 1);
+    return plisp_make_fixnum(checked_vector(kind, vec)->len);
+}
+
+static plisp_t homvec_fill(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t vec, plisp_t val) {
+    plisp_assert(nargs == 2);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+    if (vecptr->len == 0) {
+        return plisp_unspec;
+    }
+
+    // storing the first element checks and converts val, and the rest
+    // are copies of it
+    plisp_vector_set(vec, 0, val);
+    switch (closure_kind(kind)) {
+    case HOMVEC_U8:
+        memset(vecptr->vec, *(uint8_t *) vecptr->vec, vecptr->len);
+        break;
+    case HOMVEC_S32:
+        plisp_simd_fill_s32(vecptr->vec, *(int32_t *) vecptr->vec, vecptr->len);
+        break;
+    case HOMVEC_S64:
+        plisp_simd_fill_s64(vecptr->vec, *(int64_t *) vecptr->vec, vecptr->len);
+        break;
+    default:
+        plisp_simd_fill_f64(vecptr->vec, *(double *) vecptr->vec, vecptr->len);
+        break;
+    }
+    return plisp_unspec;
+}
+
+static plisp_t homvec_copy(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t vec) {
+    plisp_assert(nargs == 1);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+
+    plisp_t copy = plisp_make_homvec(closure_kind(kind), vecptr->len);
+    struct plisp_vector *copyptr = (void *) (copy & ~LOTAGS);
+    memcpy(copyptr->vec, vecptr->vec, vecptr->len * vecptr->elem_width);
+    return copy;
+}
+
+static plisp_t homvec_map(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t proc, plisp_t vec) {
+    plisp_assert(nargs == 2);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+
+    plisp_t result = plisp_make_homvec(closure_kind(kind), vecptr->len);
+    for (size_t i = 0; i < vecptr->len; ++i) {
+        plisp_t elem = plisp_vector_ref(vec, i);
+        plisp_vector_set(result, i, plisp_call_closure(proc, 1, &elem));
+    }
+    return result;
+}
+
+static plisp_t homvec_fold(struct plisp_closure_data *kind, size_t nargs,
+                           plisp_t kons, plisp_t knil, plisp_t vec) {
+    plisp_assert(nargs == 3);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+
+    plisp_t args[2] = { knil };
+    for (size_t i = 0; i < vecptr->len; ++i) {
+        args[1] = plisp_vector_ref(vec, i);
+        args[0] = plisp_call_closure(kons, 2, args);
+    }
+    return args[0];
+}
+
+static int64_t int_at(struct plisp_vector *vecptr, size_t idx) {
+    if (vecptr->elem_width == sizeof(uint8_t)) {
+        return ((uint8_t *) vecptr->vec)[idx];
+    } else if (vecptr->elem_width == sizeof(int32_t)) {
+        return ((int32_t *) vecptr->vec)[idx];
+    }
+    return ((int64_t *) vecptr->vec)[idx];
+}
+
+// the sum of a, or the dot product of a and b, in 64 bits for as long
+// as it fits and in bignums after that
+static plisp_t int_dot(struct plisp_vector *a, struct plisp_vector *b) {
+    int64_t sum = 0;
+    size_t i = 0;
+    for (; i < a->len; ++i) {
+        int64_t term = int_at(a, i);
+        if ((b != NULL && __builtin_mul_overflow(term, int_at(b, i), &term))
+            || __builtin_add_overflow(sum, term, &term)) {
+            break;
+        }
+        sum = term;
+    }
+
+    plisp_t total = plisp_make_integer(sum);
+    for (; i < a->len; ++i) {
+        plisp_t term = plisp_make_integer(int_at(a, i));
+        if (b != NULL) {
+            term = plisp_num_mul(term, plisp_make_integer(int_at(b, i)));
+        }
+        total = plisp_num_add(total, term);
+    }
+    return total;
+}
+
+static plisp_t homvec_sum(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec) {
+    plisp_assert(nargs == 1);
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+
+    switch (closure_kind(kind)) {
+    case HOMVEC_U8:
+        return plisp_make_integer(plisp_simd_sum_u8(vecptr->vec, vecptr->len));
+    case HOMVEC_S32:
+        // 2^32 elements of 32 bits can't overflow 64 bits
+        return plisp_make_integer(plisp_simd_sum_s32(vecptr->vec, vecptr->len));
+    case HOMVEC_S64:
+        return int_dot(vecptr, NULL);
+    default:
+        return plisp_make_flonum(plisp_simd_sum_f64(vecptr->vec, vecptr->len));
+    }
+}
+
+static plisp_t homvec_dot(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t a, plisp_t b) {
+    plisp_assert(nargs == 2);
+    struct plisp_vector *aptr = checked_vector(kind, a);
+    struct plisp_vector *bptr = checked_vector(kind, b);
+    plisp_assert(aptr->len == bptr->len);
+
+    if (closure_kind(kind) == HOMVEC_F64) {
+        return plisp_make_flonum(plisp_simd_dot_f64(aptr->vec, bptr->vec,
+                                                    aptr->len));
+    }
+    return int_dot(aptr, bptr);
+}
+
+static plisp_t homvec_extremum(struct plisp_closure_data *kind, plisp_t vec,
+                               bool max) {
+    struct plisp_vector *vecptr = checked_vector(kind, vec);
+    plisp_assert(vecptr->len > 0);
+
+    switch (closure_kind(kind)) {
+    case HOMVEC_U8:
+        return plisp_make_fixnum(max ? plisp_simd_max_u8(vecptr->vec, vecptr->len)
+                                     : plisp_simd_min_u8(vecptr->vec, vecptr->len));
+    case HOMVEC_S32:
+        return plisp_make_fixnum(max ? plisp_simd_max_s32(vecptr->vec, vecptr->len)
+                                     : plisp_simd_min_s32(vecptr->vec, vecptr->len));
+    case HOMVEC_S64: {
+        int64_t *elems = vecptr->vec;
+        int64_t best = elems[0];
+        for (size_t i = 1; i < vecptr->len; ++i) {
+            best = (max ? elems[i] > best : elems[i] < best) ? elems[i] : best;
+        }
+        return plisp_make_integer(best);
+    }
+    default:
+        return plisp_make_flonum(max ? plisp_simd_max_f64(vecptr->vec, vecptr->len)
+                                     : plisp_simd_min_f64(vecptr->vec, vecptr->len));
+    }
+}
+
+static plisp_t homvec_min(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec) {
+    plisp_assert(nargs == 1);
+    return homvec_extremum(kind, vec, false);
+}
+
+static plisp_t homvec_max(struct plisp_closure_data *kind, size_t nargs,
+                          plisp_t vec) {
+    plisp_assert(nargs == 1);
+    return homvec_extremum(kind, vec, true);
+}
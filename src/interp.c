@@ -0,0 +1,500 @@
+#include <plisp/interp.h>
+#include <plisp/compile.h>
+#include <plisp/toplevel.h>
+#include <plisp/builtin.h>
+#include <plisp/list.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+#include <plisp/background.h>
+#include <plisp/gc.h>
+#include <Judy.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+the interpreter is the first tier. toplevel forms are run once, so
+walking the s-expression is much cheaper than generating code for
+them. lambdas evaluated here become interpreted closures, which are
+compiled in place once they have been called jit_threshold times.
+the compiling happens on a background thread when there is one, and
+the closure is interpreted until its next call after that.
+
+every local variable lives in a consbox, so when a closure is
+promoted the compiled code can share the interpreter's variables.
+*/
+
+#define DEFAULT_JIT_THRESHOLD 32
+
+// 0 means never promote
+static size_t jit_threshold = DEFAULT_JIT_THRESHOLD;
+
+static plisp_t lambda_sym;
+static plisp_t define_sym;
+static plisp_t if_sym;
+static plisp_t quote_sym;
+static plisp_t quasiquote_sym;
+static plisp_t unquote_sym;
+static plisp_t unquote_splicing_sym;
+static plisp_t set_sym;
+static plisp_t declare_sym;
+
+// layout of an interpreted closure's data
+enum {
+    ICLOS_LAMBDA,
+    ICLOS_ENV,
+    ICLOS_CALLS,
+    ICLOS_SELF,
+    ICLOS_LENGTH,
+    // past the end, so it isn't traced. NULL, PROMOTION_QUEUED, or
+    // the promotion to install
+    ICLOS_PROMOTION = ICLOS_LENGTH,
+};
+
+#define PROMOTION_QUEUED ((plisp_t) 1)
+
+// compiled code for an interpreted closure, and the data to go with it
+struct promotion {
+    plisp_fn_t fun;
+    struct plisp_closure_data *data;
+};
+
+void plisp_init_interp(void) {
+    lambda_sym = plisp_intern(plisp_make_symbol("lambda"));
+    define_sym = plisp_intern(plisp_make_symbol("define"));
+    if_sym = plisp_intern(plisp_make_symbol("if"));
+    quote_sym = plisp_intern(plisp_make_symbol("quote"));
+    quasiquote_sym = plisp_intern(plisp_make_symbol("quasiquote"));
+    unquote_sym = plisp_intern(plisp_make_symbol("unquote"));
+    unquote_splicing_sym = plisp_intern(plisp_make_symbol("unquote-splicing"));
+    set_sym = plisp_intern(plisp_make_symbol("set!"));
+    declare_sym = plisp_intern(plisp_make_symbol("declare"));
+
+    const char *threshold = getenv("PLISP_JIT_THRESHOLD");
+    if (threshold != NULL) {
+        jit_threshold = strtoul(threshold, NULL, 10);
+    }
+}
+
+static void unbound_error(plisp_t sym) {
+    fprintf(stderr, "error: attempt to reference unbound variable '");
+    plisp_c_write(stderr, sym);
+    fprintf(stderr, "'\n");
+}
+
+static plisp_t env_lookup_box(plisp_t env, plisp_t sym) {
+    for (; env != plisp_nil; env = plisp_cdr(env)) {
+        plisp_t binding = plisp_car(env);
+        if (plisp_car(binding) == sym) {
+            return plisp_cdr(binding);
+        }
+    }
+    return plisp_nil;
+}
+
+static plisp_t *env_lookup(plisp_t env, plisp_t sym) {
+    plisp_t box = env_lookup_box(env, sym);
+    if (box == plisp_nil) {
+        return NULL;
+    }
+    return plisp_get_consbox(box);
+}
+
+static plisp_t env_bind(plisp_t env, plisp_t sym, plisp_t value) {
+    return plisp_cons(plisp_cons(sym, plisp_make_consbox(value)), env);
+}
+
+static plisp_t interp_ref(plisp_t sym, plisp_t env) {
+    plisp_t *slot = env_lookup(env, sym);
+    if (slot == NULL) {
+        slot = plisp_toplevel_ref(sym);
+    }
+
+    #ifndef PLISP_UNSAFE
+    if (*slot == plisp_unbound) {
+        unbound_error(sym);
+    }
+    assert(*slot != plisp_unbound);
+    #endif
+
+    return *slot;
+}
+
+static plisp_t interp_set(plisp_t expr, plisp_t env) {
+    plisp_t sym = plisp_car(plisp_cdr(expr));
+    plisp_assert(plisp_c_symbolp(sym));
+
+    plisp_t *slot = env_lookup(env, sym);
+    if (slot == NULL) {
+        slot = plisp_toplevel_ref(sym);
+
+        #ifndef PLISP_UNSAFE
+        if (*slot == plisp_unbound) {
+            unbound_error(sym);
+        }
+        assert(*slot != plisp_unbound);
+        #endif
+    }
+
+    *slot = plisp_interp_eval(plisp_car(plisp_cdr(plisp_cdr(expr))), env);
+    return plisp_unspec;
+}
+
+static plisp_t interp_quasiquote(plisp_t expr, plisp_t env) {
+    if (!plisp_c_consp(expr)) {
+        return expr;
+    }
+
+    if (plisp_car(expr) == unquote_sym) {
+        return plisp_interp_eval(plisp_car(plisp_cdr(expr)), env);
+    } else if (plisp_car(expr) == quasiquote_sym) {
+        return expr;
+    } else if (plisp_c_consp(plisp_car(expr))
+               && plisp_car(plisp_car(expr)) == unquote_splicing_sym) {
+        plisp_t spliced = plisp_interp_eval(
+            plisp_car(plisp_cdr(plisp_car(expr))), env);
+        plisp_t rest = interp_quasiquote(plisp_cdr(expr), env);
+        return plisp_append(spliced, rest);
+    } else {
+        plisp_t car = interp_quasiquote(plisp_car(expr), env);
+        plisp_t cdr = interp_quasiquote(plisp_cdr(expr), env);
+        return plisp_cons(car, cdr);
+    }
+}
+
+static plisp_t interp_if(plisp_t expr, plisp_t env) {
+    plisp_t rest = plisp_cdr(expr);
+    if (plisp_interp_eval(plisp_car(rest), env) != plisp_make_bool(false)) {
+        return plisp_interp_eval(plisp_car(plisp_cdr(rest)), env);
+    }
+
+    plisp_t alt = plisp_cdr(plisp_cdr(rest));
+    if (alt == plisp_nil) {
+        return plisp_unspec;
+    }
+    return plisp_interp_eval(plisp_car(alt), env);
+}
+
+static plisp_t plisp_interp_call(struct plisp_closure_data *data,
+                                 size_t nargs, ...);
+
+static plisp_t make_interp_closure(plisp_t lambda, plisp_t env) {
+    struct plisp_closure_data *data =
+        malloc(sizeof(struct plisp_closure_data)
+               + (ICLOS_LENGTH + 1) * sizeof(plisp_t));
+    data->length = ICLOS_LENGTH;
+    data->objs[ICLOS_PROMOTION] = (plisp_t) NULL;
+    data->objs[ICLOS_LAMBDA] = lambda;
+    data->objs[ICLOS_ENV] = env;
+    data->objs[ICLOS_CALLS] = plisp_make_fixnum(0);
+    data->objs[ICLOS_SELF] = plisp_nil;
+
+    plisp_t closure = plisp_make_closure(data, (plisp_fn_t) plisp_interp_call);
+    data->objs[ICLOS_SELF] = closure;
+    return closure;
+}
+
+static plisp_t interp_call(plisp_t expr, plisp_t env) {
+    plisp_t args[32];
+    size_t nargs = 0;
+
+    // arguments are evaluated before the function, like compiled code
+    for (plisp_t arglist = plisp_cdr(expr);
+         arglist != plisp_nil; arglist = plisp_cdr(arglist)) {
+        plisp_assert(nargs < sizeof(args)/sizeof(plisp_t));
+        args[nargs++] = plisp_interp_eval(plisp_car(arglist), env);
+    }
+
+    plisp_t fn = plisp_interp_eval(plisp_car(expr), env);
+
+    #ifndef PLISP_UNSAFE
+    if (!plisp_c_closurep(fn)) {
+        fprintf(stderr, "error: attempt to call non-closure object\n");
+    }
+    assert(plisp_c_closurep(fn));
+    #endif
+
+    return plisp_call_closure(fn, nargs, args);
+}
+
+static plisp_t interp_local_define(plisp_t form, plisp_t env) {
+    plisp_t target = plisp_car(plisp_cdr(form));
+    plisp_t sym;
+    plisp_t valexpr;
+
+    if (plisp_c_consp(target)) {
+        // function define
+        sym = plisp_car(target);
+        valexpr = plisp_cons(lambda_sym,
+                             plisp_cons(plisp_cdr(target),
+                                        plisp_cdr(plisp_cdr(form))));
+    } else {
+        // value define
+        sym = target;
+        valexpr = plisp_car(plisp_cdr(plisp_cdr(form)));
+    }
+    plisp_assert(plisp_c_symbolp(sym));
+
+    // bind first, so local functions can recurse
+    env = env_bind(env, sym, plisp_unbound);
+    *env_lookup(env, sym) = plisp_interp_eval(valexpr, env);
+
+    return env;
+}
+
+static plisp_t interp_body(plisp_t body, plisp_t env) {
+    plisp_t ret = plisp_unspec;
+    for (; body != plisp_nil; body = plisp_cdr(body)) {
+        plisp_t stmt = plisp_car(body);
+        if (plisp_c_consp(stmt) && plisp_car(stmt) == define_sym) {
+            env = interp_local_define(stmt, env);
+            ret = plisp_unspec;
+        } else if (plisp_c_consp(stmt) && plisp_car(stmt) == declare_sym) {
+            // declarations are for the compiler
+        } else {
+            ret = plisp_interp_eval(stmt, env);
+        }
+    }
+    return ret;
+}
+
+plisp_t plisp_interp_eval(plisp_t expr, plisp_t env) {
+    if (plisp_c_symbolp(expr)) {
+        return interp_ref(expr, env);
+    } else if (!plisp_c_consp(expr)) {
+        return expr;
+    }
+
+    plisp_t head = plisp_car(expr);
+    if (head == quote_sym) {
+        return plisp_car(plisp_cdr(expr));
+    } else if (head == if_sym) {
+        return interp_if(expr, env);
+    } else if (head == lambda_sym) {
+        return make_interp_closure(expr, env);
+    } else if (head == quasiquote_sym) {
+        return interp_quasiquote(plisp_car(plisp_cdr(expr)), env);
+    } else if (head == set_sym) {
+        return interp_set(expr, env);
+    } else {
+        return interp_call(expr, env);
+    }
+}
+
+static plisp_t interp_apply(plisp_t lambda, plisp_t env,
+                            size_t nargs, va_list args) {
+    size_t nfixed = 0;
+    plisp_t params;
+    for (params = plisp_car(plisp_cdr(lambda));
+         plisp_c_consp(params); params = plisp_cdr(params)) {
+        nfixed++;
+    }
+
+    #ifndef PLISP_UNSAFE
+    if (plisp_c_nullp(params) && nargs != nfixed) {
+        fprintf(stderr, "error: expected %lu args, got %lu\n", nfixed, nargs);
+    } else if (!plisp_c_nullp(params) && nargs < nfixed) {
+        fprintf(stderr, "error: expected >=%lu args, got %lu\n", nfixed, nargs);
+    }
+    assert(plisp_c_nullp(params) ? nargs == nfixed : nargs >= nfixed);
+    #endif
+
+    for (params = plisp_car(plisp_cdr(lambda));
+         plisp_c_consp(params); params = plisp_cdr(params)) {
+        env = env_bind(env, plisp_car(params), va_arg(args, plisp_t));
+    }
+
+    if (!plisp_c_nullp(params)) {
+        // pass the remaining arguments as a list
+        plisp_t rest = plisp_nil;
+        for (size_t i = nfixed; i < nargs; ++i) {
+            rest = plisp_cons(va_arg(args, plisp_t), rest);
+        }
+        env = env_bind(env, params, plisp_c_reverse(rest));
+    }
+
+    return interp_body(plisp_cdr(plisp_cdr(lambda)), env);
+}
+
+static void promote_job(void *arg, plisp_t closure);
+static void install_promotion(plisp_t closure, struct promotion *promotion);
+
+static plisp_t plisp_interp_call(struct plisp_closure_data *data,
+                                 size_t nargs, ...) {
+    // promotion frees data, so take everything we need up front
+    plisp_t lambda = data->objs[ICLOS_LAMBDA];
+    plisp_t env = data->objs[ICLOS_ENV];
+    plisp_t self = data->objs[ICLOS_SELF];
+    plisp_t promotion = __atomic_load_n(&data->objs[ICLOS_PROMOTION],
+                                        __ATOMIC_ACQUIRE);
+
+    va_list vl;
+    va_start(vl, nargs);
+
+    // a background compile finished. compiles read interpreted
+    // closures, so it's only installed when none is running.
+    bool promote = promotion != (plisp_t) NULL
+        && promotion != PROMOTION_QUEUED
+        && plisp_gc_trylock();
+
+    if (jit_threshold != 0 && promotion == (plisp_t) NULL) {
+        size_t calls = plisp_fixnum_value(data->objs[ICLOS_CALLS]) + 1;
+        data->objs[ICLOS_CALLS] = plisp_make_fixnum(calls);
+
+        if (calls >= jit_threshold) {
+            data->objs[ICLOS_PROMOTION] = PROMOTION_QUEUED;
+            if (!plisp_background(promote_job, NULL, self)) {
+                data->objs[ICLOS_PROMOTION] = (plisp_t) NULL;
+                promote = true;
+            }
+        }
+    }
+
+    if (promote) {
+        plisp_t args[32];
+        plisp_assert(nargs <= sizeof(args)/sizeof(plisp_t));
+        for (size_t i = 0; i < nargs; ++i) {
+            args[i] = va_arg(vl, plisp_t);
+        }
+        va_end(vl);
+
+        if (promotion != (plisp_t) NULL) {
+            install_promotion(self, (struct promotion *) promotion);
+            plisp_gc_unlock();
+        } else {
+            plisp_interp_promote(self);
+        }
+        return plisp_call_closure(self, nargs, args);
+    }
+
+    // only once data is done with, since a collection frees it if
+    // another thread promoted the closure
+    plisp_safepoint();
+    plisp_t ret = interp_apply(lambda, env, nargs, vl);
+    va_end(vl);
+    return ret;
+}
+
+plisp_t plisp_interp_lambda(plisp_t closure) {
+    struct plisp_closure_data *data = plisp_closure_data(closure);
+    if (data->objs[ICLOS_ENV] != plisp_nil) {
+        return plisp_nil;
+    }
+    return data->objs[ICLOS_LAMBDA];
+}
+
+bool plisp_c_interpretedp(plisp_t closure) {
+    return plisp_c_closurep(closure)
+        && plisp_closure_fun(closure) == (plisp_fn_t) plisp_interp_call;
+}
+
+static void collect_symbols(plisp_t expr, Pvoid_t *seen, plisp_t *syms) {
+    if (plisp_c_symbolp(expr)) {
+        int *pval;
+        JLI(pval, *seen, expr);
+        if (*pval == 0) {
+            *pval = 1;
+            *syms = plisp_cons(expr, *syms);
+        }
+    } else if (plisp_c_consp(expr) && plisp_car(expr) != quote_sym) {
+        for (; plisp_c_consp(expr); expr = plisp_cdr(expr)) {
+            collect_symbols(plisp_car(expr), seen, syms);
+        }
+        collect_symbols(expr, seen, syms);
+    }
+}
+
+plisp_t plisp_mentioned_symbols(plisp_t expr) {
+    Pvoid_t seen = NULL;
+    plisp_t syms = plisp_nil;
+    collect_symbols(expr, &seen, &syms);
+    size_t Rc_word;
+    JLFA(Rc_word, seen);
+    return syms;
+}
+
+static struct promotion *compile_promotion(struct plisp_closure_data *data) {
+    plisp_t lambda = data->objs[ICLOS_LAMBDA];
+    plisp_t env = data->objs[ICLOS_ENV];
+
+    plisp_t syms = plisp_mentioned_symbols(plisp_cdr(lambda));
+
+    // the closure layout is the local variables the lambda mentions
+    plisp_t closure_syms = plisp_nil;
+    plisp_t boxes = plisp_nil;
+    size_t nvars = 0;
+    for (; syms != plisp_nil; syms = plisp_cdr(syms)) {
+        plisp_t box = env_lookup_box(env, plisp_car(syms));
+        if (box != plisp_nil) {
+            closure_syms = plisp_cons(plisp_car(syms), closure_syms);
+            boxes = plisp_cons(box, boxes);
+            nvars++;
+        }
+    }
+
+    struct promotion *promotion = malloc(sizeof(struct promotion));
+    promotion->fun = plisp_compile_lambda_closure(lambda, closure_syms);
+
+    struct plisp_closure_data *newdata = NULL;
+    if (nvars != 0) {
+        newdata = malloc(sizeof(struct plisp_closure_data)
+                         + nvars * sizeof(plisp_t));
+        newdata->length = nvars;
+        for (size_t i = 0; i < nvars; ++i) {
+            newdata->objs[i] = plisp_car(boxes);
+            boxes = plisp_cdr(boxes);
+        }
+    }
+
+    promotion->data = newdata;
+    return promotion;
+}
+
+// runs on a compiler thread. the closure is installed by the main
+// thread, the next time it is called.
+static void promote_job(void *arg, plisp_t closure) {
+    struct plisp_closure_data *data = plisp_closure_data(closure);
+    struct promotion *promotion = compile_promotion(data);
+    __atomic_store_n(&data->objs[ICLOS_PROMOTION], (plisp_t) promotion,
+                     __ATOMIC_RELEASE);
+}
+
+plisp_fn_t plisp_interp_promote(plisp_t closure) {
+    if (!plisp_c_interpretedp(closure)) {
+        return plisp_closure_fun(closure);
+    }
+
+    struct plisp_closure_data *data = plisp_closure_data(closure);
+    if (data->objs[ICLOS_PROMOTION] == PROMOTION_QUEUED) {
+        plisp_background_wait();
+    }
+
+    plisp_gc_lock();
+    struct promotion *promotion = (void *) data->objs[ICLOS_PROMOTION];
+    if (promotion == NULL || (plisp_t) promotion == PROMOTION_QUEUED) {
+        promotion = compile_promotion(data);
+    }
+    install_promotion(closure, promotion);
+    plisp_gc_unlock();
+
+    return plisp_closure_fun(closure);
+}
+
+// compiles read other interpreted closures, so this is done with the
+// gc lock held
+static void install_promotion(plisp_t closure, struct promotion *promotion) {
+    struct plisp_closure_data *data = plisp_closure_data(closure);
+
+    // patch the closure in place, so every reference to it sees the
+    // compiled code (change whenever plisp_closure changes). callers
+    // read fun and data separately, so none may see one of each.
+    struct plisp_closure *clptr = (void *) (closure & ~LOTAGS);
+    plisp_gc_stop_world();
+    clptr->fun = promotion->fun;
+    clptr->data = promotion->data;
+    plisp_gc_start_world();
+    // other threads may be calling the interpreted version still
+    plisp_gc_retire(data);
+    free(promotion);
+}
@@ -0,0 +1,354 @@
+#include <plisp/list.h>
+#include <plisp/builtin.h>
+#include <plisp/number.h>
+#include <plisp/saftey.h>
+
+#include <stdarg.h>
+#include <stdlib.h>
+
+/*
+the list builtins loop rather than recurse, so they work on lists of
+any length, and the ones that return new lists build them front to
+back, setting the cdr of the last cell as they go, so each cell of the
+result is allocated once and nothing is reversed afterwards.
+*/
+
+// plisp_call_closure takes at most this many arguments
+#define MAX_LISTS 32
+
+static plisp_t list_map(plisp_t *clos, size_t nargs, plisp_t fn,
+                        plisp_t lst, ...);
+static plisp_t list_for_each(plisp_t *clos, size_t nargs, plisp_t fn,
+                             plisp_t lst, ...);
+static plisp_t list_filter(plisp_t *clos, size_t nargs, plisp_t pred,
+                           plisp_t lst);
+static plisp_t list_fold_left(plisp_t *clos, size_t nargs, plisp_t kons,
+                              plisp_t knil, plisp_t lst);
+static plisp_t list_fold_right(plisp_t *clos, size_t nargs, plisp_t kons,
+                               plisp_t knil, plisp_t lst);
+static plisp_t list_append(plisp_t *clos, size_t nargs, ...);
+static plisp_t list_reverse_x(plisp_t *clos, size_t nargs, plisp_t lst);
+static plisp_t list_tail(plisp_t *clos, size_t nargs, plisp_t lst,
+                         plisp_t k);
+static plisp_t list_memq(plisp_t *clos, size_t nargs, plisp_t obj,
+                         plisp_t lst);
+static plisp_t list_member(plisp_t *clos, size_t nargs, plisp_t obj,
+                           plisp_t lst);
+static plisp_t list_assq(plisp_t *clos, size_t nargs, plisp_t key,
+                         plisp_t alist);
+static plisp_t list_assoc(plisp_t *clos, size_t nargs, plisp_t key,
+                          plisp_t alist);
+static plisp_t list_copy(plisp_t *clos, size_t nargs, plisp_t lst);
+static plisp_t list_make(plisp_t *clos, size_t nargs, plisp_t len,
+                         plisp_t fill);
+static plisp_t list_iota(plisp_t *clos, size_t nargs, plisp_t count,
+                         plisp_t start, plisp_t step);
+
+void plisp_init_list(void) {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("map", list_map);
+    plisp_define_builtin("for-each", list_for_each);
+    plisp_define_builtin("filter", list_filter);
+    plisp_define_builtin("fold-left", list_fold_left);
+    plisp_define_builtin("fold-right", list_fold_right);
+    plisp_define_builtin("append", list_append);
+    plisp_define_builtin("reverse!", list_reverse_x);
+    plisp_define_builtin("list-tail", list_tail);
+    plisp_define_builtin("memq", list_memq);
+    plisp_define_builtin("member", list_member);
+    plisp_define_builtin("assq", list_assq);
+    plisp_define_builtin("assoc", list_assoc);
+    plisp_define_builtin("list-copy", list_copy);
+    plisp_define_builtin("make-list", list_make);
+    plisp_define_builtin("iota", list_iota);
+
+    #pragma GCC diagnostic pop
+}
+
+// adds cell to the end of the list from head to tail
+static void push_cell(plisp_t *head, plisp_t *tail, plisp_t cell) {
+    if (plisp_c_nullp(*head)) {
+        *head = cell;
+    } else {
+        plisp_set_cdr(*tail, cell);
+    }
+    *tail = cell;
+}
+
+// copies the cells of lst onto the end of the list from head to tail,
+// and returns whatever ended it
+static plisp_t push_copy(plisp_t *head, plisp_t *tail, plisp_t lst) {
+    for (; plisp_c_consp(lst); lst = plisp_cdr(lst)) {
+        push_cell(head, tail, plisp_cons(plisp_car(lst), plisp_nil));
+    }
+    return lst;
+}
+
+plisp_t plisp_append(plisp_t a, plisp_t b) {
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    plisp_t end = push_copy(&head, &tail, a);
+    plisp_assert(plisp_c_nullp(end));
+    if (plisp_c_nullp(head)) {
+        return b;
+    }
+    plisp_set_cdr(tail, b);
+    return head;
+}
+
+plisp_t plisp_list_copy(plisp_t lst) {
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    plisp_t end = push_copy(&head, &tail, lst);
+    if (plisp_c_nullp(head)) {
+        return end;
+    }
+    plisp_set_cdr(tail, end);
+    return head;
+}
+
+// reads the lists of a variadic builtin whose first nfixed arguments
+// aren't lists
+static size_t collect_lists(size_t nargs, size_t nfixed, plisp_t first,
+                            va_list vl, plisp_t *lsts) {
+    plisp_assert(nargs > nfixed && nargs - nfixed <= MAX_LISTS);
+    lsts[0] = first;
+    for (size_t i = 1; i < nargs - nfixed; ++i) {
+        lsts[i] = va_arg(vl, plisp_t);
+    }
+    return nargs - nfixed;
+}
+
+// the next element of each list as arguments, or false once any of
+// them runs out
+static bool next_args(size_t nlists, plisp_t *lsts, plisp_t *args) {
+    for (size_t i = 0; i < nlists; ++i) {
+        if (!plisp_c_consp(lsts[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < nlists; ++i) {
+        args[i] = plisp_car(lsts[i]);
+        lsts[i] = plisp_cdr(lsts[i]);
+    }
+    return true;
+}
+
+static plisp_t list_map(plisp_t *clos, size_t nargs, plisp_t fn,
+                        plisp_t lst, ...) {
+    plisp_t lsts[MAX_LISTS];
+    plisp_t args[MAX_LISTS];
+    va_list vl;
+    va_start(vl, lst);
+    size_t nlists = collect_lists(nargs, 1, lst, vl, lsts);
+    va_end(vl);
+
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    while (next_args(nlists, lsts, args)) {
+        plisp_t val = plisp_call_closure(fn, nlists, args);
+        push_cell(&head, &tail, plisp_cons(val, plisp_nil));
+    }
+    return head;
+}
+
+static plisp_t list_for_each(plisp_t *clos, size_t nargs, plisp_t fn,
+                             plisp_t lst, ...) {
+    plisp_t lsts[MAX_LISTS];
+    plisp_t args[MAX_LISTS];
+    va_list vl;
+    va_start(vl, lst);
+    size_t nlists = collect_lists(nargs, 1, lst, vl, lsts);
+    va_end(vl);
+
+    while (next_args(nlists, lsts, args)) {
+        plisp_call_closure(fn, nlists, args);
+    }
+    return plisp_unspec;
+}
+
+static plisp_t list_filter(plisp_t *clos, size_t nargs, plisp_t pred,
+                           plisp_t lst) {
+    plisp_assert(nargs == 2);
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    for (; !plisp_c_nullp(lst); lst = plisp_cdr(lst)) {
+        plisp_t elem = plisp_car(lst);
+        if (plisp_call_closure(pred, 1, &elem) != plisp_make_bool(false)) {
+            push_cell(&head, &tail, plisp_cons(elem, plisp_nil));
+        }
+    }
+    return head;
+}
+
+static plisp_t list_fold_left(plisp_t *clos, size_t nargs, plisp_t kons,
+                              plisp_t knil, plisp_t lst) {
+    plisp_assert(nargs == 3);
+    plisp_t acc = knil;
+    for (; !plisp_c_nullp(lst); lst = plisp_cdr(lst)) {
+        plisp_t args[] = { acc, plisp_car(lst) };
+        acc = plisp_call_closure(kons, 2, args);
+    }
+    return acc;
+}
+
+static plisp_t list_fold_right(plisp_t *clos, size_t nargs, plisp_t kons,
+                               plisp_t knil, plisp_t lst) {
+    plisp_assert(nargs == 3);
+    // the elements are walked backwards out of an array rather than
+    // the stack. the array isn't scanned by the collector, so lst
+    // keeps them alive until the fold is done.
+    volatile plisp_t keep = lst;
+    size_t len = plisp_c_length(lst);
+    plisp_t *elems = malloc(len * sizeof(plisp_t));
+    for (size_t i = 0; i < len; ++i, lst = plisp_cdr(lst)) {
+        elems[i] = plisp_car(lst);
+    }
+
+    plisp_t acc = knil;
+    for (size_t i = len; i > 0; --i) {
+        plisp_t args[] = { elems[i - 1], acc };
+        acc = plisp_call_closure(kons, 2, args);
+    }
+    free(elems);
+    (void) keep;
+    return acc;
+}
+
+static plisp_t list_append(plisp_t *clos, size_t nargs, ...) {
+    va_list vl;
+    va_start(vl, nargs);
+
+    // every list but the last is copied, and the last is shared
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    plisp_t last = plisp_nil;
+    for (size_t i = 0; i < nargs; ++i) {
+        plisp_t lst = va_arg(vl, plisp_t);
+        if (i == nargs - 1) {
+            last = lst;
+        } else {
+            plisp_t end = push_copy(&head, &tail, lst);
+            plisp_assert(plisp_c_nullp(end));
+        }
+    }
+    va_end(vl);
+
+    if (plisp_c_nullp(head)) {
+        return last;
+    }
+    plisp_set_cdr(tail, last);
+    return head;
+}
+
+static plisp_t list_reverse_x(plisp_t *clos, size_t nargs, plisp_t lst) {
+    plisp_assert(nargs == 1);
+    plisp_t rev = plisp_nil;
+    while (!plisp_c_nullp(lst)) {
+        plisp_t next = plisp_cdr(lst);
+        plisp_set_cdr(lst, rev);
+        rev = lst;
+        lst = next;
+    }
+    return rev;
+}
+
+static plisp_t list_tail(plisp_t *clos, size_t nargs, plisp_t lst,
+                         plisp_t k) {
+    plisp_assert(nargs == 2);
+    plisp_assert(plisp_c_fixnump(k) && plisp_fixnum_value(k) >= 0);
+    for (int64_t i = plisp_fixnum_value(k); i > 0; --i) {
+        lst = plisp_cdr(lst);
+    }
+    return lst;
+}
+
+// the first tail of lst whose car is obj, or #f
+static plisp_t find_member(plisp_t obj, plisp_t lst, bool equal) {
+    for (; !plisp_c_nullp(lst); lst = plisp_cdr(lst)) {
+        plisp_t elem = plisp_car(lst);
+        if (elem == obj || (equal && plisp_c_equal(elem, obj))) {
+            return lst;
+        }
+    }
+    return plisp_make_bool(false);
+}
+
+// the first pair in alist whose car is key, or #f
+static plisp_t find_assoc(plisp_t key, plisp_t alist, bool equal) {
+    for (; !plisp_c_nullp(alist); alist = plisp_cdr(alist)) {
+        plisp_t pair = plisp_car(alist);
+        plisp_t elem = plisp_car(pair);
+        if (elem == key || (equal && plisp_c_equal(elem, key))) {
+            return pair;
+        }
+    }
+    return plisp_make_bool(false);
+}
+
+static plisp_t list_memq(plisp_t *clos, size_t nargs, plisp_t obj,
+                         plisp_t lst) {
+    plisp_assert(nargs == 2);
+    return find_member(obj, lst, false);
+}
+
+static plisp_t list_member(plisp_t *clos, size_t nargs, plisp_t obj,
+                           plisp_t lst) {
+    plisp_assert(nargs == 2);
+    return find_member(obj, lst, true);
+}
+
+static plisp_t list_assq(plisp_t *clos, size_t nargs, plisp_t key,
+                         plisp_t alist) {
+    plisp_assert(nargs == 2);
+    return find_assoc(key, alist, false);
+}
+
+static plisp_t list_assoc(plisp_t *clos, size_t nargs, plisp_t key,
+                          plisp_t alist) {
+    plisp_assert(nargs == 2);
+    return find_assoc(key, alist, true);
+}
+
+static plisp_t list_copy(plisp_t *clos, size_t nargs, plisp_t lst) {
+    plisp_assert(nargs == 1);
+    return plisp_list_copy(lst);
+}
+
+static plisp_t list_make(plisp_t *clos, size_t nargs, plisp_t len,
+                         plisp_t fill) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    plisp_assert(plisp_c_fixnump(len) && plisp_fixnum_value(len) >= 0);
+    if (nargs == 1) {
+        fill = plisp_unspec;
+    }
+
+    plisp_t lst = plisp_nil;
+    for (int64_t i = plisp_fixnum_value(len); i > 0; --i) {
+        lst = plisp_cons(fill, lst);
+    }
+    return lst;
+}
+
+static plisp_t list_iota(plisp_t *clos, size_t nargs, plisp_t count,
+                         plisp_t start, plisp_t step) {
+    plisp_assert(nargs >= 1 && nargs <= 3);
+    plisp_assert(plisp_c_fixnump(count) && plisp_fixnum_value(count) >= 0);
+    if (nargs < 2) {
+        start = plisp_make_fixnum(0);
+    }
+    if (nargs < 3) {
+        step = plisp_make_fixnum(1);
+    }
+
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    plisp_t val = start;
+    for (int64_t i = plisp_fixnum_value(count); i > 0; --i) {
+        push_cell(&head, &tail, plisp_cons(val, plisp_nil));
+        val = plisp_num_add(val, step);
+    }
+    return head;
+}
@@ -3,19 +3,27 @@
 #include <plisp/write.h>
 #include <plisp/compile.h>
 #include <plisp/toplevel.h>
+#include <plisp/interp.h>
 #include <plisp/builtin.h>
 #include <plisp/gc.h>
+#include <plisp/precompile.h>
+#include <plisp/background.h>
+#include <plisp/simd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 
 int main(int argc, char *argv[]) {
+    plisp_init_simd();
     plisp_init_gc();
     plisp_init_reader();
     plisp_init_compiler(argv[0]);
     plisp_init_toplevel();
+    plisp_init_interp();
     plisp_init_builtin();
+    plisp_init_background();
 
     // load the standard library
     const char *bootfile = getenv("PLISP_BOOT");
@@ -23,7 +31,16 @@ int main(int argc, char *argv[]) {
         plisp_c_load(bootfile);
     }
 
-    if (argc > 1) {
+    if (argc > 2 && strcmp(argv[1], "--compile") == 0) {
+        // plisp --compile foo.scm [-o foo.plc]
+        if (argc > 4 && strcmp(argv[3], "-o") == 0) {
+            plisp_c_compile_file(argv[2], argv[4]);
+        } else {
+            char *dst = plisp_compiled_path(argv[2]);
+            plisp_c_compile_file(argv[2], dst);
+            free(dst);
+        }
+    } else if (argc > 1) {
         plisp_c_load(argv[1]);
     } else {
 
@@ -31,6 +48,12 @@ int main(int argc, char *argv[]) {
         plisp_toplevel_define(filesym, plisp_make_bool(false));
         while (1) {
             printf("> ");
+            fflush(stdout);
+            // other threads can collect while this waits for a line
+            plisp_enter_blocking();
+            int ch = getc(stdin);
+            plisp_leave_blocking();
+            ungetc(ch, stdin);
             plisp_t obj = plisp_c_read(stdin);
             if (plisp_c_eofp(obj)) {
                 putchar('\n');
@@ -44,6 +67,10 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (getenv("PLISP_JIT_STATS") != NULL) {
+        plisp_expansion_cache_report(stderr);
+    }
+    plisp_end_background();
     plisp_end_compiler();
 
     return 0;
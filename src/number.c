@@ -0,0 +1,627 @@
+#include <plisp/number.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/saftey.h>
+#include <plisp/simd.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+
+void plisp_init_number(void) {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("=", plisp_builtin_numeq);
+    plisp_define_builtin("/", plisp_builtin_divide);
+    plisp_define_builtin("number?", plisp_builtin_numberp);
+    plisp_define_builtin("flonum?", plisp_builtin_flonump);
+    plisp_define_builtin("exact->inexact", plisp_builtin_exact_to_inexact);
+    plisp_define_builtin("inexact->exact", plisp_builtin_inexact_to_exact);
+
+    #pragma GCC diagnostic pop
+}
+
+static struct plisp_number *number_cell(plisp_t val) {
+    return (void *) (val & ~LOTAGS);
+}
+
+bool plisp_c_numberp(plisp_t val) {
+    return plisp_c_fixnump(val) || (val & LOTAGS) == LT_NUMBER;
+}
+
+bool plisp_c_flonump(plisp_t val) {
+    return (val & LOTAGS) == LT_NUMBER
+        && number_cell(val)->type == NUM_FLONUM;
+}
+
+bool plisp_c_bignump(plisp_t val) {
+    return (val & LOTAGS) == LT_NUMBER
+        && number_cell(val)->type == NUM_BIGNUM;
+}
+
+plisp_t plisp_make_flonum(double val) {
+    plisp_t num = plisp_alloc_obj(LT_NUMBER, false);
+    struct plisp_number *numptr = number_cell(num);
+    numptr->type = NUM_FLONUM;
+    numptr->flonum = val;
+    return num;
+}
+
+double plisp_flonum_value(plisp_t val) {
+    plisp_assert(plisp_c_flonump(val));
+    return number_cell(val)->flonum;
+}
+
+uint64_t plisp_number_hash(plisp_t num) {
+    int64_t val;
+    if (plisp_integer_to_int64(num, &val)) {
+        return plisp_hash_word(val);
+    } else if (plisp_c_flonump(num)) {
+        // 0.0 and -0.0 are eqv
+        double flo = plisp_flonum_value(num);
+        uint64_t bits;
+        flo = flo == 0 ? 0 : flo;
+        memcpy(&bits, &flo, sizeof(bits));
+        return plisp_hash_word(~bits);
+    }
+
+    struct plisp_bignum *big = number_cell(num)->bignum;
+    return plisp_simd_hash((const uint8_t *) big->limbs,
+                           big->len * sizeof(uint32_t)) ^ big->negative;
+}
+
+/*
+integer arithmetic works on magnitudes as arrays of 32 bit limbs,
+least significant first. fixnums are viewed as limbs without
+allocating, and results are turned back into fixnums whenever they
+fit, so bignums only exist while a value is actually out of range.
+*/
+
+struct limbs {
+    bool negative;
+    uint32_t len;
+    const uint32_t *limbs;
+    uint32_t space[2]; // the limbs of a fixnum
+};
+
+static void integer_limbs(plisp_t num, struct limbs *out) {
+    if (plisp_c_fixnump(num)) {
+        int64_t val = plisp_fixnum_value(num);
+        uint64_t mag = val < 0 ? -(uint64_t) val : (uint64_t) val;
+        out->negative = val < 0;
+        out->space[0] = mag;
+        out->space[1] = mag >> 32;
+        out->len = out->space[1] != 0 ? 2 : out->space[0] != 0;
+        out->limbs = out->space;
+    } else {
+        plisp_assert(plisp_c_bignump(num));
+        struct plisp_bignum *big = number_cell(num)->bignum;
+        out->negative = big->negative;
+        out->len = big->len;
+        out->limbs = big->limbs;
+    }
+}
+
+static plisp_t make_integer_from(bool negative, const uint32_t *limbs,
+                                 uint32_t len) {
+    while (len > 0 && limbs[len-1] == 0) {
+        --len;
+    }
+
+    if (len <= 2) {
+        uint64_t mag = 0;
+        if (len > 0) {
+            mag = limbs[0];
+        }
+        if (len > 1) {
+            mag |= (uint64_t) limbs[1] << 32;
+        }
+
+        if (!negative && mag <= (uint64_t) PLISP_FIXNUM_MAX) {
+            return plisp_make_fixnum(mag);
+        } else if (negative && mag <= (uint64_t) PLISP_FIXNUM_MAX + 1) {
+            return plisp_make_fixnum(-(int64_t) mag);
+        }
+    }
+
+    struct plisp_bignum *big = malloc(sizeof(struct plisp_bignum)
+                                      + len * sizeof(uint32_t));
+    big->negative = negative;
+    big->len = len;
+    memcpy(big->limbs, limbs, len * sizeof(uint32_t));
+
+    plisp_t num = plisp_alloc_obj(LT_NUMBER, true);
+    struct plisp_number *numptr = number_cell(num);
+    numptr->type = NUM_BIGNUM;
+    numptr->bignum = big;
+    return num;
+}
+
+plisp_t plisp_make_integer(int64_t val) {
+    if (val >= PLISP_FIXNUM_MIN && val <= PLISP_FIXNUM_MAX) {
+        return plisp_make_fixnum(val);
+    }
+
+    uint64_t mag = val < 0 ? -(uint64_t) val : (uint64_t) val;
+    uint32_t limbs[2] = { mag, mag >> 32 };
+    return make_integer_from(val < 0, limbs, 2);
+}
+
+bool plisp_integer_to_int64(plisp_t num, int64_t *out) {
+    if (plisp_c_fixnump(num)) {
+        *out = plisp_fixnum_value(num);
+        return true;
+    } else if (!plisp_c_bignump(num)) {
+        return false;
+    }
+
+    struct limbs a;
+    integer_limbs(num, &a);
+    if (a.len > 2) {
+        return false;
+    }
+
+    uint64_t mag = a.limbs[0] | (uint64_t) a.limbs[1] << 32;
+    if (mag > (uint64_t) INT64_MAX + a.negative) {
+        return false;
+    }
+    *out = a.negative ? -mag : mag;
+    return true;
+}
+
+static int mag_compare(const struct limbs *a, const struct limbs *b) {
+    if (a->len != b->len) {
+        return a->len < b->len ? -1 : 1;
+    }
+    for (size_t i = a->len; i-- > 0;) {
+        if (a->limbs[i] != b->limbs[i]) {
+            return a->limbs[i] < b->limbs[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// out has room for max(a->len, b->len) + 1 limbs
+static void mag_add(const struct limbs *a, const struct limbs *b,
+                    uint32_t *out) {
+    uint32_t len = a->len > b->len ? a->len : b->len;
+    uint64_t carry = 0;
+    for (size_t i = 0; i < len; ++i) {
+        uint64_t sum = carry;
+        if (i < a->len) {
+            sum += a->limbs[i];
+        }
+        if (i < b->len) {
+            sum += b->limbs[i];
+        }
+        out[i] = sum;
+        carry = sum >> 32;
+    }
+    out[len] = carry;
+}
+
+// a must be at least as large as b. out has room for a->len limbs
+static void mag_sub(const struct limbs *a, const struct limbs *b,
+                    uint32_t *out) {
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a->len; ++i) {
+        int64_t diff = (int64_t) a->limbs[i] - borrow;
+        if (i < b->len) {
+            diff -= b->limbs[i];
+        }
+        borrow = diff < 0;
+        out[i] = diff + (borrow << 32);
+    }
+}
+
+// out has room for a->len + b->len limbs
+static void mag_mul(const struct limbs *a, const struct limbs *b,
+                    uint32_t *out) {
+    memset(out, 0, (a->len + b->len) * sizeof(uint32_t));
+    for (size_t i = 0; i < a->len; ++i) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < b->len; ++j) {
+            uint64_t cur = (uint64_t) a->limbs[i] * b->limbs[j]
+                + out[i+j] + carry;
+            out[i+j] = cur;
+            carry = cur >> 32;
+        }
+        out[i + b->len] = carry;
+    }
+}
+
+static plisp_t add_integers(plisp_t x, plisp_t y, bool subtract) {
+    struct limbs a, b;
+    integer_limbs(x, &a);
+    integer_limbs(y, &b);
+    b.negative = b.negative != subtract;
+
+    uint32_t len = (a.len > b.len ? a.len : b.len) + 1;
+    uint32_t *out = malloc(len * sizeof(uint32_t));
+    plisp_t res;
+
+    if (a.negative == b.negative) {
+        mag_add(&a, &b, out);
+        res = make_integer_from(a.negative, out, len);
+    } else if (mag_compare(&a, &b) >= 0) {
+        mag_sub(&a, &b, out);
+        res = make_integer_from(a.negative, out, a.len);
+    } else {
+        mag_sub(&b, &a, out);
+        res = make_integer_from(b.negative, out, b.len);
+    }
+
+    free(out);
+    return res;
+}
+
+static plisp_t mul_integers(plisp_t x, plisp_t y) {
+    struct limbs a, b;
+    integer_limbs(x, &a);
+    integer_limbs(y, &b);
+
+    uint32_t *out = malloc((a.len + b.len + 1) * sizeof(uint32_t));
+    mag_mul(&a, &b, out);
+    plisp_t res = make_integer_from(a.negative != b.negative, out,
+                                    a.len + b.len);
+    free(out);
+    return res;
+}
+
+static int compare_integers(plisp_t x, plisp_t y) {
+    struct limbs a, b;
+    integer_limbs(x, &a);
+    integer_limbs(y, &b);
+
+    if (a.negative != b.negative) {
+        return a.negative ? -1 : 1;
+    }
+    int cmp = mag_compare(&a, &b);
+    return a.negative ? -cmp : cmp;
+}
+
+double plisp_number_to_double(plisp_t num) {
+    if (plisp_c_fixnump(num)) {
+        return plisp_fixnum_value(num);
+    } else if (plisp_c_flonump(num)) {
+        return plisp_flonum_value(num);
+    }
+
+    struct limbs a;
+    integer_limbs(num, &a);
+    double val = 0;
+    for (size_t i = a.len; i-- > 0;) {
+        val = val * 4294967296.0 + a.limbs[i];
+    }
+    return a.negative ? -val : val;
+}
+
+static bool inexact_args(plisp_t a, plisp_t b) {
+    plisp_assert(plisp_c_numberp(a));
+    plisp_assert(plisp_c_numberp(b));
+    return plisp_c_flonump(a) || plisp_c_flonump(b);
+}
+
+plisp_t plisp_num_add(plisp_t a, plisp_t b) {
+    if (((a | b) & LOTAGS) == LT_FIXNUM) {
+        // tagged fixnums add directly, and overflow exactly when the
+        // sum leaves fixnum range
+        int64_t sum;
+        if (!__builtin_add_overflow((int64_t) a, (int64_t) b, &sum)) {
+            return sum;
+        }
+        return plisp_make_integer(plisp_fixnum_value(a)
+                                  + plisp_fixnum_value(b));
+    } else if (inexact_args(a, b)) {
+        return plisp_make_flonum(plisp_number_to_double(a)
+                                 + plisp_number_to_double(b));
+    }
+    return add_integers(a, b, false);
+}
+
+plisp_t plisp_num_sub(plisp_t a, plisp_t b) {
+    if (((a | b) & LOTAGS) == LT_FIXNUM) {
+        int64_t diff;
+        if (!__builtin_sub_overflow((int64_t) a, (int64_t) b, &diff)) {
+            return diff;
+        }
+        return plisp_make_integer(plisp_fixnum_value(a)
+                                  - plisp_fixnum_value(b));
+    } else if (inexact_args(a, b)) {
+        return plisp_make_flonum(plisp_number_to_double(a)
+                                 - plisp_number_to_double(b));
+    }
+    return add_integers(a, b, true);
+}
+
+plisp_t plisp_num_mul(plisp_t a, plisp_t b) {
+    if (plisp_c_fixnump(a) && plisp_c_fixnump(b)) {
+        int64_t prod;
+        if (!__builtin_mul_overflow(plisp_fixnum_value(a),
+                                    plisp_fixnum_value(b), &prod)) {
+            return plisp_make_integer(prod);
+        }
+    } else if (inexact_args(a, b)) {
+        return plisp_make_flonum(plisp_number_to_double(a)
+                                 * plisp_number_to_double(b));
+    }
+    return mul_integers(a, b);
+}
+
+// there are no rationals, so inexact quotients become flonums
+plisp_t plisp_num_div(plisp_t a, plisp_t b) {
+    if (!inexact_args(a, b) && plisp_num_eq(b, plisp_make_fixnum(0))) {
+        fprintf(stderr, "error: division by zero\n");
+        assert(false);
+    }
+
+    if (plisp_c_fixnump(a) && plisp_c_fixnump(b)) {
+        int64_t x = plisp_fixnum_value(a);
+        int64_t y = plisp_fixnum_value(b);
+        if (x % y == 0) {
+            return plisp_make_integer(x / y);
+        }
+    }
+    return plisp_make_flonum(plisp_number_to_double(a)
+                             / plisp_number_to_double(b));
+}
+
+bool plisp_num_lt(plisp_t a, plisp_t b) {
+    if (plisp_c_fixnump(a) && plisp_c_fixnump(b)) {
+        return (intptr_t) a < (intptr_t) b;
+    } else if (inexact_args(a, b)) {
+        return plisp_number_to_double(a) < plisp_number_to_double(b);
+    }
+    return compare_integers(a, b) < 0;
+}
+
+bool plisp_num_eq(plisp_t a, plisp_t b) {
+    if (plisp_c_fixnump(a) && plisp_c_fixnump(b)) {
+        return a == b;
+    } else if (inexact_args(a, b)) {
+        return plisp_number_to_double(a) == plisp_number_to_double(b);
+    }
+    return compare_integers(a, b) == 0;
+}
+
+bool plisp_num_eqv(plisp_t a, plisp_t b) {
+    if (plisp_c_flonump(a) != plisp_c_flonump(b)) {
+        return false;
+    }
+    return plisp_num_eq(a, b);
+}
+
+static void write_flonum(FILE *f, double val) {
+    if (isnan(val)) {
+        fprintf(f, "+nan.0");
+        return;
+    } else if (isinf(val)) {
+        fprintf(f, val < 0 ? "-inf.0" : "+inf.0");
+        return;
+    }
+
+    // the shortest text that reads back as the same double
+    char buf[32];
+    for (int prec = 1; prec <= 17; ++prec) {
+        snprintf(buf, sizeof(buf), "%.*g", prec, val);
+        if (strtod(buf, NULL) == val) {
+            break;
+        }
+    }
+
+    fputs(buf, f);
+    if (strpbrk(buf, ".e") == NULL) {
+        fprintf(f, ".0");
+    }
+}
+
+static void write_bignum(FILE *f, struct plisp_bignum *big) {
+    // peel off base 10^9 digits, least significant first
+    uint32_t *mag = malloc(big->len * sizeof(uint32_t));
+    memcpy(mag, big->limbs, big->len * sizeof(uint32_t));
+    uint32_t *chunks = malloc((big->len * 10 / 9 + 2) * sizeof(uint32_t));
+    size_t nchunks = 0;
+
+    uint32_t len = big->len;
+    do {
+        uint64_t rem = 0;
+        for (size_t i = len; i-- > 0;) {
+            uint64_t cur = (rem << 32) | mag[i];
+            mag[i] = cur / 1000000000;
+            rem = cur % 1000000000;
+        }
+        chunks[nchunks++] = rem;
+        while (len > 0 && mag[len-1] == 0) {
+            --len;
+        }
+    } while (len > 0);
+
+    if (big->negative) {
+        fputc('-', f);
+    }
+    fprintf(f, "%u", chunks[nchunks-1]);
+    for (size_t i = nchunks-1; i-- > 0;) {
+        fprintf(f, "%09u", chunks[i]);
+    }
+
+    free(chunks);
+    free(mag);
+}
+
+void plisp_write_number(FILE *f, plisp_t num) {
+    if (plisp_c_fixnump(num)) {
+        fprintf(f, "%li", plisp_fixnum_value(num));
+    } else if (plisp_c_flonump(num)) {
+        write_flonum(f, plisp_flonum_value(num));
+    } else {
+        plisp_assert(plisp_c_bignump(num));
+        write_bignum(f, number_cell(num)->bignum);
+    }
+}
+
+static plisp_t parse_integer(bool negative, const char *digits) {
+    size_t ndigits = strlen(digits);
+    if (ndigits < 18) {
+        int64_t val = strtoll(digits, NULL, 10);
+        return plisp_make_fixnum(negative ? -val : val);
+    }
+
+    // every 9 digits need less than one limb
+    uint32_t cap = ndigits / 9 + 2;
+    uint32_t *mag = calloc(cap, sizeof(uint32_t));
+    uint32_t len = 0;
+    for (const char *p = digits; *p != '\0'; ++p) {
+        uint64_t carry = *p - '0';
+        for (size_t i = 0; i < len; ++i) {
+            uint64_t cur = (uint64_t) mag[i] * 10 + carry;
+            mag[i] = cur;
+            carry = cur >> 32;
+        }
+        if (carry != 0) {
+            mag[len++] = carry;
+        }
+    }
+
+    plisp_t num = make_integer_from(negative, mag, len);
+    free(mag);
+    return num;
+}
+
+plisp_t plisp_parse_number(const char *text) {
+    if (strcmp(text, "+inf.0") == 0) {
+        return plisp_make_flonum(INFINITY);
+    } else if (strcmp(text, "-inf.0") == 0) {
+        return plisp_make_flonum(-INFINITY);
+    } else if (strcmp(text, "+nan.0") == 0) {
+        return plisp_make_flonum(NAN);
+    }
+
+    const char *p = text;
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+        ++p;
+    }
+    const char *digits = p;
+
+    size_t ndigits = 0;
+    bool inexact = false;
+    while (isdigit(*p)) {
+        ++p;
+        ++ndigits;
+    }
+    if (*p == '.') {
+        inexact = true;
+        ++p;
+        while (isdigit(*p)) {
+            ++p;
+            ++ndigits;
+        }
+    }
+    if (ndigits == 0) {
+        return plisp_unbound;
+    }
+    if (*p == 'e' || *p == 'E') {
+        inexact = true;
+        ++p;
+        if (*p == '-' || *p == '+') {
+            ++p;
+        }
+        if (!isdigit(*p)) {
+            return plisp_unbound;
+        }
+        while (isdigit(*p)) {
+            ++p;
+        }
+    }
+    if (*p != '\0') {
+        return plisp_unbound;
+    }
+
+    if (inexact) {
+        return plisp_make_flonum(strtod(text, NULL));
+    }
+    return parse_integer(negative, digits);
+}
+
+plisp_t plisp_builtin_numeq(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
+    plisp_assert(nargs == 2);
+    plisp_assert(plisp_c_numberp(a));
+    plisp_assert(plisp_c_numberp(b));
+    return plisp_make_bool(plisp_num_eq(a, b));
+}
+
+plisp_t plisp_builtin_divide(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    if (nargs == 1) {
+        return plisp_num_div(plisp_make_fixnum(1), a);
+    }
+    return plisp_num_div(a, b);
+}
+
+plisp_t plisp_builtin_numberp(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_numberp(obj));
+}
+
+plisp_t plisp_builtin_flonump(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_flonump(obj));
+}
+
+plisp_t plisp_builtin_exact_to_inexact(plisp_t *clos, size_t nargs, plisp_t num) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_numberp(num));
+    if (plisp_c_flonump(num)) {
+        return num;
+    }
+    return plisp_make_flonum(plisp_number_to_double(num));
+}
+
+// a double with no fractional part, which may be too large for int64_t
+static plisp_t integer_from_double(double val) {
+    if (val > -9.2e18 && val < 9.2e18) {
+        return plisp_make_integer(val);
+    }
+
+    // take the 53 bit mantissa and shift it into place
+    uint64_t bits;
+    memcpy(&bits, &val, sizeof(bits));
+    int shift = (int) ((bits >> 52) & 0x7ff) - 1075;
+    uint64_t mant = (bits & ((1lu << 52) - 1)) | (1lu << 52);
+
+    uint32_t len = (shift + 53) / 32 + 2;
+    uint32_t *mag = calloc(len, sizeof(uint32_t));
+    size_t limb = shift / 32;
+    int bit = shift % 32;
+    mag[limb] = mant << bit;
+    mag[limb+1] = mant >> (32 - bit);
+    mag[limb+2] = bit == 0 ? 0 : mant >> (64 - bit);
+
+    plisp_t num = make_integer_from(val < 0, mag, len);
+    free(mag);
+    return num;
+}
+
+plisp_t plisp_builtin_inexact_to_exact(plisp_t *clos, size_t nargs, plisp_t num) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_numberp(num));
+    if (!plisp_c_flonump(num)) {
+        return num;
+    }
+
+    // without rationals only integers are representable. doubles this
+    // large have no fractional part
+    double val = plisp_flonum_value(num);
+    bool large = val <= -9.2e18 || val >= 9.2e18;
+    if (isnan(val) || isinf(val)
+        || (!large && val != (double) (int64_t) val)) {
+        fprintf(stderr, "error: no exact representation of ");
+        plisp_write_number(stderr, num);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    return integer_from_double(val);
+}
@@ -1,5 +1,8 @@
 #include <plisp/object.h>
 #include <plisp/gc.h>
+#include <plisp/number.h>
+#include <plisp/text.h>
+#include <plisp/simd.h>
 #include <plisp/saftey.h>
 #include <string.h>
 #include <stdlib.h>
@@ -69,6 +72,12 @@ plisp_t plisp_cdr(plisp_t cons) {
     return cellptr->cdr;
 }
 
+void plisp_set_cdr(plisp_t cons, plisp_t cdr) {
+    plisp_assert(plisp_c_consp(cons));
+    struct plisp_cons *cellptr = (void *) (cons & ~LOTAGS);
+    cellptr->cdr = cdr;
+}
+
 bool plisp_c_nullp(plisp_t val) {
     return val == (0lu | LT_CONS);
 }
@@ -113,6 +122,55 @@ plisp_t plisp_symbol_name(plisp_t val) {
     return (val & ~LOTAGS) | LT_VECTOR;
 }
 
+// the VEC_INT element at idx, sign or zero extended
+static int64_t int_element(struct plisp_vector *vecptr, size_t idx) {
+    bool usigned = vecptr->flags & VFLAG_UNSIGNED;
+    switch (vecptr->elem_width) {
+    case 1:
+        return usigned ? ((uint8_t *) vecptr->vec)[idx]
+                       : ((int8_t *) vecptr->vec)[idx];
+    case 2:
+        return usigned ? ((uint16_t *) vecptr->vec)[idx]
+                       : ((int16_t *) vecptr->vec)[idx];
+    case 4:
+        // without the casts, the signed case would be converted to unsigned
+        return usigned ? (int64_t) ((uint32_t *) vecptr->vec)[idx]
+                       : (int64_t) ((int32_t *) vecptr->vec)[idx];
+    default:
+        plisp_assert(vecptr->elem_width == 8 && !usigned);
+        return ((int64_t *) vecptr->vec)[idx];
+    }
+}
+
+static void set_int_element(struct plisp_vector *vecptr, size_t idx,
+                            plisp_t value) {
+    int64_t val;
+    bool fits = plisp_integer_to_int64(value, &val);
+    unsigned bits = vecptr->elem_width * 8;
+    if (vecptr->flags & VFLAG_UNSIGNED) {
+        fits = fits && val >= 0 && (uint64_t) val >> (bits - 1) >> 1 == 0;
+    } else if (bits < 64) {
+        fits = fits && val >= -(INT64_C(1) << (bits - 1))
+                    && val < INT64_C(1) << (bits - 1);
+    }
+    plisp_assert(fits);
+
+    switch (vecptr->elem_width) {
+    case 1:
+        ((uint8_t *) vecptr->vec)[idx] = val;
+        break;
+    case 2:
+        ((uint16_t *) vecptr->vec)[idx] = val;
+        break;
+    case 4:
+        ((uint32_t *) vecptr->vec)[idx] = val;
+        break;
+    default:
+        ((int64_t *) vecptr->vec)[idx] = val;
+        break;
+    }
+}
+
 bool plisp_c_vectorp(plisp_t val) {
     return (val & LOTAGS) == LT_VECTOR;
 }
@@ -128,7 +186,8 @@ plisp_t plisp_make_vector(enum plisp_vec_type type, uint8_t
     vecptr->elem_width = elem_width;
     vecptr->flags      = flags;
     vecptr->len        = len;
-    vecptr->vec        = malloc(len * elem_width);
+    // zeroed, since the collector traces vectors of objects
+    vecptr->vec        = calloc(len, elem_width);
 
     if (use_ie) {
         for (size_t i = 0; i < len; ++i) {
@@ -152,7 +211,11 @@ plisp_t plisp_vector_ref(plisp_t vec, size_t idx) {
         // TODO: support utf-16 and utf-32 strings
         plisp_assert(vecptr->elem_width == sizeof(char));
         return plisp_make_char(*(char *)(vecptr->vec + vecptr->elem_width * idx));
-
+    } else if (vecptr->type == VEC_FLOAT) {
+        plisp_assert(vecptr->elem_width == sizeof(double));
+        return plisp_make_flonum(((double *) vecptr->vec)[idx]);
+    } else if (vecptr->type == VEC_INT) {
+        return plisp_make_integer(int_element(vecptr, idx));
     } else {
         //TODO
         assert(false);
@@ -171,6 +234,12 @@ void plisp_vector_set(plisp_t vec, size_t idx, plisp_t value) {
     if (vecptr->type == VEC_OBJ) {
         plisp_assert(vecptr->elem_width == sizeof(plisp_t));
         *(plisp_t *)(vecptr->vec + vecptr->elem_width * idx) = value;
+    } else if (vecptr->type == VEC_FLOAT) {
+        plisp_assert(vecptr->elem_width == sizeof(double));
+        plisp_assert(plisp_c_numberp(value));
+        ((double *) vecptr->vec)[idx] = plisp_number_to_double(value);
+    } else if (vecptr->type == VEC_INT) {
+        set_int_element(vecptr, idx, value);
     } else {
         //TODO
         assert(false);
@@ -183,6 +252,31 @@ size_t plisp_vector_c_length(plisp_t vec) {
     return vecptr->len;
 }
 
+plisp_t *plisp_vector_objs(plisp_t vec) {
+    plisp_assert(plisp_c_vectorp(vec));
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    plisp_assert(vecptr->type == VEC_OBJ);
+    return vecptr->vec;
+}
+
+plisp_t plisp_make_slice(plisp_t vec, size_t start, size_t end) {
+    plisp_assert(plisp_c_vectorp(vec));
+    plisp_assert(start <= end && end <= plisp_vector_c_length(vec));
+
+    // the payload isn't the slice's to free
+    plisp_t slice = plisp_alloc_obj(LT_VECTOR, false);
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    struct plisp_vector *sliceptr = (void *) (slice & ~LOTAGS);
+
+    *sliceptr = *vecptr;
+    sliceptr->flags |= VFLAG_SLICE;
+    sliceptr->len = end - start;
+    sliceptr->vec = vecptr->vec + start * vecptr->elem_width;
+    plisp_gc_set_owner(slice, vec);
+
+    return slice;
+}
+
 bool plisp_c_stringp(plisp_t val) {
     struct plisp_vector *strptr = (void *) (val & ~LOTAGS);
     return plisp_c_vectorp(val) && strptr->type == VEC_CHAR;
@@ -206,6 +300,12 @@ const char *plisp_string_value(plisp_t str) {
     return strptr->vec;
 }
 
+char *plisp_string_cstring(plisp_t str) {
+    plisp_assert(plisp_c_stringp(str));
+    struct plisp_vector *strptr = (void *) (str & ~LOTAGS);
+    return strndup(strptr->vec, strptr->len - 1);
+}
+
 size_t plisp_c_stringlen(plisp_t str) {
     plisp_assert(plisp_c_stringp(str));
     struct plisp_vector *strptr = (void *) (str & ~LOTAGS);
@@ -248,12 +348,49 @@ plisp_t *plisp_get_consbox(plisp_t consbox) {
     return &(cellptr->car);
 }
 
+// whether o1 and o2 are vectors of the same unboxed element type
+static bool unboxed_vectors(plisp_t o1, plisp_t o2) {
+    if (!plisp_c_vectorp(o1) || !plisp_c_vectorp(o2)) {
+        return false;
+    }
+    struct plisp_vector *v1 = (void *) (o1 & ~LOTAGS);
+    struct plisp_vector *v2 = (void *) (o2 & ~LOTAGS);
+    return v1->type != VEC_OBJ && v1->type == v2->type
+        && v1->elem_width == v2->elem_width
+        && (v1->flags & VFLAG_UNSIGNED) == (v2->flags & VFLAG_UNSIGNED);
+}
+
+static bool unboxed_equal(plisp_t o1, plisp_t o2) {
+    struct plisp_vector *v1 = (void *) (o1 & ~LOTAGS);
+    struct plisp_vector *v2 = (void *) (o2 & ~LOTAGS);
+    if (v1->len != v2->len) {
+        return false;
+    }
+
+    if (v1->type == VEC_FLOAT) {
+        // not bitwise, since 0.0 and -0.0 are equal and nans aren't
+        for (size_t i = 0; i < v1->len; ++i) {
+            if (((double *) v1->vec)[i] != ((double *) v2->vec)[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t bytes = v1->len * v1->elem_width;
+    return plisp_simd_mismatch(v1->vec, v2->vec, bytes) == bytes;
+}
+
 bool plisp_c_equal(plisp_t o1, plisp_t o2) {
     if (o1 == o2) {
         return true;
     } else if (plisp_c_consp(o1) && plisp_c_consp(o2)) {
         return plisp_c_equal(plisp_car(o1), plisp_car(o2))
             && plisp_c_equal(plisp_cdr(o1), plisp_cdr(o2));
+    } else if (plisp_c_stringp(o1) && plisp_c_stringp(o2)) {
+        return plisp_c_string_equal(o1, o2);
+    } else if (unboxed_vectors(o1, o2)) {
+        return unboxed_equal(o1, o2);
     } else if (plisp_c_vectorp(o1) && plisp_c_vectorp(o2)) {
         if (plisp_vector_c_length(o1) == plisp_vector_c_length(o2)) {
             for (size_t i = 0; i < plisp_vector_c_length(o1); ++i) {
@@ -265,6 +402,8 @@ bool plisp_c_equal(plisp_t o1, plisp_t o2) {
 
             return true;
         }
+    } else if (plisp_c_numberp(o1) && plisp_c_numberp(o2)) {
+        return plisp_num_eqv(o1, o2);
     }
 
     return false;
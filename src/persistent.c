@@ -0,0 +1,1193 @@
+#include <plisp/persistent.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+persistent maps are compressed hash array mapped tries. each node
+takes 5 bits of the hash of a key, and has one bitmap of the branches
+that hold an entry and another of those that hold a child node, and
+stores just those, the entries first. once the hash runs out, a node
+holds its colliding entries in a row. a removal that leaves a child
+with one entry pulls that entry up, so equal maps have the same shape.
+
+persistent vectors are 32 way tries of their elements, apart from the
+last 32 or fewer, which are kept in a tail node of their own. pushing
+copies just the tail until it fills up and joins the trie.
+
+nodes are object vectors, so the collector traces and frees them like
+anything else. an update copies the nodes on the path to what it
+changed and shares the rest with the old version, so it costs log32 n
+copies of at most 33 words. the first slot of every node is the edit
+of the transient that made it, or 0. a transient changes the nodes of
+its own edit in place, and making it persistent retires its edit, so
+those nodes are never changed again.
+*/
+
+#define BITS 5
+#define WIDTH (1 << BITS)
+#define MASK (WIDTH - 1)
+// below this many bits of hash, nodes hold collisions
+#define HASH_BITS 64
+
+// the slots every map node starts with
+enum {
+    NODE_EDIT,
+    NODE_DATAMAP,
+    NODE_NODEMAP,
+    MAP_HEADER,
+};
+
+// vector nodes are the edit followed by WIDTH children or elements,
+// except for the tail of persistent vectors, which is as long as it
+// needs to be
+#define VEC_HEADER 1
+#define FULL_NODE (VEC_HEADER + WIDTH)
+// what the unused slots of vector nodes hold
+#define NO_NODE ((plisp_t) LT_FIXNUM)
+
+// the edit of a persistent version is 0. a transient that has been
+// made persistent has its edit negated.
+struct pmap {
+    enum plisp_hash_kind kind;
+    int64_t edit;
+    // whether any key is hashed by address, and plisp_gc_moves when
+    // they were hashed
+    bool address_keys;
+    size_t moves;
+    size_t count;
+    plisp_t root;
+};
+
+struct pvec {
+    int64_t edit;
+    size_t count;
+    // of the level below the root
+    unsigned shift;
+    plisp_t root;
+    plisp_t tail;
+};
+
+// what an update changed, and how
+struct change {
+    enum plisp_hash_kind kind;
+    int64_t edit;
+    bool addressed;
+    // whether an entry was added or removed
+    bool resized;
+};
+
+static plisp_t pmap_sym;
+static plisp_t pvector_sym;
+static int64_t last_edit = 0;
+
+// shared by the empty versions, and never changed
+static plisp_t empty_map_root;
+static plisp_t empty_vec_root;
+static plisp_t empty_vec_tail;
+
+static void trace_pmap(void *data, void (*trace)(plisp_t));
+static void trace_pvec(void *data, void (*trace)(plisp_t));
+
+static plisp_t make_pmap(struct plisp_closure_data *kind, size_t nargs);
+static plisp_t pmap_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t pmap_ref(plisp_t *clos, size_t nargs, plisp_t map,
+                        plisp_t key, plisp_t fail);
+static plisp_t pmap_ref_default(plisp_t *clos, size_t nargs, plisp_t map,
+                                plisp_t key, plisp_t dflt);
+static plisp_t pmap_set(plisp_t *clos, size_t nargs, plisp_t map,
+                        plisp_t key, plisp_t value);
+static plisp_t pmap_set_x(plisp_t *clos, size_t nargs, plisp_t map,
+                          plisp_t key, plisp_t value);
+static plisp_t pmap_delete(plisp_t *clos, size_t nargs, plisp_t map,
+                           plisp_t key);
+static plisp_t pmap_delete_x(plisp_t *clos, size_t nargs, plisp_t map,
+                             plisp_t key);
+static plisp_t pmap_contains(plisp_t *clos, size_t nargs, plisp_t map,
+                             plisp_t key);
+static plisp_t pmap_count(plisp_t *clos, size_t nargs, plisp_t map);
+static plisp_t pmap_fold(plisp_t *clos, size_t nargs, plisp_t map,
+                         plisp_t kons, plisp_t knil);
+static plisp_t pmap_to_alist(plisp_t *clos, size_t nargs, plisp_t map);
+
+static plisp_t pvector(plisp_t *clos, size_t nargs, ...);
+static plisp_t list_to_pvector(plisp_t *clos, size_t nargs, plisp_t lst);
+static plisp_t pvector_to_list(plisp_t *clos, size_t nargs, plisp_t vec);
+static plisp_t pvector_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t pvector_length(plisp_t *clos, size_t nargs, plisp_t vec);
+static plisp_t pvector_ref(plisp_t *clos, size_t nargs, plisp_t vec,
+                           plisp_t idx);
+static plisp_t pvector_set(plisp_t *clos, size_t nargs, plisp_t vec,
+                           plisp_t idx, plisp_t value);
+static plisp_t pvector_set_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                             plisp_t idx, plisp_t value);
+static plisp_t pvector_push(plisp_t *clos, size_t nargs, plisp_t vec,
+                            plisp_t value);
+static plisp_t pvector_push_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                              plisp_t value);
+static plisp_t pvector_pop(plisp_t *clos, size_t nargs, plisp_t vec);
+static plisp_t pvector_pop_x(plisp_t *clos, size_t nargs, plisp_t vec);
+
+static plisp_t transient(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t persistent(plisp_t *clos, size_t nargs, plisp_t obj);
+
+static plisp_t new_node(size_t len, int64_t edit);
+
+static void define_kind_builtin(enum plisp_hash_kind kind, const char *name) {
+    struct plisp_closure_data *data = malloc(sizeof(struct plisp_closure_data)
+                                             + sizeof(plisp_t));
+    data->length = 1;
+    data->objs[0] = plisp_make_fixnum(kind);
+    plisp_define_builtin_data(name, (plisp_fn_t) make_pmap, data);
+}
+
+void plisp_init_persistent(void) {
+    pmap_sym = plisp_intern(plisp_make_symbol("pmap"));
+    pvector_sym = plisp_intern(plisp_make_symbol("pvector"));
+    plisp_gc_custom_tracer(pmap_sym, trace_pmap);
+    plisp_gc_custom_tracer(pvector_sym, trace_pvec);
+
+    empty_map_root = new_node(MAP_HEADER, 0);
+    plisp_gc_permanent(empty_map_root);
+    empty_vec_root = new_node(FULL_NODE, 0);
+    plisp_gc_permanent(empty_vec_root);
+    empty_vec_tail = new_node(VEC_HEADER, 0);
+    plisp_gc_permanent(empty_vec_tail);
+
+    define_kind_builtin(HASH_EQ, "make-eq-pmap");
+    define_kind_builtin(HASH_EQV, "make-eqv-pmap");
+    define_kind_builtin(HASH_EQUAL, "make-pmap");
+    define_kind_builtin(HASH_STRING, "make-string-pmap");
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("pmap?", pmap_p);
+    plisp_define_builtin("pmap-ref", pmap_ref);
+    plisp_define_builtin("pmap-ref/default", pmap_ref_default);
+    plisp_define_builtin("pmap-set", pmap_set);
+    plisp_define_builtin("pmap-set!", pmap_set_x);
+    plisp_define_builtin("pmap-delete", pmap_delete);
+    plisp_define_builtin("pmap-delete!", pmap_delete_x);
+    plisp_define_builtin("pmap-contains?", pmap_contains);
+    plisp_define_builtin("pmap-count", pmap_count);
+    plisp_define_builtin("pmap-fold", pmap_fold);
+    plisp_define_builtin("pmap->alist", pmap_to_alist);
+
+    plisp_define_builtin("pvector", pvector);
+    plisp_define_builtin("list->pvector", list_to_pvector);
+    plisp_define_builtin("pvector->list", pvector_to_list);
+    plisp_define_builtin("pvector?", pvector_p);
+    plisp_define_builtin("pvector-length", pvector_length);
+    plisp_define_builtin("pvector-ref", pvector_ref);
+    plisp_define_builtin("pvector-set", pvector_set);
+    plisp_define_builtin("pvector-set!", pvector_set_x);
+    plisp_define_builtin("pvector-push", pvector_push);
+    plisp_define_builtin("pvector-push!", pvector_push_x);
+    plisp_define_builtin("pvector-pop", pvector_pop);
+    plisp_define_builtin("pvector-pop!", pvector_pop_x);
+
+    plisp_define_builtin("transient", transient);
+    plisp_define_builtin("persistent!", persistent);
+
+    #pragma GCC diagnostic pop
+}
+
+static void trace_pmap(void *data, void (*trace)(plisp_t)) {
+    struct pmap *map = data;
+    trace(map->root);
+}
+
+static void trace_pvec(void *data, void (*trace)(plisp_t)) {
+    struct pvec *vec = data;
+    trace(vec->root);
+    trace(vec->tail);
+}
+
+static int64_t new_edit(void) {
+    return __atomic_add_fetch(&last_edit, 1, __ATOMIC_RELAXED);
+}
+
+/*
+nodes
+*/
+
+static plisp_t *objs(plisp_t node) {
+    return plisp_vector_objs(node);
+}
+
+static size_t node_len(plisp_t node) {
+    return plisp_vector_c_length(node);
+}
+
+// a node of len slots, with the ones after the edit unused
+static plisp_t new_node(size_t len, int64_t edit) {
+    plisp_t node = plisp_make_vector(VEC_OBJ, sizeof(plisp_t), 0, len,
+                                     plisp_nil, false);
+    objs(node)[NODE_EDIT] = plisp_make_fixnum(edit);
+    return node;
+}
+
+static bool owned(plisp_t node, int64_t edit) {
+    return edit != 0 && objs(node)[NODE_EDIT] == plisp_make_fixnum(edit);
+}
+
+// node, or a copy of it if it isn't edit's to change
+static plisp_t editable(plisp_t node, int64_t edit) {
+    if (owned(node, edit)) {
+        return node;
+    }
+
+    size_t len = node_len(node);
+    plisp_t copy = new_node(len, edit);
+    memcpy(objs(copy) + 1, objs(node) + 1, (len - 1) * sizeof(plisp_t));
+    return copy;
+}
+
+/*
+maps
+*/
+
+static uint32_t datamap(plisp_t node) {
+    return plisp_fixnum_value(objs(node)[NODE_DATAMAP]);
+}
+
+static uint32_t nodemap(plisp_t node) {
+    return plisp_fixnum_value(objs(node)[NODE_NODEMAP]);
+}
+
+static uint32_t branch_bit(uint64_t hash, unsigned shift) {
+    return 1u << ((hash >> shift) & MASK);
+}
+
+// how many of the branches in map come before bit
+static size_t below(uint32_t map, uint32_t bit) {
+    return __builtin_popcount(map & (bit - 1));
+}
+
+// the slot of the child at bit
+static size_t child_slot(plisp_t node, uint32_t bit) {
+    return MAP_HEADER + 2 * __builtin_popcount(datamap(node))
+        + below(nodemap(node), bit);
+}
+
+static bool node_lookup(plisp_t node, enum plisp_hash_kind kind,
+                        uint64_t hash, plisp_t key, plisp_t *out) {
+    for (unsigned shift = 0;; shift += BITS) {
+        plisp_t *slots = objs(node);
+        if (shift >= HASH_BITS) {
+            for (size_t i = MAP_HEADER; i < node_len(node); i += 2) {
+                if (plisp_hash_keys_equal(kind, slots[i], key)) {
+                    *out = slots[i + 1];
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        uint32_t bit = branch_bit(hash, shift);
+        if (datamap(node) & bit) {
+            size_t i = MAP_HEADER + 2 * below(datamap(node), bit);
+            if (plisp_hash_keys_equal(kind, slots[i], key)) {
+                *out = slots[i + 1];
+                return true;
+            }
+            return false;
+        } else if (!(nodemap(node) & bit)) {
+            return false;
+        }
+        node = slots[child_slot(node, bit)];
+    }
+}
+
+// a node at shift holding both entries
+static plisp_t merge_entries(plisp_t key1, plisp_t value1, uint64_t hash1,
+                             plisp_t key2, plisp_t value2, uint64_t hash2,
+                             unsigned shift, int64_t edit) {
+    if (shift >= HASH_BITS) {
+        plisp_t node = new_node(MAP_HEADER + 4, edit);
+        plisp_t *slots = objs(node);
+        slots[NODE_DATAMAP] = plisp_make_fixnum(0);
+        slots[NODE_NODEMAP] = plisp_make_fixnum(0);
+        slots[MAP_HEADER] = key1;
+        slots[MAP_HEADER + 1] = value1;
+        slots[MAP_HEADER + 2] = key2;
+        slots[MAP_HEADER + 3] = value2;
+        return node;
+    }
+
+    uint32_t bit1 = branch_bit(hash1, shift);
+    uint32_t bit2 = branch_bit(hash2, shift);
+    if (bit1 == bit2) {
+        plisp_t child = merge_entries(key1, value1, hash1, key2, value2,
+                                      hash2, shift + BITS, edit);
+        plisp_t node = new_node(MAP_HEADER + 1, edit);
+        plisp_t *slots = objs(node);
+        slots[NODE_DATAMAP] = plisp_make_fixnum(0);
+        slots[NODE_NODEMAP] = plisp_make_fixnum(bit1);
+        slots[MAP_HEADER] = child;
+        return node;
+    }
+
+    plisp_t node = new_node(MAP_HEADER + 4, edit);
+    plisp_t *slots = objs(node);
+    slots[NODE_DATAMAP] = plisp_make_fixnum(bit1 | bit2);
+    slots[NODE_NODEMAP] = plisp_make_fixnum(0);
+    size_t first = bit1 < bit2 ? MAP_HEADER : MAP_HEADER + 2;
+    size_t second = bit1 < bit2 ? MAP_HEADER + 2 : MAP_HEADER;
+    slots[first] = key1;
+    slots[first + 1] = value1;
+    slots[second] = key2;
+    slots[second + 1] = value2;
+    return node;
+}
+
+// node with the value at slot i replaced
+static plisp_t replace_value(plisp_t node, size_t i, plisp_t value,
+                             int64_t edit) {
+    if (objs(node)[i + 1] == value) {
+        return node;
+    }
+    plisp_t fresh = editable(node, edit);
+    objs(fresh)[i + 1] = value;
+    return fresh;
+}
+
+// node with an entry inserted at slot i, and its bitmaps set to
+// datamap and nodemap
+static plisp_t insert_entry(plisp_t node, size_t i, plisp_t key,
+                            plisp_t value, uint32_t dmap, uint32_t nmap,
+                            int64_t edit) {
+    size_t len = node_len(node);
+    plisp_t fresh = new_node(len + 2, edit);
+    plisp_t *from = objs(node);
+    plisp_t *to = objs(fresh);
+    to[NODE_DATAMAP] = plisp_make_fixnum(dmap);
+    to[NODE_NODEMAP] = plisp_make_fixnum(nmap);
+    memcpy(to + MAP_HEADER, from + MAP_HEADER,
+           (i - MAP_HEADER) * sizeof(plisp_t));
+    to[i] = key;
+    to[i + 1] = value;
+    memcpy(to + i + 2, from + i, (len - i) * sizeof(plisp_t));
+    return fresh;
+}
+
+static plisp_t node_set(plisp_t node, unsigned shift, uint64_t hash,
+                        plisp_t key, plisp_t value, struct change *ch) {
+    if (shift >= HASH_BITS) {
+        size_t len = node_len(node);
+        for (size_t i = MAP_HEADER; i < len; i += 2) {
+            if (plisp_hash_keys_equal(ch->kind, objs(node)[i], key)) {
+                return replace_value(node, i, value, ch->edit);
+            }
+        }
+        ch->resized = true;
+        return insert_entry(node, len, key, value, 0, 0, ch->edit);
+    }
+
+    uint32_t bit = branch_bit(hash, shift);
+    uint32_t dmap = datamap(node);
+    uint32_t nmap = nodemap(node);
+
+    if (dmap & bit) {
+        size_t i = MAP_HEADER + 2 * below(dmap, bit);
+        plisp_t other = objs(node)[i];
+        if (plisp_hash_keys_equal(ch->kind, other, key)) {
+            return replace_value(node, i, value, ch->edit);
+        }
+
+        // both entries move down into a new child
+        uint64_t other_hash = plisp_hash_key(ch->kind, other,
+                                             &ch->addressed);
+        plisp_t child = merge_entries(other, objs(node)[i + 1], other_hash,
+                                      key, value, hash, shift + BITS,
+                                      ch->edit);
+        ch->resized = true;
+
+        size_t len = node_len(node);
+        size_t children = MAP_HEADER + 2 * __builtin_popcount(dmap);
+        size_t before = below(nmap, bit);
+        plisp_t fresh = new_node(len - 1, ch->edit);
+        plisp_t *from = objs(node);
+        plisp_t *to = objs(fresh);
+        to[NODE_DATAMAP] = plisp_make_fixnum(dmap ^ bit);
+        to[NODE_NODEMAP] = plisp_make_fixnum(nmap | bit);
+        memcpy(to + MAP_HEADER, from + MAP_HEADER,
+               (i - MAP_HEADER) * sizeof(plisp_t));
+        memcpy(to + i, from + i + 2, (children - i - 2) * sizeof(plisp_t));
+        memcpy(to + children - 2, from + children, before * sizeof(plisp_t));
+        to[children - 2 + before] = child;
+        memcpy(to + children - 1 + before, from + children + before,
+               (len - children - before) * sizeof(plisp_t));
+        return fresh;
+    } else if (nmap & bit) {
+        size_t slot = child_slot(node, bit);
+        plisp_t child = objs(node)[slot];
+        plisp_t updated = node_set(child, shift + BITS, hash, key, value, ch);
+        if (updated == child) {
+            return node;
+        }
+        plisp_t fresh = editable(node, ch->edit);
+        objs(fresh)[slot] = updated;
+        return fresh;
+    }
+
+    ch->resized = true;
+    return insert_entry(node, MAP_HEADER + 2 * below(dmap, bit), key, value,
+                        dmap | bit, nmap, ch->edit);
+}
+
+// node without the two slots at i, and its bitmaps set to datamap and
+// nodemap
+static plisp_t remove_slots(plisp_t node, size_t i, uint32_t dmap,
+                            uint32_t nmap, int64_t edit) {
+    size_t len = node_len(node);
+    plisp_t fresh = new_node(len - 2, edit);
+    plisp_t *from = objs(node);
+    plisp_t *to = objs(fresh);
+    to[NODE_DATAMAP] = plisp_make_fixnum(dmap);
+    to[NODE_NODEMAP] = plisp_make_fixnum(nmap);
+    memcpy(to + MAP_HEADER, from + MAP_HEADER,
+           (i - MAP_HEADER) * sizeof(plisp_t));
+    memcpy(to + i, from + i + 2, (len - i - 2) * sizeof(plisp_t));
+    return fresh;
+}
+
+// whether node holds just one entry, which its parent should hold
+// instead
+static bool single_entry(plisp_t node) {
+    return node_len(node) == MAP_HEADER + 2 && nodemap(node) == 0;
+}
+
+static plisp_t node_delete(plisp_t node, unsigned shift, uint64_t hash,
+                           plisp_t key, struct change *ch) {
+    if (shift >= HASH_BITS) {
+        for (size_t i = MAP_HEADER; i < node_len(node); i += 2) {
+            if (plisp_hash_keys_equal(ch->kind, objs(node)[i], key)) {
+                ch->resized = true;
+                return remove_slots(node, i, 0, 0, ch->edit);
+            }
+        }
+        return node;
+    }
+
+    uint32_t bit = branch_bit(hash, shift);
+    uint32_t dmap = datamap(node);
+    uint32_t nmap = nodemap(node);
+
+    if (dmap & bit) {
+        size_t i = MAP_HEADER + 2 * below(dmap, bit);
+        if (!plisp_hash_keys_equal(ch->kind, objs(node)[i], key)) {
+            return node;
+        }
+        ch->resized = true;
+        return remove_slots(node, i, dmap ^ bit, nmap, ch->edit);
+    } else if (!(nmap & bit)) {
+        return node;
+    }
+
+    size_t slot = child_slot(node, bit);
+    plisp_t child = objs(node)[slot];
+    plisp_t updated = node_delete(child, shift + BITS, hash, key, ch);
+    if (!ch->resized) {
+        return node;
+    }
+
+    if (single_entry(updated)) {
+        // the child's last entry takes its place
+        size_t len = node_len(node);
+        size_t i = MAP_HEADER + 2 * below(dmap, bit);
+        size_t children = MAP_HEADER + 2 * __builtin_popcount(dmap);
+        size_t before = below(nmap, bit);
+        plisp_t fresh = new_node(len + 1, ch->edit);
+        plisp_t *from = objs(node);
+        plisp_t *to = objs(fresh);
+        to[NODE_DATAMAP] = plisp_make_fixnum(dmap | bit);
+        to[NODE_NODEMAP] = plisp_make_fixnum(nmap ^ bit);
+        memcpy(to + MAP_HEADER, from + MAP_HEADER,
+               (i - MAP_HEADER) * sizeof(plisp_t));
+        to[i] = objs(updated)[MAP_HEADER];
+        to[i + 1] = objs(updated)[MAP_HEADER + 1];
+        memcpy(to + i + 2, from + i, (children - i) * sizeof(plisp_t));
+        memcpy(to + children + 2, from + children, before * sizeof(plisp_t));
+        memcpy(to + children + 2 + before, from + children + before + 1,
+               (len - children - before - 1) * sizeof(plisp_t));
+        return fresh;
+    } else if (updated == child) {
+        return node;
+    }
+
+    plisp_t fresh = editable(node, ch->edit);
+    objs(fresh)[slot] = updated;
+    return fresh;
+}
+
+// calls fn on every entry under node
+static void node_walk(plisp_t node, unsigned shift,
+                      void (*fn)(void *, plisp_t, plisp_t), void *arg) {
+    size_t data_end = shift >= HASH_BITS
+        ? node_len(node) : MAP_HEADER + 2 * __builtin_popcount(datamap(node));
+    for (size_t i = MAP_HEADER; i < data_end; i += 2) {
+        fn(arg, objs(node)[i], objs(node)[i + 1]);
+    }
+    for (size_t i = data_end; i < node_len(node); ++i) {
+        node_walk(objs(node)[i], shift + BITS, fn, arg);
+    }
+}
+
+static plisp_t wrap_pmap(struct pmap *map) {
+    // the collector can't see map until it is wrapped
+    volatile plisp_t root = map->root;
+    plisp_t obj = plisp_make_custom(pmap_sym, map);
+    (void) root;
+    return obj;
+}
+
+bool plisp_c_pmapp(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == pmap_sym;
+}
+
+plisp_t plisp_make_pmap(enum plisp_hash_kind kind) {
+    struct pmap *map = calloc(1, sizeof(struct pmap));
+    map->kind = kind;
+    map->moves = plisp_gc_moves();
+    map->root = empty_map_root;
+    return wrap_pmap(map);
+}
+
+static void reinsert(void *arg, plisp_t key, plisp_t value) {
+    struct pmap *map = arg;
+    struct change ch = { map->kind, map->edit, false, false };
+    uint64_t hash = plisp_hash_key(map->kind, key, &ch.addressed);
+    map->root = node_set(map->root, 0, hash, key, value, &ch);
+    map->address_keys = map->address_keys || ch.addressed;
+}
+
+// the map of obj, rebuilt first if the collector has moved its keys
+// since they were hashed
+static struct pmap *get_pmap(plisp_t obj) {
+    if (!plisp_c_pmapp(obj)) {
+        fprintf(stderr, "error: expected a persistent map, got ");
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+
+    struct pmap *map = plisp_custom_data(obj);
+    if (map->edit < 0) {
+        fprintf(stderr, "error: transient used after persistent!\n");
+        assert(false);
+    }
+
+    if (map->address_keys && map->moves != plisp_gc_moves()) {
+        // into nodes of a fresh edit, so other versions keep theirs
+        plisp_t old = map->root;
+        int64_t edit = map->edit;
+        map->root = empty_map_root;
+        map->edit = new_edit();
+        map->address_keys = false;
+        map->moves = plisp_gc_moves();
+        node_walk(old, 0, reinsert, map);
+        map->edit = edit;
+    }
+    return map;
+}
+
+bool plisp_pmap_lookup(plisp_t obj, plisp_t key, plisp_t *out) {
+    struct pmap *map = get_pmap(obj);
+    bool addressed = false;
+    uint64_t hash = plisp_hash_key(map->kind, key, &addressed);
+    return node_lookup(map->root, map->kind, hash, key, out);
+}
+
+// the map to change, which is obj for a transient and a copy of it
+// otherwise
+static plisp_t changed_pmap(plisp_t obj) {
+    struct pmap *map = get_pmap(obj);
+    if (map->edit != 0) {
+        return obj;
+    }
+    struct pmap *copy = malloc(sizeof(struct pmap));
+    *copy = *map;
+    return wrap_pmap(copy);
+}
+
+plisp_t plisp_pmap_set(plisp_t obj, plisp_t key, plisp_t value) {
+    plisp_t out = changed_pmap(obj);
+    struct pmap *map = plisp_custom_data(out);
+    struct change ch = { map->kind, map->edit, false, false };
+    uint64_t hash = plisp_hash_key(map->kind, key, &ch.addressed);
+    map->root = node_set(map->root, 0, hash, key, value, &ch);
+    map->address_keys = map->address_keys || ch.addressed;
+    if (ch.resized) {
+        map->count++;
+    }
+    return out;
+}
+
+plisp_t plisp_pmap_delete(plisp_t obj, plisp_t key) {
+    plisp_t out = changed_pmap(obj);
+    struct pmap *map = plisp_custom_data(out);
+    struct change ch = { map->kind, map->edit, false, false };
+    uint64_t hash = plisp_hash_key(map->kind, key, &ch.addressed);
+    map->root = node_delete(map->root, 0, hash, key, &ch);
+    if (ch.resized) {
+        map->count--;
+    }
+    return out;
+}
+
+size_t plisp_pmap_count(plisp_t obj) {
+    return get_pmap(obj)->count;
+}
+
+/*
+vectors
+*/
+
+bool plisp_c_pvectorp(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == pvector_sym;
+}
+
+static plisp_t wrap_pvec(struct pvec *vec) {
+    volatile plisp_t root = vec->root;
+    volatile plisp_t tail = vec->tail;
+    plisp_t obj = plisp_make_custom(pvector_sym, vec);
+    (void) root;
+    (void) tail;
+    return obj;
+}
+
+plisp_t plisp_make_pvector(void) {
+    struct pvec *vec = calloc(1, sizeof(struct pvec));
+    vec->shift = BITS;
+    vec->root = empty_vec_root;
+    vec->tail = empty_vec_tail;
+    return wrap_pvec(vec);
+}
+
+static struct pvec *get_pvec(plisp_t obj) {
+    if (!plisp_c_pvectorp(obj)) {
+        fprintf(stderr, "error: expected a persistent vector, got ");
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+
+    struct pvec *vec = plisp_custom_data(obj);
+    if (vec->edit < 0) {
+        fprintf(stderr, "error: transient used after persistent!\n");
+        assert(false);
+    }
+    return vec;
+}
+
+static plisp_t changed_pvec(plisp_t obj) {
+    struct pvec *vec = get_pvec(obj);
+    if (vec->edit != 0) {
+        return obj;
+    }
+    struct pvec *copy = malloc(sizeof(struct pvec));
+    *copy = *vec;
+    return wrap_pvec(copy);
+}
+
+// the index of the first element in the tail
+static size_t tail_offset(size_t count) {
+    return count < WIDTH ? 0 : ((count - 1) >> BITS) << BITS;
+}
+
+static void check_index(struct pvec *vec, size_t idx) {
+    if (idx >= vec->count) {
+        fprintf(stderr, "error: index %lu out of range for a persistent "
+                "vector of length %lu\n", idx, vec->count);
+        assert(false);
+    }
+}
+
+// the node holding the element at idx
+static plisp_t leaf_for(struct pvec *vec, size_t idx) {
+    if (idx >= tail_offset(vec->count)) {
+        return vec->tail;
+    }
+    plisp_t node = vec->root;
+    for (unsigned level = vec->shift; level > 0; level -= BITS) {
+        node = objs(node)[VEC_HEADER + ((idx >> level) & MASK)];
+    }
+    return node;
+}
+
+plisp_t plisp_pvector_ref(plisp_t obj, size_t idx) {
+    struct pvec *vec = get_pvec(obj);
+    check_index(vec, idx);
+    return objs(leaf_for(vec, idx))[VEC_HEADER + (idx & MASK)];
+}
+
+static plisp_t assoc_leaf(plisp_t node, unsigned level, size_t idx,
+                          plisp_t value, int64_t edit) {
+    plisp_t fresh = editable(node, edit);
+    if (level == 0) {
+        objs(fresh)[VEC_HEADER + (idx & MASK)] = value;
+        return fresh;
+    }
+
+    size_t slot = VEC_HEADER + ((idx >> level) & MASK);
+    plisp_t child = assoc_leaf(objs(fresh)[slot], level - BITS, idx, value,
+                               edit);
+    objs(fresh)[slot] = child;
+    return fresh;
+}
+
+plisp_t plisp_pvector_set(plisp_t obj, size_t idx, plisp_t value) {
+    check_index(get_pvec(obj), idx);
+    plisp_t out = changed_pvec(obj);
+    struct pvec *vec = plisp_custom_data(out);
+    if (idx >= tail_offset(vec->count)) {
+        plisp_t tail = editable(vec->tail, vec->edit);
+        objs(tail)[VEC_HEADER + (idx & MASK)] = value;
+        vec->tail = tail;
+    } else {
+        vec->root = assoc_leaf(vec->root, vec->shift, idx, value, vec->edit);
+    }
+    return out;
+}
+
+// node under a chain of new parents reaching up to level
+static plisp_t new_path(plisp_t node, unsigned level, int64_t edit) {
+    if (level == 0) {
+        return node;
+    }
+    plisp_t child = new_path(node, level - BITS, edit);
+    plisp_t parent = new_node(FULL_NODE, edit);
+    objs(parent)[VEC_HEADER] = child;
+    return parent;
+}
+
+// parent with leaf added after the last leaf under it
+static plisp_t push_leaf(plisp_t parent, unsigned level, size_t count,
+                         plisp_t leaf, int64_t edit) {
+    size_t slot = VEC_HEADER + (((count - 1) >> level) & MASK);
+    plisp_t fresh = editable(parent, edit);
+    plisp_t child = leaf;
+    if (level > BITS) {
+        child = objs(fresh)[slot];
+        child = child == NO_NODE
+            ? new_path(leaf, level - BITS, edit)
+            : push_leaf(child, level - BITS, count, leaf, edit);
+    }
+    objs(fresh)[slot] = child;
+    return fresh;
+}
+
+plisp_t plisp_pvector_push(plisp_t obj, plisp_t value) {
+    plisp_t out = changed_pvec(obj);
+    struct pvec *vec = plisp_custom_data(out);
+    size_t in_tail = vec->count - tail_offset(vec->count);
+
+    if (in_tail < WIDTH) {
+        // a transient's own tail has room for every element
+        plisp_t tail = vec->tail;
+        if (!owned(tail, vec->edit)) {
+            tail = new_node(vec->edit != 0 ? FULL_NODE
+                                           : VEC_HEADER + in_tail + 1,
+                            vec->edit);
+            memcpy(objs(tail) + VEC_HEADER, objs(vec->tail) + VEC_HEADER,
+                   in_tail * sizeof(plisp_t));
+        }
+        objs(tail)[VEC_HEADER + in_tail] = value;
+        vec->tail = tail;
+        vec->count++;
+        return out;
+    }
+
+    // the full tail joins the trie, growing it a level if it is full
+    plisp_t root;
+    if ((vec->count >> BITS) > (1lu << vec->shift)) {
+        plisp_t path = new_path(vec->tail, vec->shift, vec->edit);
+        root = new_node(FULL_NODE, vec->edit);
+        objs(root)[VEC_HEADER] = vec->root;
+        objs(root)[VEC_HEADER + 1] = path;
+        vec->shift += BITS;
+    } else {
+        root = push_leaf(vec->root, vec->shift, vec->count, vec->tail,
+                         vec->edit);
+    }
+    vec->root = root;
+
+    plisp_t tail = new_node(vec->edit != 0 ? FULL_NODE : VEC_HEADER + 1,
+                            vec->edit);
+    objs(tail)[VEC_HEADER] = value;
+    vec->tail = tail;
+    vec->count++;
+    return out;
+}
+
+// node without the last leaf under it, or NO_NODE if that was all
+static plisp_t pop_leaf(plisp_t node, unsigned level, size_t count,
+                        int64_t edit) {
+    size_t sub = ((count - 2) >> level) & MASK;
+    plisp_t child = NO_NODE;
+    if (level > BITS) {
+        child = pop_leaf(objs(node)[VEC_HEADER + sub], level - BITS, count,
+                         edit);
+    }
+    if (child == NO_NODE && sub == 0) {
+        return NO_NODE;
+    }
+
+    plisp_t fresh = editable(node, edit);
+    objs(fresh)[VEC_HEADER + sub] = child;
+    return fresh;
+}
+
+plisp_t plisp_pvector_pop(plisp_t obj) {
+    struct pvec *vec = get_pvec(obj);
+    if (vec->count == 0) {
+        fprintf(stderr, "error: pop from an empty persistent vector\n");
+        assert(false);
+    }
+
+    plisp_t out = changed_pvec(obj);
+    vec = plisp_custom_data(out);
+    size_t in_tail = vec->count - tail_offset(vec->count);
+
+    if (vec->count == 1) {
+        vec->shift = BITS;
+        vec->root = empty_vec_root;
+        vec->tail = empty_vec_tail;
+    } else if (in_tail > 1) {
+        plisp_t tail = vec->tail;
+        if (owned(tail, vec->edit)) {
+            // so the collector can free the element
+            objs(tail)[VEC_HEADER + in_tail - 1] = NO_NODE;
+        } else {
+            tail = new_node(vec->edit != 0 ? FULL_NODE
+                                           : VEC_HEADER + in_tail - 1,
+                            vec->edit);
+            memcpy(objs(tail) + VEC_HEADER, objs(vec->tail) + VEC_HEADER,
+                   (in_tail - 1) * sizeof(plisp_t));
+        }
+        vec->tail = tail;
+    } else {
+        // the last leaf of the trie becomes the tail
+        plisp_t tail = leaf_for(vec, vec->count - 2);
+        plisp_t root = pop_leaf(vec->root, vec->shift, vec->count,
+                                vec->edit);
+        if (root == NO_NODE) {
+            root = empty_vec_root;
+        }
+        if (vec->shift > BITS && objs(root)[VEC_HEADER + 1] == NO_NODE) {
+            root = objs(root)[VEC_HEADER];
+            vec->shift -= BITS;
+        }
+        vec->root = root;
+        vec->tail = tail;
+    }
+    vec->count--;
+    return out;
+}
+
+size_t plisp_pvector_length(plisp_t obj) {
+    return get_pvec(obj)->count;
+}
+
+/*
+transients
+*/
+
+plisp_t plisp_transient(plisp_t obj) {
+    if (plisp_c_pmapp(obj)) {
+        struct pmap *copy = malloc(sizeof(struct pmap));
+        *copy = *get_pmap(obj);
+        copy->edit = new_edit();
+        return wrap_pmap(copy);
+    }
+
+    struct pvec *copy = malloc(sizeof(struct pvec));
+    *copy = *get_pvec(obj);
+    copy->edit = new_edit();
+    plisp_t out = wrap_pvec(copy);
+
+    // the tail gets room for every element, so pushes go in place
+    size_t in_tail = copy->count - tail_offset(copy->count);
+    plisp_t tail = new_node(FULL_NODE, copy->edit);
+    memcpy(objs(tail) + VEC_HEADER, objs(copy->tail) + VEC_HEADER,
+           in_tail * sizeof(plisp_t));
+    copy->tail = tail;
+    return out;
+}
+
+plisp_t plisp_persistent(plisp_t obj) {
+    if (plisp_c_pmapp(obj)) {
+        struct pmap *map = get_pmap(obj);
+        plisp_assert(map->edit > 0);
+        struct pmap *copy = malloc(sizeof(struct pmap));
+        *copy = *map;
+        copy->edit = 0;
+        map->edit = -map->edit;
+        return wrap_pmap(copy);
+    }
+
+    struct pvec *vec = get_pvec(obj);
+    plisp_assert(vec->edit > 0);
+    struct pvec *copy = malloc(sizeof(struct pvec));
+    *copy = *vec;
+    copy->edit = 0;
+    plisp_t out = wrap_pvec(copy);
+
+    // persistent tails are as long as they need to be
+    size_t in_tail = copy->count - tail_offset(copy->count);
+    plisp_t tail = new_node(VEC_HEADER + in_tail, 0);
+    memcpy(objs(tail) + VEC_HEADER, objs(copy->tail) + VEC_HEADER,
+           in_tail * sizeof(plisp_t));
+    copy->tail = tail;
+    vec->edit = -vec->edit;
+    return out;
+}
+
+/*
+builtins
+*/
+
+static void check_transient(int64_t edit, bool want) {
+    if ((edit != 0) != want) {
+        fprintf(stderr, want ? "error: expected a transient\n"
+                             : "error: expected a persistent version, "
+                               "not a transient\n");
+        assert(false);
+    }
+}
+
+static plisp_t make_pmap(struct plisp_closure_data *kind, size_t nargs) {
+    plisp_assert(nargs == 0);
+    return plisp_make_pmap(plisp_fixnum_value(kind->objs[0]));
+}
+
+static plisp_t pmap_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_pmapp(obj));
+}
+
+static plisp_t pmap_ref(plisp_t *clos, size_t nargs, plisp_t map,
+                        plisp_t key, plisp_t fail) {
+    plisp_assert(nargs == 2 || nargs == 3);
+    plisp_t value;
+    if (plisp_pmap_lookup(map, key, &value)) {
+        return value;
+    } else if (nargs == 3) {
+        return plisp_call_closure(fail, 0, NULL);
+    }
+
+    fprintf(stderr, "error: key not in persistent map: ");
+    plisp_c_write(stderr, key);
+    fprintf(stderr, "\n");
+    assert(false);
+    return plisp_unspec;
+}
+
+static plisp_t pmap_ref_default(plisp_t *clos, size_t nargs, plisp_t map,
+                                plisp_t key, plisp_t dflt) {
+    plisp_assert(nargs == 3);
+    plisp_t value;
+    if (plisp_pmap_lookup(map, key, &value)) {
+        return value;
+    }
+    return dflt;
+}
+
+static plisp_t pmap_set(plisp_t *clos, size_t nargs, plisp_t map,
+                        plisp_t key, plisp_t value) {
+    plisp_assert(nargs == 3);
+    check_transient(get_pmap(map)->edit, false);
+    return plisp_pmap_set(map, key, value);
+}
+
+static plisp_t pmap_set_x(plisp_t *clos, size_t nargs, plisp_t map,
+                          plisp_t key, plisp_t value) {
+    plisp_assert(nargs == 3);
+    check_transient(get_pmap(map)->edit, true);
+    plisp_pmap_set(map, key, value);
+    return plisp_unspec;
+}
+
+static plisp_t pmap_delete(plisp_t *clos, size_t nargs, plisp_t map,
+                           plisp_t key) {
+    plisp_assert(nargs == 2);
+    check_transient(get_pmap(map)->edit, false);
+    return plisp_pmap_delete(map, key);
+}
+
+static plisp_t pmap_delete_x(plisp_t *clos, size_t nargs, plisp_t map,
+                             plisp_t key) {
+    plisp_assert(nargs == 2);
+    check_transient(get_pmap(map)->edit, true);
+    plisp_pmap_delete(map, key);
+    return plisp_unspec;
+}
+
+static plisp_t pmap_contains(plisp_t *clos, size_t nargs, plisp_t map,
+                             plisp_t key) {
+    plisp_assert(nargs == 2);
+    plisp_t value;
+    return plisp_make_bool(plisp_pmap_lookup(map, key, &value));
+}
+
+static plisp_t pmap_count(plisp_t *clos, size_t nargs, plisp_t map) {
+    plisp_assert(nargs == 1);
+    return plisp_make_fixnum(plisp_pmap_count(map));
+}
+
+struct fold {
+    plisp_t kons;
+    plisp_t acc;
+};
+
+static void fold_entry(void *arg, plisp_t key, plisp_t value) {
+    struct fold *fold = arg;
+    plisp_t args[] = { key, value, fold->acc };
+    fold->acc = plisp_call_closure(fold->kons, 3, args);
+}
+
+static plisp_t pmap_fold(plisp_t *clos, size_t nargs, plisp_t map,
+                         plisp_t kons, plisp_t knil) {
+    plisp_assert(nargs == 3);
+    // on the stack, where the collector sees the accumulator
+    struct fold fold = { kons, knil };
+    node_walk(get_pmap(map)->root, 0, fold_entry, &fold);
+    return fold.acc;
+}
+
+static void cons_entry(void *arg, plisp_t key, plisp_t value) {
+    plisp_t *alist = arg;
+    *alist = plisp_cons(plisp_cons(key, value), *alist);
+}
+
+static plisp_t pmap_to_alist(plisp_t *clos, size_t nargs, plisp_t map) {
+    plisp_assert(nargs == 1);
+    plisp_t alist = plisp_nil;
+    node_walk(get_pmap(map)->root, 0, cons_entry, &alist);
+    return alist;
+}
+
+static plisp_t pvector(plisp_t *clos, size_t nargs, ...) {
+    plisp_t vec = plisp_transient(plisp_make_pvector());
+    va_list args;
+    va_start(args, nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        plisp_pvector_push(vec, va_arg(args, plisp_t));
+    }
+    va_end(args);
+    return plisp_persistent(vec);
+}
+
+static plisp_t list_to_pvector(plisp_t *clos, size_t nargs, plisp_t lst) {
+    plisp_assert(nargs == 1);
+    plisp_t vec = plisp_transient(plisp_make_pvector());
+    for (; plisp_c_consp(lst); lst = plisp_cdr(lst)) {
+        plisp_pvector_push(vec, plisp_car(lst));
+    }
+    return plisp_persistent(vec);
+}
+
+static plisp_t pvector_to_list(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    struct pvec *vec = get_pvec(obj);
+    plisp_t lst = plisp_nil;
+    // backwards a leaf at a time, so the list is consed front first
+    for (size_t end = vec->count; end > 0;) {
+        plisp_t leaf = leaf_for(vec, end - 1);
+        size_t start = (end - 1) & ~(size_t) MASK;
+        for (; end > start; --end) {
+            lst = plisp_cons(objs(leaf)[VEC_HEADER + ((end - 1) & MASK)],
+                             lst);
+        }
+    }
+    return lst;
+}
+
+static plisp_t pvector_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_pvectorp(obj));
+}
+
+static plisp_t pvector_length(plisp_t *clos, size_t nargs, plisp_t vec) {
+    plisp_assert(nargs == 1);
+    return plisp_make_fixnum(plisp_pvector_length(vec));
+}
+
+static size_t index_value(plisp_t idx) {
+    plisp_assert(plisp_c_fixnump(idx) && plisp_fixnum_value(idx) >= 0);
+    return plisp_fixnum_value(idx);
+}
+
+static plisp_t pvector_ref(plisp_t *clos, size_t nargs, plisp_t vec,
+                           plisp_t idx) {
+    plisp_assert(nargs == 2);
+    return plisp_pvector_ref(vec, index_value(idx));
+}
+
+static plisp_t pvector_set(plisp_t *clos, size_t nargs, plisp_t vec,
+                           plisp_t idx, plisp_t value) {
+    plisp_assert(nargs == 3);
+    check_transient(get_pvec(vec)->edit, false);
+    return plisp_pvector_set(vec, index_value(idx), value);
+}
+
+static plisp_t pvector_set_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                             plisp_t idx, plisp_t value) {
+    plisp_assert(nargs == 3);
+    check_transient(get_pvec(vec)->edit, true);
+    plisp_pvector_set(vec, index_value(idx), value);
+    return plisp_unspec;
+}
+
+static plisp_t pvector_push(plisp_t *clos, size_t nargs, plisp_t vec,
+                            plisp_t value) {
+    plisp_assert(nargs == 2);
+    check_transient(get_pvec(vec)->edit, false);
+    return plisp_pvector_push(vec, value);
+}
+
+static plisp_t pvector_push_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                              plisp_t value) {
+    plisp_assert(nargs == 2);
+    check_transient(get_pvec(vec)->edit, true);
+    plisp_pvector_push(vec, value);
+    return plisp_unspec;
+}
+
+static plisp_t pvector_pop(plisp_t *clos, size_t nargs, plisp_t vec) {
+    plisp_assert(nargs == 1);
+    check_transient(get_pvec(vec)->edit, false);
+    return plisp_pvector_pop(vec);
+}
+
+static plisp_t pvector_pop_x(plisp_t *clos, size_t nargs, plisp_t vec) {
+    plisp_assert(nargs == 1);
+    check_transient(get_pvec(vec)->edit, true);
+    plisp_pvector_pop(vec);
+    return plisp_unspec;
+}
+
+static plisp_t transient(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    int64_t edit = plisp_c_pmapp(obj) ? get_pmap(obj)->edit
+                                      : get_pvec(obj)->edit;
+    check_transient(edit, false);
+    return plisp_transient(obj);
+}
+
+static plisp_t persistent(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    int64_t edit = plisp_c_pmapp(obj) ? get_pmap(obj)->edit
+                                      : get_pvec(obj)->edit;
+    check_transient(edit, true);
+    return plisp_persistent(obj);
+}
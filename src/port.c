@@ -0,0 +1,647 @@
+#define _GNU_SOURCE
+#include <plisp/port.h>
+#include <plisp/coroutine.h>
+#include <plisp/homvec.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ports wrap file descriptors, which are made non blocking and added to
+a single epoll set, edge triggered, when they are opened. reading or
+writing makes the system call straight away, and only when it would
+block does the task park on the port, until the poller sees the port
+become ready and wakes every task parked on it to try again. anything
+but a task runs tasks while it waits, and blocks in epoll once there
+are none. reads and writes go straight between the descriptor and the
+payload of a u8vector or string, and a list of them is written with
+one writev, so a stream costs a system call per buffer rather than per
+byte. regular files can't be polled, so they are read and written
+blocking. every thread has an epoll set of its own, which its ports
+are added to, and only its tasks can wait on them.
+*/
+
+#define MAX_EVENTS 256
+
+struct port {
+    int fd;
+    // whether it is in the epoll set of thread
+    bool polled;
+    pthread_t thread;
+    // the tasks parked until it can be read or written
+    plisp_t readers;
+    plisp_t writers;
+    // where in waited it is, if any task is parked on it
+    size_t waited_index;
+    // of a listening socket, which is unlinked when it is closed
+    char *path;
+};
+
+struct waited {
+    plisp_t *ports;
+    size_t count;
+    size_t size;
+};
+
+static plisp_t port_sym;
+static plisp_t waited_sym;
+static __thread int epoll_fd = -1;
+
+// the ports tasks are parked on, which are kept alive until the tasks
+// are woken, since nothing else might refer to them
+static __thread struct waited waited;
+static __thread plisp_t waited_obj;
+
+// the port the main stack, or whatever isn't a task, is waiting on
+static __thread struct port *main_port = NULL;
+static __thread bool main_ready;
+
+static void trace_port(void *data, void (*trace)(plisp_t));
+static void trace_waited(void *data, void (*trace)(plisp_t));
+static bool port_poller(bool wait);
+
+static plisp_t port_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t port_fd(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t port_open_fd(plisp_t *clos, size_t nargs, plisp_t fd);
+static plisp_t port_open_file(plisp_t *clos, size_t nargs, plisp_t path,
+                              plisp_t mode);
+static plisp_t port_make_pipe(plisp_t *clos, size_t nargs);
+static plisp_t port_make_socketpair(plisp_t *clos, size_t nargs);
+static plisp_t port_unix_listen(plisp_t *clos, size_t nargs, plisp_t path);
+static plisp_t port_unix_accept(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t port_unix_connect(plisp_t *clos, size_t nargs, plisp_t path);
+static plisp_t port_read(plisp_t *clos, size_t nargs, plisp_t obj,
+                         plisp_t buf, plisp_t start, plisp_t end);
+static plisp_t port_write(plisp_t *clos, size_t nargs, plisp_t obj,
+                          plisp_t buf, plisp_t start, plisp_t end);
+static plisp_t port_close(plisp_t *clos, size_t nargs, plisp_t obj);
+
+void plisp_init_port(void) {
+    port_sym = plisp_intern(plisp_make_symbol("port"));
+    waited_sym = plisp_intern(plisp_make_symbol("waited-ports"));
+    plisp_gc_custom_tracer(port_sym, trace_port);
+    plisp_gc_custom_tracer(waited_sym, trace_waited);
+    plisp_scheduler_poller(port_poller);
+    // writing to a closed pipe or socket returns EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("port?", port_p);
+    plisp_define_builtin("port-fd", port_fd);
+    plisp_define_builtin("open-fd-port", port_open_fd);
+    plisp_define_builtin("open-file-port", port_open_file);
+    plisp_define_builtin("make-pipe", port_make_pipe);
+    plisp_define_builtin("make-socketpair", port_make_socketpair);
+    plisp_define_builtin("unix-listen", port_unix_listen);
+    plisp_define_builtin("unix-accept", port_unix_accept);
+    plisp_define_builtin("unix-connect", port_unix_connect);
+    plisp_define_builtin("port-read!", port_read);
+    plisp_define_builtin("port-write", port_write);
+    plisp_define_builtin("port-close", port_close);
+
+    #pragma GCC diagnostic pop
+}
+
+// the epoll set and waited of a thread are made when it first opens a
+// port
+static void init_port_thread(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("error: couldn't create an epoll set");
+        assert(false);
+    }
+    waited_obj = plisp_make_custom(waited_sym, &waited);
+    plisp_gc_thread_root(&waited_obj);
+}
+
+void plisp_end_port_thread(void) {
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+    free(waited.ports);
+    waited.ports = NULL;
+    waited.count = waited.size = 0;
+}
+
+/*
+ports
+*/
+
+static void trace_port(void *data, void (*trace)(plisp_t)) {
+    struct port *port = data;
+    trace(port->readers);
+    trace(port->writers);
+}
+
+static void trace_waited(void *data, void (*trace)(plisp_t)) {
+    struct waited *w = data;
+    for (size_t i = 0; i < w->count; ++i) {
+        trace(w->ports[i]);
+    }
+}
+
+static void close_port(struct port *port) {
+    if (port->fd >= 0) {
+        // closing it takes it out of the epoll set too
+        close(port->fd);
+        port->fd = -1;
+    }
+    if (port->path != NULL) {
+        unlink(port->path);
+        free(port->path);
+        port->path = NULL;
+    }
+}
+
+static void finalize_port(void *data) {
+    close_port(data);
+    free(data);
+}
+
+bool plisp_c_portp(plisp_t obj) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == port_sym;
+}
+
+plisp_t plisp_make_port(int fd) {
+    plisp_assert(fd >= 0);
+    if (epoll_fd < 0) {
+        init_port_thread();
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct port *port = malloc(sizeof(struct port));
+    port->fd = fd;
+    port->thread = pthread_self();
+    port->readers = plisp_nil;
+    port->writers = plisp_nil;
+    port->waited_index = SIZE_MAX;
+    port->path = NULL;
+
+    // it is edge triggered, so it only reports the port becoming
+    // ready, which is all a parked task needs
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+        .data.ptr = port,
+    };
+    port->polled = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+    if (!port->polled && errno != EPERM) {
+        perror("error: couldn't poll a port");
+        assert(false);
+    }
+
+    plisp_t obj = plisp_make_custom(port_sym, port);
+    plisp_gc_finalizer(obj, finalize_port);
+    return obj;
+}
+
+static struct port *get_port(plisp_t obj) {
+    if (!plisp_c_portp(obj)) {
+        fprintf(stderr, "error: expected a port, got ");
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    return plisp_custom_data(obj);
+}
+
+static struct port *get_open_port(plisp_t obj) {
+    struct port *port = get_port(obj);
+    if (port->fd < 0) {
+        fprintf(stderr, "error: used a closed port\n");
+        assert(false);
+    }
+    return port;
+}
+
+/*
+waiting
+*/
+
+static void add_waited(plisp_t obj) {
+    struct port *port = plisp_custom_data(obj);
+    if (port->waited_index != SIZE_MAX) {
+        return;
+    }
+    if (waited.count == waited.size) {
+        waited.size = waited.size == 0 ? 64 : waited.size * 2;
+        waited.ports = realloc(waited.ports, waited.size * sizeof(plisp_t));
+    }
+    port->waited_index = waited.count;
+    waited.ports[waited.count++] = obj;
+}
+
+static void remove_waited(struct port *port) {
+    if (port->waited_index == SIZE_MAX) {
+        return;
+    }
+    plisp_t last = waited.ports[--waited.count];
+    waited.ports[port->waited_index] = last;
+    ((struct port *) plisp_custom_data(last))->waited_index =
+        port->waited_index;
+    port->waited_index = SIZE_MAX;
+}
+
+// wakes every task in *tasks, and returns whether there were any
+static bool wake_all(plisp_t *tasks) {
+    bool woke = *tasks != plisp_nil;
+    for (; *tasks != plisp_nil; *tasks = plisp_cdr(*tasks)) {
+        plisp_wake(plisp_car(*tasks));
+    }
+    return woke;
+}
+
+// waits up to timeout milliseconds, or forever if it is -1, for ports
+// to become ready, and wakes what waits on them. returns whether it
+// woke a task.
+static bool poll_events(int timeout) {
+    struct epoll_event events[MAX_EVENTS];
+    int n;
+    if (timeout != 0) {
+        plisp_enter_blocking();
+    }
+    do {
+        n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+    } while (n < 0 && errno == EINTR);
+    if (timeout != 0) {
+        plisp_leave_blocking();
+    }
+    if (n < 0) {
+        perror("error: couldn't wait for ports");
+        assert(false);
+    }
+
+    bool woke = false;
+    for (int i = 0; i < n; ++i) {
+        struct port *port = events[i].data.ptr;
+        uint32_t ready = events[i].events;
+        // errors and hang ups are reported to both, by the call failing
+        bool readable = ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+        bool writable = ready & (EPOLLOUT | EPOLLHUP | EPOLLERR);
+
+        if (readable) {
+            woke |= wake_all(&port->readers);
+        }
+        if (writable) {
+            woke |= wake_all(&port->writers);
+        }
+        if (port->readers == plisp_nil && port->writers == plisp_nil) {
+            remove_waited(port);
+        }
+        if (port == main_port && (readable || writable)) {
+            main_ready = true;
+        }
+    }
+    return woke;
+}
+
+static bool port_poller(bool wait) {
+    bool woke = false;
+    while (waited.count > 0) {
+        woke = poll_events(wait ? -1 : 0);
+        if (woke || !wait || main_ready) {
+            break;
+        }
+    }
+    return woke;
+}
+
+// waits for obj to become readable, or writable. the caller tries
+// again either way, since waking up doesn't guarantee it.
+static void wait_port(plisp_t obj, bool write) {
+    volatile plisp_t keep = obj;
+    struct port *port = get_open_port(obj);
+    if (!pthread_equal(port->thread, pthread_self())) {
+        fprintf(stderr, "error: waited on a port from another thread than "
+                "the one that opened it\n");
+        assert(false);
+    }
+
+    if (plisp_in_task()) {
+        plisp_t *tasks = write ? &port->writers : &port->readers;
+        *tasks = plisp_cons(plisp_current_task(), *tasks);
+        add_waited(obj);
+        plisp_park();
+    } else {
+        // run tasks until one of them, or the poller, makes it ready
+        struct port *outer = main_port;
+        bool outer_ready = main_ready;
+        main_port = port;
+        main_ready = false;
+        while (!plisp_run_one() && !main_ready) {
+            poll_events(-1);
+        }
+        main_port = outer;
+        main_ready = outer_ready;
+    }
+    (void) keep;
+}
+
+/*
+buffers
+*/
+
+static uint8_t *buffer_bytes(plisp_t buf, size_t *len) {
+    if (plisp_c_stringp(buf)) {
+        *len = plisp_c_stringlen(buf);
+        return (uint8_t *) plisp_string_value(buf);
+    }
+    if (plisp_homvec_kind(buf) != HOMVEC_U8) {
+        fprintf(stderr, "error: expected a u8vector or string, got ");
+        plisp_c_write(stderr, buf);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    struct plisp_vector *vec = (void *) (buf & ~LOTAGS);
+    *len = vec->len;
+    return vec->vec;
+}
+
+// the part of buf from start to end, which default to all of it
+static struct iovec buffer_range(size_t nargs, plisp_t buf, plisp_t start,
+                                 plisp_t end) {
+    size_t len;
+    uint8_t *bytes = buffer_bytes(buf, &len);
+    size_t from = 0, to = len;
+    if (nargs >= 3) {
+        plisp_assert(plisp_c_fixnump(start));
+        from = plisp_fixnum_value(start);
+    }
+    if (nargs >= 4) {
+        plisp_assert(plisp_c_fixnump(end));
+        to = plisp_fixnum_value(end);
+    }
+    plisp_assert(from <= to && to <= len);
+    return (struct iovec) { bytes + from, to - from };
+}
+
+/*
+builtins
+*/
+
+static plisp_t port_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_portp(obj));
+}
+
+static plisp_t port_fd(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_fixnum(get_port(obj)->fd);
+}
+
+static plisp_t port_open_fd(plisp_t *clos, size_t nargs, plisp_t fd) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_fixnump(fd) && plisp_fixnum_value(fd) >= 0);
+    return plisp_make_port(plisp_fixnum_value(fd));
+}
+
+// mode is read, write or append, and defaults to read. returns #f if
+// the file can't be opened.
+static plisp_t port_open_file(plisp_t *clos, size_t nargs, plisp_t path,
+                              plisp_t mode) {
+    plisp_assert(nargs == 1 || nargs == 2);
+
+    int flags = O_RDONLY;
+    if (nargs == 2) {
+        const char *name = plisp_string_value(plisp_symbol_name(mode));
+        if (strcmp(name, "write") == 0) {
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+        } else if (strcmp(name, "append") == 0) {
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+        } else {
+            plisp_assert(strcmp(name, "read") == 0);
+        }
+    }
+
+    char *p = plisp_string_cstring(path);
+    int fd = open(p, flags | O_CLOEXEC, 0666);
+    free(p);
+    if (fd < 0) {
+        return plisp_make_bool(false);
+    }
+    return plisp_make_port(fd);
+}
+
+static plisp_t make_port_pair(int fds[2]) {
+    volatile plisp_t first = plisp_make_port(fds[0]);
+    plisp_t second = plisp_make_port(fds[1]);
+    return plisp_cons(first, plisp_cons(second, plisp_nil));
+}
+
+// a list of the reading end and the writing end
+static plisp_t port_make_pipe(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("error: couldn't make a pipe");
+        assert(false);
+    }
+    return make_port_pair(fds);
+}
+
+static plisp_t port_make_socketpair(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        perror("error: couldn't make a socket pair");
+        assert(false);
+    }
+    return make_port_pair(fds);
+}
+
+// a unix stream socket, and its address at path. returns -1 if path
+// is too long.
+static int unix_socket(plisp_t path, struct sockaddr_un *addr) {
+    size_t len = plisp_c_stringlen(path);
+    if (len >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, plisp_string_value(path), len);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("error: couldn't make a socket");
+        assert(false);
+    }
+    return fd;
+}
+
+// a port accepting connections at path, or #f if it can't be bound
+static plisp_t port_unix_listen(plisp_t *clos, size_t nargs, plisp_t path) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_stringp(path));
+
+    struct sockaddr_un addr;
+    int fd = unix_socket(path, &addr);
+    if (fd < 0) {
+        return plisp_make_bool(false);
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0
+        || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return plisp_make_bool(false);
+    }
+
+    plisp_t obj = plisp_make_port(fd);
+    get_port(obj)->path = strdup(addr.sun_path);
+    return obj;
+}
+
+static plisp_t port_unix_accept(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    for (;;) {
+        int fd = accept4(get_open_port(obj)->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            return plisp_make_port(fd);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_port(obj, false);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            perror("error: couldn't accept a connection");
+            assert(false);
+        }
+    }
+}
+
+// a port connected to the socket at path, or #f if nothing listens
+// there
+static plisp_t port_unix_connect(plisp_t *clos, size_t nargs, plisp_t path) {
+    plisp_assert(nargs == 1);
+    plisp_assert(plisp_c_stringp(path));
+
+    struct sockaddr_un addr;
+    int fd = unix_socket(path, &addr);
+    if (fd < 0) {
+        return plisp_make_bool(false);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // a unix socket connects at once, unless the listener's backlog is
+    // full, which polling doesn't report the end of, so it lets the
+    // tasks that might accept run first
+    while (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (errno == EAGAIN && plisp_in_task()) {
+            plisp_yield(plisp_unspec);
+        } else if (errno == EAGAIN && plisp_run_one()) {
+            continue;
+        } else if (errno != EINTR) {
+            close(fd);
+            return plisp_make_bool(false);
+        }
+    }
+    return plisp_make_port(fd);
+}
+
+// reads as much into buf as is there, from start to end, and returns
+// how much that was, or 0 at the end of the stream. it only waits if
+// nothing is there at all.
+static plisp_t port_read(plisp_t *clos, size_t nargs, plisp_t obj,
+                         plisp_t buf, plisp_t start, plisp_t end) {
+    plisp_assert(nargs >= 2 && nargs <= 4);
+    plisp_assert(plisp_homvec_kind(buf) == HOMVEC_U8);
+
+    for (;;) {
+        struct iovec range = buffer_range(nargs, buf, start, end);
+        ssize_t n = read(get_open_port(obj)->fd, range.iov_base,
+                         range.iov_len);
+        if (n >= 0) {
+            return plisp_make_fixnum(n);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_port(obj, false);
+        } else if (errno == ECONNRESET) {
+            return plisp_make_fixnum(0);
+        } else if (errno != EINTR) {
+            perror("error: couldn't read from a port");
+            assert(false);
+        }
+    }
+}
+
+// writes all of buf, from start to end, or every buffer in a list of
+// them, and returns how many bytes that was, or #f if the other end
+// was closed first
+static plisp_t port_write(plisp_t *clos, size_t nargs, plisp_t obj,
+                          plisp_t buf, plisp_t start, plisp_t end) {
+    plisp_assert(nargs >= 2 && nargs <= 4);
+
+    size_t count = 1;
+    if (plisp_c_consp(buf) || plisp_c_nullp(buf)) {
+        plisp_assert(nargs == 2);
+        count = 0;
+        for (plisp_t lst = buf; lst != plisp_nil; lst = plisp_cdr(lst)) {
+            count++;
+        }
+    }
+
+    struct iovec *iov = malloc((count > 0 ? count : 1) * sizeof(struct iovec));
+    size_t total = 0;
+    if (plisp_c_consp(buf) || plisp_c_nullp(buf)) {
+        size_t i = 0;
+        for (plisp_t lst = buf; lst != plisp_nil; lst = plisp_cdr(lst)) {
+            iov[i] = buffer_range(2, plisp_car(lst), plisp_nil, plisp_nil);
+            total += iov[i++].iov_len;
+        }
+    } else {
+        iov[0] = buffer_range(nargs, buf, start, end);
+        total = iov[0].iov_len;
+    }
+
+    // the buffers are kept alive by the arguments, and their payloads
+    // don't move, so iov stays good across waiting
+    struct iovec *next = iov;
+    size_t left = count;
+    while (left > 0) {
+        ssize_t n = writev(get_open_port(obj)->fd, next,
+                           left < IOV_MAX ? left : IOV_MAX);
+        if (n >= 0) {
+            for (; left > 0 && (size_t) n >= next->iov_len; next++, left--) {
+                n -= next->iov_len;
+            }
+            if (left > 0) {
+                next->iov_base = (uint8_t *) next->iov_base + n;
+                next->iov_len -= n;
+            }
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            wait_port(obj, true);
+        } else if (errno == EPIPE || errno == ECONNRESET) {
+            free(iov);
+            return plisp_make_bool(false);
+        } else if (errno != EINTR) {
+            perror("error: couldn't write to a port");
+            assert(false);
+        }
+    }
+
+    free(iov);
+    return plisp_make_fixnum(total);
+}
+
+// tasks parked on the port are woken, to find it closed
+static plisp_t port_close(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    struct port *port = get_port(obj);
+    close_port(port);
+    wake_all(&port->readers);
+    wake_all(&port->writers);
+    remove_waited(port);
+    return plisp_unspec;
+}
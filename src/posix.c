@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <libgen.h>
 #include <string.h>
+#include <stdio.h>
 
 
 void plisp_init_posix(void) {
@@ -15,6 +16,8 @@ void plisp_init_posix(void) {
     plisp_define_builtin("realpath", plisp_realpath);
     plisp_define_builtin("dirname", plisp_dirname);
     plisp_define_builtin("basename", plisp_basename);
+    plisp_define_builtin("make-temp-directory", plisp_make_temp_directory);
+    plisp_define_builtin("delete-file", plisp_delete_file);
 
     #pragma GCC diagnostic pop
 }
@@ -23,7 +26,9 @@ plisp_t plisp_realpath(plisp_t *clos, size_t nargs, plisp_t path) {
     plisp_assert(nargs == 1);
 
     char buf[PATH_MAX];
-    char *res = realpath(plisp_string_value(path), buf);
+    char *p = plisp_string_cstring(path);
+    char *res = realpath(p, buf);
+    free(p);
     if (res == NULL) {
         return plisp_make_bool(false);
     } else {
@@ -34,7 +39,7 @@ plisp_t plisp_realpath(plisp_t *clos, size_t nargs, plisp_t path) {
 plisp_t plisp_dirname(plisp_t *clos, size_t nargs, plisp_t path) {
     plisp_assert(nargs == 1);
 
-    char *d = strdup(plisp_string_value(path));
+    char *d = plisp_string_cstring(path);
     plisp_t ret = plisp_make_string(dirname(d));
     free(d);
     return ret;
@@ -43,8 +48,34 @@ plisp_t plisp_dirname(plisp_t *clos, size_t nargs, plisp_t path) {
 plisp_t plisp_basename(plisp_t *clos, size_t nargs, plisp_t path) {
     plisp_assert(nargs == 1);
 
-    char *d = strdup(plisp_string_value(path));
+    char *d = plisp_string_cstring(path);
     plisp_t ret = plisp_make_string(basename(d));
     free(d);
     return ret;
 }
+
+// a new directory under $TMPDIR or /tmp, which only we can use
+plisp_t plisp_make_temp_directory(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+
+    const char *tmpdir = getenv("TMPDIR");
+    if (tmpdir == NULL || tmpdir[0] == '\0') {
+        tmpdir = "/tmp";
+    }
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/plisp-XXXXXX", tmpdir);
+    if (mkdtemp(path) == NULL) {
+        return plisp_make_bool(false);
+    }
+    return plisp_make_string(path);
+}
+
+// removes a file or an empty directory
+plisp_t plisp_delete_file(plisp_t *clos, size_t nargs, plisp_t path) {
+    plisp_assert(nargs == 1);
+
+    char *p = plisp_string_cstring(path);
+    int res = remove(p);
+    free(p);
+    return plisp_make_bool(res == 0);
+}
@@ -0,0 +1,809 @@
+#define _GNU_SOURCE
+#include <plisp/precompile.h>
+#include <plisp/builtin.h>
+#include <plisp/toplevel.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <link.h>
+#include <elf.h>
+#include <pthread.h>
+#include <Judy.h>
+
+/*
+compiled files hold the macroexpanded toplevel forms of a source file,
+so loading them skips the macroexpander. forms that can't be written
+out readably are kept as source, wrapped in eval.
+
+the header lists what the expansions depend on: the binary, which
+defines the core forms, and every file loaded before or while the file
+was compiled, since any of them could have defined a macro it used.
+the file is stale once any of them has changed. macros defined some
+other way, like by eval, are covered by a digest of the macro
+definitions, taken before and after compiling, since the file may be
+loaded again once its own macros are defined. it also lists the
+gensyms in the expansions, which mean nothing to another process, so
+loading it swaps them for fresh ones.
+*/
+
+// change whenever the format or the expansion of core forms changes
+#define COMPILED_HEADER ";; plisp compiled v3\n"
+#define COMPILED_END ";; end\n"
+
+static plisp_t define_sym;
+static plisp_t set_sym;
+static plisp_t quote_sym;
+static plisp_t eval_sym;
+static plisp_t macro_set_sym;
+static plisp_t require_sym;
+static plisp_t load_sym;
+static plisp_t begin_sym;
+static plisp_t filesym;
+static plisp_t macroexpand_sym;
+
+static char build[72];
+
+static void build_id(char *id);
+static void init_expansion_cache(void);
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t len);
+static char *form_text(plisp_t form, size_t *len);
+static plisp_t canonical_form(plisp_t form);
+
+// a digest of every macro-set! evaluated at toplevel, by a digest of
+// the name it set, so the same definitions give the same sum in any
+// order
+static Pvoid_t macro_defs = NULL;
+static uint64_t macro_digest = 0;
+static pthread_mutex_t macro_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void plisp_init_precompile(void) {
+    build_id(build);
+
+    define_sym = plisp_intern(plisp_make_symbol("define"));
+    set_sym = plisp_intern(plisp_make_symbol("set!"));
+    quote_sym = plisp_intern(plisp_make_symbol("quote"));
+    eval_sym = plisp_intern(plisp_make_symbol("eval"));
+    macro_set_sym = plisp_intern(plisp_make_symbol("macro-set!"));
+    require_sym = plisp_intern(plisp_make_symbol("require"));
+    load_sym = plisp_intern(plisp_make_symbol("load"));
+    begin_sym = plisp_intern(plisp_make_symbol("begin"));
+    filesym = plisp_intern(plisp_make_symbol("%file"));
+    macroexpand_sym = plisp_intern(plisp_make_symbol("macroexpand"));
+
+    init_expansion_cache();
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("compile-file", plisp_builtin_compile_file);
+
+    #pragma GCC diagnostic pop
+}
+
+char *plisp_compiled_path(const char *src) {
+    size_t len = strlen(src);
+    char *path = malloc(len + sizeof(".plc"));
+    strcpy(path, src);
+
+    if (len > 4 && strcmp(src + len - 4, ".scm") == 0) {
+        strcpy(path + len - 4, ".plc");
+    } else {
+        strcat(path, ".plc");
+    }
+    return path;
+}
+
+struct loaded_file {
+    char *path;
+    struct timespec mtime;
+    off_t size;
+};
+
+static struct loaded_file *loaded_files = NULL;
+static size_t nloaded_files = 0;
+static pthread_mutex_t loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void plisp_note_loaded_file(const char *path) {
+    char *full = realpath(path, NULL);
+    struct stat st;
+    if (full == NULL || stat(full, &st) != 0) {
+        free(full);
+        return;
+    }
+
+    pthread_mutex_lock(&loaded_lock);
+    size_t i = 0;
+    while (i < nloaded_files && strcmp(loaded_files[i].path, full) != 0) {
+        ++i;
+    }
+    if (i == nloaded_files) {
+        loaded_files = realloc(loaded_files,
+                               (nloaded_files + 1) * sizeof(*loaded_files));
+        loaded_files[nloaded_files++].path = full;
+    } else {
+        free(full);
+    }
+    // a file loaded again may have changed in between
+    loaded_files[i].mtime = st.st_mtim;
+    loaded_files[i].size = st.st_size;
+    pthread_mutex_unlock(&loaded_lock);
+}
+
+// the digest of form's text, or of its address if it can't be written
+static uint64_t form_digest(plisp_t form) {
+    size_t len;
+    char *text = form_text(canonical_form(form), &len);
+    if (text == NULL) {
+        // never the same in another run
+        return fnv1a(14695981039346656037lu, (char *) &form, sizeof(form));
+    }
+    uint64_t hash = fnv1a(14695981039346656037lu, text, len);
+    free(text);
+    return hash;
+}
+
+void plisp_note_macro_definition(plisp_t form) {
+    plisp_t name = plisp_car(plisp_cdr(form));
+    uint64_t key = form_digest(name);
+    uint64_t def = form_digest(form);
+
+    pthread_mutex_lock(&macro_lock);
+    Word_t *pval;
+    JLI(pval, macro_defs, key);
+    macro_digest += def - *pval;
+    *pval = def;
+    pthread_mutex_unlock(&macro_lock);
+}
+
+static uint64_t current_macro_digest(void) {
+    pthread_mutex_lock(&macro_lock);
+    uint64_t digest = macro_digest;
+    pthread_mutex_unlock(&macro_lock);
+    return digest;
+}
+
+static void write_depends(FILE *out, uint64_t macros_before) {
+    fprintf(out, ";; build %s\n", build);
+    fprintf(out, ";; macros %016lx %016lx\n",
+            macros_before, current_macro_digest());
+
+    pthread_mutex_lock(&loaded_lock);
+    for (size_t i = 0; i < nloaded_files; ++i) {
+        fprintf(out, ";; depends %ld %ld %ld %s\n",
+                (long) loaded_files[i].mtime.tv_sec,
+                (long) loaded_files[i].mtime.tv_nsec,
+                (long) loaded_files[i].size, loaded_files[i].path);
+    }
+    pthread_mutex_unlock(&loaded_lock);
+}
+
+// whether the thing a header line names is as it was when compiling
+static bool depend_current(char *line) {
+    line[strcspn(line, "\n")] = '\0';
+
+    if (strncmp(line, ";; build ", 9) == 0) {
+        return strcmp(line + 9, build) == 0;
+    }
+
+    uint64_t before, after;
+    if (sscanf(line, ";; macros %lx %lx", &before, &after) == 2) {
+        uint64_t digest = current_macro_digest();
+        return digest == before || digest == after;
+    }
+
+    long sec, nsec, size;
+    int path;
+    if (sscanf(line, ";; depends %ld %ld %ld %n", &sec, &nsec, &size,
+               &path) == 3) {
+        struct stat st;
+        return stat(line + path, &st) == 0
+            && st.st_mtim.tv_sec == sec && st.st_mtim.tv_nsec == nsec
+            && st.st_size == size;
+    }
+    return true;
+}
+
+bool plisp_compiled_fresh(const char *src, const char *compiled) {
+    struct stat srcst, compst;
+    if (stat(src, &srcst) != 0 || stat(compiled, &compst) != 0) {
+        return false;
+    }
+
+    if (compst.st_mtim.tv_sec < srcst.st_mtim.tv_sec
+        || (compst.st_mtim.tv_sec == srcst.st_mtim.tv_sec
+            && compst.st_mtim.tv_nsec < srcst.st_mtim.tv_nsec)) {
+        return false;
+    }
+
+    FILE *f = fopen(compiled, "r");
+    if (f == NULL) {
+        return false;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    bool fresh = getline(&line, &cap, f) > 0
+        && strcmp(line, COMPILED_HEADER) == 0;
+    bool ended = false;
+    while (fresh && !ended && getline(&line, &cap, f) > 0) {
+        ended = strcmp(line, COMPILED_END) == 0;
+        fresh = ended || depend_current(line);
+    }
+
+    free(line);
+    fclose(f);
+    return fresh && ended;
+}
+
+// adds the gensyms in form to the set gensyms
+static void note_gensyms(plisp_t form, Pvoid_t *gensyms) {
+    if (plisp_c_consp(form)) {
+        for (; plisp_c_consp(form); form = plisp_cdr(form)) {
+            note_gensyms(plisp_car(form), gensyms);
+        }
+        note_gensyms(form, gensyms);
+    } else if (plisp_c_vectorp(form)) {
+        for (size_t i = 0; i < plisp_vector_c_length(form); ++i) {
+            note_gensyms(plisp_vector_ref(form, i), gensyms);
+        }
+    } else if (plisp_c_symbolp(form) && plisp_c_gensymp(form)) {
+        // numbered in the order they first appear
+        Word_t *pval;
+        JLI(pval, *gensyms, form);
+        if (*pval == 0) {
+            JLC(*pval, *gensyms, 0, -1);
+        }
+    }
+}
+
+static void write_gensyms(FILE *out, Pvoid_t gensyms) {
+    Word_t sym = 0;
+    Word_t *pval;
+    JLF(pval, gensyms, sym);
+    while (pval != NULL) {
+        fprintf(out, ";; gensym %s\n",
+                plisp_string_value(plisp_symbol_name(sym)));
+        JLN(pval, gensyms, sym);
+    }
+}
+
+Pvoid_t plisp_read_compiled_header(FILE *f) {
+    Pvoid_t renames = NULL;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) > 0 && strcmp(line, COMPILED_END) != 0) {
+        if (strncmp(line, ";; gensym ", 10) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            plisp_t sym = plisp_intern(plisp_make_symbol(line + 10));
+
+            plisp_t *val;
+            JLI(val, renames, sym);
+            *val = plisp_c_gensym();
+        }
+    }
+    free(line);
+    return renames;
+}
+
+plisp_t plisp_rename_gensyms(plisp_t form, Pvoid_t renames) {
+    if (plisp_c_consp(form)) {
+        plisp_t head = plisp_cons(plisp_rename_gensyms(plisp_car(form),
+                                                       renames), plisp_nil);
+        plisp_t tail = head;
+        for (form = plisp_cdr(form); plisp_c_consp(form);
+             form = plisp_cdr(form)) {
+            plisp_t cell = plisp_cons(plisp_rename_gensyms(plisp_car(form),
+                                                           renames),
+                                      plisp_nil);
+            plisp_set_cdr(tail, cell);
+            tail = cell;
+        }
+        plisp_set_cdr(tail, plisp_rename_gensyms(form, renames));
+        return head;
+    } else if (plisp_c_vectorp(form)) {
+        // copied only if it changes, like the rest of a quoted constant
+        plisp_t elems = plisp_nil;
+        bool changed = false;
+        for (size_t i = plisp_vector_c_length(form); i > 0; --i) {
+            plisp_t elem = plisp_vector_ref(form, i - 1);
+            plisp_t renamed = plisp_rename_gensyms(elem, renames);
+            changed = changed || renamed != elem;
+            elems = plisp_cons(renamed, elems);
+        }
+        if (changed) {
+            return plisp_list_to_vector(elems);
+        }
+    } else if (plisp_c_symbolp(form)) {
+        plisp_t *val;
+        JLG(val, renames, form);
+        if (val != NULL) {
+            return *val;
+        }
+    }
+    return form;
+}
+
+void plisp_free_renames(Pvoid_t renames) {
+    size_t Rc_word;
+    JLFA(Rc_word, renames);
+}
+
+// whether a form has to run at compile time, because later forms may
+// need it to expand. this is definitions, and the files they come from
+static bool compile_time_formp(plisp_t form) {
+    if (!plisp_c_consp(form)) {
+        return false;
+    }
+
+    plisp_t head = plisp_car(form);
+    return head == define_sym || head == set_sym || head == macro_set_sym
+        || head == require_sym || head == load_sym;
+}
+
+// runs the compile time forms in form, looking inside toplevel begins
+static void run_compile_time_forms(plisp_t form) {
+    if (plisp_c_consp(form) && plisp_car(form) == begin_sym) {
+        for (plisp_t body = plisp_cdr(form); plisp_c_consp(body);
+             body = plisp_cdr(body)) {
+            run_compile_time_forms(plisp_car(body));
+        }
+    } else if (compile_time_formp(form)) {
+        plisp_toplevel_eval_expanded(form);
+    }
+}
+
+void plisp_c_compile_file(const char *src, const char *dst) {
+    plisp_t oldfile = *plisp_toplevel_ref(filesym);
+    plisp_toplevel_define(filesym, plisp_make_string(src));
+    plisp_note_loaded_file(src);
+    uint64_t macros_before = current_macro_digest();
+
+    FILE *in = fopen(src, "r");
+    if (in == NULL) {
+        fprintf(stderr, "error: could not open %s\n", src);
+    }
+    assert(in != NULL);
+
+    // write somewhere else first, so nobody loads half a file
+    char *tmp = malloc(strlen(dst) + 32);
+    sprintf(tmp, "%s.%d.tmp", dst, getpid());
+    FILE *out = fopen(tmp, "w");
+    if (out == NULL) {
+        fprintf(stderr, "error: could not open %s\n", tmp);
+    }
+    assert(out != NULL);
+
+    // the header lists the files loaded while compiling, so the body
+    // comes first
+    char *body;
+    size_t bodylen;
+    FILE *bodyf = open_memstream(&body, &bodylen);
+    Pvoid_t gensyms = NULL;
+
+    plisp_t obj;
+    while (!plisp_c_eofp(obj = plisp_c_read(in))) {
+        plisp_t expanded = plisp_macroexpand(obj);
+
+        if (plisp_c_readablep(expanded)) {
+            plisp_c_write(bodyf, expanded);
+            note_gensyms(expanded, &gensyms);
+        } else {
+            // expand it again when it is loaded
+            plisp_t quoted = plisp_cons(quote_sym, plisp_cons(obj, plisp_nil));
+            plisp_c_write(bodyf, plisp_cons(eval_sym,
+                                            plisp_cons(quoted, plisp_nil)));
+        }
+        fputc('\n', bodyf);
+
+        run_compile_time_forms(expanded);
+    }
+    fclose(bodyf);
+
+    fputs(COMPILED_HEADER, out);
+    write_depends(out, macros_before);
+    write_gensyms(out, gensyms);
+    fputs(COMPILED_END, out);
+    fwrite(body, 1, bodylen, out);
+    free(body);
+    size_t Rc_word;
+    JLFA(Rc_word, gensyms);
+
+    fclose(in);
+    fclose(out);
+
+    if (rename(tmp, dst) != 0) {
+        perror("error: could not write compiled file");
+        unlink(tmp);
+    }
+    free(tmp);
+
+    plisp_toplevel_define(filesym, oldfile);
+}
+
+plisp_t plisp_builtin_compile_file(plisp_t *clos, size_t nargs,
+                                   plisp_t src, plisp_t dst) {
+    plisp_assert(nargs == 1 || nargs == 2);
+
+    char *srcpath = plisp_string_cstring(src);
+    char *dstpath = nargs == 2 ? plisp_string_cstring(dst)
+                               : plisp_compiled_path(srcpath);
+    plisp_c_compile_file(srcpath, dstpath);
+    free(srcpath);
+    free(dstpath);
+    return plisp_unspec;
+}
+
+/*
+the expansion cache keeps the expansion of every toplevel form that is
+loaded from source, in $XDG_CACHE_HOME/plisp/<build id>/. an entry is
+keyed by the text of the form and a digest of every form loaded before
+it, since those are what defined the macros it was expanded with.
+entries list their gensyms the way compiled files do.
+
+hits touch their entry, and once there are more than CACHE_MAX_ENTRIES
+the least recently used are removed. the directories of other builds
+are removed once they go unused for CACHE_STALE_DAYS.
+*/
+
+#define CACHE_MAX_ENTRIES 4096
+#define CACHE_STALE_DAYS 7
+
+static char *cache_dir = NULL;
+// loads on any thread define macros for all of them, so the digest is
+// shared
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t load_digest = 14695981039346656037lu;
+static size_t cache_entries = 0;
+static size_t cache_hits = 0;
+static size_t cache_misses = 0;
+
+static uint64_t fnv1a(uint64_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211lu;
+    }
+    return hash;
+}
+
+static int find_build_id(struct dl_phdr_info *info, size_t size, void *data) {
+    char *id = data;
+    // the first object is the executable
+    for (size_t i = 0; i < info->dlpi_phnum; ++i) {
+        const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+        if (ph->p_type != PT_NOTE) {
+            continue;
+        }
+
+        const char *note = (void *) (info->dlpi_addr + ph->p_vaddr);
+        const char *end = note + ph->p_memsz;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *nh = (void *) note;
+            const unsigned char *desc = (void *) (note + sizeof(ElfW(Nhdr))
+                                                  + ((nh->n_namesz + 3) & ~3));
+            if (nh->n_type == NT_GNU_BUILD_ID && nh->n_descsz <= 32) {
+                for (size_t j = 0; j < nh->n_descsz; ++j) {
+                    sprintf(id + j*2, "%02x", desc[j]);
+                }
+                return 1;
+            }
+            note = (const char *) desc + ((nh->n_descsz + 3) & ~3);
+        }
+    }
+    return 1;
+}
+
+// identifies this binary, so an upgrade never sees old expansions
+static void build_id(char *id) {
+    id[0] = '\0';
+    dl_iterate_phdr(find_build_id, id);
+
+    if (id[0] == '\0') {
+        // no build id note, use the executable instead
+        struct stat st;
+        if (stat("/proc/self/exe", &st) == 0) {
+            sprintf(id, "%lx-%lx", (unsigned long) st.st_mtime,
+                    (unsigned long) st.st_size);
+        } else {
+            strcpy(id, "unknown");
+        }
+    }
+}
+
+static bool make_dir(const char *path) {
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// removes a directory and the files in it
+static void remove_dir(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] != '.') {
+            unlinkat(dirfd(dir), ent->d_name, 0);
+        }
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// removes the caches of other builds that haven't been used for a while
+static void remove_stale_builds(const char *base) {
+    DIR *dir = opendir(base);
+    if (dir == NULL) {
+        return;
+    }
+    time_t stale = time(NULL) - CACHE_STALE_DAYS * 24 * 60 * 60;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.' || strcmp(ent->d_name, build) == 0) {
+            continue;
+        }
+        char path[4096 + 512];
+        snprintf(path, sizeof(path), "%s/%s", base, ent->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)
+            && st.st_mtime < stale) {
+            remove_dir(path);
+        }
+    }
+    closedir(dir);
+}
+
+struct cache_entry {
+    time_t used;
+    char name[40];
+};
+
+static int compare_entries(const void *a, const void *b) {
+    time_t x = ((const struct cache_entry *) a)->used;
+    time_t y = ((const struct cache_entry *) b)->used;
+    return (x > y) - (x < y);
+}
+
+// counts the entries in the cache, removing the least recently used
+// down to three quarters of the limit if there are too many. with
+// cache_lock held
+static void prune_cache(void) {
+    DIR *dir = opendir(cache_dir);
+    if (dir == NULL) {
+        return;
+    }
+    struct cache_entry *entries = NULL;
+    size_t n = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        struct stat st;
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= 40
+            || fstatat(dirfd(dir), ent->d_name, &st, 0) != 0) {
+            continue;
+        }
+        entries = realloc(entries, (n + 1) * sizeof(*entries));
+        entries[n].used = st.st_mtime;
+        strcpy(entries[n].name, ent->d_name);
+        ++n;
+    }
+
+    if (n > CACHE_MAX_ENTRIES) {
+        qsort(entries, n, sizeof(*entries), compare_entries);
+        size_t remove = n - CACHE_MAX_ENTRIES * 3 / 4;
+        for (size_t i = 0; i < remove; ++i) {
+            unlinkat(dirfd(dir), entries[i].name, 0);
+        }
+        n -= remove;
+    }
+    cache_entries = n;
+
+    free(entries);
+    closedir(dir);
+}
+
+static void init_expansion_cache(void) {
+    // PLISP_CACHE=0 turns the cache off
+    const char *setting = getenv("PLISP_CACHE");
+    if (setting != NULL && strcmp(setting, "0") == 0) {
+        return;
+    }
+
+    char base[4096];
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg != NULL && xdg[0] != '\0') {
+        snprintf(base, sizeof(base), "%s", xdg);
+    } else if (home != NULL) {
+        snprintf(base, sizeof(base), "%s/.cache", home);
+    } else {
+        return;
+    }
+
+    char path[4096 + 128];
+    snprintf(path, sizeof(path), "%s/plisp", base);
+    if (!make_dir(base) || !make_dir(path)) {
+        return;
+    }
+    remove_stale_builds(path);
+    snprintf(path, sizeof(path), "%s/plisp/%s", base, build);
+    if (!make_dir(path)) {
+        return;
+    }
+    // so other builds see this one is in use
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    cache_dir = strdup(path);
+    prune_cache();
+}
+
+// the written form, or NULL if it can't be read back
+static char *form_text(plisp_t form, size_t *len) {
+    if (!plisp_c_readablep(form)) {
+        return NULL;
+    }
+
+    char *text;
+    FILE *f = open_memstream(&text, len);
+    plisp_c_write(f, form);
+    fclose(f);
+    return text;
+}
+
+// the gensyms in form, renamed by the order they appear in, since they
+// are named differently on every run
+static plisp_t canonical_form(plisp_t form) {
+    Pvoid_t gensyms = NULL;
+    note_gensyms(form, &gensyms);
+    if (gensyms == NULL) {
+        return form;
+    }
+
+    Word_t sym = 0;
+    plisp_t *pval;
+    JLF(pval, gensyms, sym);
+    while (pval != NULL) {
+        char name[32];
+        snprintf(name, sizeof(name), "%%gensym%lu", (unsigned long) *pval);
+        *pval = plisp_intern(plisp_make_symbol(name));
+        JLN(pval, gensyms, sym);
+    }
+
+    form = plisp_rename_gensyms(form, gensyms);
+    size_t Rc_word;
+    JLFA(Rc_word, gensyms);
+    return form;
+}
+
+void plisp_note_loaded_form(plisp_t expanded) {
+    size_t len;
+    char *text = form_text(canonical_form(expanded), &len);
+    pthread_mutex_lock(&cache_lock);
+    if (text != NULL) {
+        load_digest = fnv1a(load_digest, text, len);
+    } else {
+        // something we can't name went by, so later keys can't match
+        // anything from a run that didn't see it
+        load_digest = fnv1a(load_digest, (char *) &expanded, sizeof(expanded));
+    }
+    pthread_mutex_unlock(&cache_lock);
+    free(text);
+}
+
+static plisp_t read_entry(const char *path, const char *text, size_t len) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return plisp_unbound;
+    }
+
+    // the entry starts with the source of the form, in case of a
+    // collision
+    plisp_t expanded = plisp_unbound;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t got = getline(&line, &cap, f);
+    if (got == (ssize_t) len + 1 && memcmp(line, text, len) == 0) {
+        // then the gensyms, which get fresh names like compiled files'
+        Pvoid_t renames = plisp_read_compiled_header(f);
+        plisp_t obj = plisp_c_read(f);
+        if (!plisp_c_eofp(obj)) {
+            expanded = renames == NULL ? obj
+                                       : plisp_rename_gensyms(obj, renames);
+        }
+        plisp_free_renames(renames);
+    }
+
+    free(line);
+    fclose(f);
+    return expanded;
+}
+
+static void write_entry(const char *path, const char *text, plisp_t expanded) {
+    // other threads may be writing the same entry
+    char tmp[4096 + 256];
+    snprintf(tmp, sizeof(tmp), "%s.%d.%lx.tmp", path, getpid(),
+             (unsigned long) pthread_self());
+
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        return;
+    }
+    fprintf(f, "%s\n", text);
+
+    Pvoid_t gensyms = NULL;
+    note_gensyms(expanded, &gensyms);
+    write_gensyms(f, gensyms);
+    fputs(COMPILED_END, f);
+    size_t Rc_word;
+    JLFA(Rc_word, gensyms);
+
+    plisp_c_write(f, expanded);
+    fputc('\n', f);
+
+    // rename is atomic, so other processes see all of it or nothing
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+}
+
+plisp_t plisp_cached_macroexpand(plisp_t form) {
+    plisp_t mexpand = *plisp_toplevel_ref(macroexpand_sym);
+    if (cache_dir == NULL || mexpand == plisp_unbound
+        || mexpand == plisp_unspec) {
+        return plisp_macroexpand(form);
+    }
+
+    size_t len;
+    char *text = form_text(form, &len);
+    if (text == NULL || memchr(text, '\n', len) != NULL) {
+        free(text);
+        return plisp_macroexpand(form);
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    uint64_t digest = load_digest;
+    pthread_mutex_unlock(&cache_lock);
+
+    char path[4096 + 64];
+    snprintf(path, sizeof(path), "%s/%016lx%016lx", cache_dir,
+             digest, fnv1a(14695981039346656037lu, text, len));
+
+    plisp_t expanded = read_entry(path, text, len);
+    if (expanded != plisp_unbound) {
+        // recently used entries are the last to go
+        utimensat(AT_FDCWD, path, NULL, 0);
+        pthread_mutex_lock(&cache_lock);
+        cache_hits++;
+        pthread_mutex_unlock(&cache_lock);
+    } else {
+        expanded = plisp_macroexpand(form);
+        bool written = plisp_c_readablep(expanded);
+        if (written) {
+            write_entry(path, text, expanded);
+        }
+        pthread_mutex_lock(&cache_lock);
+        cache_misses++;
+        if (written && ++cache_entries > CACHE_MAX_ENTRIES) {
+            prune_cache();
+        }
+        pthread_mutex_unlock(&cache_lock);
+    }
+
+    free(text);
+    return expanded;
+}
+
+void plisp_expansion_cache_report(FILE *f) {
+    pthread_mutex_lock(&cache_lock);
+    size_t total = cache_hits + cache_misses;
+    fprintf(f, "expansion cache hits: %lu, misses: %lu (%.1f%% hit)\n",
+            cache_hits, cache_misses,
+            total == 0 ? 0.0 : 100.0 * cache_hits / total);
+    pthread_mutex_unlock(&cache_lock);
+}
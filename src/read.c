@@ -1,14 +1,21 @@
 #include <plisp/read.h>
 #include <plisp/builtin.h>
+#include <plisp/number.h>
+#include <plisp/homvec.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 #include <Judy.h>
+#include <pthread.h>
 #include <plisp/gc.h>
 
 static plisp_t make_interned_symbol(const char *text);
+static bool symchar(int ch);
+static plisp_t plisp_read_token(FILE *f, const char *prefix);
 
 // Judy's API makes no sense
 static Pvoid_t intern_table = NULL;
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
 
 plisp_t plisp_eof = plisp_nil;
 
@@ -29,24 +36,32 @@ void plisp_init_reader(void) {
 plisp_t plisp_intern(plisp_t sym) {
     const unsigned char *key = (const unsigned char *)
         plisp_string_value(plisp_symbol_name(sym));
-    plisp_t *val;
-    JSLG(val, intern_table, key);
-    if (val != NULL) {
-        return *val;
-    }
 
+    pthread_mutex_lock(&intern_lock);
+    plisp_t *val;
     JSLI(val, intern_table, key);
-    *val = sym;
-    plisp_gc_permanent(sym);
+    bool fresh = *val == 0;
+    if (fresh) {
+        *val = sym;
+    }
+    sym = *val;
+    pthread_mutex_unlock(&intern_lock);
 
+    // outside the lock, since allocating can wait for a compiler thread
+    if (fresh) {
+        plisp_gc_permanent(sym);
+    }
     return sym;
 }
 
 bool plisp_symbol_internedp(plisp_t sym) {
     const unsigned char *key = (const unsigned char *)
         plisp_string_value(plisp_symbol_name(sym));
+
+    pthread_mutex_lock(&intern_lock);
     plisp_t *val;
     JSLG(val, intern_table, key);
+    pthread_mutex_unlock(&intern_lock);
     return val != NULL;
 }
 
@@ -76,8 +91,19 @@ static plisp_t plisp_read_list(FILE *f) {
         return plisp_eof;
     }
 
+    int next = ch == '.' ? fgetc(f) : EOF;
+    if (next != EOF) {
+        ungetc(next, f);
+    }
+
     if (ch == ')') {
         return plisp_nil;
+    } else if (ch == '.' && symchar(next)) {
+        // a symbol or number starting with a dot, like ... or .5
+        plisp_t car = plisp_read_token(f, ".");
+        plisp_t cdr = plisp_read_list(f);
+
+        return plisp_cons(car, cdr);
     } else if (ch == '.') {
         plisp_t cdr = plisp_c_read(f);
         skip_cws(f, &ch);
@@ -178,10 +204,13 @@ static plisp_t make_interned_symbol(const char *text) {
     return plisp_intern(plisp_make_symbol(text));
 }
 
-static plisp_t plisp_read_symbol(FILE *f) {
+// reads a symbol or a number, the first characters of which were
+// already read as prefix
+static plisp_t plisp_read_token(FILE *f, const char *prefix) {
     //TODO: unbounded symbols
     char text[1024];
-    size_t off = 0;
+    size_t off = strlen(prefix);
+    memcpy(text, prefix, off);
 
     char ch;
     while (symchar(ch = fgetc(f))) {
@@ -191,26 +220,17 @@ static plisp_t plisp_read_symbol(FILE *f) {
     ungetc(ch, f);
 
     text[off] = '\0';
-    return make_interned_symbol(text);
-}
 
-static plisp_t plisp_read_number(FILE *f) {
-    //TODO: floats
-    //TODO: negatives
-    long num = 0;
-
-    int ch;
-    while (true) {
-        ch = fgetc(f);
-        if (isdigit(ch)) {
-            num = num * 10 + (ch - '0');
-        } else {
-            ungetc(ch, f);
-            break;
-        }
+    plisp_t num = plisp_parse_number(text);
+    if (num != plisp_unbound) {
+        return num;
     }
 
-    return plisp_make_fixnum(num);
+    return make_interned_symbol(text);
+}
+
+static plisp_t plisp_read_symbol(FILE *f) {
+    return plisp_read_token(f, "");
 }
 
 plisp_t plisp_read_call(FILE *f, const char *sym) {
@@ -240,6 +260,15 @@ plisp_t plisp_read_hash(FILE *f) {
         return plisp_make_bool(false);
     } else if (sym == tsym) {
         return plisp_make_bool(true);
+    } else if (plisp_c_symbolp(sym)) {
+        // #u8(...), #f64(...) and so on
+        enum plisp_homvec_kind kind = plisp_homvec_tag_kind(
+            plisp_string_value(plisp_symbol_name(sym)));
+        ch = fgetc(f);
+        if (kind != HOMVEC_NONE && ch == '(') {
+            return plisp_list_to_homvec(kind, plisp_read_list(f));
+        }
+        ungetc(ch, f);
     }
 
     return plisp_nil;
@@ -271,9 +300,6 @@ plisp_t plisp_c_read(FILE *f) {
         }
     } else if (ch == '#') {
         return plisp_read_hash(f);
-    } else if (isdigit(ch)) {
-        ungetc(ch, f);
-        return plisp_read_number(f);
     } else {
         ungetc(ch, f);
         return plisp_read_symbol(f);
@@ -0,0 +1,293 @@
+#include <plisp/record.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/list.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+a record is one cell holding its type descriptor and a malloc'd array
+of its fields, which the collector frees with it like the payload of a
+vector. a type descriptor is a record too, of the type record-type,
+holding the name of the type, the list of its field names and how many
+there are. record-type is its own type.
+
+accessors, modifiers and predicates are builtin closures carrying the
+type descriptor in their data, so the compiler can inline a call to
+one as a check of the tag and the descriptor and a single load or
+store.
+*/
+
+enum {
+    RTD_NAME,
+    RTD_FIELDS,
+    RTD_NFIELDS,
+    RTD_LENGTH,
+};
+
+static plisp_t record_type_rtd;
+
+static plisp_t record_make_record_type(plisp_t *clos, size_t nargs,
+                                       plisp_t name, plisp_t fields);
+static plisp_t record_constructor(plisp_t *clos, size_t nargs, plisp_t rtd,
+                                  plisp_t fields);
+static plisp_t record_predicate(plisp_t *clos, size_t nargs, plisp_t rtd);
+static plisp_t record_accessor(plisp_t *clos, size_t nargs, plisp_t rtd,
+                               plisp_t field);
+static plisp_t record_modifier(plisp_t *clos, size_t nargs, plisp_t rtd,
+                               plisp_t field);
+static plisp_t record_recordp(plisp_t *clos, size_t nargs, plisp_t obj);
+
+void plisp_init_record(void) {
+    // record-type is its own type, so it is put together by hand
+    plisp_t name = plisp_intern(plisp_make_symbol("record-type"));
+    plisp_t fields =
+        plisp_cons(plisp_intern(plisp_make_symbol("name")),
+                   plisp_cons(plisp_intern(plisp_make_symbol("fields")),
+                              plisp_cons(plisp_intern(
+                                             plisp_make_symbol("nfields")),
+                                         plisp_nil)));
+
+    plisp_t *slots = malloc(RTD_LENGTH * sizeof(plisp_t));
+    slots[RTD_NAME] = name;
+    slots[RTD_FIELDS] = fields;
+    slots[RTD_NFIELDS] = plisp_make_fixnum(RTD_LENGTH);
+
+    record_type_rtd = plisp_alloc_obj(LT_RECORD, true);
+    struct plisp_record *recptr = (void *) (record_type_rtd & ~LOTAGS);
+    recptr->rtd = record_type_rtd;
+    recptr->fields = slots;
+    plisp_gc_permanent(record_type_rtd);
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("make-record-type", record_make_record_type);
+    plisp_define_builtin("record-constructor", record_constructor);
+    plisp_define_builtin("record-predicate", record_predicate);
+    plisp_define_builtin("record-accessor", record_accessor);
+    plisp_define_builtin("record-modifier", record_modifier);
+    plisp_define_builtin("record?", record_recordp);
+
+    #pragma GCC diagnostic pop
+}
+
+bool plisp_c_recordp(plisp_t obj) {
+    return (obj & LOTAGS) == LT_RECORD;
+}
+
+plisp_t plisp_record_rtd(plisp_t rec) {
+    plisp_assert(plisp_c_recordp(rec));
+    struct plisp_record *recptr = (void *) (rec & ~LOTAGS);
+    return recptr->rtd;
+}
+
+static plisp_t *record_fields(plisp_t rec) {
+    struct plisp_record *recptr = (void *) (rec & ~LOTAGS);
+    return recptr->fields;
+}
+
+static bool rtdp(plisp_t obj) {
+    return plisp_c_recordp(obj) && plisp_record_rtd(obj) == record_type_rtd;
+}
+
+plisp_t plisp_make_record(plisp_t rtd) {
+    plisp_assert(rtdp(rtd));
+    size_t nfields = plisp_record_type_nfields(rtd);
+
+    // the fields are filled in before the record can be traced
+    plisp_t *fields = malloc(nfields * sizeof(plisp_t));
+    for (size_t i = 0; i < nfields; ++i) {
+        fields[i] = plisp_unspec;
+    }
+
+    plisp_t rec = plisp_alloc_obj(LT_RECORD, true);
+    struct plisp_record *recptr = (void *) (rec & ~LOTAGS);
+    recptr->rtd = rtd;
+    recptr->fields = fields;
+    return rec;
+}
+
+plisp_t plisp_make_record_type(plisp_t name, plisp_t fields) {
+    plisp_assert(plisp_c_symbolp(name));
+    size_t nfields = 0;
+    for (plisp_t lst = fields; plisp_c_consp(lst); lst = plisp_cdr(lst)) {
+        plisp_assert(plisp_c_symbolp(plisp_car(lst)));
+        nfields++;
+    }
+
+    fields = plisp_list_copy(fields);
+    plisp_t rtd = plisp_make_record(record_type_rtd);
+    plisp_t *slots = record_fields(rtd);
+    slots[RTD_NAME] = name;
+    slots[RTD_FIELDS] = fields;
+    slots[RTD_NFIELDS] = plisp_make_fixnum(nfields);
+    return rtd;
+}
+
+plisp_t plisp_record_type_name(plisp_t rtd) {
+    return record_fields(rtd)[RTD_NAME];
+}
+
+size_t plisp_record_type_nfields(plisp_t rtd) {
+    return plisp_fixnum_value(record_fields(rtd)[RTD_NFIELDS]);
+}
+
+static void check_rtd(plisp_t rtd) {
+    if (!rtdp(rtd)) {
+        fprintf(stderr, "error: expected a record type, got ");
+        plisp_c_write(stderr, rtd);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+}
+
+static void check_record(plisp_t rtd, plisp_t obj) {
+    if (!plisp_c_recordp(obj) || plisp_record_rtd(obj) != rtd) {
+        fprintf(stderr, "error: expected a %s record, got ",
+                plisp_string_value(plisp_symbol_name(
+                                       plisp_record_type_name(rtd))));
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+}
+
+static size_t field_index(plisp_t rtd, plisp_t field) {
+    size_t idx = 0;
+    for (plisp_t lst = record_fields(rtd)[RTD_FIELDS];
+         plisp_c_consp(lst); lst = plisp_cdr(lst), ++idx) {
+        if (plisp_car(lst) == field) {
+            return idx;
+        }
+    }
+
+    fprintf(stderr, "error: record type %s has no field ",
+            plisp_string_value(plisp_symbol_name(
+                                   plisp_record_type_name(rtd))));
+    plisp_c_write(stderr, field);
+    fprintf(stderr, "\n");
+    assert(false);
+    return 0;
+}
+
+// a builtin closure whose data is rtd followed by nidx fixnums
+static plisp_t record_closure(plisp_fn_t fun, plisp_t rtd, size_t *idx,
+                              size_t nidx) {
+    struct plisp_closure_data *data =
+        malloc(sizeof(struct plisp_closure_data)
+               + (nidx + 1) * sizeof(plisp_t));
+    data->length = nidx + 1;
+    data->objs[RECORD_DATA_RTD] = rtd;
+    for (size_t i = 0; i < nidx; ++i) {
+        data->objs[RECORD_DATA_INDEX + i] = plisp_make_fixnum(idx[i]);
+    }
+    return plisp_make_closure(data, fun);
+}
+
+static plisp_t record_construct(struct plisp_closure_data *data,
+                                size_t nargs, ...) {
+    size_t nfields = data->length - RECORD_DATA_INDEX;
+    if (nargs != nfields) {
+        fprintf(stderr, "error: expected %lu args, got %lu\n", nfields, nargs);
+        assert(false);
+    }
+
+    plisp_t rec = plisp_make_record(data->objs[RECORD_DATA_RTD]);
+    plisp_t *fields = record_fields(rec);
+
+    va_list args;
+    va_start(args, nargs);
+    for (size_t i = 0; i < nargs; ++i) {
+        size_t idx = plisp_fixnum_value(data->objs[RECORD_DATA_INDEX + i]);
+        fields[idx] = va_arg(args, plisp_t);
+    }
+    va_end(args);
+
+    return rec;
+}
+
+plisp_t plisp_record_ref(struct plisp_closure_data *data, size_t nargs,
+                         plisp_t rec) {
+    plisp_assert(nargs == 1);
+    check_record(data->objs[RECORD_DATA_RTD], rec);
+    return record_fields(rec)[
+        plisp_fixnum_value(data->objs[RECORD_DATA_INDEX])];
+}
+
+plisp_t plisp_record_set(struct plisp_closure_data *data, size_t nargs,
+                         plisp_t rec, plisp_t value) {
+    plisp_assert(nargs == 2);
+    check_record(data->objs[RECORD_DATA_RTD], rec);
+    record_fields(rec)[plisp_fixnum_value(data->objs[RECORD_DATA_INDEX])]
+        = value;
+    return plisp_unspec;
+}
+
+plisp_t plisp_record_p(struct plisp_closure_data *data, size_t nargs,
+                       plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_recordp(obj)
+                           && plisp_record_rtd(obj)
+                              == data->objs[RECORD_DATA_RTD]);
+}
+
+static plisp_t record_make_record_type(plisp_t *clos, size_t nargs,
+                                       plisp_t name, plisp_t fields) {
+    plisp_assert(nargs == 2);
+    return plisp_make_record_type(name, fields);
+}
+
+static plisp_t record_constructor(plisp_t *clos, size_t nargs, plisp_t rtd,
+                                  plisp_t fields) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    check_rtd(rtd);
+    if (nargs == 1) {
+        fields = record_fields(rtd)[RTD_FIELDS];
+    }
+
+    size_t nidx = plisp_c_length(fields);
+    size_t *idx = malloc((nidx + 1) * sizeof(size_t));
+    size_t i = 0;
+    for (; plisp_c_consp(fields); fields = plisp_cdr(fields)) {
+        idx[i++] = field_index(rtd, plisp_car(fields));
+    }
+
+    plisp_t ctor = record_closure((plisp_fn_t) record_construct, rtd,
+                                  idx, nidx);
+    free(idx);
+    return ctor;
+}
+
+static plisp_t record_predicate(plisp_t *clos, size_t nargs, plisp_t rtd) {
+    plisp_assert(nargs == 1);
+    check_rtd(rtd);
+    return record_closure((plisp_fn_t) plisp_record_p, rtd, NULL, 0);
+}
+
+static plisp_t record_accessor(plisp_t *clos, size_t nargs, plisp_t rtd,
+                               plisp_t field) {
+    plisp_assert(nargs == 2);
+    check_rtd(rtd);
+    size_t idx = field_index(rtd, field);
+    return record_closure((plisp_fn_t) plisp_record_ref, rtd, &idx, 1);
+}
+
+static plisp_t record_modifier(plisp_t *clos, size_t nargs, plisp_t rtd,
+                               plisp_t field) {
+    plisp_assert(nargs == 2);
+    check_rtd(rtd);
+    size_t idx = field_index(rtd, field);
+    return record_closure((plisp_fn_t) plisp_record_set, rtd, &idx, 1);
+}
+
+static plisp_t record_recordp(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    // type descriptors are records to the collector, not to programs
+    return plisp_make_bool(plisp_c_recordp(obj) && !rtdp(obj));
+}
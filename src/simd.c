@@ -0,0 +1,932 @@
+#define _GNU_SOURCE
+#include <plisp/simd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+/*
+each instruction set has its own table of kernels, and the wrappers
+below call through whichever table plisp_init_simd picked. sse2 is part
+of x86-64, so only avx2 has to be detected. the vector loops use
+unaligned loads, since they are as fast as aligned ones on anything
+with avx2 and let the kernels run over any part of a vector.
+*/
+
+struct kernels {
+    const char *name;
+    void (*fill_f64)(double *, double, size_t);
+    void (*fill_s32)(int32_t *, int32_t, size_t);
+    void (*fill_s64)(int64_t *, int64_t, size_t);
+    double (*sum_f64)(const double *, size_t);
+    double (*dot_f64)(const double *, const double *, size_t);
+    double (*min_f64)(const double *, size_t);
+    double (*max_f64)(const double *, size_t);
+    uint64_t (*sum_u8)(const uint8_t *, size_t);
+    uint8_t (*min_u8)(const uint8_t *, size_t);
+    uint8_t (*max_u8)(const uint8_t *, size_t);
+    int64_t (*sum_s32)(const int32_t *, size_t);
+    int32_t (*min_s32)(const int32_t *, size_t);
+    int32_t (*max_s32)(const int32_t *, size_t);
+    size_t (*mismatch)(const uint8_t *, const uint8_t *, size_t);
+    size_t (*find_byte)(const uint8_t *, uint8_t, size_t);
+    size_t (*search)(const uint8_t *, size_t, const uint8_t *, size_t);
+    void (*hash_blocks)(const uint8_t *, size_t, uint64_t *);
+};
+
+/*
+strings hash in 32 byte blocks, each an xxh3 style accumulation into
+four 64 bit lanes, followed by a word at a time pass over the rest.
+every kernel set computes exactly the same lanes, so a hash never
+depends on the cpu it was computed on.
+*/
+
+#define HASH_BLOCK 32
+
+static const uint64_t hash_keys[4] = {
+    0x9e3779b185ebca87, 0xc2b2ae3d27d4eb4f,
+    0x165667b19e3779f9, 0x27d4eb2f165667c5,
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccd;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t load64(const uint8_t *src) {
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return word;
+}
+
+// scalar kernels, which also finish the tails of the vector ones
+
+static void scalar_fill_f64(double *dst, double val, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = val;
+    }
+}
+
+static void scalar_fill_s32(int32_t *dst, int32_t val, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = val;
+    }
+}
+
+static void scalar_fill_s64(int64_t *dst, int64_t val, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = val;
+    }
+}
+
+static double scalar_sum_f64(const double *src, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += src[i];
+    }
+    return sum;
+}
+
+static double scalar_dot_f64(const double *a, const double *b, size_t n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static double scalar_min_f64(const double *src, size_t n) {
+    double min = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static double scalar_max_f64(const double *src, size_t n) {
+    double max = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static uint64_t scalar_sum_u8(const uint8_t *src, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += src[i];
+    }
+    return sum;
+}
+
+static uint8_t scalar_min_u8(const uint8_t *src, size_t n) {
+    uint8_t min = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static uint8_t scalar_max_u8(const uint8_t *src, size_t n) {
+    uint8_t max = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static int64_t scalar_sum_s32(const int32_t *src, size_t n) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += src[i];
+    }
+    return sum;
+}
+
+static int32_t scalar_min_s32(const int32_t *src, size_t n) {
+    int32_t min = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static int32_t scalar_max_s32(const int32_t *src, size_t n) {
+    int32_t max = src[0];
+    for (size_t i = 1; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static size_t scalar_mismatch(const uint8_t *a, const uint8_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t diff = load64(a + i) ^ load64(b + i);
+        if (diff != 0) {
+            return i + __builtin_ctzll(diff) / 8;
+        }
+    }
+    for (; i < n && a[i] == b[i]; ++i);
+    return i;
+}
+
+static size_t scalar_find_byte(const uint8_t *src, uint8_t byte, size_t n) {
+    const uint8_t *found = memchr(src, byte, n);
+    return found != NULL ? (size_t) (found - src) : n;
+}
+
+static size_t scalar_search(const uint8_t *hay, size_t n,
+                            const uint8_t *needle, size_t m) {
+    // glibc's memmem is two way, so this is linear too
+    const uint8_t *found = memmem(hay, n, needle, m);
+    return found != NULL ? (size_t) (found - hay) : SIZE_MAX;
+}
+
+static void scalar_hash_blocks(const uint8_t *src, size_t nblocks,
+                               uint64_t *acc) {
+    for (size_t i = 0; i < nblocks; ++i, src += HASH_BLOCK) {
+        for (size_t j = 0; j < 4; ++j) {
+            uint64_t data = load64(src + 8*j);
+            uint64_t keyed = data ^ hash_keys[j];
+            acc[j] += data + (keyed & 0xffffffff) * (keyed >> 32);
+        }
+    }
+}
+
+static const struct kernels scalar_kernels = {
+    "scalar",
+    scalar_fill_f64, scalar_fill_s32, scalar_fill_s64,
+    scalar_sum_f64, scalar_dot_f64, scalar_min_f64, scalar_max_f64,
+    scalar_sum_u8, scalar_min_u8, scalar_max_u8,
+    scalar_sum_s32, scalar_min_s32, scalar_max_s32,
+    scalar_mismatch, scalar_find_byte, scalar_search, scalar_hash_blocks,
+};
+
+#ifdef __x86_64__
+
+// sse2, 16 bytes at a time
+
+static void sse2_fill_f64(double *dst, double val, size_t n) {
+    __m128d v = _mm_set1_pd(val);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(dst + i, v);
+    }
+    scalar_fill_f64(dst + i, val, n - i);
+}
+
+static void sse2_fill_s32(int32_t *dst, int32_t val, size_t n) {
+    __m128i v = _mm_set1_epi32(val);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+    scalar_fill_s32(dst + i, val, n - i);
+}
+
+static void sse2_fill_s64(int64_t *dst, int64_t val, size_t n) {
+    __m128i v = _mm_set1_epi64x(val);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_si128((__m128i *) (dst + i), v);
+    }
+    scalar_fill_s64(dst + i, val, n - i);
+}
+
+static double sse2_sum_f64(const double *src, size_t n) {
+    // two accumulators, so consecutive adds don't wait on each other
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(src + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(src + i + 2));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + scalar_sum_f64(src + i, n - i);
+}
+
+static double sse2_dot_f64(const double *a, const double *b, size_t n) {
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i),
+                                           _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+                                           _mm_loadu_pd(b + i + 2)));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + scalar_dot_f64(a + i, b + i, n - i);
+}
+
+static double sse2_min_f64(const double *src, size_t n) {
+    if (n < 2) {
+        return scalar_min_f64(src, n);
+    }
+
+    __m128d acc = _mm_loadu_pd(src);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_min_pd(acc, _mm_loadu_pd(src + i));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double min = scalar_min_f64(lanes, 2);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static double sse2_max_f64(const double *src, size_t n) {
+    if (n < 2) {
+        return scalar_max_f64(src, n);
+    }
+
+    __m128d acc = _mm_loadu_pd(src);
+    size_t i = 2;
+    for (; i + 2 <= n; i += 2) {
+        acc = _mm_max_pd(acc, _mm_loadu_pd(src + i));
+    }
+
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    double max = scalar_max_f64(lanes, 2);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static uint64_t sse2_sum_u8(const uint8_t *src, size_t n) {
+    // psadbw against zero sums each half of the bytes into 64 bits
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) (src + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(bytes, zero));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return lanes[0] + lanes[1] + scalar_sum_u8(src + i, n - i);
+}
+
+static uint8_t sse2_min_u8(const uint8_t *src, size_t n) {
+    if (n < 16) {
+        return scalar_min_u8(src, n);
+    }
+
+    __m128i acc = _mm_loadu_si128((const __m128i *) src);
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_min_epu8(acc, _mm_loadu_si128((const __m128i *) (src + i)));
+    }
+
+    uint8_t lanes[16];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    uint8_t min = scalar_min_u8(lanes, 16);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static uint8_t sse2_max_u8(const uint8_t *src, size_t n) {
+    if (n < 16) {
+        return scalar_max_u8(src, n);
+    }
+
+    __m128i acc = _mm_loadu_si128((const __m128i *) src);
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_max_epu8(acc, _mm_loadu_si128((const __m128i *) (src + i)));
+    }
+
+    uint8_t lanes[16];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    uint8_t max = scalar_max_u8(lanes, 16);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static int64_t sse2_sum_s32(const int32_t *src, size_t n) {
+    // sse2 can't sign extend, so interleave each word with its sign
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i signs = _mm_srai_epi32(words, 31);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(words, signs));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(words, signs));
+    }
+
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return lanes[0] + lanes[1] + scalar_sum_s32(src + i, n - i);
+}
+
+static int32_t sse2_min_s32(const int32_t *src, size_t n) {
+    if (n < 4) {
+        return scalar_min_s32(src, n);
+    }
+
+    // no pminsd before sse4.1, so select with a compare mask
+    __m128i acc = _mm_loadu_si128((const __m128i *) src);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i gt = _mm_cmpgt_epi32(acc, words);
+        acc = _mm_or_si128(_mm_and_si128(gt, words), _mm_andnot_si128(gt, acc));
+    }
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    int32_t min = scalar_min_s32(lanes, 4);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+static int32_t sse2_max_s32(const int32_t *src, size_t n) {
+    if (n < 4) {
+        return scalar_max_s32(src, n);
+    }
+
+    __m128i acc = _mm_loadu_si128((const __m128i *) src);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        __m128i gt = _mm_cmpgt_epi32(words, acc);
+        acc = _mm_or_si128(_mm_and_si128(gt, words), _mm_andnot_si128(gt, acc));
+    }
+
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    int32_t max = scalar_max_s32(lanes, 4);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+static size_t sse2_mismatch(const uint8_t *a, const uint8_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (a + i)),
+                                    _mm_loadu_si128((const __m128i *) (b + i)));
+        unsigned mask = _mm_movemask_epi8(eq) ^ 0xffff;
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scalar_mismatch(a + i, b + i, n - i);
+}
+
+static size_t sse2_find_byte(const uint8_t *src, uint8_t byte, size_t n) {
+    __m128i needle = _mm_set1_epi8(byte);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *) (src + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + scalar_find_byte(src + i, byte, n - i);
+}
+
+static size_t sse2_search(const uint8_t *hay, size_t n,
+                          const uint8_t *needle, size_t m) {
+    if (m < 2 || m > n) {
+        return scalar_search(hay, n, needle, m);
+    }
+
+    // only positions whose first and last bytes both match get compared
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[m-1]);
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *) (hay + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *) (hay + i + m - 1));
+        unsigned mask = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(head, first),
+                          _mm_cmpeq_epi8(tail, last)));
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, m - 2) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    size_t rest = scalar_search(hay + i, n - i, needle, m);
+    return rest == SIZE_MAX ? SIZE_MAX : i + rest;
+}
+
+static void sse2_hash_blocks(const uint8_t *src, size_t nblocks,
+                             uint64_t *acc) {
+    __m128i acc0 = _mm_loadu_si128((const __m128i *) acc);
+    __m128i acc1 = _mm_loadu_si128((const __m128i *) (acc + 2));
+    __m128i key0 = _mm_loadu_si128((const __m128i *) hash_keys);
+    __m128i key1 = _mm_loadu_si128((const __m128i *) (hash_keys + 2));
+
+    for (size_t i = 0; i < nblocks; ++i, src += HASH_BLOCK) {
+        __m128i data0 = _mm_loadu_si128((const __m128i *) src);
+        __m128i data1 = _mm_loadu_si128((const __m128i *) (src + 16));
+        __m128i keyed0 = _mm_xor_si128(data0, key0);
+        __m128i keyed1 = _mm_xor_si128(data1, key1);
+        // pmuludq multiplies the low halves of each lane
+        __m128i prod0 = _mm_mul_epu32(keyed0, _mm_srli_epi64(keyed0, 32));
+        __m128i prod1 = _mm_mul_epu32(keyed1, _mm_srli_epi64(keyed1, 32));
+        acc0 = _mm_add_epi64(acc0, _mm_add_epi64(data0, prod0));
+        acc1 = _mm_add_epi64(acc1, _mm_add_epi64(data1, prod1));
+    }
+
+    _mm_storeu_si128((__m128i *) acc, acc0);
+    _mm_storeu_si128((__m128i *) (acc + 2), acc1);
+}
+
+static const struct kernels sse2_kernels = {
+    "sse2",
+    sse2_fill_f64, sse2_fill_s32, sse2_fill_s64,
+    sse2_sum_f64, sse2_dot_f64, sse2_min_f64, sse2_max_f64,
+    sse2_sum_u8, sse2_min_u8, sse2_max_u8,
+    sse2_sum_s32, sse2_min_s32, sse2_max_s32,
+    sse2_mismatch, sse2_find_byte, sse2_search, sse2_hash_blocks,
+};
+
+// avx2, 32 bytes at a time
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void avx2_fill_f64(double *dst, double val, size_t n) {
+    __m256d v = _mm256_set1_pd(val);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, v);
+    }
+    scalar_fill_f64(dst + i, val, n - i);
+}
+
+AVX2 static void avx2_fill_s32(int32_t *dst, int32_t val, size_t n) {
+    __m256i v = _mm256_set1_epi32(val);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+    scalar_fill_s32(dst + i, val, n - i);
+}
+
+AVX2 static void avx2_fill_s64(int64_t *dst, int64_t val, size_t n) {
+    __m256i v = _mm256_set1_epi64x(val);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_si256((__m256i *) (dst + i), v);
+    }
+    scalar_fill_s64(dst + i, val, n - i);
+}
+
+AVX2 static double avx2_sum_f64(const double *src, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(src + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(src + i + 4));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+        + scalar_sum_f64(src + i, n - i);
+}
+
+AVX2 static double avx2_dot_f64(const double *a, const double *b, size_t n) {
+    // no fma, so each product rounds the same way as in the other kernels
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i),
+                                                 _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                                 _mm256_loadu_pd(b + i + 4)));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+        + scalar_dot_f64(a + i, b + i, n - i);
+}
+
+AVX2 static double avx2_min_f64(const double *src, size_t n) {
+    if (n < 4) {
+        return scalar_min_f64(src, n);
+    }
+
+    __m256d acc = _mm256_loadu_pd(src);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_min_pd(acc, _mm256_loadu_pd(src + i));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double min = scalar_min_f64(lanes, 4);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+AVX2 static double avx2_max_f64(const double *src, size_t n) {
+    if (n < 4) {
+        return scalar_max_f64(src, n);
+    }
+
+    __m256d acc = _mm256_loadu_pd(src);
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_max_pd(acc, _mm256_loadu_pd(src + i));
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    double max = scalar_max_f64(lanes, 4);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+AVX2 static uint64_t avx2_sum_u8(const uint8_t *src, size_t n) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *) (src + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(bytes, zero));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+        + scalar_sum_u8(src + i, n - i);
+}
+
+AVX2 static uint8_t avx2_min_u8(const uint8_t *src, size_t n) {
+    if (n < 32) {
+        return sse2_min_u8(src, n);
+    }
+
+    __m256i acc = _mm256_loadu_si256((const __m256i *) src);
+    size_t i = 32;
+    for (; i + 32 <= n; i += 32) {
+        acc = _mm256_min_epu8(acc, _mm256_loadu_si256((const __m256i *) (src + i)));
+    }
+
+    uint8_t lanes[32];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    uint8_t min = scalar_min_u8(lanes, 32);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+AVX2 static uint8_t avx2_max_u8(const uint8_t *src, size_t n) {
+    if (n < 32) {
+        return sse2_max_u8(src, n);
+    }
+
+    __m256i acc = _mm256_loadu_si256((const __m256i *) src);
+    size_t i = 32;
+    for (; i + 32 <= n; i += 32) {
+        acc = _mm256_max_epu8(acc, _mm256_loadu_si256((const __m256i *) (src + i)));
+    }
+
+    uint8_t lanes[32];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    uint8_t max = scalar_max_u8(lanes, 32);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+AVX2 static int64_t avx2_sum_s32(const int32_t *src, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i words = _mm_loadu_si128((const __m128i *) (src + i));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(words));
+    }
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+        + scalar_sum_s32(src + i, n - i);
+}
+
+AVX2 static int32_t avx2_min_s32(const int32_t *src, size_t n) {
+    if (n < 8) {
+        return sse2_min_s32(src, n);
+    }
+
+    __m256i acc = _mm256_loadu_si256((const __m256i *) src);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_min_epi32(acc, _mm256_loadu_si256((const __m256i *) (src + i)));
+    }
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    int32_t min = scalar_min_s32(lanes, 8);
+    for (; i < n; ++i) {
+        min = min < src[i] ? min : src[i];
+    }
+    return min;
+}
+
+AVX2 static int32_t avx2_max_s32(const int32_t *src, size_t n) {
+    if (n < 8) {
+        return sse2_max_s32(src, n);
+    }
+
+    __m256i acc = _mm256_loadu_si256((const __m256i *) src);
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm256_max_epi32(acc, _mm256_loadu_si256((const __m256i *) (src + i)));
+    }
+
+    int32_t lanes[8];
+    _mm256_storeu_si256((__m256i *) lanes, acc);
+    int32_t max = scalar_max_s32(lanes, 8);
+    for (; i < n; ++i) {
+        max = max > src[i] ? max : src[i];
+    }
+    return max;
+}
+
+AVX2 static size_t avx2_mismatch(const uint8_t *a, const uint8_t *b, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *) (a + i)),
+            _mm256_loadu_si256((const __m256i *) (b + i)));
+        unsigned mask = ~(unsigned) _mm256_movemask_epi8(eq);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + sse2_mismatch(a + i, b + i, n - i);
+}
+
+AVX2 static size_t avx2_find_byte(const uint8_t *src, uint8_t byte, size_t n) {
+    __m256i needle = _mm256_set1_epi8(byte);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *) (src + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + sse2_find_byte(src + i, byte, n - i);
+}
+
+AVX2 static size_t avx2_search(const uint8_t *hay, size_t n,
+                               const uint8_t *needle, size_t m) {
+    if (m < 2 || m > n) {
+        return scalar_search(hay, n, needle, m);
+    }
+
+    __m256i first = _mm256_set1_epi8(needle[0]);
+    __m256i last = _mm256_set1_epi8(needle[m-1]);
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i *) (hay + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i *) (hay + i + m - 1));
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+                             _mm256_cmpeq_epi8(tail, last)));
+        while (mask != 0) {
+            size_t at = i + __builtin_ctz(mask);
+            if (memcmp(hay + at + 1, needle + 1, m - 2) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+
+    size_t rest = sse2_search(hay + i, n - i, needle, m);
+    return rest == SIZE_MAX ? SIZE_MAX : i + rest;
+}
+
+AVX2 static void avx2_hash_blocks(const uint8_t *src, size_t nblocks,
+                                  uint64_t *acc) {
+    __m256i lanes = _mm256_loadu_si256((const __m256i *) acc);
+    __m256i keys = _mm256_loadu_si256((const __m256i *) hash_keys);
+
+    for (size_t i = 0; i < nblocks; ++i, src += HASH_BLOCK) {
+        __m256i data = _mm256_loadu_si256((const __m256i *) src);
+        __m256i keyed = _mm256_xor_si256(data, keys);
+        __m256i prod = _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+        lanes = _mm256_add_epi64(lanes, _mm256_add_epi64(data, prod));
+    }
+
+    _mm256_storeu_si256((__m256i *) acc, lanes);
+}
+
+static const struct kernels avx2_kernels = {
+    "avx2",
+    avx2_fill_f64, avx2_fill_s32, avx2_fill_s64,
+    avx2_sum_f64, avx2_dot_f64, avx2_min_f64, avx2_max_f64,
+    avx2_sum_u8, avx2_min_u8, avx2_max_u8,
+    avx2_sum_s32, avx2_min_s32, avx2_max_s32,
+    avx2_mismatch, avx2_find_byte, avx2_search, avx2_hash_blocks,
+};
+
+#endif
+
+static const struct kernels *kernels = &scalar_kernels;
+
+void plisp_init_simd(void) {
+    // fastest first
+    const struct kernels *supported[3];
+    size_t nsupported = 0;
+#ifdef __x86_64__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        supported[nsupported++] = &avx2_kernels;
+    }
+    supported[nsupported++] = &sse2_kernels;
+#endif
+    supported[nsupported++] = &scalar_kernels;
+
+    kernels = supported[0];
+
+    // PLISP_SIMD can pick a slower set, to compare them
+    const char *setting = getenv("PLISP_SIMD");
+    for (size_t i = 0; setting != NULL && i < nsupported; ++i) {
+        if (strcmp(setting, supported[i]->name) == 0) {
+            kernels = supported[i];
+        }
+    }
+}
+
+const char *plisp_simd_name(void) {
+    return kernels->name;
+}
+
+void plisp_simd_fill_f64(double *dst, double val, size_t n) {
+    kernels->fill_f64(dst, val, n);
+}
+
+void plisp_simd_fill_s32(int32_t *dst, int32_t val, size_t n) {
+    kernels->fill_s32(dst, val, n);
+}
+
+void plisp_simd_fill_s64(int64_t *dst, int64_t val, size_t n) {
+    kernels->fill_s64(dst, val, n);
+}
+
+double plisp_simd_sum_f64(const double *src, size_t n) {
+    return kernels->sum_f64(src, n);
+}
+
+double plisp_simd_dot_f64(const double *a, const double *b, size_t n) {
+    return kernels->dot_f64(a, b, n);
+}
+
+double plisp_simd_min_f64(const double *src, size_t n) {
+    return kernels->min_f64(src, n);
+}
+
+double plisp_simd_max_f64(const double *src, size_t n) {
+    return kernels->max_f64(src, n);
+}
+
+uint64_t plisp_simd_sum_u8(const uint8_t *src, size_t n) {
+    return kernels->sum_u8(src, n);
+}
+
+uint8_t plisp_simd_min_u8(const uint8_t *src, size_t n) {
+    return kernels->min_u8(src, n);
+}
+
+uint8_t plisp_simd_max_u8(const uint8_t *src, size_t n) {
+    return kernels->max_u8(src, n);
+}
+
+int64_t plisp_simd_sum_s32(const int32_t *src, size_t n) {
+    return kernels->sum_s32(src, n);
+}
+
+int32_t plisp_simd_min_s32(const int32_t *src, size_t n) {
+    return kernels->min_s32(src, n);
+}
+
+int32_t plisp_simd_max_s32(const int32_t *src, size_t n) {
+    return kernels->max_s32(src, n);
+}
+
+size_t plisp_simd_mismatch(const uint8_t *a, const uint8_t *b, size_t n) {
+    return kernels->mismatch(a, b, n);
+}
+
+size_t plisp_simd_find_byte(const uint8_t *src, uint8_t byte, size_t n) {
+    return kernels->find_byte(src, byte, n);
+}
+
+size_t plisp_simd_search(const uint8_t *hay, size_t n,
+                         const uint8_t *needle, size_t m) {
+    return kernels->search(hay, n, needle, m);
+}
+
+uint64_t plisp_hash_word(uint64_t word) {
+    return mix64(word);
+}
+
+uint64_t plisp_simd_hash(const uint8_t *src, size_t n) {
+    uint64_t hash = n * 0x9e3779b97f4a7c15;
+
+    size_t nblocks = n / HASH_BLOCK;
+    if (nblocks > 0) {
+        uint64_t acc[4];
+        memcpy(acc, hash_keys, sizeof(acc));
+        kernels->hash_blocks(src, nblocks, acc);
+        for (size_t j = 0; j < 4; ++j) {
+            hash = mix64(hash ^ acc[j]);
+        }
+        src += nblocks * HASH_BLOCK;
+        n -= nblocks * HASH_BLOCK;
+    }
+
+    for (; n >= 8; n -= 8, src += 8) {
+        hash = (hash ^ load64(src)) * 0xc4ceb9fe1a85ec53;
+        hash ^= hash >> 29;
+    }
+    uint64_t last = 0;
+    memcpy(&last, src, n);
+    return mix64(hash ^ last);
+}
@@ -0,0 +1,447 @@
+#include <plisp/sort.h>
+#include <plisp/builtin.h>
+#include <plisp/list.h>
+#include <plisp/text.h>
+#include <plisp/saftey.h>
+
+#include <string.h>
+
+/*
+lists are sorted with a natural merge sort. it splits the list into
+the runs that are already in order, reversing the descending ones, and
+merges neighbouring runs the way timsort does, keeping the lengths on
+its stack growing at least as fast as the fibonacci numbers. sorted
+and reversed input is a single run, and merging relinks the cells, so
+sort! conses nothing and sort conses one copy of the list. equal
+elements keep their order.
+
+vectors of objects are sorted in place with introsort: quicksort around
+a median of three, insertion sort for short ranges, and heapsort once
+the quicksort has split too many times, so it is never quadratic.
+equal elements may be reordered.
+
+when the predicate is the builtin < and every element is a fixnum, or
+it is string<? and every element is a string, the elements are
+compared directly instead of calling it.
+*/
+
+// ranges this short are insertion sorted
+#define INSERTION_MAX 16
+// plenty for runs whose lengths grow like the fibonacci numbers
+#define MAX_RUNS 128
+
+enum compare {
+    COMPARE_CALL,
+    COMPARE_FIXNUM,
+    COMPARE_STRING,
+};
+
+struct less {
+    enum compare how;
+    plisp_t pred;
+};
+
+struct run {
+    plisp_t head;
+    size_t len;
+};
+
+static plisp_t sort_sort(plisp_t *clos, size_t nargs, plisp_t seq,
+                         plisp_t pred);
+static plisp_t sort_sort_x(plisp_t *clos, size_t nargs, plisp_t seq,
+                           plisp_t pred);
+static plisp_t sort_list_sort(plisp_t *clos, size_t nargs, plisp_t pred,
+                              plisp_t lst);
+static plisp_t sort_vector_sort_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                                  plisp_t pred);
+static plisp_t sort_merge(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b,
+                          plisp_t pred);
+
+void plisp_init_sort(void) {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("sort", sort_sort);
+    plisp_define_builtin("sort!", sort_sort_x);
+    plisp_define_builtin("list-sort", sort_list_sort);
+    plisp_define_builtin("vector-sort!", sort_vector_sort_x);
+    plisp_define_builtin("merge", sort_merge);
+
+    #pragma GCC diagnostic pop
+}
+
+static bool less(struct less *lt, plisp_t a, plisp_t b) {
+    switch (lt->how) {
+    case COMPARE_FIXNUM:
+        // fixnums are their values shifted over a zero tag, so they
+        // compare the same way
+        return (int64_t) a < (int64_t) b;
+    case COMPARE_STRING:
+        return plisp_c_string_less(a, b);
+    case COMPARE_CALL:
+        break;
+    }
+
+    plisp_t args[] = { a, b };
+    return plisp_call_closure(lt->pred, 2, args) != plisp_make_bool(false);
+}
+
+// the direct comparison pred allows, if every element passes check
+static enum compare fast_compare(plisp_t pred, bool (**check)(plisp_t)) {
+    plisp_assert(plisp_c_closurep(pred));
+    plisp_fn_t fun = plisp_closure_fun(pred);
+    if (fun == (plisp_fn_t) plisp_builtin_lt) {
+        *check = plisp_c_fixnump;
+        return COMPARE_FIXNUM;
+    } else if (fun == (plisp_fn_t) plisp_builtin_string_lt) {
+        *check = plisp_c_stringp;
+        return COMPARE_STRING;
+    }
+    return COMPARE_CALL;
+}
+
+static struct less list_less(plisp_t pred, plisp_t lst) {
+    bool (*check)(plisp_t);
+    struct less lt = { fast_compare(pred, &check), pred };
+    if (lt.how != COMPARE_CALL) {
+        for (; plisp_c_consp(lst); lst = plisp_cdr(lst)) {
+            if (!check(plisp_car(lst))) {
+                lt.how = COMPARE_CALL;
+                break;
+            }
+        }
+    }
+    return lt;
+}
+
+static struct less vector_less(plisp_t pred, plisp_t *elems, size_t len) {
+    bool (*check)(plisp_t);
+    struct less lt = { fast_compare(pred, &check), pred };
+    if (lt.how != COMPARE_CALL) {
+        for (size_t i = 0; i < len; ++i) {
+            if (!check(elems[i])) {
+                lt.how = COMPARE_CALL;
+                break;
+            }
+        }
+    }
+    return lt;
+}
+
+// merges two sorted lists by relinking their cells. ties go to a, so
+// merging neighbouring runs keeps the sort stable.
+static plisp_t merge_lists(struct less *lt, plisp_t first, plisp_t second) {
+    // once a cell is relinked, the rest of its old list is reachable
+    // only from these, so they stay where the collector can see them
+    // while the predicate runs
+    volatile plisp_t a = first;
+    volatile plisp_t b = second;
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    while (plisp_c_consp(a) && plisp_c_consp(b)) {
+        plisp_t next;
+        if (less(lt, plisp_car(b), plisp_car(a))) {
+            next = b;
+            b = plisp_cdr(b);
+        } else {
+            next = a;
+            a = plisp_cdr(a);
+        }
+
+        if (plisp_c_nullp(head)) {
+            head = next;
+        } else {
+            plisp_set_cdr(tail, next);
+        }
+        tail = next;
+    }
+
+    plisp_t rest = plisp_c_consp(a) ? a : b;
+    if (plisp_c_nullp(head)) {
+        return rest;
+    }
+    plisp_set_cdr(tail, rest);
+    return head;
+}
+
+// detaches the run at the front of *lst. a strictly descending run is
+// reversed, which keeps equal elements in order since it has none.
+static struct run next_run(struct less *lt, volatile plisp_t *lst) {
+    plisp_t head = *lst;
+    plisp_t next = plisp_cdr(head);
+    size_t len = 1;
+
+    if (plisp_c_consp(next) && less(lt, plisp_car(next), plisp_car(head))) {
+        // *lst follows the unreversed part, which nothing else reaches
+        plisp_set_cdr(head, plisp_nil);
+        *lst = next;
+        while (plisp_c_consp(next)
+               && less(lt, plisp_car(next), plisp_car(head))) {
+            plisp_t after = plisp_cdr(next);
+            plisp_set_cdr(next, head);
+            head = next;
+            next = after;
+            *lst = next;
+            len++;
+        }
+        return (struct run) { head, len };
+    }
+
+    plisp_t last = head;
+    while (plisp_c_consp(next) && !less(lt, plisp_car(next), plisp_car(last))) {
+        last = next;
+        next = plisp_cdr(next);
+        len++;
+    }
+    plisp_set_cdr(last, plisp_nil);
+    *lst = next;
+    return (struct run) { head, len };
+}
+
+// merges runs i and i + 1
+static void merge_at(struct less *lt, volatile struct run *runs,
+                     size_t *nruns, size_t i) {
+    runs[i].head = merge_lists(lt, runs[i].head, runs[i + 1].head);
+    runs[i].len += runs[i + 1].len;
+    for (size_t j = i + 1; j + 1 < *nruns; ++j) {
+        runs[j] = runs[j + 1];
+    }
+    (*nruns)--;
+}
+
+// merges runs until each is longer than the two above it together,
+// so the stack stays logarithmic and merges stay balanced
+static void collapse(struct less *lt, volatile struct run *runs,
+                     size_t *nruns) {
+    while (*nruns > 1) {
+        size_t i = *nruns - 2;
+        if ((i > 0 && runs[i - 1].len <= runs[i].len + runs[i + 1].len)
+            || (i > 1 && runs[i - 2].len <= runs[i - 1].len + runs[i].len)) {
+            if (runs[i - 1].len < runs[i + 1].len) {
+                i--;
+            }
+        } else if (runs[i].len > runs[i + 1].len) {
+            return;
+        }
+        merge_at(lt, runs, nruns, i);
+    }
+}
+
+static plisp_t sort_cells(struct less *lt, plisp_t lst) {
+    // kept on the stack, so the collector finds the runs and the rest
+    // of the list while the predicate runs
+    volatile struct run runs[MAX_RUNS];
+    volatile plisp_t rest = lst;
+    size_t nruns = 0;
+    while (plisp_c_consp(rest)) {
+        plisp_assert(nruns < MAX_RUNS);
+        runs[nruns++] = next_run(lt, &rest);
+        collapse(lt, runs, &nruns);
+    }
+    while (nruns > 1) {
+        merge_at(lt, runs, &nruns, nruns - 2);
+    }
+    return nruns == 0 ? plisp_nil : runs[0].head;
+}
+
+plisp_t plisp_sort_list(plisp_t lst, plisp_t pred) {
+    struct less lt = list_less(pred, lst);
+    return sort_cells(&lt, lst);
+}
+
+static void swap(plisp_t *a, plisp_t *b) {
+    plisp_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+static void insertion_sort(struct less *lt, plisp_t *elems, size_t len) {
+    for (size_t i = 1; i < len; ++i) {
+        plisp_t elem = elems[i];
+        size_t j = i;
+        for (; j > 0 && less(lt, elem, elems[j - 1]); --j) {
+            elems[j] = elems[j - 1];
+        }
+        elems[j] = elem;
+    }
+}
+
+static void sift_down(struct less *lt, plisp_t *elems, size_t root,
+                      size_t len) {
+    for (size_t child; (child = 2 * root + 1) < len; root = child) {
+        if (child + 1 < len && less(lt, elems[child], elems[child + 1])) {
+            child++;
+        }
+        if (!less(lt, elems[root], elems[child])) {
+            return;
+        }
+        swap(elems + root, elems + child);
+    }
+}
+
+static void heap_sort(struct less *lt, plisp_t *elems, size_t len) {
+    for (size_t i = len / 2; i > 0; --i) {
+        sift_down(lt, elems, i - 1, len);
+    }
+    for (size_t end = len - 1; end > 0; --end) {
+        swap(elems, elems + end);
+        sift_down(lt, elems, 0, end);
+    }
+}
+
+// the index that splits elems into elements no greater and no less
+// than a median of three pivot
+static size_t partition(struct less *lt, plisp_t *elems, size_t len) {
+    size_t mid = len / 2;
+    if (less(lt, elems[mid], elems[0])) {
+        swap(elems + mid, elems);
+    }
+    if (less(lt, elems[len - 1], elems[mid])) {
+        swap(elems + len - 1, elems + mid);
+        if (less(lt, elems[mid], elems[0])) {
+            swap(elems + mid, elems);
+        }
+    }
+
+    // the first and last elements are on the right sides already. the
+    // bounds checks are for predicates that aren't strict orders.
+    plisp_t pivot = elems[mid];
+    size_t i = 0;
+    size_t j = len - 1;
+    while (true) {
+        do {
+            ++i;
+        } while (i < len - 1 && less(lt, elems[i], pivot));
+        do {
+            --j;
+        } while (j > 0 && less(lt, pivot, elems[j]));
+        if (i >= j) {
+            return j + 1;
+        }
+        swap(elems + i, elems + j);
+    }
+}
+
+static void intro_sort(struct less *lt, plisp_t *elems, size_t len,
+                       size_t depth) {
+    while (len > INSERTION_MAX) {
+        if (depth == 0) {
+            heap_sort(lt, elems, len);
+            return;
+        }
+        depth--;
+
+        // recurse into the shorter side, so the stack stays small
+        size_t split = partition(lt, elems, len);
+        if (split < len - split) {
+            intro_sort(lt, elems, split, depth);
+            elems += split;
+            len -= split;
+        } else {
+            intro_sort(lt, elems + split, len - split, depth);
+            len = split;
+        }
+    }
+    insertion_sort(lt, elems, len);
+}
+
+static plisp_t *vector_elems(plisp_t vec, size_t *len) {
+    plisp_assert(plisp_c_vectorp(vec));
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    plisp_assert(vecptr->type == VEC_OBJ);
+    *len = vecptr->len;
+    return vecptr->vec;
+}
+
+void plisp_sort_vector(plisp_t vec, plisp_t pred) {
+    // only the elements are used below, and they go with the vector,
+    // so it is kept alive until the sort is done
+    volatile plisp_t keep = vec;
+    size_t len;
+    plisp_t *elems = vector_elems(vec, &len);
+    struct plisp_vector *vecptr = (void *) (vec & ~LOTAGS);
+    plisp_assert(!(vecptr->flags & VFLAG_IMMUTABLE));
+
+    struct less lt = vector_less(pred, elems, len);
+    size_t depth = 0;
+    for (size_t n = len; n > 1; n /= 2) {
+        depth += 2;
+    }
+    intro_sort(&lt, elems, len, depth);
+    (void) keep;
+}
+
+static plisp_t sort_sort(plisp_t *clos, size_t nargs, plisp_t seq,
+                         plisp_t pred) {
+    plisp_assert(nargs == 2);
+    if (plisp_c_vectorp(seq)) {
+        size_t len;
+        plisp_t *elems = vector_elems(seq, &len);
+        plisp_t copy = plisp_make_vector(VEC_OBJ, sizeof(plisp_t), 0, len,
+                                         plisp_nil, false);
+        size_t copylen;
+        memcpy(vector_elems(copy, &copylen), elems, len * sizeof(plisp_t));
+        plisp_sort_vector(copy, pred);
+        return copy;
+    }
+    return plisp_sort_list(plisp_list_copy(seq), pred);
+}
+
+static plisp_t sort_sort_x(plisp_t *clos, size_t nargs, plisp_t seq,
+                           plisp_t pred) {
+    plisp_assert(nargs == 2);
+    if (plisp_c_vectorp(seq)) {
+        plisp_sort_vector(seq, pred);
+        return seq;
+    }
+    return plisp_sort_list(seq, pred);
+}
+
+static plisp_t sort_list_sort(plisp_t *clos, size_t nargs, plisp_t pred,
+                              plisp_t lst) {
+    plisp_assert(nargs == 2);
+    return plisp_sort_list(plisp_list_copy(lst), pred);
+}
+
+static plisp_t sort_vector_sort_x(plisp_t *clos, size_t nargs, plisp_t vec,
+                                  plisp_t pred) {
+    plisp_assert(nargs == 2);
+    plisp_sort_vector(vec, pred);
+    return plisp_unspec;
+}
+
+static plisp_t sort_merge(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b,
+                          plisp_t pred) {
+    plisp_assert(nargs == 3);
+    struct less lt = { COMPARE_CALL, pred };
+
+    // copies the cells taken from either list, and shares whatever is
+    // left of the other one
+    plisp_t head = plisp_nil;
+    plisp_t tail = plisp_nil;
+    while (plisp_c_consp(a) && plisp_c_consp(b)) {
+        plisp_t elem;
+        if (less(&lt, plisp_car(b), plisp_car(a))) {
+            elem = plisp_car(b);
+            b = plisp_cdr(b);
+        } else {
+            elem = plisp_car(a);
+            a = plisp_cdr(a);
+        }
+
+        plisp_t cell = plisp_cons(elem, plisp_nil);
+        if (plisp_c_nullp(head)) {
+            head = cell;
+        } else {
+            plisp_set_cdr(tail, cell);
+        }
+        tail = cell;
+    }
+
+    plisp_t rest = plisp_c_consp(a) ? a : b;
+    if (plisp_c_nullp(head)) {
+        return rest;
+    }
+    plisp_set_cdr(tail, rest);
+    return head;
+}
@@ -0,0 +1,108 @@
+#include <plisp/text.h>
+#include <plisp/builtin.h>
+#include <plisp/simd.h>
+#include <plisp/saftey.h>
+
+/*
+strings are compared, searched and hashed a block of bytes at a time by
+the kernels in simd.c, straight from their payloads. none of this
+touches the chars one by one, so nothing is boxed.
+*/
+
+void plisp_init_text(void) {
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("string=?", plisp_builtin_string_eq);
+    plisp_define_builtin("string<?", plisp_builtin_string_lt);
+    plisp_define_builtin("string-index", plisp_builtin_string_index);
+    plisp_define_builtin("string-contains", plisp_builtin_string_contains);
+    plisp_define_builtin("string-hash", plisp_builtin_string_hash);
+
+    #pragma GCC diagnostic pop
+}
+
+static const uint8_t *chars(plisp_t str) {
+    return (const uint8_t *) plisp_string_value(str);
+}
+
+// the index to start at, which defaults to 0
+static size_t start_index(size_t nargs, size_t required, plisp_t start,
+                          size_t len) {
+    if (nargs == required) {
+        return 0;
+    }
+    plisp_assert(plisp_c_fixnump(start));
+    plisp_assert(plisp_fixnum_value(start) >= 0
+                 && (size_t) plisp_fixnum_value(start) <= len);
+    return plisp_fixnum_value(start);
+}
+
+bool plisp_c_string_equal(plisp_t a, plisp_t b) {
+    size_t len = plisp_c_stringlen(a);
+    return len == plisp_c_stringlen(b)
+        && plisp_simd_mismatch(chars(a), chars(b), len) == len;
+}
+
+plisp_t plisp_builtin_string_eq(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
+    plisp_assert(nargs == 2);
+    return plisp_make_bool(plisp_c_string_equal(a, b));
+}
+
+bool plisp_c_string_less(plisp_t a, plisp_t b) {
+    size_t alen = plisp_c_stringlen(a);
+    size_t blen = plisp_c_stringlen(b);
+    size_t len = alen < blen ? alen : blen;
+
+    size_t i = plisp_simd_mismatch(chars(a), chars(b), len);
+    if (i == len) {
+        return alen < blen;
+    }
+    return chars(a)[i] < chars(b)[i];
+}
+
+plisp_t plisp_builtin_string_lt(plisp_t *clos, size_t nargs, plisp_t a, plisp_t b) {
+    plisp_assert(nargs == 2);
+    return plisp_make_bool(plisp_c_string_less(a, b));
+}
+
+plisp_t plisp_builtin_string_index(plisp_t *clos, size_t nargs, plisp_t str,
+                                   plisp_t ch, plisp_t start) {
+    plisp_assert(nargs == 2 || nargs == 3);
+    plisp_assert(plisp_c_charp(ch));
+    size_t len = plisp_c_stringlen(str);
+    size_t from = start_index(nargs, 2, start, len);
+
+    size_t i = plisp_simd_find_byte(chars(str) + from,
+                                    plisp_char_value(ch), len - from);
+    if (i == len - from) {
+        return plisp_make_bool(false);
+    }
+    return plisp_make_fixnum(from + i);
+}
+
+plisp_t plisp_builtin_string_contains(plisp_t *clos, size_t nargs, plisp_t str,
+                                      plisp_t needle, plisp_t start) {
+    plisp_assert(nargs == 2 || nargs == 3);
+    size_t len = plisp_c_stringlen(str);
+    size_t from = start_index(nargs, 2, start, len);
+
+    size_t i = plisp_simd_search(chars(str) + from, len - from,
+                                 chars(needle), plisp_c_stringlen(needle));
+    if (i == SIZE_MAX) {
+        return plisp_make_bool(false);
+    }
+    return plisp_make_fixnum(from + i);
+}
+
+plisp_t plisp_builtin_string_hash(plisp_t *clos, size_t nargs, plisp_t str,
+                                  plisp_t bound) {
+    plisp_assert(nargs == 1 || nargs == 2);
+    uint64_t hash = plisp_simd_hash(chars(str), plisp_c_stringlen(str));
+    if (nargs == 2) {
+        plisp_assert(plisp_c_fixnump(bound) && plisp_fixnum_value(bound) > 0);
+        return plisp_make_fixnum(hash % plisp_fixnum_value(bound));
+    }
+    // as many bits as a nonnegative fixnum holds
+    return plisp_make_fixnum(hash >> (LOSHIFT + 1));
+}
@@ -0,0 +1,344 @@
+#include <plisp/thread.h>
+#include <plisp/coroutine.h>
+#include <plisp/port.h>
+#include <plisp/builtin.h>
+#include <plisp/gc.h>
+#include <plisp/read.h>
+#include <plisp/write.h>
+#include <plisp/saftey.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+threads are os threads, which share the heap and the toplevel, and
+have their own stacks, continuations and schedulers. each registers
+with the collector before it touches the heap, so collections stop it
+at a safepoint and scan its stack. waiting on a mutex, a condition
+variable or another thread blocks, which lets collections go ahead
+without waiting for it in turn.
+
+a thread that hasn't finished is kept alive by a list of them, so its
+thunk can't be collected out from under it when nothing else refers to
+it.
+*/
+
+// like the main stack and coroutines', since there are no tail calls
+#define THREAD_STACK (8 * 1024 * 1024)
+
+struct thread {
+    plisp_t obj;
+    plisp_t thunk;
+    plisp_t result;
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    // in unfinished, while it is
+    struct thread *prev;
+    struct thread *next;
+};
+
+static plisp_t thread_sym;
+static plisp_t mutex_sym;
+static plisp_t condvar_sym;
+static plisp_t unfinished_sym;
+
+static struct thread *unfinished = NULL;
+static pthread_mutex_t unfinished_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void trace_thread(void *data, void (*trace)(plisp_t));
+static void trace_unfinished(void *data, void (*trace)(plisp_t));
+
+static plisp_t thread_make(plisp_t *clos, size_t nargs, plisp_t thunk);
+static plisp_t thread_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t thread_join(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t mutex_make(plisp_t *clos, size_t nargs);
+static plisp_t mutex_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t mutex_lock(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t mutex_unlock(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t condvar_make(plisp_t *clos, size_t nargs);
+static plisp_t condvar_p(plisp_t *clos, size_t nargs, plisp_t obj);
+static plisp_t condvar_wait(plisp_t *clos, size_t nargs, plisp_t cv,
+                            plisp_t mutex);
+static plisp_t condvar_signal(plisp_t *clos, size_t nargs, plisp_t cv);
+static plisp_t condvar_broadcast(plisp_t *clos, size_t nargs, plisp_t cv);
+
+void plisp_init_thread(void) {
+    thread_sym = plisp_intern(plisp_make_symbol("thread"));
+    mutex_sym = plisp_intern(plisp_make_symbol("mutex"));
+    condvar_sym = plisp_intern(plisp_make_symbol("condition-variable"));
+    unfinished_sym = plisp_intern(plisp_make_symbol("unfinished-threads"));
+    plisp_gc_custom_tracer(thread_sym, trace_thread);
+    plisp_gc_custom_tracer(unfinished_sym, trace_unfinished);
+    plisp_gc_permanent(plisp_make_custom(unfinished_sym, NULL));
+
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+    plisp_define_builtin("make-thread", thread_make);
+    plisp_define_builtin("thread?", thread_p);
+    plisp_define_builtin("thread-join", thread_join);
+    plisp_define_builtin("make-mutex", mutex_make);
+    plisp_define_builtin("mutex?", mutex_p);
+    plisp_define_builtin("mutex-lock!", mutex_lock);
+    plisp_define_builtin("mutex-unlock!", mutex_unlock);
+    plisp_define_builtin("make-condition-variable", condvar_make);
+    plisp_define_builtin("condition-variable?", condvar_p);
+    plisp_define_builtin("condition-variable-wait!", condvar_wait);
+    plisp_define_builtin("condition-variable-signal!", condvar_signal);
+    plisp_define_builtin("condition-variable-broadcast!", condvar_broadcast);
+
+    #pragma GCC diagnostic pop
+}
+
+static bool customp(plisp_t obj, plisp_t typesym) {
+    return plisp_c_customp(obj) && plisp_custom_typesym(obj) == typesym;
+}
+
+static void *get_custom(plisp_t obj, plisp_t typesym) {
+    if (!customp(obj, typesym)) {
+        fprintf(stderr, "error: expected a %s, got ",
+                plisp_string_value(plisp_symbol_name(typesym)));
+        plisp_c_write(stderr, obj);
+        fprintf(stderr, "\n");
+        assert(false);
+    }
+    return plisp_custom_data(obj);
+}
+
+/*
+threads
+*/
+
+static void trace_thread(void *data, void (*trace)(plisp_t)) {
+    struct thread *th = data;
+    trace(th->thunk);
+    trace(th->result);
+}
+
+// nothing touches the list at a safepoint, so it is never being
+// changed while it is traced
+static void trace_unfinished(void *data, void (*trace)(plisp_t)) {
+    for (struct thread *th = unfinished; th != NULL; th = th->next) {
+        trace(th->obj);
+    }
+}
+
+static void finalize_thread(void *data) {
+    struct thread *th = data;
+    pthread_mutex_destroy(&th->lock);
+    pthread_cond_destroy(&th->finished);
+    free(th);
+}
+
+static void *thread_main(void *arg) {
+    struct thread *th = arg;
+    plisp_gc_register_thread();
+    plisp_init_coroutine_thread();
+
+    plisp_t result = plisp_call_closure(th->thunk, 0, NULL);
+    plisp_end_port_thread();
+
+    pthread_mutex_lock(&th->lock);
+    th->result = result;
+    th->done = true;
+    pthread_cond_broadcast(&th->finished);
+    pthread_mutex_unlock(&th->lock);
+
+    // nothing keeps it alive past here but whoever joins it
+    pthread_mutex_lock(&unfinished_lock);
+    if (th->prev != NULL) {
+        th->prev->next = th->next;
+    } else {
+        unfinished = th->next;
+    }
+    if (th->next != NULL) {
+        th->next->prev = th->prev;
+    }
+    pthread_mutex_unlock(&unfinished_lock);
+
+    plisp_gc_unregister_thread();
+    return NULL;
+}
+
+bool plisp_c_threadp(plisp_t obj) {
+    return customp(obj, thread_sym);
+}
+
+plisp_t plisp_make_thread(plisp_t thunk) {
+    plisp_assert(plisp_c_closurep(thunk));
+
+    struct thread *th = calloc(1, sizeof(struct thread));
+    th->thunk = thunk;
+    th->result = plisp_unspec;
+    pthread_mutex_init(&th->lock, NULL);
+    pthread_cond_init(&th->finished, NULL);
+    plisp_t obj = plisp_make_custom(thread_sym, th);
+    plisp_gc_finalizer(obj, finalize_thread);
+    th->obj = obj;
+
+    pthread_mutex_lock(&unfinished_lock);
+    th->next = unfinished;
+    if (unfinished != NULL) {
+        unfinished->prev = th;
+    }
+    unfinished = th;
+    pthread_mutex_unlock(&unfinished_lock);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    pthread_t id;
+    int err = pthread_create(&id, &attr, thread_main, th);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        fprintf(stderr, "error: couldn't start a thread: %s\n",
+                strerror(err));
+        assert(false);
+    }
+    return obj;
+}
+
+plisp_t plisp_thread_join(plisp_t obj) {
+    struct thread *th = get_custom(obj, thread_sym);
+
+    plisp_enter_blocking();
+    pthread_mutex_lock(&th->lock);
+    while (!th->done) {
+        pthread_cond_wait(&th->finished, &th->lock);
+    }
+    pthread_mutex_unlock(&th->lock);
+    plisp_leave_blocking();
+
+    return th->result;
+}
+
+/*
+mutexes and condition variables
+*/
+
+static void finalize_mutex(void *data) {
+    pthread_mutex_destroy(data);
+    free(data);
+}
+
+static void finalize_condvar(void *data) {
+    pthread_cond_destroy(data);
+    free(data);
+}
+
+/*
+builtins
+*/
+
+static plisp_t thread_make(plisp_t *clos, size_t nargs, plisp_t thunk) {
+    plisp_assert(nargs == 1);
+    return plisp_make_thread(thunk);
+}
+
+static plisp_t thread_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(plisp_c_threadp(obj));
+}
+
+static plisp_t thread_join(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_thread_join(obj);
+}
+
+static plisp_t mutex_make(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    pthread_mutex_t *mutex = malloc(sizeof(pthread_mutex_t));
+    // so locking one twice, or unlocking another thread's, is an error
+    // rather than a hang
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+    pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    plisp_t obj = plisp_make_custom(mutex_sym, mutex);
+    plisp_gc_finalizer(obj, finalize_mutex);
+    return obj;
+}
+
+static plisp_t mutex_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(customp(obj, mutex_sym));
+}
+
+static plisp_t mutex_lock(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    pthread_mutex_t *mutex = get_custom(obj, mutex_sym);
+
+    int err = pthread_mutex_trylock(mutex);
+    if (err == EBUSY) {
+        plisp_enter_blocking();
+        err = pthread_mutex_lock(mutex);
+        plisp_leave_blocking();
+    }
+    if (err != 0) {
+        fprintf(stderr, "error: couldn't lock a mutex: %s\n", strerror(err));
+        assert(false);
+    }
+    return plisp_unspec;
+}
+
+static plisp_t mutex_unlock(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    int err = pthread_mutex_unlock(get_custom(obj, mutex_sym));
+    if (err != 0) {
+        fprintf(stderr, "error: couldn't unlock a mutex: %s\n",
+                strerror(err));
+        assert(false);
+    }
+    return plisp_unspec;
+}
+
+static plisp_t condvar_make(plisp_t *clos, size_t nargs) {
+    plisp_assert(nargs == 0);
+    pthread_cond_t *cv = malloc(sizeof(pthread_cond_t));
+    pthread_cond_init(cv, NULL);
+    plisp_t obj = plisp_make_custom(condvar_sym, cv);
+    plisp_gc_finalizer(obj, finalize_condvar);
+    return obj;
+}
+
+static plisp_t condvar_p(plisp_t *clos, size_t nargs, plisp_t obj) {
+    plisp_assert(nargs == 1);
+    return plisp_make_bool(customp(obj, condvar_sym));
+}
+
+// unlocks mutex, which must be locked, until cv is signalled
+static plisp_t condvar_wait(plisp_t *clos, size_t nargs, plisp_t cv,
+                            plisp_t mutex) {
+    plisp_assert(nargs == 2);
+    pthread_cond_t *cond = get_custom(cv, condvar_sym);
+    pthread_mutex_t *lock = get_custom(mutex, mutex_sym);
+
+    plisp_enter_blocking();
+    int err = pthread_cond_wait(cond, lock);
+    plisp_leave_blocking();
+    if (err != 0) {
+        fprintf(stderr, "error: couldn't wait on a condition variable: %s\n",
+                strerror(err));
+        assert(false);
+    }
+    return plisp_unspec;
+}
+
+static plisp_t condvar_signal(plisp_t *clos, size_t nargs, plisp_t cv) {
+    plisp_assert(nargs == 1);
+    pthread_cond_signal(get_custom(cv, condvar_sym));
+    return plisp_unspec;
+}
+
+static plisp_t condvar_broadcast(plisp_t *clos, size_t nargs, plisp_t cv) {
+    plisp_assert(nargs == 1);
+    pthread_cond_broadcast(get_custom(cv, condvar_sym));
+    return plisp_unspec;
+}
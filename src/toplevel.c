@@ -2,23 +2,34 @@
 #include <plisp/gc.h>
 #include <plisp/read.h>
 #include <plisp/write.h>
-#include <plisp/compile.h>
+#include <plisp/interp.h>
 #include <plisp/saftey.h>
+#include <plisp/precompile.h>
 #include <Judy.h>
 #include <assert.h>
+#include <pthread.h>
 
 static Pvoid_t toplevel_scope = NULL;
+// the background compiler looks up variables too
+static pthread_mutex_t scope_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static plisp_t define_sym;
 static plisp_t lambda_sym;
 static plisp_t set_sym;
+static plisp_t begin_sym;
+static plisp_t macro_set_sym;
 static plisp_t macroexpand_sym;
+static plisp_t macroexpand_toplevel_sym;
 
 void plisp_init_toplevel(void) {
     define_sym = plisp_intern(plisp_make_symbol("define"));
     lambda_sym = plisp_intern(plisp_make_symbol("lambda"));
     set_sym = plisp_intern(plisp_make_symbol("set!"));
+    begin_sym = plisp_intern(plisp_make_symbol("begin"));
+    macro_set_sym = plisp_intern(plisp_make_symbol("macro-set!"));
     macroexpand_sym = plisp_intern(plisp_make_symbol("macroexpand"));
+    macroexpand_toplevel_sym =
+        plisp_intern(plisp_make_symbol("macroexpand-toplevel"));
 }
 
 void plisp_toplevel_define(plisp_t sym, plisp_t value) {
@@ -28,15 +39,26 @@ void plisp_toplevel_define(plisp_t sym, plisp_t value) {
 plisp_t *plisp_toplevel_ref(plisp_t sym) {
     plisp_assert(plisp_c_symbolp(sym));
 
+    pthread_mutex_lock(&scope_lock);
     plisp_t *pval;
     JLG(pval, toplevel_scope, sym);
     if (pval == NULL) {
+        // allocating can wait on the gc lock, which a compiling thread
+        // may hold while it waits on us
+        pthread_mutex_unlock(&scope_lock);
         plisp_t box = plisp_make_consbox(plisp_unbound);
         plisp_gc_permanent(box);
+        pthread_mutex_lock(&scope_lock);
+
         JLI(pval, toplevel_scope, sym);
-        *pval = box;
+        if (*pval == 0) {
+            *pval = box;
+        }
     }
-    return plisp_get_consbox(*pval);
+    plisp_t box = *pval;
+    pthread_mutex_unlock(&scope_lock);
+
+    return plisp_get_consbox(box);
 }
 
 static plisp_t do_define(plisp_t form) {
@@ -49,7 +71,7 @@ static plisp_t do_define(plisp_t form) {
         // function define
         plisp_toplevel_define(
             plisp_car(plisp_car(plisp_cdr(form))),
-            plisp_toplevel_eval(
+            plisp_toplevel_eval_expanded(
                 plisp_cons(
                     lambda_sym,
                     plisp_cons(
@@ -68,7 +90,7 @@ static plisp_t do_define(plisp_t form) {
         // value define
         plisp_toplevel_define(
             plisp_car(plisp_cdr(form)),
-            plisp_toplevel_eval(
+            plisp_toplevel_eval_expanded(
                 plisp_car(plisp_cdr(plisp_cdr(form)))));
     }
 
@@ -77,37 +99,54 @@ static plisp_t do_define(plisp_t form) {
 
 static plisp_t do_set(plisp_t form) {
     plisp_t sym = plisp_car(plisp_cdr(form));
-    plisp_t value = plisp_car(plisp_cdr(plisp_cdr(form)));
+    plisp_t value = plisp_toplevel_eval_expanded(
+                        plisp_car(plisp_cdr(plisp_cdr(form))));
 
     plisp_assert(*plisp_toplevel_ref(sym) != plisp_unbound);
     *plisp_toplevel_ref(sym) = value;
     return plisp_unspec;
 }
 
-plisp_t plisp_toplevel_eval(plisp_t form) {
-    plisp_t mexpand = *plisp_toplevel_ref(macroexpand_sym);
+plisp_t plisp_macroexpand(plisp_t form) {
+    // the toplevel expander leaves begins alone, so the definitions in
+    // them stay toplevel
+    plisp_t mexpand = *plisp_toplevel_ref(macroexpand_toplevel_sym);
+    if (mexpand == plisp_unbound || mexpand == plisp_unspec) {
+        mexpand = *plisp_toplevel_ref(macroexpand_sym);
+    }
     if (mexpand != plisp_unbound && mexpand != plisp_unspec) {
         form = plisp_closure_fun(mexpand)(
                    plisp_closure_data(mexpand),
                    1, form);
     }
+    return form;
+}
 
+plisp_t plisp_toplevel_eval(plisp_t form) {
+    return plisp_toplevel_eval_expanded(plisp_macroexpand(form));
+}
 
+plisp_t plisp_toplevel_eval_expanded(plisp_t form) {
     if (plisp_c_consp(form)) {
         if (plisp_car(form) == define_sym) {
             return do_define(form);
         } else if (plisp_car(form) == set_sym) {
             return do_set(form);
+        } else if (plisp_car(form) == begin_sym) {
+            plisp_t value = plisp_unspec;
+            for (plisp_t body = plisp_cdr(form); plisp_c_consp(body);
+                 body = plisp_cdr(body)) {
+                value = plisp_toplevel_eval_expanded(plisp_car(body));
+            }
+            return value;
         } else {
-            // compile an execute an argumentless lambda function
-            plisp_t lamb = plisp_cons(
-                               lambda_sym,
-                               plisp_cons(plisp_nil,
-                                          plisp_cons(form, plisp_nil)));
-            plisp_fn_t fn = plisp_compile_lambda(lamb);
-            plisp_t result = fn(NULL, 0);
-            plisp_free_fn(fn);
-            return result;
+            if (plisp_car(form) == macro_set_sym
+                && plisp_c_consp(plisp_cdr(form))) {
+                plisp_note_macro_definition(form);
+            }
+            // toplevel forms run once, so they are interpreted rather
+            // than compiled. lambdas they create are compiled when hot.
+            return plisp_interp_eval(form, plisp_nil);
         }
     } else if (plisp_c_symbolp(form)) {
         plisp_t *ref = plisp_toplevel_ref(form);
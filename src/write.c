@@ -1,4 +1,7 @@
 #include <plisp/write.h>
+#include <plisp/number.h>
+#include <plisp/homvec.h>
+#include <plisp/record.h>
 #include <ctype.h>
 
 static void plisp_c_write_cons(FILE *f, plisp_t obj) {
@@ -38,14 +41,15 @@ static void plisp_c_write_string(FILE *f, plisp_t obj) {
         } else if (isprint(ch)) {
             fputc(ch, f);
         } else {
-            fprintf(f, "\\x%X", (unsigned char)ch);
+            fprintf(f, "\\x%02X", (unsigned char)ch);
         }
     }
     fputc('"', f);
 }
 
 static void plisp_c_write_vector(FILE *f, plisp_t obj) {
-    fprintf(f, "#(");
+    enum plisp_homvec_kind kind = plisp_homvec_kind(obj);
+    fprintf(f, "#%s(", kind == HOMVEC_NONE ? "" : plisp_homvec_tag(kind));
     for (size_t i = 0; i < plisp_vector_c_length(obj); ++i) {
         if (i != 0) {
             fprintf(f, " ");
@@ -60,8 +64,8 @@ void plisp_c_write(FILE *f, plisp_t obj) {
         fprintf(f, "(");
         plisp_c_write_cons(f, obj);
         fprintf(f, ")");
-    } else if (plisp_c_fixnump(obj)) {
-        fprintf(f, "%li", plisp_fixnum_value(obj));
+    } else if (plisp_c_numberp(obj)) {
+        plisp_write_number(f, obj);
     } else if (plisp_c_boolp(obj)) {
         if (plisp_bool_value(obj)) {
             fprintf(f, "#t");
@@ -85,7 +89,50 @@ void plisp_c_write(FILE *f, plisp_t obj) {
         fprintf(f, "#<unbound>");
     } else if (plisp_c_charp(obj)) {
         fprintf(f, "#\\%c", plisp_char_value(obj));
+    } else if (plisp_c_customp(obj)) {
+        fprintf(f, "#<%s>",
+                plisp_string_value(plisp_symbol_name(plisp_custom_typesym(obj))));
+    } else if (plisp_c_recordp(obj)) {
+        plisp_t name = plisp_record_type_name(plisp_record_rtd(obj));
+        fprintf(f, "#<%s>", plisp_string_value(plisp_symbol_name(name)));
     } else {
         fprintf(f, "#?");
     }
 }
+
+static bool plisp_c_string_readablep(plisp_t obj) {
+    const char *str = plisp_string_value(obj);
+    for (size_t i = 0; i < plisp_c_stringlen(obj); ++i) {
+        // a nul would end the string when it is read back
+        if (str[i] == '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool plisp_c_readablep(plisp_t obj) {
+    if (plisp_c_consp(obj)) {
+        for (; plisp_c_consp(obj); obj = plisp_cdr(obj)) {
+            if (!plisp_c_readablep(plisp_car(obj))) {
+                return false;
+            }
+        }
+        return plisp_c_readablep(obj);
+    } else if (plisp_c_stringp(obj)) {
+        return plisp_c_string_readablep(obj);
+    } else if (plisp_c_vectorp(obj)) {
+        for (size_t i = 0; i < plisp_vector_c_length(obj); ++i) {
+            if (!plisp_c_readablep(plisp_vector_ref(obj, i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    return plisp_c_numberp(obj)
+        || plisp_c_boolp(obj)
+        || plisp_c_symbolp(obj)
+        || plisp_c_nullp(obj)
+        || plisp_c_charp(obj);
+}
@@ -0,0 +1,17 @@
+;; a call site through a variable sees one function, then several
+
+(define (twice f x) (f (f x)))
+
+(define (add1 x) (+ x 1))
+(define (dbl x) (+ x x))
+
+(define (repeat n f x)
+  (if (eq? n 0)
+      x
+      (repeat (- n 1) f (twice f x))))
+
+(println (repeat 50 add1 0))
+(println (twice dbl 3) (twice add1 3) (twice (lambda (x) (cons x x)) 1))
+
+(define (adder n) (lambda (x) (+ x n)))
+(println (map (adder 1) '(1 2 3)) (map (adder 10) '(1 2 3)))
@@ -14,3 +14,67 @@
 (when c
   (c 66)
   (set! c #f))
+
+(println (call/ec (lambda (k) 1 (k 2) 3)) (call/ec (lambda (k) 4)))
+(println (call/ec (lambda (outer) (call/ec (lambda (inner) (outer 1))) 2))
+         (call/ec (lambda (outer) (+ 10 (call/ec (lambda (inner) (inner 1)))))))
+
+;; only called from a lambda, which for-each could have kept, so this
+;; one copies the stack
+(define (find-first pred lst)
+  (call/cc (lambda (return)
+             (for-each (lambda (x) (if (pred x) (return x))) lst)
+             #f)))
+(println (find-first (lambda (x) (< 5 x)) (iota 10))
+         (find-first (lambda (x) (< 50 x)) (iota 10)))
+(println (macroexpand '(call/cc (lambda (k) (k 1))))
+         (macroexpand '(call/cc (lambda (k) (set! c k)))))
+
+;; a closure calling k outlives the call/cc, and re-enters it
+(define saved #f)
+(println (+ 100 (call/cc (lambda (k) (set! saved (lambda (v) (k v))) 1))))
+(when saved
+  (let ((again saved))
+    (set! saved #f)
+    (again 2)))
+(println (macroexpand '(call/cc (lambda (k) (let ((k 1)) k))))
+         (car (macroexpand '(call/cc (lambda (k) (let ((x 1)) (k x)))))))
+
+;; re-entering continuations, whose frames refer to things nothing
+;; else does any more
+(define (make-gen lst)
+  (define return #f)
+  (define resume #f)
+  (lambda ()
+    (call-with-current-continuation
+     (lambda (r)
+       (set! return r)
+       (if resume
+           (resume #f)
+           (begin
+             (for-each (lambda (x)
+                         (call-with-current-continuation
+                          (lambda (k) (set! resume k) (return x))))
+                       lst)
+             (return 'done)))))))
+(define g (make-gen (iota 4)))
+(println (g) (g))
+(collect-garbage)
+(println (g) (g) (g) (g))
+
+(define fail-stack '())
+(define (fail)
+  (let ((k (car fail-stack)))
+    (set! fail-stack (cdr fail-stack))
+    (k #f)))
+(define (amb lst)
+  (if (null? lst)
+      (fail)
+      (if (call-with-current-continuation
+           (lambda (next) (set! fail-stack (cons next fail-stack)) #t))
+          (car lst)
+          (amb (cdr lst)))))
+(println (let* ((a (amb (iota 10))) (b (amb (iota 10))) (c (amb (iota 20))))
+           (if (and (< 0 a) (< a b) (= (+ (* a a) (* b b)) (* c c)))
+               (list a b c)
+               (fail))))
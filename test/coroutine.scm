@@ -0,0 +1,54 @@
+(define gen (make-coroutine (lambda ()
+                              (for-each (lambda (i) (yield (* i i))) (iota 4))
+                              'finished)))
+(println (coroutine? gen) (coroutine? '()) (coroutine-resume gen)
+         (coroutine-resume gen))
+(println (coroutine-resume gen) (coroutine-resume gen) (coroutine-resume gen)
+         (coroutine-done? gen))
+
+;; values go both ways
+(define (doubler x) (doubler (yield (* 2 x))))
+(define echo (make-coroutine (lambda () (doubler (yield 'ready)))))
+(println (coroutine-resume echo) (coroutine-resume echo 1)
+         (coroutine-resume echo 21))
+
+;; a pipeline through a bounded channel
+(define numbers (make-channel 4))
+(define total (make-channel))
+(spawn (lambda ()
+         (for-each (lambda (i) (channel-send! numbers i)) (iota 1000))
+         (channel-send! numbers 'eof)))
+(define (sum acc)
+  (let ((x (channel-receive numbers)))
+    (if (eq? x 'eof)
+        (channel-send! total acc)
+        (sum (+ acc x)))))
+(spawn (lambda () (sum 0)))
+(println (channel? numbers) (channel-receive total))
+
+;; lots of tasks, taking turns
+(define squares (make-channel))
+(for-each (lambda (i)
+            (spawn (lambda ()
+                     (yield)
+                     (channel-send! squares (* i i)))))
+          (iota 2000))
+(run-scheduler)
+(define (sum-squares n acc)
+  (if (= n 0)
+      acc
+      (sum-squares (- n 1) (+ acc (channel-receive squares)))))
+(println (sum-squares 2000 0))
+
+;; suspended stacks keep what they refer to alive
+(define gens
+  (map (lambda (i)
+         (make-coroutine (lambda ()
+                           (for-each (lambda (j) (yield (list i j))) (iota 3))
+                           'end)))
+       (iota 100)))
+(for-each coroutine-resume gens)
+(collect-garbage)
+(println (coroutine-resume (car gens)) (coroutine-resume (cadr gens)))
+(println (coroutine-resume (make-coroutine
+                            (lambda () (call/cc (lambda (k) (k 5)))))))
@@ -0,0 +1,26 @@
+;; (safety 0) drops the runtime checks of a lambda and the lambdas
+;; inside it. the results have to stay the same.
+
+(define (vector-sum v)
+  (declare (optimize speed) (safety 0))
+  (define (loop i acc)
+    (if (< i (vector-length v))
+        (loop (+ i 1) (+ acc (vector-ref v i)))
+        acc))
+  (loop 0 0))
+
+(println (vector-sum #(1 2 3 4 5)))
+
+(define (sum-cars lst)
+  (declare (optimize (speed 3) (safety 0)))
+  (if (null? lst)
+      0
+      (+ (car (car lst)) (sum-cars (cdr lst)))))
+
+(println (sum-cars '((1 . a) (2 . b) (3 . c))))
+
+(define (checked x)
+  (declare (safety 1))
+  (car x))
+
+(println (checked '(7)))
@@ -0,0 +1,38 @@
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+;; touching waits for the thunk, or runs it if no worker has yet
+(define f (future (lambda () (fib 18))))
+(println (future? f) (future? 'no) (touch f) (touch f))
+(println (map touch (map (lambda (i) (future (lambda () (fib i)))) (iota 12))))
+
+;; lists map to lists and vectors to vectors, in order
+(println (parallel-map (lambda (x) (* x x)) (iota 10)))
+(println (parallel-map (lambda (x) (* x x)) (vector 1 2 3)))
+(println (parallel-map car '()) (parallel-reduce + 7 #()))
+
+;; big inputs are cut into chunks
+(println (parallel-reduce + 0 (iota 100001)))
+(println (vector-length (parallel-map (lambda (x) (* 2 x)) (make-vector 50000 3))))
+(println (parallel-reduce + 0 (make-f64vector 1000 1.5)))
+
+;; jobs inside jobs, and allocating on every worker
+(define (build n acc)
+  (if (= n 0)
+      acc
+      (build (- n 1) (cons n acc))))
+(println (parallel-map (lambda (n) (parallel-reduce + 0 (build n '())))
+                       (iota 8)))
+(println (parallel-reduce + 0 (parallel-map (lambda (i) (length (build 500 '())))
+                                            (iota 400))))
+
+(define m (make-mutex))
+(define total 0)
+(parallel-for-each (lambda (x)
+                     (mutex-lock! m)
+                     (set! total (+ total x))
+                     (mutex-unlock! m))
+                   (iota 1000))
+(println total (< 0 (worker-count)))
@@ -0,0 +1,79 @@
+(define eqt (make-eq-hash-table))
+(hash-table-set! eqt 'a 1)
+(hash-table-set! eqt 'b 2)
+(hash-table-set! eqt 'a 3)
+(println (hash-table? eqt) (hash-table? '()) (hash-table-count eqt))
+(println (hash-table-ref eqt 'a) (hash-table-ref/default eqt 'c 'none)
+         (hash-table-ref eqt 'c (lambda () 'thunk)))
+(println (hash-table-contains? eqt 'b) (hash-table-contains? eqt "b"))
+
+;; enough keys to grow the table a few times, then delete every other one
+(define (fill! table n)
+  (if (< 0 n)
+      (begin
+        (hash-table-set! table n (* n n))
+        (fill! table (- n 1)))))
+(define (delete-odd! table n)
+  (if (< 0 n)
+      (begin
+        (hash-table-delete! table (- (* 2 n) 1))
+        (delete-odd! table (- n 1)))))
+(define (all-even? table n)
+  (if (= n 0)
+      #t
+      (and (equal? (hash-table-ref/default table (* 2 n) #f) (* 4 n n))
+           (not (hash-table-contains? table (- (* 2 n) 1)))
+           (all-even? table (- n 1)))))
+
+(define big (make-eqv-hash-table))
+(fill! big 1000)
+(println (hash-table-count big) (hash-table-ref big 777))
+(delete-odd! big 500)
+(println (hash-table-count big) (all-even? big 500))
+(println (hash-table-fold big (lambda (k v acc) (+ k acc)) 0))
+
+;; eqv tables compare numbers by value, eq tables by identity
+(define eqvt (make-eqv-hash-table))
+(hash-table-set! eqvt 1.5 'flo)
+(hash-table-set! eqvt 100000000000000000000 'big)
+(hash-table-set! eqvt 0.0 'zero)
+(println (hash-table-ref/default eqvt (/ 3.0 2) #f)
+         (hash-table-ref/default eqvt (* 10000000000 10000000000) #f)
+         (hash-table-ref/default eqvt -0.0 #f)
+         (hash-table-ref/default eqvt 1 #f))
+
+(define equalt (make-equal-hash-table))
+(hash-table-set! equalt '(1 (2 "three") #(4 5)) 'nested)
+(hash-table-set! equalt "key" 'string)
+(hash-table-set! equalt #s64(1 2 3) 'homvec)
+(println (hash-table-ref/default equalt (list 1 (list 2 "three") (vector 4 5)) #f)
+         (hash-table-ref/default equalt (string-append "k" "ey") #f)
+         (hash-table-ref/default equalt #(1 2 3) #f)
+         (hash-table-ref/default equalt '(1 2) #f))
+
+(define strt (make-string-hash-table))
+(hash-table-set! strt "apple" 1)
+(hash-table-update! strt "apple" (lambda (x) (+ x 10)))
+(hash-table-update! strt "pear" (lambda (x) (+ x 1)) (lambda () 0))
+(hash-table-update!/default strt "plum" (lambda (x) (cons 'p x)) '())
+(println (hash-table-ref strt "apple") (hash-table-ref strt "pear")
+         (hash-table-ref strt "plum") (hash-table-count strt))
+
+(define small (make-hash-table))
+(hash-table-set! small 'only "one")
+(println (hash-table-keys small) (hash-table-values small)
+         (hash-table->alist small))
+(hash-table-walk small (lambda (k v) (println k v)))
+(println small)
+
+;; make-hash-table takes the equivalence predicate and then the capacity
+(define byeq (make-hash-table eq?))
+(define bystr (make-hash-table string=? 64))
+(define byequal (make-hash-table equal?))
+(hash-table-set! byeq (list 1) 'a)
+(hash-table-set! bystr "key" 'b)
+(hash-table-set! byequal (list 1) 'c)
+(println (hash-table-ref/default byeq (list 1) 'none)
+         (hash-table-ref/default bystr (string-append "k" "ey") 'none)
+         (hash-table-ref/default byequal (list 1) 'none)
+         (hash-table-count (make-hash-table 16)))
@@ -0,0 +1,35 @@
+(println #u8(1 2 255) #s32(-1 2) #s64(1152921504606846976) #f64(0.5))
+(println (u8vector 1 2 3) (s32vector? #s32(1)) (s32vector? #s64(1)))
+
+(define (fill-up! v store len f)
+  (define (loop i)
+    (when (< i len)
+      (store v i (f i))
+      (loop (+ i 1))))
+  (loop 0)
+  v)
+
+;; long enough for every kernel to run its vector loop and a tail
+(define bytes (fill-up! (make-u8vector 75) u8vector-set! 75
+                        (lambda (i) (- 200 i))))
+(define words (fill-up! (make-s32vector 37) s32vector-set! 37
+                        (lambda (i) (- (* i 1000) 20000))))
+(define longs (fill-up! (make-s64vector 9) s64vector-set! 9
+                        (lambda (i) (* i 1000000000000000000))))
+(define floats (fill-up! (make-f64vector 21) f64vector-set! 21
+                         (lambda (i) (* (- i 10) 0.5))))
+(collect-garbage)
+
+(println (u8vector-sum bytes) (u8vector-min bytes) (u8vector-max bytes))
+(println (s32vector-sum words) (s32vector-min words) (s32vector-max words))
+(println (s64vector-sum longs) (s64vector-max longs) (s64vector-dot longs longs))
+(println (f64vector-sum floats) (f64vector-min floats) (f64vector-max floats))
+(println (f64vector-dot floats floats) (s32vector-dot words words))
+
+(define copy (f64vector-copy floats))
+(f64vector-fill! copy 2)
+(println (f64vector-ref copy 20) (f64vector-ref floats 20) (f64vector-length copy))
+
+(println (u8vector->list (u8vector-map (lambda (x) (* x 2)) #u8(1 2 3))))
+(println (f64vector-fold (lambda (acc x) (+ acc (* x x))) 0 #f64(1 2 3)))
+(println (make-s32vector 3 -7) (equal? #u8(1 2) (list->u8vector '(1 2))))
@@ -0,0 +1,31 @@
+;; small toplevel functions are inlined into their callers. it has to
+;; look like a call: rebinding the function, and locals in the caller
+;; named like the function's variables, all still work.
+
+(define (second lst) (car (cdr lst)))
+(define (pair-sum p) (+ (car p) (cdr p)))
+(define scale 10)
+(define (scaled x) (+ x scale))
+
+(define (sum-seconds lsts acc)
+  (if (null? lsts)
+      acc
+      (sum-seconds (cdr lsts) (+ acc (second (car lsts))))))
+
+(define (shadowing scale cdr)
+  (list (scaled scale) (pair-sum (cons scale cdr))))
+
+(define (run n acc)
+  (if (eq? n 0)
+      acc
+      (run (- n 1) (+ acc (sum-seconds '((1 2) (3 4) (5 6)) 0)))))
+
+(println (run 100 0))
+(println (shadowing 1 2))
+
+(set! second car)
+(println (run 100 0))
+
+(define (lst-second lst) (second lst))
+(set! second (lambda (lst) (car (cdr (cdr lst)))))
+(println (lst-second '(1 2 3)))
@@ -0,0 +1,79 @@
+;; a pipe, written and read without any tasks
+(define pipe (make-pipe))
+(define in (car pipe))
+(define out (cadr pipe))
+(define buf (make-u8vector 8 0))
+(println (port? in) (port? buf) (port-write out "hello") (port-read! in buf)
+         buf)
+(println (port-write out (u8vector 1 2 3 4 5) 1 4) (port-read! in buf 2)
+         buf)
+
+;; a list of buffers goes out in one write, and reads take what's there
+(port-write out (list "ab" (u8vector 67 68) "ef"))
+(println (port-read! in buf 0 3) (port-read! in buf 3) buf)
+
+;; closing the writing end is the end of the stream
+(port-close out)
+(println (port-read! in buf))
+
+;; a reader parks until a writer gets to it
+(define ends (make-socketpair))
+(define got (make-channel))
+(spawn (lambda ()
+         (let ((b (make-u8vector 4 0)))
+           (channel-send! got (port-read! (car ends) b))
+           (channel-send! got b))))
+(spawn (lambda ()
+         (yield)
+         (port-write (cadr ends) "ping")))
+(println (channel-receive got) (channel-receive got))
+
+;; more than fits in a socket buffer, so the writer waits for the reader
+(define big (make-u8vector 1000000 7))
+(spawn (lambda () (port-write (cadr ends) big) (port-close (cadr ends))))
+(define (drain port b total)
+  (let ((n (port-read! port b)))
+    (if (= n 0)
+        total
+        (drain port b (+ total n)))))
+(println (drain (car ends) (make-u8vector 65536 0) 0))
+
+;; lots of streams at once, each echoed by a task of its own
+(define replies (make-channel))
+(define (echo port b)
+  (let ((n (port-read! port b)))
+    (if (= n 0)
+        (port-close port)
+        (begin (port-write port b 0 n) (echo port b)))))
+(for-each (lambda (i)
+            (let ((pair (make-socketpair)))
+              (spawn (lambda () (echo (car pair) (make-u8vector 16 0))))
+              (spawn (lambda ()
+                       (let ((b (make-u8vector 1 0)))
+                         (port-write (cadr pair) (u8vector (- 255 i)))
+                         (port-read! (cadr pair) b)
+                         (port-close (cadr pair))
+                         (channel-send! replies (u8vector-ref b 0)))))))
+          (iota 250))
+(define (sum-replies n acc)
+  (if (= n 0)
+      acc
+      (sum-replies (- n 1) (+ acc (channel-receive replies)))))
+(println (sum-replies 250 0))
+
+;; a unix socket server
+(define path "/tmp/plisp-io-test.sock")
+(define server (unix-listen path))
+(spawn (lambda ()
+         (let ((conn (unix-accept server))
+               (b (make-u8vector 5 0)))
+           (port-read! conn b)
+           (port-write conn b)
+           (port-close conn))))
+(define client (unix-connect path))
+(port-write client "howdy")
+(define reply (make-u8vector 5 0))
+(println (port-read! client reply) reply (port-read! client reply))
+(port-close client)
+(port-close server)
+(println (unix-connect path) (open-file-port "/nonexistent/file"))
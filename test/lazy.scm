@@ -0,0 +1,40 @@
+;; inner lambdas are compiled the first time they are called. their
+;; closures have to see the same variables either way.
+
+(define (counter start)
+  (define n start)
+  (define unused (lambda () (undefined-function n)))
+  (lambda (step)
+    (set! n (+ n step))
+    n))
+
+(define (run-counter k)
+  (define c (counter k))
+  (c 1)
+  (c 2)
+  (c 3))
+
+(define (loop i acc)
+  (if (eq? i 0)
+      acc
+      (loop (- i 1) (+ acc (run-counter i)))))
+
+(println (loop 200 0))
+
+(define (adder x)
+  (lambda (y) (+ x y)))
+
+(define (sum-adders n)
+  (define first (adder 1))
+  (if (eq? n 0)
+      0
+      (+ (first n) ((adder n) n) (sum-adders (- n 1)))))
+
+(println (sum-adders 200))
+
+(define (pick which a b)
+  (if which
+      (lambda () a)
+      (lambda () b)))
+
+(println ((pick #t 1 2)) ((pick #f 1 2)))
@@ -0,0 +1,31 @@
+(println (map (lambda (x) (* x x)) '(1 2 3)) (map + '(1 2) '(10 20 30))
+         (map car '()))
+(for-each (lambda (x y) (println x y)) '(a b) '(1 2))
+(println (filter (lambda (x) (< x 3)) '(1 5 2 4 0)) (filter car '()))
+(println (fold-left cons '() '(1 2 3)) (fold-right cons '() '(1 2 3))
+         (fold-left + 0 '()))
+(println (append) (append '(1)) (append '(1) '(2 3) '() '(4 . 5))
+         (append '() 'tail))
+(println (reverse! (list 1 2 3)) (reverse! '()))
+(println (list-tail '(1 2 3 4) 2) (list-tail '(1 2) 0) (list-tail '(1 2) 2))
+(println (memq 'c '(a b c d)) (memq 'z '(a b)) (member "b" '("a" "b" "c"))
+         (memq "b" (list "a" (string-append "b"))))
+(println (assq 'b '((a . 1) (b . 2))) (assoc '(1) '((() . 0) ((1) . 1)))
+         (assq 'z '()))
+(define orig (list 1 2 3))
+(define copy (list-copy orig))
+(println copy (eq? orig copy) (list-copy '(1 2 . 3)))
+(println (make-list 3 'x) (length (make-list 2)) (iota 5) (iota 3 1) (iota 3 0 2))
+
+(define l '(1 2))
+(println (list? l) (list? '(1 . 2)) (list? '()) (list? 5))
+
+;; long enough to overflow the stack if anything recursed per element
+(define big (iota 100000))
+(define doubled (map (lambda (x) (* 2 x)) big))
+(println (length doubled) (car (list-tail doubled 99999)))
+(println (fold-left + 0 big) (fold-right + 0 big))
+(println (length (filter (lambda (x) (< x 10)) big)))
+(println (length (append big big '(1))) (list? big))
+(println (car (reverse! (list-copy big))) (car big))
+(println (assq 99999 (map cons big doubled)) (car (memq 99998 big)))
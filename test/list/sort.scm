@@ -0,0 +1,42 @@
+(println (sort '(3 1 2) <) (sort '() <) (sort '(1) <) (sort '(5 4 3 2 1) <))
+(println (sort (vector 3 1 2) <) (sort (vector) <)
+         (sort '("b" "c" "a") string<?))
+(println (sort '(2 1.5 -3 0.5) (lambda (a b) (< a b))))
+
+;; equal keys keep their order in lists
+(define pairs '((1 . a) (0 . b) (1 . c) (0 . d) (1 . e)))
+(println (sort pairs (lambda (a b) (< (car a) (car b)))))
+(println (list-sort (lambda (a b) (< (car a) (car b))) pairs))
+
+(define l (list 3 1 2))
+(define s (sort! l <))
+(println s (length s))
+(define v (vector 9 7 8))
+(println (eq? (sort! v <) v) v)
+(vector-sort! v (lambda (a b) (< b a)))
+(println v)
+(define orig (list 2 1))
+(sort orig <)
+(println orig)
+
+(println (merge '(1 3 5) '(2 4 6) <) (merge '() '(1) <) (merge '(1 2) '() <))
+(println (merge '((1 . a) (2 . a)) '((1 . b) (2 . b))
+                (lambda (a b) (< (car a) (car b)))))
+
+;; long enough to overflow the stack if the sort recursed per element
+(define (sorted? l)
+  (if (null? l) #t
+      (if (null? (cdr l)) #t
+          (if (< (car (cdr l)) (car l)) #f (sorted? (cdr l))))))
+(define (vsorted? v i)
+  (if (< i (- (vector-length v) 1))
+      (if (< (vector-ref v (+ i 1)) (vector-ref v i)) #f (vsorted? v (+ i 1)))
+      #t))
+(define rnd (map (lambda (i) (hashq i 20)) (iota 100000)))
+(define sl (sort rnd <))
+(println (length sl) (sorted? (list-tail sl 90000)))
+(define sv (sort (list->vector rnd) (lambda (a b) (< a b))))
+(println (vector-length sv) (vsorted? sv 99000) (equal? (list->vector sl) sv))
+(define few (map (lambda (i) (hashq i 3)) (iota 50000)))
+(println (equal? (sort few (lambda (a b) (< a b))) (sort few <)))
+(println (car (sort (iota 100000) <)) (car (sort (reverse (iota 100000)) <)))
@@ -0,0 +1,14 @@
+(println (+ 576460752303423487 1))
+(println (- -576460752303423488 1))
+(println (- (+ 576460752303423487 1) 1))
+(println (* 123456789012 987654321098))
+
+(define (fact n)
+  (if (< n 1)
+      1
+      (* n (fact (- n 1)))))
+
+(println (fact 30))
+(println (- (fact 25) (fact 24)))
+(println (< (fact 21) (fact 22)) (< (- (fact 22)) 5) (= (fact 22) (* 22 (fact 21))))
+(println (exact->inexact (fact 20)) (inexact->exact 1e20))
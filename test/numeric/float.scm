@@ -0,0 +1,45 @@
+(println 1.5 -2.25 0.1 3.0 1e21 .5 -.5)
+(println (+ 1.5 2) (- 1 0.5) (* 2.0 3) (/ 1 4) (/ 6 3))
+(println (- 2.5) (- 0.0) (- 3) (- 0))
+(println (< 1 1.5) (< 2.5 1) (= 1 1.0) (equal? 1 1.0) (equal? 1.5 1.5))
+(println (flonum? 1.5) (flonum? 1) (number? 2.0))
+(println (exact->inexact 3) (inexact->exact 4.0))
+
+(define (dist x y)
+  (+ (* x x) (* y y)))
+
+(define (integrate f lo hi n)
+  (define dx (/ (- hi lo) n))
+  (define (loop i acc)
+    (if (< i n)
+        (loop (+ i 1) (+ acc (* dx (f (+ lo (* i dx))))))
+        acc))
+  (loop 0 0.0))
+
+(println (dist 3 4.0))
+(println (integrate (lambda (x) (* 2.0 x)) 0 1.0 4))
+
+(define v (make-f64vector 3 1))
+(vector-set! v 1 2.5)
+(collect-garbage)
+(println v (vector-ref v 1) '#f64(1.5 2))
+
+;; past 2^53 fixnums have no exact double, so compiled code leaves
+;; them to the builtins rather than converting them itself
+(define (below a b)
+  (if (fixnum? a)
+      (if (flonum? b)
+          (< a (+ b 0.5))
+          'not-flonum)
+      'not-fixnum))
+(define (offset a b) (+ a (* b 1.0)))
+(define (warm n)
+  (if (< 0 n)
+      (begin
+        (below 1 2.0)
+        (offset 1 2)
+        (warm (- n 1)))))
+(warm 2000)
+(define big 36028797018963969)
+(println (below big 36028797018963968.0) (below 1 1.0)
+         (offset big 1) (offset 1 big) (offset 1 2))
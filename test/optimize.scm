@@ -0,0 +1,29 @@
+;; hot functions are recompiled with what their profile saw. the
+;; guesses have to hold up when the profile stops being true.
+
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+(println (fib 20))
+
+(println (< (- 0 5) 3) (< 3 (- 0 5)))
+
+(define (double x) (+ x x))
+(define (triple x) (+ x (+ x x)))
+(define op double)
+
+(define (apply-op n acc)
+  (if (eq? n 0)
+      acc
+      (apply-op (- n 1) (op acc))))
+
+(define (loop n)
+  (if (eq? n 0)
+      0
+      (+ (apply-op 2 1) (loop (- n 1)))))
+
+(println (loop 1500))
+(set! op triple)
+(println (loop 10))
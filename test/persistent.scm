@@ -0,0 +1,51 @@
+(define m0 (make-pmap))
+(define m1 (pmap-set m0 'a 1))
+(define m2 (pmap-set m1 "b" 2))
+(println (pmap? m0) (pmap? '()) (pmap-count m0) (pmap-count m1) (pmap-count m2))
+(println (pmap-ref/default m1 "b" 'none) (pmap-ref m2 "b")
+         (pmap-ref m2 'c (lambda () 'thunk)))
+(define m3 (pmap-delete m2 'a))
+(println (pmap-contains? m2 'a) (pmap-contains? m3 'a) (pmap-count m3))
+(println (pmap->alist (pmap-set (make-eq-pmap) 'k 'v)))
+
+;; build a big map in place, then take versions of it apart
+(define t (transient (make-eqv-pmap)))
+(for-each (lambda (i) (pmap-set! t i (* i i))) (iota 100000))
+(define big (persistent! t))
+(println (pmap-count big) (pmap-ref big 777))
+(define half
+  (pmap-fold big (lambda (k v acc) (if (< k 50000) (pmap-delete acc k) acc))
+             big))
+(define none (pmap-fold half (lambda (k v acc) (pmap-delete acc k)) half))
+(collect-garbage)
+(println (pmap-count big) (pmap-ref big 10) (pmap-count half)
+         (pmap-contains? half 10) (pmap-ref half 99999))
+(println (pmap-count none) (pmap->alist none))
+
+(define st (transient (make-pmap)))
+(for-each (lambda (i) (pmap-set! st (list i) i)) (iota 20000))
+(for-each (lambda (i) (pmap-delete! st (list i))) (iota 6667))
+(define lists (persistent! st))
+(println (pmap-count lists) (pmap-ref/default lists (list 3) 'gone)
+         (pmap-ref lists (list 7000)))
+
+(define v (list->pvector (iota 100000)))
+(define v2 (pvector-set v 5000 'x))
+(println (pvector? v) (pvector-length v) (pvector-ref v 5000)
+         (pvector-ref v2 5000) (pvector-ref v 99999))
+(println (pvector->list (pvector 1 2 3)) (pvector->list (pvector-push (pvector) 'a)))
+
+;; pop back down across the levels of the trie
+(define tv (transient (pvector)))
+(for-each (lambda (i) (pvector-push! tv i)) (iota 2000))
+(define pv (persistent! tv))
+(define (pop-n v n) (if (= n 0) v (pop-n (pvector-pop v) (- n 1))))
+(define pv2 (pop-n pv 1990))
+(collect-garbage)
+(println (pvector->list pv2) (pvector-length pv) (pvector-ref pv 1999))
+(println (pvector->list (pvector-push pv2 'y)))
+
+(define tv2 (transient v))
+(for-each (lambda (i) (pvector-pop! tv2)) (iota 99990))
+(pvector-set! tv2 0 'z)
+(println (pvector->list (persistent! tv2)) (pvector-ref v 0))
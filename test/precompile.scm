@@ -0,0 +1,41 @@
+;; compiled files are expanded ahead of time, and load prefers them.
+;; they are written next to their source, so it is copied somewhere
+;; temporary first
+
+(define (copy-file from to)
+  (define in (open-file-port from))
+  (define out (open-file-port to 'write))
+  (define buf (make-u8vector 4096 0))
+  (define (copy)
+    (define n (port-read! in buf))
+    (if (< 0 n)
+        (begin
+          (port-write out buf 0 n)
+          (copy))))
+  (copy)
+  (port-close in)
+  (port-close out))
+
+(define dir (make-temp-directory))
+(define lib (string-append dir "/lib.scm"))
+(copy-file (string-append (dirname %file) "/precompile/lib.scm") lib)
+(compile-file lib)
+(load lib)
+(println (square 12) (swapped 'a 'b))
+
+;; a compiled file is passed over once the macros it was expanded
+;; with change, even when no file did
+(define user (string-append dir "/user.scm"))
+(define port (open-file-port user 'write))
+(port-write port "(println (twice 'x))\n")
+(port-close port)
+
+(eval '(define-macro (twice x) `(list ,x ,x)))
+(compile-file user)
+(load user)
+(eval '(define-macro (twice x) `(vector ,x ,x)))
+(load user)
+
+(for-each delete-file
+          (list lib (string-append dir "/lib.plc")
+                user (string-append dir "/user.plc") dir))
@@ -0,0 +1,15 @@
+;; loaded by test/precompile.scm after compiling it
+
+(define-macro (swap! a b)
+  (define tmp (gensym))
+  `(let ((,tmp ,a))
+     (set! ,a ,b)
+     (set! ,b ,tmp)))
+
+(define (square x) (* x x))
+
+(define (swapped a b)
+  (swap! a b)
+  (list a b))
+
+(println "loaded" (swapped -1 "tab\there") (square -3))
@@ -0,0 +1,68 @@
+;; the optimized version of a function reads its baseline's profile by
+;; form, so it has to find the right one however the code around it
+;; was rearranged. calling what the profile saw keeps it optimized.
+
+(define (warm f x tier n)
+  (if (or (= n 0) (eq? (procedure-tier f) tier))
+      (procedure-tier f)
+      (begin
+        (f x)
+        (warm f x tier (- n 1)))))
+
+(define (keep f x n)
+  (if (= n 0)
+      (procedure-tier f)
+      (begin
+        (f x)
+        (keep f x (- n 1)))))
+
+;; closures with data of their own are called, not inlined
+(define (make-tagger tag) (lambda (x) (cons tag x)))
+(define tag-g (make-tagger 'g))
+(define tag-h (make-tagger 'h))
+
+;; a hot alternative is compiled first
+(define (route x)
+  (if (eq? x 0)
+      (tag-g x)
+      (tag-h (+ x 1))))
+
+(println (warm route 1 'optimized 10000000))
+(println (keep route 2 500) (route 3) (route 0))
+
+;; the predicate's fast path and the copy for when it is redefined
+;; share the branch's profile
+(define (kind x)
+  (if (fixnum? x)
+      (tag-h (+ x 1))
+      (tag-g x)))
+
+(println (warm kind 1 'optimized 10000000))
+(println (keep kind 2 500) (kind 3) (kind 'a))
+(define real-fixnum? fixnum?)
+(set! fixnum? (lambda (x) #f))
+(println (kind 3) (kind 'a))
+(set! fixnum? real-fixnum?)
+(println (kind 3))
+
+;; a small function is inlined by the baseline, then redefined before
+;; the function it was inlined into is optimized
+(define (bump x) (+ x 1))
+(define (twice x)
+  (if (eq? x 'none)
+      x
+      (tag-h (bump (bump x)))))
+
+(println (twice 1))
+(println (warm twice 1 'baseline 10000000))
+(define (bump x) (* x 10))
+(println (warm twice 1 'optimized 10000000))
+(println (keep twice 2 500) (twice 3) (twice 'none))
+
+;; the same function inlined at two calls profiles each separately
+(define (call-with f x) (f x))
+(define (both x)
+  (cons (call-with tag-g x) (call-with tag-h x)))
+
+(println (warm both 1 'optimized 10000000))
+(println (keep both 2 500) (both 3))
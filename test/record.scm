@@ -0,0 +1,50 @@
+(define-record-type point (make-point x y) point?
+  (x point-x set-point-x!)
+  (y point-y set-point-y!))
+(define-record-type node (make-node value next) node?
+  (value node-value)
+  (next node-next set-node-next!))
+
+(define p (make-point 1 2))
+(println p (point? p) (point-x p) (point-y p))
+(set-point-x! p 10)
+(set-point-y! p '(a b))
+(println (point-x p) (point-y p))
+(println (point? (make-node 1 '())) (point? '(1 2)) (point? 5) (node? p))
+(println (record? p) (record? point) (record? (vector 1 2)) point)
+(println (eq? p p) (equal? p (make-point 10 '(a b))))
+
+;; fields left out of the constructor are unspecified until set
+(define-record-type cell make-cell-of cell? (content cell-content))
+(define-record-type lazy (make-lazy) lazy? (value lazy-value set-lazy-value!))
+(define l (make-lazy))
+(println (lazy-value l) (cell-content (make-cell-of 'in)))
+(set-lazy-value! l 'second)
+(println (lazy-value l))
+
+;; the procedures under define-record-type
+(define pair-type (make-record-type 'kv '(key value)))
+(define make-kv (record-constructor pair-type '(value key)))
+(define kv-key (record-accessor pair-type 'key))
+(define kv (make-kv 1 'one))
+(println kv (kv-key kv) ((record-accessor pair-type 'value) kv)
+         ((record-predicate pair-type) kv)
+         ((record-constructor pair-type) 'a 'b))
+
+;; a toplevel begin defines toplevel variables
+(begin
+  (define in-begin 1)
+  (define (in-begin-fn) (+ in-begin 1)))
+(println in-begin (in-begin-fn))
+
+;; only the records hold onto their fields
+(define (chain n acc)
+  (if (= n 0) acc (chain (- n 1) (make-node n acc))))
+(define (sum-chain node acc)
+  (if (node? node) (sum-chain (node-next node) (+ acc (node-value node))) acc))
+(define c (chain 10000 'end))
+(collect-garbage)
+(define junk (map (lambda (i) (make-point i (list i))) (iota 20000)))
+(collect-garbage)
+(println (sum-chain c 0) (node-value c))
+(println (length (sort junk (lambda (a b) (< (point-x b) (point-x a))))))
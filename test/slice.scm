@@ -0,0 +1,30 @@
+(define v (vector 1 2 3 4 5 6))
+(define s (subvector v 1 4))
+(println s (vector-length s))
+
+;; slices share their parent's elements
+(vector-set! s 0 'two)
+(println v)
+
+(define inner (subvector s 1 3))
+(set! v #f)
+(set! s #f)
+(collect-garbage)
+(println inner)
+
+(define line "name,age,city")
+(define field (substring line 5 8))
+(println field (string-length field) (equal? field "age"))
+(println (substring line 9) (string-append (substring line 0 4) "!"))
+
+(define bytes (u8vector 1 2 3 4 5))
+(vector-copy! bytes 1 bytes 0 3)
+(println bytes)
+
+(define dst (make-vector 5 0))
+(vector-copy! dst 2 #(a b c) 1)
+(println dst)
+
+(define floats (make-f64vector 4))
+(vector-copy! floats 0 (subvector #f64(1 2 3 4 5) 2 5))
+(println floats (f64vector-sum (subvector floats 1 3)))
@@ -0,0 +1,19 @@
+(define text "the quick brown fox jumps over the lazy dog, then the quick brown fox sleeps")
+
+(println (string=? "abc" "abc") (string=? "abc" "abd") (string=? "ab" "abc"))
+(println (string<? "abc" "abd") (string<? "abd" "abc") (string<? "ab" "abc")
+         (string<? "abc" "abc"))
+(println (equal? (substring text 4 9) "quick") (equal? text (substring text 0)))
+
+(println (string-index text #\q) (string-index text #\q 5) (string-index text #\Z))
+(println (string-contains text "fox") (string-contains text "fox" 20)
+         (string-contains text "fox sleeps") (string-contains text "cat")
+         (string-contains text ""))
+
+(println (= (string-hash text) (string-hash (string-append (substring text 0 40)
+                                                           (substring text 40))))
+         (= (string-hash "abc") (string-hash "abd"))
+         (< (string-hash text 100) 100))
+
+(println (equal? #u8(1 2 3) #u8(1 2 3)) (equal? #s32(1 2) #s32(1 3))
+         (equal? #f64(0.0 1.5) #f64(-0.0 1.5)) (equal? #u8(1) #s32(1)))
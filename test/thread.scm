@@ -0,0 +1,66 @@
+;; threads share the heap, and joining one returns what its thunk did
+(define (count-up n acc)
+  (if (= n 0)
+      acc
+      (count-up (- n 1) (+ acc 1))))
+(define counters
+  (map (lambda (i) (make-thread (lambda () (list i (count-up 5000 0)))))
+       (iota 4)))
+(println (thread? (car counters)) (thread? 'no) (map thread-join counters))
+
+;; allocating on several threads at once, so they collect with the
+;; others stopped
+(define (build n acc)
+  (if (= n 0)
+      acc
+      (build (- n 1) (cons n acc))))
+(define (churn rounds total)
+  (if (= rounds 0)
+      total
+      (churn (- rounds 1) (+ total (fold-left + 0 (build 1000 '()))))))
+(println (map thread-join
+              (map (lambda (i) (make-thread (lambda () (churn 300 i))))
+                   (iota 4))))
+
+;; a counter guarded by a mutex
+(define m (make-mutex))
+(define counter 0)
+(define (bump n)
+  (if (= n 0)
+      'done
+      (begin
+        (mutex-lock! m)
+        (set! counter (+ counter 1))
+        (mutex-unlock! m)
+        (bump (- n 1)))))
+(for-each thread-join
+          (map (lambda (i) (make-thread (lambda () (bump 2000)))) (iota 4)))
+(println (mutex? m) counter)
+
+;; handing a value over with a condition variable
+(define cv (make-condition-variable))
+(define box '())
+(define (wait-for-box)
+  (if (null? box)
+      (begin (condition-variable-wait! cv m) (wait-for-box))
+      (car box)))
+(define consumer (make-thread (lambda ()
+                                (mutex-lock! m)
+                                (let ((v (wait-for-box)))
+                                  (mutex-unlock! m)
+                                  v))))
+(mutex-lock! m)
+(set! box (list 'hello))
+(condition-variable-signal! cv)
+(mutex-unlock! m)
+(println (condition-variable? cv) (thread-join consumer))
+
+;; each thread has its own scheduler and continuations
+(println (thread-join
+          (make-thread (lambda ()
+                         (let ((ch (make-channel)))
+                           (spawn (lambda () (channel-send! ch 42)))
+                           (channel-receive ch)))))
+         (thread-join
+          (make-thread (lambda ()
+                         (+ 1 (call/cc (lambda (k) (k 41))))))))
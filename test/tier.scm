@@ -0,0 +1,36 @@
+;; closures are interpreted until they are hot, then compiled in
+;; place. state must be shared across the switch.
+
+(define (counter)
+  (define n 0)
+  (lambda ()
+    (set! n (+ n 1))
+    n))
+
+(define (call-times f n)
+  (if (eq? n 0)
+      (f)
+      (begin
+        (f)
+        (call-times f (- n 1)))))
+
+(define c (counter))
+(println (call-times c 99))
+(println (c))
+
+(define (cell x)
+  (list (lambda () x)
+        (lambda (v) (set! x v))))
+
+(define xcell (cell 1))
+(println (call-times (car xcell) 99))
+((cadr xcell) 2)
+(println ((car xcell)))
+
+(define (sum lst)
+  (if (null? lst)
+      0
+      (+ (car lst) (sum (cdr lst)))))
+
+(println (sum '(1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+                21 22 23 24 25 26 27 28 29 30 31 32 33 34 35 36 37 38 39 40)))
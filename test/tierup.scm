@@ -0,0 +1,44 @@
+;; a function moves from the interpreter to baseline code, to code
+;; optimized for what it was called with, and back to baseline when
+;; that guess stops holding. compiles may happen on another thread,
+;; so warm calls it until it reaches a tier, or gives up.
+
+(define (warm f x y tier n)
+  (if (or (= n 0) (eq? (procedure-tier f) tier))
+      (procedure-tier f)
+      (begin
+        (f x y)
+        (warm f x y tier (- n 1)))))
+
+(define (add a b) (+ a b))
+
+(println (procedure-tier add))
+(println (warm add 1 2 'baseline 10000000))
+(println (warm add 1 2 'optimized 10000000))
+(println (add 20 22))
+
+;; the optimized version only expects fixnums
+(println (warm add 1.5 2.5 'baseline 1000))
+(println (add 1.5 2.5))
+
+;; the next one is compiled with flonums in the profile, so they no
+;; longer send it back
+(println (warm add 1.5 2 'optimized 10000000))
+(println (warm add 1.5 2 'baseline 1000))
+(println (add 1.5 2))
+
+;; abandoned code is freed once no call is running it, which here
+;; it still is when it collects
+(define (add-and-collect a b)
+  (define sum (+ a b))
+  (if (flonum? sum) (collect-garbage))
+  sum)
+
+(println (warm add-and-collect 1 2 'optimized 10000000))
+(println (warm add-and-collect 1.5 2.5 'baseline 1000))
+(println (add-and-collect 1.5 2.5))
+(println (warm add-and-collect 1.5 2 'optimized 10000000))
+(println (warm add-and-collect 1.5 2 'baseline 1000))
+(println (add-and-collect 1 2))
+
+(println (procedure-tier car) (procedure-tier (lambda () 1)))
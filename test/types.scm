@@ -0,0 +1,30 @@
+;; branches on type predicates tell the compiler what a local is.
+;; redefining a predicate has to undo that.
+
+(define (len lst)
+  (if (pair? lst)
+      (+ 1 (len (cdr lst)))
+      0))
+
+(define (sum-fixnums lst)
+  (if (null? lst)
+      0
+      (if (fixnum? (car lst))
+          (+ (car lst) (sum-fixnums (cdr lst)))
+          (sum-fixnums (cdr lst)))))
+
+(println (len '(1 2 3 4)) (len '()) (len 5))
+(println (sum-fixnums '(1 a 2 "b" 3 (4))))
+(println (fixnum? 1) (fixnum? 'a) (pair? '()) (null? '()))
+
+(define (first-or x default)
+  (define y x)
+  (if (pair? y) (car y) default))
+
+(println (first-or '(7 8) 0) (first-or 'z 0))
+
+(define real-pair? pair?)
+(set! pair? (lambda (x) #f))
+(println (len '(1 2)) (first-or '(1) 9))
+(set! pair? real-pair?)
+(println (len '(1 2)))